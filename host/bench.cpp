@@ -0,0 +1,345 @@
+// Host driver for the hosted module build (make host-bench): checks the
+// books and the depth kernels against each other, then runs the spsc
+// ping-pong and the book benchmarks, printed like hft.bench prints them
+// at boot. Exits 1 if a check failed or the ping-pong lost a stamp.
+
+#include <cstdio>
+#include <sched.h>
+#include <thread>
+
+#include "../include/freestanding/atomic.hpp"
+#include "shim.hpp"
+
+import hft.core;
+import hft.concurrent;
+import hft.simd;
+import hft.trading;
+import hft.trace;
+
+namespace hft {
+namespace {
+
+constexpr uint32_t PING_ROUNDS = 100000;
+constexpr uint32_t PING_WARMUP = 1000;   // Round trips not recorded
+constexpr uint32_t BOOK_OPS = 1000000;
+constexpr uint32_t BAND = 48;            // Price levels per side the updates land on
+constexpr uint32_t L3_LIVE = 4096;       // Resting orders the churn keeps
+constexpr trading::price_t MID = 1000000;  // $100.0000
+constexpr trading::price_t TICK = 100;
+
+using depth_book = trading::order_book<32>;
+using soa_book = trading::soa_order_book<32>;
+using l3 = trading::l3_book<65536, 32>;
+using soa_l3 = trading::l3_book<65536, 32, soa_book>;
+
+uint32_t failures = 0;
+
+void out(const char* text) noexcept {
+    std::fputs(text, stdout);
+}
+
+void check(bool ok, const char* what) noexcept {
+    std::printf("[check] %s: %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+// xorshift64: the same stream on every run and for every book
+struct rng {
+    uint64_t state;
+
+    uint64_t next() noexcept {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+};
+
+template<size_t N>
+bool same_levels(const trading::level_snapshot (&a)[N], const trading::level_snapshot (&b)[N],
+                 size_t depth) noexcept {
+    for (size_t i = 0; i < depth; ++i) {
+        if (a[i].price != b[i].price || a[i].quantity != b[i].quantity ||
+            a[i].order_count != b[i].order_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Same depth and levels on both sides (sequences differ by design)
+template<size_t N>
+bool same_snapshot(const trading::book_snapshot<N>& a, const trading::book_snapshot<N>& b) noexcept {
+    return a.bid_depth == b.bid_depth && a.ask_depth == b.ask_depth &&
+           same_levels(a.bids, b.bids, a.bid_depth) && same_levels(a.asks, b.asks, a.ask_depth);
+}
+
+// Scripted updates with known results, on the aggregated books
+template<typename Book>
+bool scripted_depth() noexcept {
+    Book book;
+    book.update_bid(MID - TICK, 300, 3);
+    book.update_bid(MID - 2 * TICK, 500, 5);
+    book.update_ask(MID + TICK, 200, 2);
+    book.update_ask(MID + 3 * TICK, 100, 1);
+    book.update_ask(MID + 2 * TICK, 400, 4);
+    book.update_bid(MID - TICK, 0);           // Removes the best bid
+
+    const trading::spread_info s = book.get_spread();
+    const auto snap = book.read_snapshot();
+    return s.bid_price == MID - 2 * TICK && s.bid_size == 500 &&
+           s.ask_price == MID + TICK && s.ask_size == 200 &&
+           snap.bid_depth == 1 && snap.ask_depth == 3 &&
+           snap.asks[1].price == MID + 2 * TICK && snap.asks[2].price == MID + 3 * TICK;
+}
+
+// Queue priority, partial fills and removal on the L3 book
+bool scripted_l3() noexcept {
+    l3* book = new l3;
+    bool ok = book->add(1, true, MID - TICK, 100) && book->add(2, true, MID - TICK, 50) &&
+              book->add(3, false, MID + TICK, 70);
+    ok = ok && !book->add(1, true, MID - TICK, 10);  // Duplicate id
+
+    const l3::queue_position behind = book->position(2);
+    ok = ok && behind.orders_ahead == 1 && behind.quantity_ahead == 100;
+
+    ok = ok && book->execute(1, 40);
+    const trading::spread_info partial = book->get_spread();
+    ok = ok && partial.bid_price == MID - TICK && partial.bid_size == 110;
+
+    ok = ok && book->execute(1, 60) && book->find(1) == nullptr;
+    ok = ok && book->position(2).orders_ahead == 0;
+    ok = ok && book->cancel(2) && !book->cancel(2);
+    const trading::spread_info after = book->get_spread();
+    ok = ok && after.bid_size == 0 && after.ask_price == MID + TICK && book->order_count() == 1;
+
+    delete book;
+    return ok;
+}
+
+// One timed pass of random level updates; tops of both sides stay
+// inside the band, an eighth of the updates remove a level
+template<typename Book>
+void update_levels(Book& book, trace::latency_histogram& cycles) noexcept {
+    rng r{0x9E3779B97F4A7C15};
+    for (uint32_t i = 0; i < BOOK_OPS; ++i) {
+        const uint64_t x = r.next();
+        const trading::price_t offset = TICK * static_cast<trading::price_t>(1 + (x >> 8) % BAND);
+        const trading::quantity_t qty = (x & 7) == 0 ? 0 : 100 * (1 + (x >> 32) % 50);
+        const uint32_t orders = static_cast<uint32_t>(1 + (x >> 40) % 8);
+
+        const uint64_t start = tsc_clock::start();
+        if (x & 8) {
+            book.update_bid(MID - offset, qty, orders);
+        } else {
+            book.update_ask(MID + offset, qty, orders);
+        }
+        cycles.record(tsc_clock::stop() - start);
+    }
+}
+
+template<typename Book>
+void read_snapshots(const Book& book, trace::latency_histogram& cycles) noexcept {
+    uint64_t sink = 0;
+    for (uint32_t i = 0; i < BOOK_OPS / 10; ++i) {
+        const uint64_t start = tsc_clock::start();
+        const auto snap = book.read_snapshot();
+        cycles.record(tsc_clock::stop() - start);
+        sink += snap.bid_depth;
+    }
+    asm volatile("" :: "r"(sink));
+}
+
+// Add/cancel churn around L3_LIVE resting orders
+template<typename Book>
+void churn(Book& book, trace::latency_histogram& adds, trace::latency_histogram& cancels,
+           uint64_t& refused) noexcept {
+    static uint64_t live[L3_LIVE];
+    uint32_t count = 0;
+    uint64_t next_id = 1;
+    rng r{0xD1B54A32D192ED03};
+
+    for (uint32_t i = 0; i < BOOK_OPS; ++i) {
+        const uint64_t x = r.next();
+        if (count == L3_LIVE || (count > 0 && (x & 1))) {
+            const uint32_t victim = static_cast<uint32_t>((x >> 1) % count);
+            const uint64_t start = tsc_clock::start();
+            const bool ok = book.cancel(live[victim]);
+            cancels.record(tsc_clock::stop() - start);
+            if (!ok) ++refused;
+            live[victim] = live[--count];
+            continue;
+        }
+
+        const bool is_buy = x & 2;
+        const trading::price_t offset = TICK * static_cast<trading::price_t>(1 + (x >> 8) % BAND);
+        const trading::quantity_t qty = 100 * (1 + (x >> 32) % 20);
+        const uint64_t start = tsc_clock::start();
+        const bool ok = book.add(next_id, is_buy, is_buy ? MID - offset : MID + offset, qty);
+        adds.record(tsc_clock::stop() - start);
+        if (ok) {
+            live[count++] = next_id;
+        } else {
+            ++refused;
+        }
+        ++next_id;
+    }
+}
+
+void bench_books() noexcept {
+    static trace::latency_histogram cycles;
+    out("[bench] books\n");
+
+    depth_book* plain = new depth_book;
+    soa_book* soa = new soa_book;
+    update_levels(*plain, cycles);
+    trace::print(out, "  order_book update", cycles);
+    cycles.reset();
+    update_levels(*soa, cycles);
+    trace::print(out, "  soa_order_book update", cycles);
+    check(same_snapshot(plain->read_snapshot(), soa->read_snapshot()),
+          "soa_order_book matches order_book after the update run");
+
+    cycles.reset();
+    read_snapshots(*plain, cycles);
+    trace::print(out, "  order_book read_snapshot", cycles);
+    cycles.reset();
+    read_snapshots(*soa, cycles);
+    trace::print(out, "  soa_order_book read_snapshot", cycles);
+
+    check(simd::matches_scalar(soa->bid_prices(), soa->bid_quantities(), soa->bid_depth()) &&
+          simd::matches_scalar(soa->ask_prices(), soa->ask_quantities(), soa->ask_depth()),
+          "depth kernels match the scalar ones on the final book");
+
+    // The SoA book's depth signals go through the selected kernels
+    double sink = 0;
+    cycles.reset();
+    for (uint32_t i = 0; i < BOOK_OPS / 10; ++i) {
+        const uint64_t start = tsc_clock::start();
+        sink += soa->bid_vwap_to_depth(5000) + soa->calculate_microprice();
+        cycles.record(tsc_clock::stop() - start);
+    }
+    asm volatile("" :: "x"(sink));
+    trace::print(out, "  soa vwap+microprice", cycles);
+
+    delete soa;
+    delete plain;
+}
+
+void bench_l3() noexcept {
+    static trace::latency_histogram adds;
+    static trace::latency_histogram cancels;
+    out("[bench] l3 add/cancel churn\n");
+
+    l3* plain = new l3;
+    soa_l3* soa = new soa_l3;
+    uint64_t refused = 0;
+    churn(*plain, adds, cancels, refused);
+    trace::print(out, "  l3_book add", adds);
+    trace::print(out, "  l3_book cancel", cancels);
+
+    adds.reset();
+    cancels.reset();
+    churn(*soa, adds, cancels, refused);
+    trace::print(out, "  l3_book<soa> add", adds);
+    trace::print(out, "  l3_book<soa> cancel", cancels);
+
+    check(refused == 0, "l3 churn refused no add or cancel");
+    check(plain->order_count() == soa->order_count() &&
+          same_snapshot(plain->levels().read_snapshot(), soa->levels().read_snapshot()),
+          "l3 books agree on the aggregated depth");
+
+    delete soa;
+    delete plain;
+}
+
+// Ping-pong between two threads pinned to the first two usable host
+// CPUs: the initiator pushes a TSC stamp, the partner echoes it back
+using ping_queue = concurrent::spsc_queue<uint64_t, 64>;
+
+struct ping_pair {
+    ping_queue there;
+    ping_queue back;
+    trace::latency_histogram round_trip;
+    atomic<bool> stop{false};
+    uint64_t corrupted = 0;
+};
+
+ping_pair pair;
+
+void echo(int host_cpu) noexcept {
+    if (!host::bind_thread(1, host_cpu)) out("[bench] warning: partner not pinned\n");
+    uint64_t stamp;
+    while (!pair.stop.load(memory_order::relaxed)) {
+        if (pair.there.try_pop(stamp)) {
+            while (!pair.back.try_push(stamp)) {}
+        }
+    }
+}
+
+void initiate() noexcept {
+    for (uint32_t i = 0; i < PING_WARMUP + PING_ROUNDS; ++i) {
+        const uint64_t sent = tsc_clock::start();
+        while (!pair.there.try_push(sent)) {}
+        uint64_t stamp;
+        while (!pair.back.try_pop(stamp)) {}
+        const uint64_t now = tsc_clock::stop();
+        if (stamp != sent) ++pair.corrupted;
+        if (i >= PING_WARMUP) pair.round_trip.record(now - stamp);
+    }
+}
+
+void bench_ping_pong() noexcept {
+    cpu_set_t allowed;
+    int cpus[2];
+    int found = 0;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE && found < 2; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) cpus[found++] = cpu;
+        }
+    }
+    if (found < 2) {
+        out("[bench] ping-pong skipped: fewer than two CPUs\n");
+        return;
+    }
+
+    std::printf("[bench] spsc ping-pong, CPU %d <-> CPU %d\n", cpus[0], cpus[1]);
+    if (!host::bind_thread(0, cpus[0])) out("[bench] warning: initiator not pinned\n");
+    std::thread partner(echo, cpus[1]);
+    initiate();
+    pair.stop.store(true, memory_order::relaxed);
+    partner.join();
+
+    trace::print(out, "  round trip", pair.round_trip);
+    check(pair.corrupted == 0 && pair.round_trip.count() == PING_ROUNDS,
+          "every stamp came back unchanged");
+}
+
+} // namespace
+} // namespace hft
+
+int main() {
+    using namespace hft;
+    if (!host::init()) {
+        out("[host] TSC calibration failed\n");
+        return 1;
+    }
+    std::printf("[host] TSC %llu MHz, %s depth kernels\n",
+                static_cast<unsigned long long>(tsc_clock::hz() / 1000000), simd::kernels().name);
+
+    check(simd::self_test(), "depth kernels match the scalar fallback");
+    check(scripted_depth<depth_book>(), "order_book scripted top of book");
+    check(scripted_depth<soa_book>(), "soa_order_book scripted top of book");
+    check(scripted_l3(), "l3_book queue priority, fills and cancels");
+
+    bench_books();
+    bench_l3();
+    bench_ping_pong();
+
+    if (failures != 0) {
+        std::printf("[host] %u check(s) FAILED\n", failures);
+        return 1;
+    }
+    out("[host] all checks passed\n");
+    return 0;
+}
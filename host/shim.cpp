@@ -0,0 +1,104 @@
+// Hosted definitions of what kernel/main_phase1.cpp and hft.tsc provide
+// in the kernel: panic, CPU feature detection, the TSC frequency and the
+// per-CPU blocks
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <pthread.h>
+#include <sched.h>
+
+#include "shim.hpp"
+
+import hft.core;
+import hft.simd;
+
+namespace hft {
+
+[[noreturn]] void kernel::panic(const char* msg) noexcept {
+    std::fprintf(stderr, "\n!!! PANIC !!!\n%s\n", msg);
+    std::abort();
+}
+
+// __builtin_cpu_supports checks XCR0 as well, like the kernel's detect()
+cpu_features cpu_features::detect() noexcept {
+    __builtin_cpu_init();
+    cpu_features features{};
+    features.avx = __builtin_cpu_supports("avx");
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.fma = __builtin_cpu_supports("fma");
+    features.avx512f = __builtin_cpu_supports("avx512f");
+    features.avx512dq = __builtin_cpu_supports("avx512dq");
+    features.avx512vl = __builtin_cpu_supports("avx512vl");
+    return features;
+}
+
+cpu_features kernel::get_cpu_features() noexcept {
+    return cpu_features::detect();
+}
+
+} // namespace hft
+
+namespace hft::host {
+
+namespace {
+
+constexpr uint64_t CALIBRATION_NS = 50000000;  // 50 ms
+
+cpu_local blocks[topology::MAX_CPUS];
+
+uint64_t clock_ns(clockid_t clock) noexcept {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// TSC cycles over a CALIBRATION_NS sleep, scaled to one second. hft.tsc
+// does the same against the PIT at boot.
+uint64_t measure_tsc_hz() noexcept {
+    const uint64_t ns0 = monotonic_ns();
+    const uint64_t tsc0 = tsc_clock::start();
+    const timespec pause = {0, static_cast<long>(CALIBRATION_NS)};
+    nanosleep(&pause, nullptr);
+    const uint64_t tsc1 = tsc_clock::stop();
+    const uint64_t ns1 = monotonic_ns();
+
+    if (ns1 <= ns0) return 0;
+    return (tsc1 - tsc0) * 1000000000 / (ns1 - ns0);
+}
+
+} // namespace
+
+uint64_t monotonic_ns() noexcept {
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+bool init() noexcept {
+    if (!tsc_clock::invariant()) {
+        std::fprintf(stderr, "[host] warning: no invariant TSC reported, cycle counts may drift\n");
+    }
+    const uint64_t hz = measure_tsc_hz();
+    if (hz == 0) return false;
+    tsc_clock::calibrate(hz);
+    tsc_clock::set_epoch(tsc_clock::now(), clock_ns(CLOCK_REALTIME));
+
+    simd::select(cpu_features::detect());
+    return bind_thread(0, -1);
+}
+
+bool bind_thread(uint32_t index, int host_cpu) noexcept {
+    if (index >= topology::MAX_CPUS) return false;
+    cpu_local& local = blocks[index];
+    local.index = index;
+    local.apic_id = index;
+    local.node = 0;
+    topology::install_cpu_local(&local);
+
+    if (host_cpu < 0) return true;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(host_cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+} // namespace hft::host
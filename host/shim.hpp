@@ -0,0 +1,27 @@
+#pragma once
+// Hosted stand-ins for what the kernel sets up at boot, for the modules
+// make host-bench builds for Linux (core, concurrent, simd, trading,
+// trace). The modules are compiled with -DHFT_HOSTED=1, which moves the
+// per-CPU block from GS to a thread_local pointer and takes placement new
+// from <new>; nothing else in them changes.
+
+#include "../include/freestanding/types.hpp"
+
+namespace hft::host {
+
+// Once, on the main thread before anything else: calibrate tsc_clock
+// against CLOCK_MONOTONIC, set its epoch from CLOCK_REALTIME, select the
+// SIMD kernels and bind the calling thread as CPU 0
+bool init() noexcept;
+
+// Install the calling thread's per-CPU block as dense CPU index and pin
+// it to host CPU host_cpu (negative: leave it unpinned). Every thread
+// that reaches topology::this_cpu() (per-core histograms, tracepoints)
+// calls this first. false if index is out of range or pinning failed;
+// the block is installed either way when index is valid.
+bool bind_thread(uint32_t index, int host_cpu) noexcept;
+
+// Nanoseconds on CLOCK_MONOTONIC
+uint64_t monotonic_ns() noexcept;
+
+} // namespace hft::host
@@ -13,6 +13,25 @@ enum class memory_order {
     seq_cst
 };
 
+// Memory fence (compiler barrier only for acquire/release on x86)
+inline void atomic_thread_fence(memory_order order) noexcept {
+    switch (order) {
+        case memory_order::relaxed:
+            break;
+        case memory_order::acquire:
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            break;
+        case memory_order::release:
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            break;
+        case memory_order::acq_rel:
+            __atomic_thread_fence(__ATOMIC_ACQ_REL);
+            break;
+        default:
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+}
+
 // Basic atomic template using compiler builtins
 template<typename T>
 class atomic {
@@ -20,7 +39,7 @@ class atomic {
     
 public:
     atomic() noexcept = default;
-    explicit atomic(T val) noexcept : value(val) {}
+    constexpr explicit atomic(T val) noexcept : value(val) {}
     
     // Delete copy operations
     atomic(const atomic&) = delete;
@@ -83,16 +102,29 @@ public:
             __ATOMIC_SEQ_CST,
             __ATOMIC_RELAXED);
     }
+    
+    // No spurious failures: false only if the value was not expected
+    bool compare_exchange_strong(T& expected, T desired,
+                                 memory_order order = memory_order::seq_cst) noexcept {
+        return __atomic_compare_exchange_n(&value, &expected, desired,
+            false,  // strong
+            order == memory_order::relaxed ? __ATOMIC_RELAXED :
+            order == memory_order::acquire ? __ATOMIC_ACQUIRE :
+            order == memory_order::release ? __ATOMIC_RELEASE :
+            order == memory_order::acq_rel ? __ATOMIC_ACQ_REL :
+            __ATOMIC_SEQ_CST,
+            __ATOMIC_RELAXED);
+    }
 };
 
 // Specialization for pointer types
 template<typename T>
 class atomic<T*> {
-    volatile T* value;
+    T* volatile value;  // The pointer itself is volatile, not the pointee
     
 public:
     atomic() noexcept = default;
-    explicit atomic(T* val) noexcept : value(val) {}
+    constexpr explicit atomic(T* val) noexcept : value(val) {}
     
     T* load(memory_order order = memory_order::seq_cst) const noexcept {
         return __atomic_load_n(&value,
@@ -116,6 +148,18 @@ public:
             order == memory_order::acq_rel ? __ATOMIC_ACQ_REL :
             __ATOMIC_SEQ_CST);
     }
+    
+    bool compare_exchange_weak(T*& expected, T* desired,
+                               memory_order order = memory_order::seq_cst) noexcept {
+        return __atomic_compare_exchange_n(&value, &expected, desired,
+            true,  // weak
+            order == memory_order::relaxed ? __ATOMIC_RELAXED :
+            order == memory_order::acquire ? __ATOMIC_ACQUIRE :
+            order == memory_order::release ? __ATOMIC_RELEASE :
+            order == memory_order::acq_rel ? __ATOMIC_ACQ_REL :
+            __ATOMIC_SEQ_CST,
+            __ATOMIC_RELAXED);
+    }
 };
 
 } // namespace hft
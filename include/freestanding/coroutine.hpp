@@ -0,0 +1,76 @@
+#pragma once
+// Minimal coroutine support for the freestanding build.
+// The compiler looks these names up in namespace std, so they live there;
+// only what co_await / co_return lowering needs is provided, on top of the
+// GCC coroutine builtins.
+
+#include "types.hpp"
+
+namespace std {
+
+template<typename R, typename... Args>
+struct coroutine_traits {
+    using promise_type = typename R::promise_type;
+};
+
+template<typename Promise = void>
+struct coroutine_handle;
+
+template<>
+struct coroutine_handle<void> {
+    constexpr coroutine_handle() noexcept = default;
+    constexpr coroutine_handle(decltype(nullptr)) noexcept {}
+
+    static constexpr coroutine_handle from_address(void* address) noexcept {
+        coroutine_handle h;
+        h.frame_ = address;
+        return h;
+    }
+
+    constexpr void* address() const noexcept { return frame_; }
+    constexpr explicit operator bool() const noexcept { return frame_ != nullptr; }
+
+    bool done() const noexcept { return __builtin_coro_done(frame_); }
+    void resume() const { __builtin_coro_resume(frame_); }
+    void operator()() const { resume(); }
+    void destroy() const { __builtin_coro_destroy(frame_); }
+
+protected:
+    void* frame_ = nullptr;
+};
+
+template<typename Promise>
+struct coroutine_handle : coroutine_handle<void> {
+    constexpr coroutine_handle() noexcept = default;
+    constexpr coroutine_handle(decltype(nullptr)) noexcept {}
+
+    static constexpr coroutine_handle from_address(void* address) noexcept {
+        coroutine_handle h;
+        h.frame_ = address;
+        return h;
+    }
+
+    static coroutine_handle from_promise(Promise& promise) noexcept {
+        coroutine_handle h;
+        h.frame_ = __builtin_coro_promise(&promise, __alignof(Promise), true);
+        return h;
+    }
+
+    Promise& promise() const noexcept {
+        return *static_cast<Promise*>(__builtin_coro_promise(frame_, __alignof(Promise), false));
+    }
+};
+
+struct suspend_always {
+    constexpr bool await_ready() const noexcept { return false; }
+    constexpr void await_suspend(coroutine_handle<>) const noexcept {}
+    constexpr void await_resume() const noexcept {}
+};
+
+struct suspend_never {
+    constexpr bool await_ready() const noexcept { return true; }
+    constexpr void await_suspend(coroutine_handle<>) const noexcept {}
+    constexpr void await_resume() const noexcept {}
+};
+
+} // namespace std
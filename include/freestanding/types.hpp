@@ -80,6 +80,10 @@ constexpr const T& max(const T& a, const T& b) {
 }
 } // namespace hft
 
+#ifdef HFT_HOSTED
+// Hosted builds (make host-bench) take placement new from the library
+#include <new>
+#else
 // Placement new/delete operators (must be in global namespace)
 // MUST use global ::size_t (compiler built-in), not hft::size_t
 inline void* operator new(::size_t, void* ptr) noexcept {
@@ -93,4 +97,4 @@ inline void* operator new[](::size_t, void* ptr) noexcept {
 // Delete operators for placement new (no-op)
 inline void operator delete(void*, void*) noexcept {}
 inline void operator delete[](void*, void*) noexcept {}
-
+#endif
@@ -1,13 +1,31 @@
 #include "../include/freestanding/types.hpp"
+#include "../include/freestanding/atomic.hpp"
 
 import hft.core;
 import hft.gdt;
 import hft.idt;
+import hft.acpi;
 import hft.pmm;
 import hft.vmm;
 import hft.heap;
+import hft.apic;
+import hft.ioapic;
+import hft.serial;
+import hft.log;
+import hft.smp;
+import hft.virtio_net;
+import hft.timer;
+import hft.tsc;
 import hft.trading;
 import hft.concurrent;
+import hft.simd;
+import hft.bench;
+import hft.capture;
+import hft.trace;
+import hft.risk;
+import hft.registry;
+import hft.sched;
+import hft.desk;
 
 namespace hft {
 
@@ -31,105 +49,6 @@ extern "C" {
     extern uint8_t __kernel_physical_start[];
 }
 
-// Serial port driver for debugging
-namespace serial {
-    constexpr uint16_t COM1 = 0x3F8;
-    
-    void init() noexcept {
-        auto outb = [](uint16_t port, uint8_t val) {
-            asm volatile("outb %0, %1" : : "a"(val), "Nd"(port));
-        };
-        
-        outb(COM1 + 1, 0x00);
-        outb(COM1 + 3, 0x80);
-        outb(COM1 + 0, 0x03);
-        outb(COM1 + 1, 0x00);
-        outb(COM1 + 3, 0x03);
-        outb(COM1 + 2, 0xC7);
-        outb(COM1 + 4, 0x0B);
-    }
-    
-    void putc(char c) noexcept {
-        auto inb = [](uint16_t port) -> uint8_t {
-            uint8_t ret;
-            asm volatile("inb %1, %0" : "=a"(ret) : "Nd"(port));
-            return ret;
-        };
-        
-        auto outb = [](uint16_t port, uint8_t val) {
-            asm volatile("outb %0, %1" : : "a"(val), "Nd"(port));
-        };
-        
-        while ((inb(COM1 + 5) & 0x20) == 0) {
-            asm volatile("pause");
-        }
-        
-        outb(COM1, c);
-    }
-    
-    void puts(const char* str) noexcept {
-        while (*str) {
-            if (*str == '\n') {
-                putc('\r');
-            }
-            putc(*str++);
-        }
-    }
-    
-    void put_hex(uint64_t val) noexcept {
-        puts("0x");
-        for (int i = 60; i >= 0; i -= 4) {
-            int digit = (val >> i) & 0xF;
-            putc(digit < 10 ? '0' + digit : 'a' + digit - 10);
-        }
-    }
-    
-    void put_number(int val) noexcept {
-        if (val < 0) {
-            putc('-');
-            val = -val;
-        }
-        
-        char buf[32];
-        int i = 0;
-        
-        if (val == 0) {
-            putc('0');
-            return;
-        }
-        
-        while (val > 0) {
-            buf[i++] = '0' + (val % 10);
-            val /= 10;
-        }
-        
-        while (i > 0) {
-            putc(buf[--i]);
-        }
-    }
-}
-
-volatile uint64_t ticks = 0;
-void timer_handler(idt::cpu_context*) {
-    ticks++;
-    if (ticks % 100 == 0) {
-        serial::puts("Tick ");
-        serial::put_number(ticks / 100);
-        serial::putc('\n');
-    }
-}
-
-void init_timer() noexcept {
-    uint32_t divisor = 1193180 / 100;
-    
-    asm volatile("outb %0, %1" : : "a"((uint8_t)0x36), "Nd"((uint16_t)0x43));
-    asm volatile("outb %0, %1" : : "a"((uint8_t)(divisor & 0xFF)), "Nd"((uint16_t)0x40));
-    asm volatile("outb %0, %1" : : "a"((uint8_t)((divisor >> 8) & 0xFF)), "Nd"((uint16_t)0x40));
-    
-    idt::register_handler(idt::irq::timer, timer_handler);
-    idt::enable_irq(0);
-}
-
 struct kernel_state {
     cpu_features features;
     bool initialized = false;
@@ -155,20 +74,109 @@ cpu_features kernel::get_cpu_features() noexcept {
     return g_state.features;
 }
 
+// Pre-open stage, on every core for its own structures (a smp::task_fn):
+// the rings, queues, gate and books it will write are walked and dirtied
+// here, so neither a page walk nor a cold line lands on the live path.
+// The memory itself was zeroed at allocation (allocate_dma) or load (.bss).
+void prefault_core(void*) noexcept {
+    trace::prefault_local();
+    log::prefault_local();
+    capture::prefault_local();
+    risk::prefault_local();
+    registry::prefault_local();
+}
+
+// Log drain as an event-loop task: the loop only sleeps once the queues
+// are empty and the UART has taken everything
+uint32_t poll_log(void*, uint32_t) noexcept {
+    return static_cast<uint32_t>(min<uint64_t>(log::poll(), 0xFFFFFFFF));
+}
+
+// Tick-to-trade breakdown every TRACE_REPORT_NS, on the core draining
+// the log: written straight to the UART once the log has gone quiet, so
+// it never splits a line. The merged histogram is too large for a stack.
+constexpr uint64_t TRACE_REPORT_NS = 10000000000;  // 10 s
+trace::latency_histogram trace_scratch;
+uint64_t next_trace_report = 0;
+
+uint32_t poll_trace_report(void*, uint32_t) noexcept {
+    const uint64_t now = tsc_clock::now();
+    if (now < next_trace_report) return 0;
+    if (log::poll() != 0) return 1;
+    next_trace_report = now + tsc_clock::from_ns(TRACE_REPORT_NS);
+    trace::report(serial::puts, trace_scratch);
+    return 1;
+}
+
+void set_flag(void* flag) noexcept {
+    static_cast<atomic<bool>*>(flag)->store(true, memory_order::release);
+}
+
+// Boot check of the one-shot timer path on the boot processor: one timer
+// armed, an earlier one armed and cancelled (so the LAPIC is reprogrammed
+// to the later deadline); only the first may fire
+bool timer_self_test() noexcept {
+    atomic<bool> fired{false};
+    atomic<bool> cancelled_fired{false};
+    timer::event due;
+    timer::event cancelled;
+    
+    if (!timer::arm_after(due, 100000, set_flag, &fired)) return false;
+    if (!timer::arm_after(cancelled, 50000, set_flag, &cancelled_fired)) {
+        timer::cancel(due);
+        return false;
+    }
+    timer::cancel(cancelled);
+    
+    const uint64_t deadline = tsc_clock::now() + tsc_clock::from_ns(10000000);
+    while (!fired.load(memory_order::acquire) && tsc_clock::now() < deadline) {
+        asm volatile("pause");
+    }
+    timer::cancel(due);  // Events live on this stack
+    return fired.load(memory_order::acquire) && !cancelled_fired.load(memory_order::acquire);
+}
+
 cpu_features cpu_features::detect() noexcept {
     cpu_features features{};
     uint32_t eax, ebx, ecx, edx;
     
+    asm volatile(
+        "cpuid"
+        : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+        : "a"(1), "c"(0)
+    );
+    
+    const bool avx = (ecx >> 28) & 1;
+    const bool fma = (ecx >> 12) & 1;
+    const bool osxsave = (ecx >> 27) & 1;
+    
     asm volatile(
         "cpuid"
         : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
         : "a"(7), "c"(0)
     );
     
-    features.avx512f = (ebx >> 16) & 1;
-    features.avx512dq = (ebx >> 17) & 1;
-    features.avx512vl = (ebx >> 31) & 1;
     features.tsx = (ebx >> 11) & 1;
+    features.cet = (ecx >> 7) & 1;
+    
+    // Vector state must also be enabled in XCR0 (done in boot64.S),
+    // otherwise the first VEX/EVEX instruction faults with #UD
+    uint64_t xcr0 = 0;
+    if (osxsave) {
+        uint32_t lo, hi;
+        asm volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = (static_cast<uint64_t>(hi) << 32) | lo;
+    }
+    
+    const bool ymm_enabled = (xcr0 & 0x6) == 0x6;     // SSE + AVX state
+    const bool zmm_enabled = (xcr0 & 0xE6) == 0xE6;   // + opmask, ZMM_Hi256, Hi16_ZMM
+    
+    features.avx = avx && ymm_enabled;
+    features.fma = fma && ymm_enabled;
+    features.avx2 = ((ebx >> 5) & 1) && ymm_enabled;
+    features.avx512f = ((ebx >> 16) & 1) && zmm_enabled;
+    features.avx512dq = ((ebx >> 17) & 1) && zmm_enabled;
+    features.avx512vl = ((ebx >> 31) & 1) && zmm_enabled;
     
     return features;
 }
@@ -191,10 +199,10 @@ extern "C" void kernel_main(hft::uint32_t magic, void* multiboot_info) {
     serial::puts("        HFT-Zero Kernel v0.1        \n");
     serial::puts("=====================================\n\n");
     
-    // Skip GDT init - bootloader's GDT is fine
-    // serial::puts("[*] Initializing GDT... ");
-    // gdt::init();
-    // serial::puts("[OK]\n");
+    // Own GDT and TSS, so faults get IST stacks and APs can copy the layout
+    serial::puts("[*] Initializing GDT... ");
+    gdt::init();
+    serial::puts("[OK]\n");
     
     serial::puts("[*] Initializing IDT... ");
     idt::init();
@@ -203,12 +211,16 @@ extern "C" void kernel_main(hft::uint32_t magic, void* multiboot_info) {
     // Parse multiboot2 info for memory map
     void* mmap_addr = nullptr;
     hft::uint32_t mmap_length = 0;
+    const void* rsdp = nullptr;
+    span<const uint8_t> capture_file;
+    span<const uint8_t> mbi_bytes;
     
     if (magic == 0x36d76289 && multiboot_info) {  // Multiboot2 magic
         serial::puts("[*] Parsing multiboot info...\n");
         
         auto* mbi = reinterpret_cast<uint8_t*>(multiboot_info);
         uint32_t total_size = *reinterpret_cast<uint32_t*>(mbi);
+        mbi_bytes = span<const uint8_t>{mbi, total_size};
         
         serial::puts("    Total size: ");
         serial::put_number(total_size);
@@ -236,7 +248,17 @@ extern "C" void kernel_main(hft::uint32_t magic, void* multiboot_info) {
                 serial::puts(", Map length: ");
                 serial::put_number(mmap_length);
                 serial::putc('\n');
-                break;
+            } else if (tag->type == 15 || (tag->type == 14 && !rsdp)) {
+                // ACPI new/old RSDP copy; the ACPI 2.0+ one wins
+                rsdp = reinterpret_cast<uint8_t*>(tag) + 8;
+            } else if (tag->type == 3 && capture_file.empty()) {
+                // First boot module: a feed capture_file for hft.bench
+                // (mod_start, mod_end; read through the identity map)
+                const auto* bounds = reinterpret_cast<const uint32_t*>(
+                    reinterpret_cast<uint8_t*>(tag) + 8);
+                capture_file = span<const uint8_t>{
+                    reinterpret_cast<const uint8_t*>(static_cast<uintptr_t>(bounds[0])),
+                    bounds[1] - bounds[0]};
             }
             
             // Next tag (8-byte aligned)
@@ -247,6 +269,19 @@ extern "C" void kernel_main(hft::uint32_t magic, void* multiboot_info) {
         }
     }
     
+    // Let current_cpu() use RDTSCP instead of CPUID from here on
+    topology::bind_current_cpu();
+    
+    // NUMA topology first, so PMM zones can be split by node
+    serial::puts("[*] Reading ACPI topology... ");
+    if (acpi::init(rsdp)) {
+        serial::puts("[OK] nodes: ");
+        serial::put_number(topology::node_count);
+        serial::putc('\n');
+    } else {
+        serial::puts("no ACPI, single node\n");
+    }
+    
     // Initialize PMM
     serial::puts("[*] Initializing PMM... ");
     
@@ -263,6 +298,15 @@ extern "C" void kernel_main(hft::uint32_t magic, void* multiboot_info) {
     serial::put_hex(kernel_phys_end);
     serial::putc('\n');
     
+    // GRUB leaves the module and the MBI (with the memory map) right
+    // after the kernel, where the PMM would lay out its metadata
+    const span<const uint8_t> loader_data[] = {capture_file, mbi_bytes};
+    for (const span<const uint8_t>& loaded : loader_data) {
+        if (loaded.empty()) continue;
+        const auto start = reinterpret_cast<uint64_t>(loaded.data());
+        pmm::keep(start, start + loaded.size());
+    }
+    
     if (mmap_addr && mmap_length > 0) {
         serial::puts("    Using multiboot memory map\n");
         pmm::init(mmap_addr, mmap_length, kernel_phys_start, kernel_phys_end);
@@ -279,32 +323,169 @@ extern "C" void kernel_main(hft::uint32_t magic, void* multiboot_info) {
     serial::putc('\n');
     serial::puts("[OK]\n");
     
-    // Skip VMM init - bootloader's page tables are fine
-    // serial::puts("[*] Initializing VMM... ");
-    // vmm::init();
-    // serial::puts("[OK]\n");
+    // Final page tables straight away: all RAM in 1 GiB / 2 MiB pages,
+    // in place before anything maps or allocates through them
+    serial::puts("[*] Initializing VMM... ");
+    serial::puts(vmm::init() ? "[OK]\n" : "failed, staying on boot tables\n");
+    
+    // Before anything else allocates: the host's ivshmem window if there
+    // is one, else the top of RAM, which a warm reboot leaves intact
+    serial::puts("[*] Attaching capture ring... ");
+    {
+        constexpr uint64_t CAPTURE_BYTES = 32 * 1024 * 1024;
+        const uint64_t cpus = acpi::processor_apic_ids().size();
+        const auto lanes = static_cast<uint32_t>(cpus == 0 ? 1 : min<uint64_t>(cpus, topology::MAX_CPUS));
+        if (capture::attach_ivshmem(lanes)) {
+            serial::puts("ivshmem\n");
+        } else if (capture::attach_top_of_memory(CAPTURE_BYTES, lanes)) {
+            serial::puts(capture::recovered() ? "top of RAM, previous session kept\n" : "top of RAM\n");
+        } else {
+            serial::puts("none\n");
+        }
+    }
     
     serial::puts("[*] Initializing heap... ");
     heap::init();
     serial::puts("[OK]\n");
     
-    serial::puts("[*] Initializing timer... ");
-    init_timer();
-    serial::puts("[OK]\n");
+    // Local APIC replaces the PICs; device IRQs are routed to this core
+    serial::puts("[*] Initializing APIC... ");
+    const bool have_apic = apic::init(acpi::local_apic_address());
+    if (have_apic) {
+        serial::puts(apic::x2apic_enabled() ? "x2APIC" : "xAPIC");
+        serial::puts(ioapic::init() ? ", IOAPIC\n" : ", no IOAPIC\n");
+    } else {
+        serial::puts("not available\n");
+    }
+    smp::init();
+    
+    // Calibrated TSC: every later timestamp is wall-clock nanoseconds
+    serial::puts("[*] Calibrating TSC... ");
+    tsc::init();
+    serial::put_number(tsc_clock::hz() / 1000000);
+    serial::puts(tsc::invariant() ? " MHz, invariant\n" : " MHz, NOT invariant\n");
+    (void)capture::recalibrated();  // Attached before the frequency was known
+    
+    // Tickless: no periodic interrupt, only per-core one-shot timers
+    if (have_apic) {
+        serial::puts("[*] Initializing timer... ");
+        timer::init();
+        serial::puts(timer::tsc_deadline_mode() ? "TSC-deadline\n" : "LAPIC one-shot\n");
+        
+        serial::puts("[*] Starting processors... ");
+        serial::put_number(smp::start_secondary());
+        serial::puts(tsc::synchronized() ? " online, TSC in sync\n" : " online, TSC NOT in sync\n");
+    }
+    
+    // Poll-mode NIC: no interrupts, rings and buffers in 2 MiB DMA pages
+    serial::puts("[*] Initializing NIC... ");
+    const bool nic_up = virtio_net::init();
+    if (nic_up) {
+        serial::puts("virtio-net ");
+        const uint8_t* mac = virtio_net::mac_address();
+        for (int i = 0; i < 6; ++i) {
+            const char digits[] = "0123456789abcdef";
+            serial::putc(digits[mac[i] >> 4]);
+            serial::putc(digits[mac[i] & 0xF]);
+            serial::putc(i < 5 ? ':' : '\n');
+        }
+    } else {
+        serial::puts("none\n");
+    }
     
     serial::puts("[*] Enabling interrupts... ");
     idt::enable();
     serial::puts("[OK]\n");
     
+    if (have_apic) {
+        serial::puts("[*] Timer self-test... ");
+        serial::puts(timer_self_test() ? "[OK]\n" : "[FAILED]\n");
+    }
+    
     serial::puts("[*] Initializing kernel... ");
     kernel::initialize();
     serial::puts("[OK]\n");
     
+    simd::select(kernel::get_cpu_features());
+    serial::puts("[*] Depth kernels: ");
+    serial::puts(simd::kernels().name);
+    serial::putc('\n');
+    if (!simd::self_test()) {
+        kernel::panic("depth kernels disagree with the scalar fallback");
+    }
+    
+    // Trading setup first, so the books it allocates are pre-faulted.
+    // This image carries no venue configuration: the plan has no
+    // instruments, groups or session until a deployment fills them in,
+    // and the loops then poll idle.
+    serial::puts("[*] Trading setup... ");
+    {
+        desk::plan plan{};
+        plan.nic = nic_up;
+        serial::puts(desk::setup(plan) ? "[OK]\n" : "incomplete\n");
+    }
+    
+    // Before the log drain and the trading loops: nothing else may be
+    // writing
+    serial::puts("[*] Pre-faulting trading memory... ");
+    {
+        const uint32_t cpus = smp::cpu_count();
+        bool pinned[topology::MAX_CPUS] = {};
+        for (uint32_t cpu = 1; cpu < cpus; ++cpu) {
+            pinned[cpu] = smp::pin(cpu, prefault_core, nullptr);
+        }
+        prefault_core(nullptr);
+        
+        const uint64_t deadline = tsc_clock::now() + tsc_clock::from_ns(1000000000);
+        uint32_t done = 1;
+        for (uint32_t cpu = 1; cpu < cpus; ++cpu) {
+            if (!pinned[cpu]) continue;
+            while (smp::state(cpu) != smp::cpu_state::idle && tsc_clock::now() < deadline) {
+                asm volatile("pause");
+            }
+            done += smp::state(cpu) == smp::cpu_state::idle;
+        }
+        serial::put_number(done);
+        serial::puts(" cores\n");
+    }
+    
     serial::puts("\nSystem ready!\n\n");
     
-    while (true) {
-        asm volatile("hlt");
+    // Before the APs get their run loops, so every core is free
+    if constexpr (bench::enabled) {
+        bench::run(capture_file, serial::puts);
     }
+    
+    // From here on serial output is deferred: cores log through hft.log
+    // and one housekeeping core formats and transmits. That core runs an
+    // event loop and takes pool jobs; the boot processor runs its own
+    // loop, keeping the device IRQs, which end its umwait. CPU 1 is the
+    // housekeeping core only if it is online and idle, so its start
+    // cannot fail (nothing else pins it) and strand pool jobs; otherwise
+    // the boot loop drains the log and takes the jobs.
+    log::set_cpu_count(smp::cpu_count());
+    const bool drain_pinned = smp::cpu_count() > 1 && smp::state(1) == smp::cpu_state::idle;
+    const uint32_t drain_cpu = drain_pinned ? 1 : 0;
+    sched::event_loop& housekeeping = sched::on(drain_cpu);
+    housekeeping.add({"log.drain", poll_log, nullptr, 1});
+    if constexpr (trace::enabled) housekeeping.add({"trace.report", poll_trace_report, nullptr, 1});
+    housekeeping.set_idle(sched::idle_mode::umwait);
+    housekeeping.join_pool(drain_cpu);
+    if (drain_pinned && !sched::start(1)) kernel::panic("Housekeeping core did not start");
+    log::write("log drain on cpu%u, %u cores online\n", drain_cpu, smp::cpu_count());
+    
+    // Feed, strategy and gateway loops on their own cores, or sharing
+    // the boot processor's loop when there are too few
+    const bool trading_started = desk::start();
+    const desk::cores roles = desk::placement();
+    log::write("feed on cpu%u, strategy on cpu%u, gateway on cpu%u%s\n", roles.feed, roles.strategy,
+               roles.gateway, trading_started ? "" : " (a loop did not start)");
+    
+    sched::event_loop& boot = sched::on(0);
+    boot.set_idle(sched::idle_mode::umwait);
+    boot.run();
+    
+    kernel::panic("boot event loop stopped");
 }
 
 extern "C" [[gnu::used]] hft::uintptr_t __stack_chk_guard = 0xDEADBEEF;
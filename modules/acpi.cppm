@@ -0,0 +1,423 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+
+export module hft.acpi;
+import hft.core;
+
+// ACPI table discovery, NUMA topology (SRAT/SLIT), processors and
+// interrupt controllers (MADT).
+// Tables are read in place through the boot identity map, so only tables
+// below identity_limit are used; everything is parsed once at boot into
+// static arrays and the results are published to hft::topology.
+export namespace hft::acpi {
+
+constexpr uint64_t identity_limit = 1ULL * 1024 * 1024 * 1024;  // boot_pdt maps 1 GiB
+constexpr size_t MAX_MEMORY_RANGES = 64;
+constexpr size_t MAX_PROCESSORS = topology::MAX_APIC_IDS;
+constexpr size_t MAX_IO_APICS = 8;
+constexpr size_t ISA_IRQS = 16;
+
+// Root System Description Pointer
+struct [[gnu::packed]] rsdp {
+    char signature[8];     // "RSD PTR "
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;      // 0 = ACPI 1.0 (RSDT only), 2+ = XSDT present
+    uint32_t rsdt_address;
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+};
+
+// Common header of every system description table
+struct [[gnu::packed]] sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+};
+
+// One SRAT memory range and the node it belongs to
+struct memory_affinity {
+    uint64_t base;
+    uint64_t length;
+    uint32_t node;
+    bool hot_pluggable;
+};
+
+// One I/O APIC and the first global system interrupt (GSI) it serves
+struct io_apic_info {
+    uint32_t id;
+    uint64_t address;
+    uint32_t gsi_base;
+};
+
+// Where an ISA IRQ arrives, with MPS INTI flags (polarity bits 0-1:
+// 0 = bus default, 1 = active high, 3 = active low; trigger bits 2-3:
+// 0 = bus default, 1 = edge, 3 = level)
+struct isa_route {
+    uint32_t gsi;
+    uint16_t flags;
+};
+
+} // namespace hft::acpi
+
+namespace hft::acpi {
+
+// SRAT and MADT entries both start with a type and a length
+struct [[gnu::packed]] entry_header {
+    uint8_t type;
+    uint8_t length;
+};
+
+// SRAT layout: header, 12 reserved bytes, then typed entries
+struct [[gnu::packed]] srat_lapic {         // type 0
+    uint8_t type;
+    uint8_t length;
+    uint8_t proximity_lo;
+    uint8_t apic_id;
+    uint32_t flags;                         // bit 0: enabled
+    uint8_t sapic_eid;
+    uint8_t proximity_hi[3];
+    uint32_t clock_domain;
+};
+
+struct [[gnu::packed]] srat_memory {        // type 1
+    uint8_t type;
+    uint8_t length;
+    uint32_t proximity;
+    uint16_t reserved0;
+    uint32_t base_lo;
+    uint32_t base_hi;
+    uint32_t length_lo;
+    uint32_t length_hi;
+    uint32_t reserved1;
+    uint32_t flags;                         // bit 0: enabled, bit 1: hot-pluggable
+    uint64_t reserved2;
+};
+
+struct [[gnu::packed]] srat_x2apic {        // type 2
+    uint8_t type;
+    uint8_t length;
+    uint16_t reserved0;
+    uint32_t proximity;
+    uint32_t x2apic_id;
+    uint32_t flags;                         // bit 0: enabled
+    uint32_t clock_domain;
+    uint32_t reserved1;
+};
+
+// MADT layout: header, local APIC address, flags, then typed entries
+struct [[gnu::packed]] madt_header {
+    sdt_header header;
+    uint32_t local_apic_address;
+    uint32_t flags;                         // bit 0: dual 8259 PICs present
+};
+
+struct [[gnu::packed]] madt_lapic {         // type 0
+    uint8_t type;
+    uint8_t length;
+    uint8_t processor_id;
+    uint8_t apic_id;
+    uint32_t flags;                         // bit 0: enabled, bit 1: online capable
+};
+
+struct [[gnu::packed]] madt_io_apic {       // type 1
+    uint8_t type;
+    uint8_t length;
+    uint8_t io_apic_id;
+    uint8_t reserved;
+    uint32_t address;
+    uint32_t gsi_base;
+};
+
+struct [[gnu::packed]] madt_source_override { // type 2
+    uint8_t type;
+    uint8_t length;
+    uint8_t bus;                            // 0 = ISA
+    uint8_t source;                         // ISA IRQ
+    uint32_t gsi;
+    uint16_t flags;
+};
+
+struct [[gnu::packed]] madt_lapic_override { // type 5
+    uint8_t type;
+    uint8_t length;
+    uint16_t reserved;
+    uint64_t address;
+};
+
+struct [[gnu::packed]] madt_x2apic {        // type 9
+    uint8_t type;
+    uint8_t length;
+    uint16_t reserved;
+    uint32_t x2apic_id;
+    uint32_t flags;                         // bit 0: enabled, bit 1: online capable
+    uint32_t processor_uid;
+};
+
+constexpr size_t srat_entries_offset = sizeof(sdt_header) + 12;
+constexpr size_t slit_matrix_offset = sizeof(sdt_header) + 8;
+
+inline const rsdp* root = nullptr;
+inline memory_affinity memory_ranges_[MAX_MEMORY_RANGES];
+inline size_t memory_range_count_ = 0;
+
+inline uint32_t processor_apic_ids_[MAX_PROCESSORS];
+inline size_t processor_count_ = 0;
+inline uint64_t local_apic_address_ = 0xFEE00000;  // Architectural default
+inline io_apic_info io_apics_[MAX_IO_APICS];
+inline size_t io_apic_count_ = 0;
+inline isa_route isa_routes_[ISA_IRQS];
+inline bool isa_overridden_[ISA_IRQS];
+
+// Proximity domains are sparse 32-bit ids; nodes are dense indices
+inline uint32_t domain_of_node[topology::MAX_NODES];
+
+bool checksum_ok(const void* data, size_t length) noexcept {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    uint8_t sum = 0;
+    for (size_t i = 0; i < length; ++i) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+bool mapped(uint64_t phys, uint64_t length) noexcept {
+    return phys != 0 && phys < identity_limit && length <= identity_limit - phys;
+}
+
+bool signature_is(const char* a, const char* b, size_t n) noexcept {
+    for (size_t i = 0; i < n; ++i) {
+        if (a[i] != b[i]) return false;
+    }
+    return true;
+}
+
+const rsdp* scan_for_rsdp(uint64_t start, uint64_t end) noexcept {
+    for (uint64_t addr = start; addr + sizeof(rsdp) <= end; addr += 16) {
+        const auto* candidate = reinterpret_cast<const rsdp*>(addr);
+        if (signature_is(candidate->signature, "RSD PTR ", 8) && checksum_ok(candidate, 20)) {
+            return candidate;
+        }
+    }
+    return nullptr;
+}
+
+const sdt_header* table_at(uint64_t phys) noexcept {
+    if (!mapped(phys, sizeof(sdt_header))) return nullptr;
+
+    const auto* header = reinterpret_cast<const sdt_header*>(phys);
+    if (!mapped(phys, header->length) || !checksum_ok(header, header->length)) {
+        return nullptr;
+    }
+    return header;
+}
+
+// Dense node index for a proximity domain, allocating one if new
+uint32_t node_for_domain(uint32_t domain) noexcept {
+    for (uint32_t node = 0; node < topology::node_count; ++node) {
+        if (domain_of_node[node] == domain) return node;
+    }
+    if (topology::node_count >= topology::MAX_NODES) {
+        return topology::MAX_NODES - 1;  // Fold extra domains into the last node
+    }
+    domain_of_node[topology::node_count] = domain;
+    return topology::node_count++;
+}
+
+void parse_srat(const sdt_header* srat) noexcept {
+    topology::node_count = 0;
+
+    const auto* base = reinterpret_cast<const uint8_t*>(srat);
+    for (size_t offset = srat_entries_offset; offset + sizeof(entry_header) <= srat->length;) {
+        const auto* entry = reinterpret_cast<const entry_header*>(base + offset);
+        if (entry->length == 0) break;
+
+        if (entry->type == 0 && entry->length >= sizeof(srat_lapic)) {
+            const auto* cpu = reinterpret_cast<const srat_lapic*>(entry);
+            if (cpu->flags & 1) {
+                const uint32_t domain = cpu->proximity_lo |
+                    (static_cast<uint32_t>(cpu->proximity_hi[0]) << 8) |
+                    (static_cast<uint32_t>(cpu->proximity_hi[1]) << 16) |
+                    (static_cast<uint32_t>(cpu->proximity_hi[2]) << 24);
+                topology::apic_node[cpu->apic_id] = static_cast<uint8_t>(node_for_domain(domain));
+            }
+        } else if (entry->type == 1 && entry->length >= sizeof(srat_memory)) {
+            const auto* mem = reinterpret_cast<const srat_memory*>(entry);
+            if ((mem->flags & 1) && memory_range_count_ < MAX_MEMORY_RANGES) {
+                memory_ranges_[memory_range_count_++] = {
+                    (static_cast<uint64_t>(mem->base_hi) << 32) | mem->base_lo,
+                    (static_cast<uint64_t>(mem->length_hi) << 32) | mem->length_lo,
+                    node_for_domain(mem->proximity),
+                    (mem->flags & 2) != 0
+                };
+            }
+        } else if (entry->type == 2 && entry->length >= sizeof(srat_x2apic)) {
+            const auto* cpu = reinterpret_cast<const srat_x2apic*>(entry);
+            if ((cpu->flags & 1) && cpu->x2apic_id < topology::MAX_APIC_IDS) {
+                topology::apic_node[cpu->x2apic_id] = static_cast<uint8_t>(node_for_domain(cpu->proximity));
+            }
+        }
+
+        offset += entry->length;
+    }
+
+    if (topology::node_count == 0) {
+        topology::node_count = 1;
+    }
+}
+
+// SLIT rows are indexed by proximity domain; translate to node indices
+void parse_slit(const sdt_header* slit) noexcept {
+    const auto* base = reinterpret_cast<const uint8_t*>(slit);
+    const uint64_t localities = *reinterpret_cast<const uint64_t*>(base + sizeof(sdt_header));
+    if (slit_matrix_offset + localities * localities > slit->length) return;
+
+    const uint8_t* matrix = base + slit_matrix_offset;
+    for (uint32_t from = 0; from < topology::node_count; ++from) {
+        for (uint32_t to = 0; to < topology::node_count; ++to) {
+            const uint64_t row = domain_of_node[from];
+            const uint64_t col = domain_of_node[to];
+            if (row < localities && col < localities) {
+                topology::node_distance[from][to] = matrix[row * localities + col];
+            }
+        }
+    }
+}
+
+// Processors firmware can start, in MADT order (the boot processor is
+// normally listed first)
+void add_processor(uint32_t apic_id, uint32_t flags) noexcept {
+    if (!(flags & 3) || apic_id >= topology::MAX_APIC_IDS) return;
+    
+    for (size_t i = 0; i < processor_count_; ++i) {
+        if (processor_apic_ids_[i] == apic_id) return;
+    }
+    if (processor_count_ < MAX_PROCESSORS) {
+        processor_apic_ids_[processor_count_++] = apic_id;
+    }
+}
+
+void parse_madt(const sdt_header* table) noexcept {
+    const auto* madt = reinterpret_cast<const madt_header*>(table);
+    local_apic_address_ = madt->local_apic_address;
+
+    const auto* base = reinterpret_cast<const uint8_t*>(madt);
+    for (size_t offset = sizeof(madt_header); offset + sizeof(entry_header) <= table->length;) {
+        const auto* entry = reinterpret_cast<const entry_header*>(base + offset);
+        if (entry->length == 0) break;
+
+        if (entry->type == 0 && entry->length >= sizeof(madt_lapic)) {
+            const auto* cpu = reinterpret_cast<const madt_lapic*>(entry);
+            add_processor(cpu->apic_id, cpu->flags);
+        } else if (entry->type == 1 && entry->length >= sizeof(madt_io_apic)) {
+            const auto* io = reinterpret_cast<const madt_io_apic*>(entry);
+            if (io_apic_count_ < MAX_IO_APICS) {
+                io_apics_[io_apic_count_++] = {io->io_apic_id, io->address, io->gsi_base};
+            }
+        } else if (entry->type == 2 && entry->length >= sizeof(madt_source_override)) {
+            const auto* redirect = reinterpret_cast<const madt_source_override*>(entry);
+            if (redirect->bus == 0 && redirect->source < ISA_IRQS) {
+                isa_routes_[redirect->source] = {redirect->gsi, redirect->flags};
+                isa_overridden_[redirect->source] = true;
+            }
+        } else if (entry->type == 5 && entry->length >= sizeof(madt_lapic_override)) {
+            local_apic_address_ = reinterpret_cast<const madt_lapic_override*>(entry)->address;
+        } else if (entry->type == 9 && entry->length >= sizeof(madt_x2apic)) {
+            const auto* cpu = reinterpret_cast<const madt_x2apic*>(entry);
+            add_processor(cpu->x2apic_id, cpu->flags);
+        }
+
+        offset += entry->length;
+    }
+}
+
+} // namespace hft::acpi
+
+export namespace hft::acpi {
+
+// Find a table by signature in the XSDT (or RSDT on ACPI 1.0)
+const sdt_header* find_table(const char* signature) noexcept {
+    if (!root) return nullptr;
+
+    const bool extended = root->revision >= 2 && root->xsdt_address != 0;
+    const sdt_header* sdt = table_at(extended ? root->xsdt_address : root->rsdt_address);
+    if (!sdt) return nullptr;
+
+    const size_t entry_size = extended ? 8 : 4;
+    const size_t entries = (sdt->length - sizeof(sdt_header)) / entry_size;
+    const auto* base = reinterpret_cast<const uint8_t*>(sdt) + sizeof(sdt_header);
+
+    for (size_t i = 0; i < entries; ++i) {
+        uint64_t phys = 0;
+        memcpy(&phys, base + i * entry_size, entry_size);  // Entries are unaligned
+
+        const sdt_header* table = table_at(phys);
+        if (table && signature_is(table->signature, signature, 4)) {
+            return table;
+        }
+    }
+    return nullptr;
+}
+
+// Locate the RSDP (from the multiboot2 ACPI tag if given, else the BIOS
+// areas) and load the NUMA and processor topology. Returns false without
+// ACPI, leaving the single-node, single-processor defaults in place.
+bool init(const void* rsdp_hint) noexcept {
+    root = static_cast<const rsdp*>(rsdp_hint);
+    if (!root) {
+        const uint64_t ebda = static_cast<uint64_t>(*reinterpret_cast<const uint16_t*>(0x40E)) << 4;
+        if (ebda) root = scan_for_rsdp(ebda, ebda + 1024);
+        if (!root) root = scan_for_rsdp(0xE0000, 0x100000);
+    }
+    if (!root || !checksum_ok(root, 20)) {
+        root = nullptr;
+        return false;
+    }
+
+    if (const sdt_header* srat = find_table("SRAT")) {
+        parse_srat(srat);
+        if (const sdt_header* slit = find_table("SLIT")) {
+            parse_slit(slit);
+        }
+    }
+    if (const sdt_header* madt = find_table("APIC")) {
+        parse_madt(madt);
+    }
+    return true;
+}
+
+[[nodiscard]] span<const memory_affinity> memory_ranges() noexcept {
+    return {memory_ranges_, memory_range_count_};
+}
+
+// APIC IDs of the usable processors (empty without a MADT)
+[[nodiscard]] span<const uint32_t> processor_apic_ids() noexcept {
+    return {processor_apic_ids_, processor_count_};
+}
+
+// Physical address of the xAPIC register page
+[[nodiscard]] uint64_t local_apic_address() noexcept {
+    return local_apic_address_;
+}
+
+[[nodiscard]] span<const io_apic_info> io_apics() noexcept {
+    return {io_apics_, io_apic_count_};
+}
+
+// GSI and flags for an ISA IRQ: identity mapped, edge, active high unless
+// the MADT overrides it
+[[nodiscard]] isa_route isa_irq_route(uint8_t irq) noexcept {
+    if (irq < ISA_IRQS && isa_overridden_[irq]) return isa_routes_[irq];
+    return {irq, 0};
+}
+
+} // namespace hft::acpi
@@ -0,0 +1,169 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+
+export module hft.apic;
+import hft.core;
+import hft.vmm;
+
+// Local APIC access for the executing core.
+// x2APIC mode (MSR access, no MMIO mapping, single-write ICR) is used when
+// the CPU has it; otherwise the xAPIC register page is mapped uncached.
+// Every core runs in the same mode, chosen by the boot processor in init().
+export namespace hft::apic {
+
+// Register offsets in the xAPIC page; x2APIC MSR = 0x800 + offset / 16
+enum class reg : uint32_t {
+    id = 0x020,
+    version = 0x030,
+    task_priority = 0x080,
+    eoi = 0x0B0,
+    spurious = 0x0F0,
+    error_status = 0x280,
+    icr_low = 0x300,
+    icr_high = 0x310,
+    lvt_timer = 0x320,
+    lvt_lint0 = 0x350,
+    lvt_lint1 = 0x360,
+    lvt_error = 0x370,
+    timer_initial = 0x380,
+    timer_current = 0x390,
+    timer_divide = 0x3E0
+};
+
+constexpr uint32_t APIC_BASE_MSR = 0x1B;
+constexpr uint32_t X2APIC_MSR_BASE = 0x800;
+constexpr uint8_t SPURIOUS_VECTOR = 0xFF;  // Matches idt::spurious_vector
+
+// Interrupt command register: delivery mode and level bits
+enum icr : uint32_t {
+    delivery_fixed = 0x000,
+    delivery_nmi = 0x400,
+    delivery_init = 0x500,
+    delivery_startup = 0x600,
+    delivery_pending = 1 << 12,  // xAPIC only
+    level_assert = 1 << 14
+};
+
+} // namespace hft::apic
+
+namespace hft::apic {
+
+inline bool x2apic = false;
+inline volatile uint32_t* registers = nullptr;  // xAPIC page
+
+bool x2apic_supported() noexcept {
+    uint32_t eax = 1, ebx, ecx = 0, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    return (ecx >> 21) & 1;
+}
+
+} // namespace hft::apic
+
+export namespace hft::apic {
+
+// Register access for the executing core's APIC
+uint32_t read(reg r) noexcept {
+    const auto offset = static_cast<uint32_t>(r);
+    if (x2apic) return static_cast<uint32_t>(read_msr(X2APIC_MSR_BASE + offset / 16));
+    return registers[offset / 4];
+}
+
+void write(reg r, uint32_t value) noexcept {
+    const auto offset = static_cast<uint32_t>(r);
+    if (x2apic) {
+        write_msr(X2APIC_MSR_BASE + offset / 16, value);
+    } else {
+        registers[offset / 4] = value;
+    }
+}
+
+} // namespace hft::apic
+
+namespace hft::apic {
+
+// In x2APIC mode the ICR is one 64-bit MSR and the write itself sends;
+// xAPIC needs the destination first and a poll until the IPI has left
+void send(uint32_t apic_id, uint32_t command) noexcept {
+    if (x2apic) {
+        // x2APIC MSR writes are not serializing: make earlier stores
+        // (e.g. a mailbox the target reads) visible first
+        asm volatile("mfence; lfence" ::: "memory");
+        write_msr(X2APIC_MSR_BASE + static_cast<uint32_t>(reg::icr_low) / 16,
+                  (static_cast<uint64_t>(apic_id) << 32) | command);
+        return;
+    }
+
+    write(reg::icr_high, apic_id << 24);
+    write(reg::icr_low, command);
+    while (read(reg::icr_low) & delivery_pending) {
+        asm volatile("pause");
+    }
+}
+
+} // namespace hft::apic
+
+export namespace hft::apic {
+
+// Enable the executing core's local APIC: software enable through the
+// spurious vector register, accept all priorities. Each core calls this
+// once, after the boot processor's init().
+void init_local() noexcept {
+    uint64_t base = read_msr(APIC_BASE_MSR);
+    base |= 1 << 11;                      // Global enable
+    write_msr(APIC_BASE_MSR, base);
+    if (x2apic) {
+        write_msr(APIC_BASE_MSR, base | (1 << 10));  // xAPIC -> x2APIC
+    }
+
+    write(reg::spurious, 0x100 | SPURIOUS_VECTOR);
+    write(reg::task_priority, 0);
+}
+
+// Pick the APIC mode and enable the boot processor's APIC. mmio_base is
+// the xAPIC register page (acpi::local_apic_address()); it is only mapped
+// when x2APIC is unavailable. Returns false if it could not be mapped.
+bool init(uint64_t mmio_base) noexcept {
+    x2apic = x2apic_supported();
+    if (!x2apic) {
+        const uint64_t virt = vmm::map_mmio(mmio_base, 4096);
+        if (virt == 0) return false;
+        registers = reinterpret_cast<volatile uint32_t*>(virt);
+    }
+
+    init_local();
+    return true;
+}
+
+[[nodiscard]] bool x2apic_enabled() noexcept {
+    return x2apic;
+}
+
+// APIC ID of the executing core
+[[nodiscard]] uint32_t id() noexcept {
+    const uint32_t value = read(reg::id);
+    return x2apic ? value : value >> 24;
+}
+
+// Signal end of interrupt for the vector being serviced
+void eoi() noexcept {
+    if (!x2apic && !registers) return;  // Before init()
+    write(reg::eoi, 0);
+}
+
+// AP startup: INIT, then STARTUP with the trampoline's page number (the
+// AP begins in real mode at vector << 12)
+void send_init(uint32_t apic_id) noexcept {
+    send(apic_id, delivery_init | level_assert);
+}
+
+void send_startup(uint32_t apic_id, uint8_t vector) noexcept {
+    send(apic_id, delivery_startup | level_assert | vector);
+}
+
+// Fixed interrupt on another core
+void send_ipi(uint32_t apic_id, uint8_t vector) noexcept {
+    send(apic_id, delivery_fixed | level_assert | vector);
+}
+
+} // namespace hft::apic
@@ -0,0 +1,651 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+#include "../include/freestanding/atomic.hpp"
+
+// Build with -DHFT_BENCH=1 to run the suite at boot
+#ifndef HFT_BENCH
+#define HFT_BENCH 0
+#endif
+
+export module hft.bench;
+import hft.core;
+import hft.concurrent;
+import hft.vmm;
+import hft.smp;
+import hft.trace;
+import hft.simd;
+import hft.trading;
+import hft.signals;
+import hft.wire;
+import hft.itch;
+
+// Boot-time benchmarks for the hot path.
+// Replay pushes a MoldUDP64/ITCH stream through decoder -> L3 book ->
+// signal pipeline on the boot processor, one datagram at a time, and
+// records each datagram's cycles in TSC histograms. The stream is either
+// a pcap capture (handed over as a multiboot module) or a synthetic one
+// generated from a seed, so two builds can be compared on the same input:
+// the checksum over the signal outputs must match, the cycles should not.
+// Each stream is replayed a second time into an L3 book that publishes
+// into a soa_order_book; its checksum must equal the first one, and after
+// every datagram its ladders are run through the selected depth kernels
+// and the scalar ones, which must agree.
+// Ping-pong bounces a TSC stamp between cores through spsc_queue and
+// mpsc_queue and records round trips. Everything runs with interrupts
+// off before the trading cores are handed their tasks.
+export namespace hft::bench {
+
+inline constexpr bool enabled = HFT_BENCH != 0;
+
+constexpr uint16_t ANY_INSTRUMENT = 0;  // Replay the first locate with an add order
+constexpr uint32_t PING_ROUNDS = 100000;
+constexpr uint32_t PING_WARMUP = 1000;  // Round trips not recorded
+
+struct replay_result {
+    uint64_t packets;
+    uint64_t messages;   // Book messages for the replayed instrument
+    uint64_t rejected;   // Refused by the book
+    uint64_t malformed;  // Datagrams that did not parse
+    uint64_t cycles;     // Whole replay, including the signals
+    uint64_t checksum;   // Over every signal evaluation
+    uint64_t soa_checksum;       // Same stream through the SoA depth book
+    uint64_t kernel_mismatches;  // Datagrams where SIMD and scalar kernels differed
+    uint16_t instrument;
+};
+
+} // namespace hft::bench
+
+namespace hft::bench {
+
+using replay_book = trading::l3_book<65536, 32>;
+using soa_replay_book = trading::l3_book<65536, 32, trading::soa_order_book<32>>;
+
+// Arena large enough for either book
+constexpr size_t REPLAY_BOOK_BYTES =
+    (max(sizeof(replay_book), sizeof(soa_replay_book)) + 63) & ~size_t{63};
+// ITCH prices carry four decimals: a cent is 100
+using replay_pipeline = signals::signal_pipeline<signals::imbalance<>, signals::microprice_skew<>,
+                                                 signals::spread_regime<100, 400>>;
+
+// Per-datagram cycles of the last replay
+inline trace::latency_histogram decode_cycles;  // Decode and book update
+inline trace::latency_histogram signal_cycles;  // Pipeline on the updated book
+
+using le16 = wire::field<uint16_t, 0, 2, wire::byte_order::little>;
+using le32 = wire::field<uint32_t, 0, 4, wire::byte_order::little>;
+using mold_count = wire::field<uint16_t, 18>;
+
+// Classic pcap, microsecond or nanosecond stamps, Ethernet link type
+constexpr uint32_t PCAP_MAGIC = 0xA1B2C3D4;
+constexpr uint32_t PCAP_MAGIC_NS = 0xA1B23C4D;
+constexpr size_t PCAP_HEADER = 24;
+constexpr size_t PCAP_RECORD = 16;
+constexpr uint32_t LINK_ETHERNET = 1;
+
+// UDP payload of an Ethernet frame (optionally VLAN tagged IPv4); false
+// for anything else
+bool udp_payload(const uint8_t* frame, size_t length, const uint8_t*& payload,
+                 size_t& payload_length) noexcept {
+    size_t l3 = 14;
+    if (length < l3 + 20) return false;
+    uint16_t ether_type = wire::field<uint16_t, 12>::read(frame);
+    if (ether_type == 0x8100) {
+        ether_type = wire::field<uint16_t, 16>::read(frame);
+        l3 += 4;
+    }
+    if (ether_type != 0x0800 || length < l3 + 20 || frame[l3 + 9] != 17) return false;
+
+    const size_t udp = l3 + (frame[l3] & 0x0F) * 4u;
+    if (length < udp + 8) return false;
+    const size_t udp_length = wire::field<uint16_t, 4>::read(frame + udp);
+    if (udp_length < 8) return false;
+
+    payload = frame + udp + 8;
+    payload_length = min(udp_length - 8, length - udp - 8);
+    return true;
+}
+
+// Call f(payload, length) for every UDP datagram in a pcap file; false if
+// the file is not one
+template<typename F>
+bool for_each_pcap(span<const uint8_t> file, F&& f) noexcept {
+    if (file.size() < PCAP_HEADER) return false;
+    const uint32_t magic = le32::read(file.data());
+    if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NS) return false;
+    if (le32::read(file.data() + 20) != LINK_ETHERNET) return false;
+
+    size_t offset = PCAP_HEADER;
+    while (offset + PCAP_RECORD <= file.size()) {
+        const size_t captured = le32::read(file.data() + offset + 8);
+        offset += PCAP_RECORD;
+        if (captured > file.size() - offset) break;
+
+        const uint8_t* payload;
+        size_t length;
+        if (udp_payload(file.data() + offset, captured, payload, length)) f(payload, length);
+        offset += captured;
+    }
+    return true;
+}
+
+// Generated streams: each datagram stored as a 2-byte length and its bytes
+template<typename F>
+void for_each_record(span<const uint8_t> stream, F&& f) noexcept {
+    size_t offset = 0;
+    while (offset + 2 <= stream.size()) {
+        const size_t length = le16::read(stream.data() + offset);
+        offset += 2;
+        if (length > stream.size() - offset) break;
+        f(stream.data() + offset, length);
+        offset += length;
+    }
+}
+
+// Finds the instrument to replay when none was asked for
+struct first_add {
+    uint16_t instrument = ANY_INSTRUMENT;
+
+    void operator()(wire::view<itch::add_order> m) noexcept { take(m.get<itch::locate>()); }
+    void operator()(wire::view<itch::add_order_mpid> m) noexcept { take(m.get<itch::locate>()); }
+
+    void take(uint16_t locate) noexcept {
+        if (instrument == ANY_INSTRUMENT) instrument = locate;
+    }
+};
+
+// Deterministic order flow for one instrument: adds around a fixed mid,
+// then executions, partial cancels, deletes and replaces of live orders,
+// with adds for a second instrument mixed in for the decoder to skip
+class generator {
+public:
+    static constexpr uint32_t MAX_LIVE = 4096;
+    static constexpr uint32_t MAX_PER_PACKET = 8;
+    static constexpr size_t MAX_PACKET = itch::MOLD_HEADER + MAX_PER_PACKET * (2 + itch::add_order::length);
+    static constexpr uint32_t MID = 1000000;  // $100.0000
+    static constexpr uint32_t TICK = 100;
+    static constexpr uint32_t LEVELS = 16;
+
+    void reset(uint64_t seed, uint16_t instrument) noexcept {
+        state_ = seed | 1;
+        instrument_ = instrument;
+        live_ = 0;
+        next_reference_ = 1;
+        sequence_ = 1;
+        clock_ns_ = 34200ull * 1000000000;  // 09:30
+    }
+
+    // One datagram into out (at least MAX_PACKET bytes); returns its length
+    size_t packet(uint8_t* out) noexcept {
+        const auto count = static_cast<uint16_t>(1 + next() % MAX_PER_PACKET);
+        memset(out, 0, itch::MOLD_HEADER);
+        memcpy(out, "BENCH     ", 10);
+        wire::field<uint64_t, 10>::write(out, sequence_);
+        mold_count::write(out, count);
+        sequence_ += count;
+
+        size_t length = itch::MOLD_HEADER;
+        for (uint16_t i = 0; i < count; ++i) {
+            const size_t size = message(out + length + 2);
+            wire::field<uint16_t, 0>::write(out + length, static_cast<uint16_t>(size));
+            length += 2 + size;
+        }
+        return length;
+    }
+
+private:
+    struct live_order {
+        uint64_t reference;
+        uint32_t price;
+        uint32_t shares;
+        bool is_buy;
+    };
+
+    uint64_t next() noexcept {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 7;
+        state_ ^= state_ << 17;
+        return state_;
+    }
+
+    void header(uint8_t* m, uint8_t type, size_t length, uint16_t instrument) noexcept {
+        memset(m, 0, length);
+        m[0] = type;
+        itch::locate::write(m, instrument);
+        clock_ns_ += 1 + next() % 2000;
+        itch::timestamp::write(m, clock_ns_);
+    }
+
+    size_t message(uint8_t* m) noexcept {
+        const uint64_t r = next();
+        if (r % 8 == 0) return add(m, static_cast<uint16_t>(instrument_ + 1), false);
+        if (live_ < 64 || (live_ < MAX_LIVE && r % 100 < 40)) return add(m, instrument_, true);
+
+        const uint32_t index = static_cast<uint32_t>((r >> 8) % live_);
+        live_order& o = live_orders_[index];
+        switch ((r >> 24) % 4) {
+            case 0: {
+                const auto shares = static_cast<uint32_t>(1 + (r >> 32) % o.shares);
+                header(m, itch::order_executed::type, itch::order_executed::length, instrument_);
+                itch::order_executed::reference::write(m, o.reference);
+                itch::order_executed::shares::write(m, shares);
+                itch::order_executed::match::write(m, r);
+                o.shares -= shares;
+                if (o.shares == 0) forget(index);
+                return itch::order_executed::length;
+            }
+            case 1:
+                if (o.shares > 1) {
+                    const auto shares = static_cast<uint32_t>(1 + (r >> 32) % (o.shares - 1));
+                    header(m, itch::order_cancel::type, itch::order_cancel::length, instrument_);
+                    itch::order_cancel::reference::write(m, o.reference);
+                    itch::order_cancel::shares::write(m, shares);
+                    o.shares -= shares;
+                    return itch::order_cancel::length;
+                }
+                [[fallthrough]];
+            case 2:
+                header(m, itch::order_delete::type, itch::order_delete::length, instrument_);
+                itch::order_delete::reference::write(m, o.reference);
+                forget(index);
+                return itch::order_delete::length;
+            default:
+                header(m, itch::order_replace::type, itch::order_replace::length, instrument_);
+                itch::order_replace::original::write(m, o.reference);
+                o.reference = next_reference_++;
+                o.price = price(o.is_buy, r >> 32);
+                o.shares = shares(r >> 40);
+                itch::order_replace::reference::write(m, o.reference);
+                itch::order_replace::shares::write(m, o.shares);
+                itch::order_replace::price::write(m, o.price);
+                return itch::order_replace::length;
+        }
+    }
+
+    size_t add(uint8_t* m, uint16_t instrument, bool track) noexcept {
+        const uint64_t r = next();
+        const live_order o{next_reference_++, price(r & 1, r >> 8), shares(r >> 16), (r & 1) != 0};
+        header(m, itch::add_order::type, itch::add_order::length, instrument);
+        itch::add_order::reference::write(m, o.reference);
+        itch::add_order::side::write(m, o.is_buy ? 'B' : 'S');
+        itch::add_order::shares::write(m, o.shares);
+        itch::add_order::stock::write(m, 0x20202048434E4542);  // "BENCH   "
+        itch::add_order::price::write(m, o.price);
+        if (track) live_orders_[live_++] = o;
+        return itch::add_order::length;
+    }
+
+    // Bids below the mid, asks above, so the book never crosses
+    static uint32_t price(bool is_buy, uint64_t r) noexcept {
+        const auto distance = static_cast<uint32_t>(1 + r % LEVELS) * TICK;
+        return is_buy ? MID - distance : MID + distance;
+    }
+
+    static uint32_t shares(uint64_t r) noexcept {
+        return static_cast<uint32_t>(100 * (1 + r % 10));
+    }
+
+    void forget(uint32_t index) noexcept {
+        live_orders_[index] = live_orders_[--live_];
+    }
+
+    uint64_t state_ = 1;
+    uint16_t instrument_ = 1;
+    uint32_t live_ = 0;
+    uint64_t next_reference_ = 1;
+    uint64_t sequence_ = 1;
+    uint64_t clock_ns_ = 0;
+    live_order live_orders_[MAX_LIVE];
+};
+
+inline generator synthetic;
+
+uint64_t mix(uint64_t hash, uint64_t value) noexcept {
+    return (hash ^ value) * 0x100000001B3;  // FNV-1a step, a word at a time
+}
+
+// Replay every datagram each() produces into a fresh Book in arena
+template<typename Book, typename Each>
+replay_result replay(void* arena, uint16_t instrument, Each&& each) noexcept {
+    Book& book = *new (arena) Book;  // Arena is zeroed; skip value-init
+    itch::book_builder<Book> builder{book, instrument};
+    replay_result result{};
+    result.instrument = instrument;
+    result.checksum = 0xCBF29CE484222325;
+    decode_cycles.reset();
+    signal_cycles.reset();
+
+    const uint64_t begin = tsc_clock::start();
+    each([&](const uint8_t* payload, size_t length) {
+        if (length < itch::MOLD_HEADER) [[unlikely]] {
+            ++result.malformed;
+            return;
+        }
+        // Receive time 0 keeps the book's contents identical between runs
+        const uint64_t t0 = tsc_clock::start();
+        builder.on_packet(payload, length, 0, mold_count::read(payload), 0);
+        const uint64_t t1 = tsc_clock::stop();
+        const auto evaluation = replay_pipeline::evaluate_book(book.levels());
+        const uint64_t t2 = tsc_clock::stop();
+
+        decode_cycles.record(t1 - t0);
+        signal_cycles.record(t2 - t1);
+        result.checksum = mix(result.checksum, static_cast<uint64_t>(evaluation.template get<0>().value.raw));
+        result.checksum = mix(result.checksum, static_cast<uint64_t>(evaluation.template get<1>().value.raw));
+        result.checksum = mix(result.checksum, static_cast<uint64_t>(evaluation.template get<2>().spread));
+        
+        if constexpr (requires { book.levels().bid_prices(); }) {
+            const auto& depth = book.levels();
+            const bool same =
+                simd::matches_scalar(depth.bid_prices(), depth.bid_quantities(), depth.bid_depth()) &&
+                simd::matches_scalar(depth.ask_prices(), depth.ask_quantities(), depth.ask_depth());
+            result.kernel_mismatches += !same;
+        }
+    });
+    result.cycles = tsc_clock::stop() - begin;
+
+    const itch::builder_stats& stats = builder.stats();
+    result.packets = stats.packets;
+    result.messages = stats.messages;
+    result.rejected = stats.rejected;
+    result.malformed += stats.malformed;
+    return result;
+}
+
+// Replay into the SoA book and then the plain one (whose histograms are
+// the ones printed), from the same arena
+template<typename Each>
+replay_result replay_both(void* arena, uint16_t instrument, Each&& each) noexcept {
+    const replay_result soa = replay<soa_replay_book>(arena, instrument, each);
+    zero_bytes(arena, REPLAY_BOOK_BYTES);
+    replay_result result = replay<replay_book>(arena, instrument, each);
+    result.soa_checksum = soa.checksum;
+    result.kernel_mismatches = soa.kernel_mismatches;
+    return result;
+}
+
+// Per second, from a count over cycles
+uint64_t rate(uint64_t count, uint64_t cycles) noexcept {
+    const uint64_t ns = tsc_clock::to_ns(cycles);
+    return ns ? count * 1000000000 / ns : 0;
+}
+
+void print(trace::writer out, const char* label, const replay_result& r) noexcept {
+    out(label);
+    out(": instrument ");
+    trace::write_number(out, r.instrument);
+    out(", ");
+    trace::write_number(out, r.packets);
+    out(" packets, ");
+    trace::write_number(out, r.messages);
+    out(" messages (");
+    trace::write_number(out, r.rejected);
+    out(" rejected, ");
+    trace::write_number(out, r.malformed);
+    out(" malformed), checksum ");
+    trace::write_number(out, r.checksum);
+    out(r.soa_checksum == r.checksum ? ", soa book matches" : ", SOA BOOK DIFFERS");
+    if (r.kernel_mismatches) {
+        out(", depth kernels differed from scalar on ");
+        trace::write_number(out, r.kernel_mismatches);
+        out(" datagrams");
+    }
+    out("\n  ");
+    trace::write_number(out, rate(r.messages, r.cycles));
+    out(" msgs/s, ");
+    trace::write_number(out, rate(r.packets, r.cycles));
+    out(" packets/s\n");
+    trace::print(out, "  decode+book", decode_cycles);
+    trace::print(out, "  signals", signal_cycles);
+}
+
+// Ping-pong between two cores: the initiator pushes a TSC stamp, the
+// partner echoes it back. Both spin without pause, which would add its
+// own latency to every hop.
+using ping_queue = concurrent::spsc_queue<uint64_t, 64>;
+
+struct ping_pair {
+    ping_queue there;
+    ping_queue back;
+    trace::latency_histogram round_trip;
+    atomic<bool> stop{false};
+    atomic<bool> initiator_done{false};
+};
+
+inline ping_pair pair;
+
+void echo(void* arg) noexcept {
+    ping_pair& p = *static_cast<ping_pair*>(arg);
+    uint64_t stamp;
+    while (!p.stop.load(memory_order::relaxed)) {
+        if (p.there.try_pop(stamp)) {
+            while (!p.back.try_push(stamp)) {}
+        }
+    }
+}
+
+void initiate(void* arg) noexcept {
+    ping_pair& p = *static_cast<ping_pair*>(arg);
+    for (uint32_t i = 0; i < PING_WARMUP + PING_ROUNDS; ++i) {
+        const uint64_t sent = tsc_clock::start();
+        while (!p.there.try_push(sent)) {}
+        uint64_t stamp;
+        while (!p.back.try_pop(stamp)) {}
+        const uint64_t now = tsc_clock::stop();
+        if (i >= PING_WARMUP) p.round_trip.record(now - stamp);
+    }
+    p.initiator_done.store(true, memory_order::release);
+}
+
+// An AP that ran a task is idle again once it returns
+bool wait_idle(uint32_t cpu) noexcept {
+    const uint64_t deadline = tsc_clock::now() + tsc_clock::from_ns(1000000000);
+    while (smp::state(cpu) != smp::cpu_state::idle) {
+        if (tsc_clock::now() > deadline) return false;
+        asm volatile("pause");
+    }
+    return true;
+}
+
+// Round trips from initiator to partner (initiator 0 runs inline)
+bool ping_pong(uint32_t initiator, uint32_t partner) noexcept {
+    pair.round_trip.reset();
+    pair.stop.store(false, memory_order::relaxed);
+    pair.initiator_done.store(false, memory_order::relaxed);
+
+    if (!smp::pin(partner, echo, &pair)) return false;
+    if (initiator == 0) {
+        initiate(&pair);
+    } else if (!smp::pin(initiator, initiate, &pair)) {
+        pair.stop.store(true, memory_order::relaxed);
+        (void)wait_idle(partner);
+        return false;
+    }
+    while (!pair.initiator_done.load(memory_order::acquire)) asm volatile("pause");
+
+    pair.stop.store(true, memory_order::relaxed);
+    return wait_idle(partner) && (initiator == 0 || wait_idle(initiator));
+}
+
+// Fan-in: every producer core sends through one mpsc_queue to the boot
+// processor, which answers on the producer's own spsc_queue
+struct fan_in_message {
+    uint32_t cpu;
+    uint64_t stamp;
+};
+
+using fan_in_queue = concurrent::mpsc_queue<fan_in_message, 256>;
+
+struct producer {
+    ping_queue back;
+    trace::latency_histogram round_trip;
+};
+
+inline producer producers[topology::MAX_CPUS];
+alignas(64) inline uint8_t fan_in_storage[sizeof(fan_in_queue)];
+inline fan_in_queue* fan_in = nullptr;
+inline atomic<uint32_t> producers_done{0};
+
+void produce(void* arg) noexcept {
+    producer& self = *static_cast<producer*>(arg);
+    const uint32_t cpu = smp::current();
+    for (uint32_t i = 0; i < PING_WARMUP + PING_ROUNDS; ++i) {
+        const uint64_t sent = tsc_clock::start();
+        while (!fan_in->try_push({cpu, sent})) {}
+        uint64_t stamp;
+        while (!self.back.try_pop(stamp)) {}
+        const uint64_t now = tsc_clock::stop();
+        if (i >= PING_WARMUP) self.round_trip.record(now - stamp);
+    }
+    producers_done.fetch_add(1, memory_order::release);
+}
+
+// Returns the number of producer cores that took part
+uint32_t fan_in_round_trips(trace::latency_histogram& merged) noexcept {
+    fan_in = new (fan_in_storage) fan_in_queue();
+    merged.reset();
+
+    uint32_t started = 0;
+    producers_done.store(0, memory_order::relaxed);
+    for (uint32_t cpu = 1; cpu < smp::cpu_count(); ++cpu) {
+        producers[cpu].round_trip.reset();
+        started += smp::pin(cpu, produce, &producers[cpu]);
+    }
+
+    fan_in_message m;
+    while (producers_done.load(memory_order::acquire) < started) {
+        if (fan_in->try_pop(m)) {
+            while (!producers[m.cpu].back.try_push(m.stamp)) {}
+        }
+    }
+
+    for (uint32_t cpu = 1; cpu < smp::cpu_count(); ++cpu) {
+        if (wait_idle(cpu)) merged.merge(producers[cpu].round_trip);
+    }
+    return started;
+}
+
+// Disables interrupts on this core for the lifetime of the guard
+class interrupts_off {
+public:
+    interrupts_off() noexcept {
+        asm volatile("pushfq; popq %0; cli" : "=r"(flags_) :: "memory");
+    }
+
+    ~interrupts_off() {
+        if (flags_ & (1u << 9)) asm volatile("sti" ::: "memory");
+    }
+
+    interrupts_off(const interrupts_off&) = delete;
+    interrupts_off& operator=(const interrupts_off&) = delete;
+
+private:
+    uint64_t flags_;
+};
+
+} // namespace hft::bench
+
+export namespace hft::bench {
+
+// Replay a pcap capture of a MoldUDP64 ITCH feed for one instrument
+// (ANY_INSTRUMENT: the first one with an add order). false if the
+// capture is not a pcap or no memory was left for the book.
+bool replay_capture(span<const uint8_t> capture, uint16_t instrument, replay_result& result) noexcept {
+    if (instrument == ANY_INSTRUMENT) {
+        first_add finder;
+        const bool parsed = for_each_pcap(capture, [&finder](const uint8_t* payload, size_t length) {
+            if (finder.instrument == ANY_INSTRUMENT && length >= itch::MOLD_HEADER) {
+                (void)itch::decode_packet(finder, payload, length, 0, mold_count::read(payload));
+            }
+        });
+        if (!parsed || finder.instrument == ANY_INSTRUMENT) return false;
+        instrument = finder.instrument;
+    }
+
+    const vmm::dma_region arena = vmm::allocate_dma(REPLAY_BOOK_BYTES);
+    if (arena.virt == 0) return false;
+    result = replay_both(reinterpret_cast<void*>(arena.virt), instrument, [capture](auto&& f) {
+        (void)for_each_pcap(capture, f);
+    });
+    vmm::free_dma(arena);
+    return true;
+}
+
+// Generate packets datagrams from seed and replay them; the same seed
+// always produces the same stream, and so the same checksum
+bool replay_synthetic(uint64_t seed, uint32_t packets, replay_result& result) noexcept {
+    constexpr uint16_t INSTRUMENT = 1;
+    const size_t book_bytes = REPLAY_BOOK_BYTES;
+    const size_t stream_bytes = static_cast<size_t>(packets) * (2 + generator::MAX_PACKET);
+
+    const vmm::dma_region arena = vmm::allocate_dma(book_bytes + stream_bytes);
+    if (arena.virt == 0) return false;
+
+    // Generated up front, so replay time is decode time only
+    uint8_t* stream = reinterpret_cast<uint8_t*>(arena.virt) + book_bytes;
+    size_t used = 0;
+    synthetic.reset(seed, INSTRUMENT);
+    for (uint32_t i = 0; i < packets; ++i) {
+        const size_t length = synthetic.packet(stream + used + 2);
+        le16::write(stream + used, static_cast<uint16_t>(length));
+        used += 2 + length;
+    }
+
+    const span<const uint8_t> records{stream, used};
+    result = replay_both(reinterpret_cast<void*>(arena.virt), INSTRUMENT, [records](auto&& f) {
+        for_each_record(records, f);
+    });
+    vmm::free_dma(arena);
+    return true;
+}
+
+// The whole suite, on the boot processor after smp::start_secondary and
+// before any AP has a task: synthetic replay, capture replay (if
+// capture is not empty), spsc ping-pong from the first AP (the boot
+// processor with only two cores) to every other core, then mpsc fan-in
+// from every AP. Results go to out.
+void run(span<const uint8_t> capture, trace::writer out) noexcept {
+    constexpr uint64_t SEED = 0x9E3779B97F4A7C15;
+    constexpr uint32_t SYNTHETIC_PACKETS = 32768;
+
+    const interrupts_off quiet;
+    out("[bench] replay and ping-pong\n");
+
+    replay_result result{};
+    if (replay_synthetic(SEED, SYNTHETIC_PACKETS, result)) {
+        print(out, "synthetic", result);
+    } else {
+        out("synthetic: no memory\n");
+    }
+
+    if (!capture.empty()) {
+        if (replay_capture(capture, ANY_INSTRUMENT, result)) {
+            print(out, "capture", result);
+        } else {
+            out("capture: not a MoldUDP64 pcap, or no memory\n");
+        }
+    }
+
+    const uint32_t cores = smp::cpu_count();
+    const uint32_t initiator = cores > 2 ? 1 : 0;
+    for (uint32_t partner = initiator + 1; partner < cores; ++partner) {
+        out("spsc ");
+        trace::write_number(out, initiator);
+        out(" <-> ");
+        trace::write_number(out, partner);
+        if (ping_pong(initiator, partner)) {
+            trace::print(out, " round trip", pair.round_trip);
+        } else {
+            out(": core busy\n");
+        }
+    }
+
+    if (cores > 1) {
+        const uint32_t producers_started = fan_in_round_trips(pair.round_trip);
+        out("mpsc ");
+        trace::write_number(out, producers_started);
+        trace::print(out, " -> 0 round trip", pair.round_trip);
+    }
+}
+
+} // namespace hft::bench
@@ -0,0 +1,352 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+#include "../include/freestanding/atomic.hpp"
+
+export module hft.capture;
+import hft.core;
+import hft.pmm;
+import hft.vmm;
+import hft.pci;
+
+// Recorded traffic for post-trade analysis.
+// Every inbound frame and outbound order is appended, with its TSC stamp,
+// to a region of memory the allocators never touch: either RAM reserved
+// at the top of the memory map (same place every boot, so a warm reboot
+// finds the previous session intact) or an ivshmem BAR the host maps as
+// a file. The region is cut into one lane per core, so appending is one
+// core writing its own ring: a header store, a memcpy and a release store
+// of the head. Mapped with 2 MiB pages, write-back.
+//
+// Region layout (version 1, little endian) for readers outside the kernel:
+//   0       region_header
+//   4096    lane_control[lane_count], 192 bytes each
+//   data    lane_count rings of lane_bytes (a power of two), 2 MiB aligned
+// A lane holds records of a record_header plus payload, padded to 16
+// bytes; positions are byte counts since the region was formatted, taken
+// modulo lane_bytes. A record that would straddle the end of the ring is
+// preceded by a pad record filling the rest of it.
+export namespace hft::capture {
+
+constexpr uint64_t MAGIC = 0x3130504143544648;  // "HFTCAP01"
+constexpr uint32_t VERSION = 1;
+constexpr uint16_t IVSHMEM_VENDOR = 0x1AF4;
+constexpr uint16_t IVSHMEM_DEVICE = 0x1110;
+constexpr uint8_t IVSHMEM_BAR = 2;  // Shared memory
+
+enum class kind : uint16_t {
+    pad = 0,       // Filler to the end of the ring
+    inbound = 1,   // Frame as received, stamped at poll time
+    outbound = 2,  // Frame as handed to the NIC
+    session = 3    // session_info: starts every lane at each attach
+};
+
+// What a full lane does with a new record
+enum class overflow : uint32_t {
+    drop,       // Keep everything not yet consumed (a reader advances tail)
+    overwrite   // Discard the oldest records (read after the writers stop)
+};
+
+struct record_header {
+    uint64_t tsc;
+    uint32_t length;  // Payload bytes, not counting padding
+    kind type;
+    uint16_t source;  // Caller's tag: feed line, gateway session
+};
+
+struct region_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t lane_count;
+    uint64_t lane_bytes;
+    uint64_t data_offset;
+    uint64_t boots;        // Attaches since the region was formatted
+    overflow policy;
+};
+
+// Payload of a session record: converts the stamps that follow it (the
+// TSC restarts on reboot) to wall-clock time. The record written at
+// attach precedes TSC calibration (tsc_hz 0); the one recalibrated()
+// appends after it carries the frequency and epoch.
+struct session_info {
+    uint64_t boot;         // region_header::boots when it was written
+    uint64_t tsc_hz;
+    uint64_t base_tsc;
+    uint64_t base_ns;      // Wall clock at base_tsc
+};
+
+// One lane's shared indices. head and the counters are written by the
+// lane's core only; tail only by the reader (drop policy).
+struct lane_control {
+    alignas(64) atomic<uint64_t> head;
+    atomic<uint64_t> oldest;     // First intact record
+    atomic<uint64_t> records;
+    atomic<uint64_t> dropped;    // Records refused by a full lane (drop policy)
+    alignas(64) atomic<uint64_t> tail;
+    alignas(64) uint64_t reserved[8];
+};
+
+struct lane_stats {
+    uint64_t head;
+    uint64_t records;
+    uint64_t dropped;
+};
+
+} // namespace hft::capture
+
+namespace hft::capture {
+
+constexpr uint64_t HEADER_BYTES = 4096;
+constexpr uint64_t ALIGN = vmm::LARGE_PAGE_SIZE;
+constexpr uint64_t MIN_LANE = 64 * 1024;
+constexpr uint32_t RECORD_ALIGN = 16;
+
+static_assert(sizeof(record_header) == RECORD_ALIGN);
+static_assert(sizeof(lane_control) == 192);
+
+// The writing core's private view of its lane
+struct alignas(64) lane_writer {
+    lane_control* control = nullptr;
+    uint8_t* data = nullptr;
+    uint64_t head = 0;
+    uint64_t limit = 0;   // Position up to which records fit without a check
+};
+
+inline region_header* region = nullptr;
+inline uint64_t lane_mask = 0;
+inline lane_writer writers[topology::MAX_CPUS];
+inline bool recovered_ = false;
+
+constexpr uint64_t padded(uint64_t length) noexcept {
+    return (sizeof(record_header) + length + RECORD_ALIGN - 1) & ~uint64_t{RECORD_ALIGN - 1};
+}
+
+// Largest power of two at most value
+constexpr uint64_t floor_power_of_two(uint64_t value) noexcept {
+    return value ? uint64_t{1} << (63 - __builtin_clzll(value)) : 0;
+}
+
+lane_control* control_of(uint32_t lane) noexcept {
+    return reinterpret_cast<lane_control*>(reinterpret_cast<uint8_t*>(region) + HEADER_BYTES) + lane;
+}
+
+uint8_t* data_of(uint32_t lane) noexcept {
+    return reinterpret_cast<uint8_t*>(region) + region->data_offset + lane * region->lane_bytes;
+}
+
+const record_header& header_at(uint8_t* data, uint64_t position) noexcept {
+    return *reinterpret_cast<const record_header*>(data + (position & lane_mask));
+}
+
+// Make room for needed bytes at the writer's head, or fail. The slow path
+// of append: a head that reaches limit re-reads the reader's tail (drop)
+// or retires the oldest records (overwrite).
+bool make_room(lane_writer& w, uint64_t needed) noexcept {
+    const uint64_t size = lane_mask + 1;
+    lane_control& c = *w.control;
+    if (region->policy == overflow::drop) {
+        w.limit = c.tail.load(memory_order::acquire) + size;
+        return w.head + needed <= w.limit;
+    }
+
+    uint64_t oldest = c.oldest.load(memory_order::relaxed);
+    while (w.head + needed > oldest + size) {
+        oldest += padded(header_at(w.data, oldest).length);
+    }
+    c.oldest.store(oldest, memory_order::release);
+    w.limit = oldest + size;
+    return true;
+}
+
+void write_record(lane_writer& w, kind type, uint16_t source, const void* data,
+                  uint32_t length, uint64_t tsc) noexcept {
+    uint8_t* at = w.data + (w.head & lane_mask);
+    const record_header h{tsc, length, type, source};
+    memcpy(at, &h, sizeof(h));
+    memcpy(at + sizeof(h), data, length);
+    w.head += padded(length);
+}
+
+bool append_to(lane_writer& w, kind type, uint16_t source, const void* data,
+               uint32_t length, uint64_t tsc) noexcept {
+    const uint64_t size = padded(length);
+    const uint64_t to_end = (lane_mask + 1) - (w.head & lane_mask);
+    const uint64_t needed = size <= to_end ? size : size + to_end;
+    if (w.head + needed > w.limit) [[unlikely]] {
+        if (size > lane_mask + 1 - RECORD_ALIGN || !make_room(w, needed)) {
+            w.control->dropped.store(w.control->dropped.load(memory_order::relaxed) + 1,
+                                     memory_order::relaxed);
+            return false;
+        }
+    }
+
+    if (size > to_end) [[unlikely]] {
+        const record_header pad{tsc, static_cast<uint32_t>(to_end - sizeof(record_header)), kind::pad, 0};
+        memcpy(w.data + (w.head & lane_mask), &pad, sizeof(pad));
+        w.head += to_end;
+    }
+    write_record(w, type, source, data, length, tsc);
+    w.control->records.store(w.control->records.load(memory_order::relaxed) + 1, memory_order::relaxed);
+    w.control->head.store(w.head, memory_order::release);
+    return true;
+}
+
+bool format(uint64_t virt, uint64_t bytes, uint32_t lanes, overflow policy) noexcept {
+    const uint64_t data_offset = (HEADER_BYTES + lanes * sizeof(lane_control) + ALIGN - 1) & ~(ALIGN - 1);
+    if (lanes == 0 || bytes <= data_offset) return false;
+    const uint64_t lane_bytes = floor_power_of_two((bytes - data_offset) / lanes);
+    if (lane_bytes < MIN_LANE) return false;
+
+    auto* h = reinterpret_cast<region_header*>(virt);
+    const bool intact = h->magic == MAGIC && h->version == VERSION && h->lane_count == lanes &&
+                        h->lane_bytes == lane_bytes && h->data_offset == data_offset &&
+                        h->policy == policy;
+    region = h;
+    if (intact) {
+        ++h->boots;
+    } else {
+        h->magic = 0;
+        memset(reinterpret_cast<void*>(virt + HEADER_BYTES), 0, lanes * sizeof(lane_control));
+        h->version = VERSION;
+        h->lane_count = lanes;
+        h->lane_bytes = lane_bytes;
+        h->data_offset = data_offset;
+        h->policy = policy;
+        h->boots = 1;
+    }
+    atomic_thread_fence(memory_order::release);
+    h->magic = MAGIC;
+
+    const uint64_t now = tsc_clock::now();
+    const session_info session{h->boots, tsc_clock::hz(), now, tsc_clock::wall_ns(now)};
+    lane_mask = lane_bytes - 1;
+    for (uint32_t lane = 0; lane < lanes && lane < topology::MAX_CPUS; ++lane) {
+        lane_writer& w = writers[lane];
+        w.control = control_of(lane);
+        w.data = data_of(lane);
+        w.head = w.control->head.load(memory_order::relaxed);
+        w.limit = w.head;  // First append settles the real limit
+        (void)append_to(w, kind::session, 0, &session, sizeof(session), now);
+    }
+    recovered_ = intact;
+    return true;
+}
+
+} // namespace hft::capture
+
+export namespace hft::capture {
+
+// Use bytes of RAM at phys (2 MiB aligned) for the region, keeping what a
+// previous boot left there if the layout matches. Call on the boot
+// processor right after pmm::init, before anything can allocate the
+// pages, with one lane per core that will append.
+bool attach_reserved(uint64_t phys, uint64_t bytes, uint32_t lanes,
+                     overflow policy = overflow::overwrite) noexcept {
+    if (region || (phys | bytes) & (ALIGN - 1)) return false;
+    if (!pmm::reserve_range(phys, phys + bytes)) return false;
+    const uint64_t virt = vmm::map_memory(phys, bytes);
+    return virt != 0 && format(virt, bytes, lanes, policy);
+}
+
+// The last bytes of RAM below the top of the memory map
+bool attach_top_of_memory(uint64_t bytes, uint32_t lanes,
+                          overflow policy = overflow::overwrite) noexcept {
+    const uint64_t top = pmm::get_memory_size() & ~(ALIGN - 1);
+    if (bytes > top) return false;
+    return attach_reserved(top - bytes, bytes, lanes, policy);
+}
+
+// QEMU ivshmem-plain: the shared-memory BAR, also mapped by the host
+// (-object memory-backend-file,share=on,mem-path=/dev/shm/...)
+bool attach_ivshmem(uint32_t lanes, overflow policy = overflow::drop) noexcept {
+    if (region) return false;
+    constexpr uint16_t ids[] = {IVSHMEM_DEVICE};
+    const pci::device d = pci::find(IVSHMEM_VENDOR, span<const uint16_t>{ids, 1});
+    if (!d.valid()) return false;
+
+    const uint64_t phys = pci::bar_address(d, IVSHMEM_BAR);
+    const uint64_t bytes = pci::bar_size(d, IVSHMEM_BAR);
+    if (phys == 0 || bytes < ALIGN || (phys & (ALIGN - 1))) return false;
+
+    pci::set_command(d, pci::memory_space);
+    const uint64_t virt = vmm::map_memory(phys, bytes);
+    return virt != 0 && format(virt, bytes, lanes, policy);
+}
+
+[[nodiscard]] bool attached() noexcept { return region != nullptr; }
+
+// Append a session record with the calibrated frequency and epoch to
+// every lane. Call once after tsc::init(), on the boot processor before
+// the other cores append.
+bool recalibrated() noexcept {
+    if (!region) return false;
+    const uint64_t now = tsc_clock::now();
+    const session_info session{region->boots, tsc_clock::hz(), now, tsc_clock::wall_ns(now)};
+    bool ok = true;
+    for (lane_writer& w : writers) {
+        if (w.control) ok = append_to(w, kind::session, 0, &session, sizeof(session), now) && ok;
+    }
+    return ok;
+}
+
+// The region held a previous session's records when it was attached
+[[nodiscard]] bool recovered() noexcept { return recovered_; }
+
+// Append one record to the executing core's lane; false if nothing is
+// attached, the core has no lane, or (drop policy) the lane is full
+bool append(kind type, uint16_t source, const void* data, uint32_t length,
+            uint64_t tsc = tsc_clock::now()) noexcept {
+    lane_writer& w = writers[topology::this_cpu()->index];
+    if (!w.control) [[unlikely]] return false;
+    return append_to(w, type, source, data, length, tsc);
+}
+
+// Consume up to budget records of lane in order: f(const record_header&,
+// const uint8_t* payload) for each (pads are skipped). Under the
+// overwrite policy the writer must be stopped. For an in-kernel
+// reader on a housekeeping core; the host reads the same way through the
+// shared region. Returns the number handed to f.
+template<typename F>
+size_t drain(uint32_t lane, F&& f, size_t budget = 64) noexcept {
+    if (!region || lane >= region->lane_count) return 0;
+    lane_control& c = *control_of(lane);
+    uint8_t* data = data_of(lane);
+
+    // Overwritten records are gone: start at the oldest intact one
+    uint64_t tail = max(c.tail.load(memory_order::relaxed), c.oldest.load(memory_order::acquire));
+    const uint64_t head = c.head.load(memory_order::acquire);
+    size_t handed = 0;
+    while (tail < head && handed < budget) {
+        const record_header& h = header_at(data, tail);
+        if (h.type != kind::pad) {
+            f(h, reinterpret_cast<const uint8_t*>(&h + 1));
+            ++handed;
+        }
+        tail += padded(h.length);
+    }
+    c.tail.store(tail, memory_order::release);
+    return handed;
+}
+
+[[nodiscard]] lane_stats stats(uint32_t lane) noexcept {
+    if (!region || lane >= region->lane_count) return {};
+    const lane_control& c = *control_of(lane);
+    return {c.head.load(memory_order::relaxed), c.records.load(memory_order::relaxed),
+            c.dropped.load(memory_order::relaxed)};
+}
+
+// This core's lane resident and dirty before the first append. Only the
+// records are touched: the reader may be moving the lane's tail.
+void prefault_local() noexcept {
+    lane_writer& w = writers[topology::this_cpu()->index];
+    if (w.control) prefault(w.data, region->lane_bytes);
+}
+
+// Write dirty lines back to the region, so what is there survives a reset
+// that does not (triple fault, watchdog). Stalls the core: shutdown paths
+// only.
+void flush() noexcept {
+    if (region) asm volatile("wbinvd" ::: "memory");
+}
+
+} // namespace hft::capture
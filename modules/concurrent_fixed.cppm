@@ -8,7 +8,123 @@ import hft.core;
 
 export namespace hft::concurrent {
 
-// Single Producer Single Consumer lock-free queue
+// Sequence lock for single-writer / multi-reader publication.
+// The sequence is odd while a write is in progress. Readers never write
+// shared state: they copy the data and retry if the sequence was odd or
+// changed underneath them. The writer never waits and never does an RMW.
+class seqlock {
+    atomic<uint64_t> sequence_{0};
+    
+public:
+    void write_begin() noexcept {
+        const auto seq = sequence_.load(memory_order::relaxed);
+        sequence_.store(seq + 1, memory_order::relaxed);
+        atomic_thread_fence(memory_order::release);
+    }
+    
+    void write_end() noexcept {
+        const auto seq = sequence_.load(memory_order::relaxed);
+        sequence_.store(seq + 1, memory_order::release);
+    }
+    
+    [[nodiscard]] uint64_t read_begin() const noexcept {
+        uint64_t seq;
+        while ((seq = sequence_.load(memory_order::acquire)) & 1) {
+            asm volatile("pause");
+        }
+        return seq;
+    }
+    
+    [[nodiscard]] bool read_retry(uint64_t start) const noexcept {
+        atomic_thread_fence(memory_order::acquire);
+        return sequence_.load(memory_order::relaxed) != start;
+    }
+    
+    // Run a copy-out function until it observes a consistent state
+    template<typename F>
+    [[nodiscard]] auto read(F&& copy) const noexcept {
+        for (;;) {
+            const uint64_t seq = read_begin();
+            auto result = copy();
+            if (!read_retry(seq)) {
+                return result;
+            }
+        }
+    }
+    
+    // Writer side: is a write section open (an enclosing batch)?
+    [[nodiscard]] bool writing() const noexcept {
+        return sequence_.load(memory_order::relaxed) & 1;
+    }
+    
+    // Number of completed writes
+    [[nodiscard]] uint64_t sequence() const noexcept {
+        return sequence_.load(memory_order::acquire) >> 1;
+    }
+};
+
+// Scoped write section that joins an already open one instead of nesting.
+// Single updates publish on their own; inside a batch (write_begin() ...
+// write_end() around many updates) they leave the sequence line alone and
+// readers see one publish for the whole batch.
+class seqlock_writer {
+    seqlock& lock_;
+    bool owner_;
+    
+public:
+    explicit seqlock_writer(seqlock& lock) noexcept
+        : lock_{lock}, owner_{!lock.writing()} {
+        if (owner_) lock_.write_begin();
+    }
+    
+    ~seqlock_writer() {
+        if (owner_) lock_.write_end();
+    }
+    
+    seqlock_writer(const seqlock_writer&) = delete;
+    seqlock_writer& operator=(const seqlock_writer&) = delete;
+};
+
+// Test-and-test-and-set spinlock. Waiters spin on a plain load, so the
+// line stays shared until the holder releases it; for short critical
+// sections off the hot path (batched refills, list maintenance).
+class spinlock {
+    atomic<uint32_t> locked_{0};
+    
+public:
+    void lock() noexcept {
+        while (locked_.exchange(1, memory_order::acquire)) {
+            while (locked_.load(memory_order::relaxed)) {
+                asm volatile("pause");
+            }
+        }
+    }
+    
+    [[nodiscard]] bool try_lock() noexcept {
+        return locked_.load(memory_order::relaxed) == 0 &&
+               locked_.exchange(1, memory_order::acquire) == 0;
+    }
+    
+    void unlock() noexcept {
+        locked_.store(0, memory_order::release);
+    }
+};
+
+// Scoped spinlock hold
+class spin_guard : non_copyable {
+    spinlock& lock_;
+    
+public:
+    explicit spin_guard(spinlock& lock) noexcept : lock_(lock) { lock_.lock(); }
+    ~spin_guard() { lock_.unlock(); }
+};
+
+// Single Producer Single Consumer lock-free queue.
+// Each side keeps a private copy of the other side's index and only
+// reloads the shared one (pulling the other core's cache line) when the
+// copy says the queue looks full or empty. claim()/commit() and
+// peek()/release() expose slots in place, so a producer can build items
+// directly in the ring and a consumer can process a batch without copies.
 template<typename T, size_t Size>
     requires (Size > 0) && ((Size & (Size - 1)) == 0)  // Power of 2
 class spsc_queue : private cache_aligned<spsc_queue<T, Size>> {
@@ -16,9 +132,12 @@ public:
     static constexpr size_t capacity = Size;
     
 private:
-    // Separate cache lines for producer and consumer
+    // Producer line: own index plus its view of the consumer index
     alignas(64) atomic<size_t> write_idx_{0};
+    size_t cached_read_ = 0;
+    // Consumer line: own index plus its view of the producer index
     alignas(64) atomic<size_t> read_idx_{0};
+    size_t cached_write_ = 0;
     alignas(64) T buffer_[Size];
     
     static constexpr size_t index_mask = Size - 1;
@@ -29,36 +148,45 @@ public:
     // Producer interface
     [[nodiscard]] bool try_push(const T& item) noexcept {
         const auto write_pos = write_idx_.load(memory_order::relaxed);
-        const auto next_pos = (write_pos + 1) & index_mask;
-        
-        if (next_pos == read_idx_.load(memory_order::acquire)) {
+        if (writable(write_pos, 1) == 0) {
             return false;  // Queue full
         }
         
         buffer_[write_pos] = item;
-        write_idx_.store(next_pos, memory_order::release);
+        write_idx_.store((write_pos + 1) & index_mask, memory_order::release);
         return true;
     }
     
     template<typename... Args>
     [[nodiscard]] bool try_emplace(Args&&... args) noexcept {
         const auto write_pos = write_idx_.load(memory_order::relaxed);
-        const auto next_pos = (write_pos + 1) & index_mask;
-        
-        if (next_pos == read_idx_.load(memory_order::acquire)) {
+        if (writable(write_pos, 1) == 0) {
             return false;  // Queue full
         }
         
         construct_at(&buffer_[write_pos], forward<Args>(args)...);
-        write_idx_.store(next_pos, memory_order::release);
+        write_idx_.store((write_pos + 1) & index_mask, memory_order::release);
         return true;
     }
     
+    // Up to n contiguous writable slots (fewer at the end of the ring or
+    // when nearly full). Fill them in place, then commit() how many were used.
+    [[nodiscard]] span<T> claim(size_t n) noexcept {
+        const auto write_pos = write_idx_.load(memory_order::relaxed);
+        const size_t count = min(min(n, writable(write_pos, n)), Size - write_pos);
+        return {&buffer_[write_pos], count};
+    }
+    
+    // Publish the first n slots of the last claim()
+    void commit(size_t n) noexcept {
+        const auto write_pos = write_idx_.load(memory_order::relaxed);
+        write_idx_.store((write_pos + n) & index_mask, memory_order::release);
+    }
+    
     // Consumer interface
     [[nodiscard]] bool try_pop(T& item) noexcept {
         const auto read_pos = read_idx_.load(memory_order::relaxed);
-        
-        if (read_pos == write_idx_.load(memory_order::acquire)) {
+        if (readable(read_pos, 1) == 0) {
             return false;  // Queue empty
         }
         
@@ -67,13 +195,24 @@ public:
         return true;
     }
     
+    // Up to n contiguous readable slots. Process them in place, then
+    // release() how many were consumed.
+    [[nodiscard]] span<T> peek(size_t n) noexcept {
+        const auto read_pos = read_idx_.load(memory_order::relaxed);
+        const size_t count = min(min(n, readable(read_pos, n)), Size - read_pos);
+        return {&buffer_[read_pos], count};
+    }
+    
+    // Hand the first n slots of the last peek() back to the producer
+    void release(size_t n) noexcept {
+        const auto read_pos = read_idx_.load(memory_order::relaxed);
+        read_idx_.store((read_pos + n) & index_mask, memory_order::release);
+    }
+    
     // Bulk operations for better throughput
     [[nodiscard]] size_t try_push_bulk(const T* items, size_t count) noexcept {
         const auto write_pos = write_idx_.load(memory_order::relaxed);
-        const auto read_pos = read_idx_.load(memory_order::acquire);
-        
-        const size_t available = (read_pos - write_pos - 1) & index_mask;
-        const size_t to_write = min(count, available);
+        const size_t to_write = min(count, writable(write_pos, count));
         
         if (to_write == 0) {
             return 0;
@@ -93,9 +232,32 @@ public:
         return to_write;
     }
     
+    [[nodiscard]] size_t try_pop_bulk(T* items, size_t count) noexcept {
+        const auto read_pos = read_idx_.load(memory_order::relaxed);
+        const size_t to_read = min(count, readable(read_pos, count));
+        
+        if (to_read == 0) {
+            return 0;
+        }
+        
+        // Copy in two parts if wrapping
+        const size_t first_part = min(to_read, Size - read_pos);
+        memcpy(items, &buffer_[read_pos], first_part * sizeof(T));
+        
+        if (to_read > first_part) {
+            memcpy(items + first_part, &buffer_[0],
+                   (to_read - first_part) * sizeof(T));
+        }
+        
+        read_idx_.store((read_pos + to_read) & index_mask,
+                       memory_order::release);
+        return to_read;
+    }
+    
+    // Approximate when called while the other side is running
     [[nodiscard]] size_t size() const noexcept {
-        const auto write_pos = write_idx_.load(memory_order::acquire);
-        const auto read_pos = read_idx_.load(memory_order::acquire);
+        const auto write_pos = write_idx_.load(memory_order::relaxed);
+        const auto read_pos = read_idx_.load(memory_order::relaxed);
         return (write_pos - read_pos) & index_mask;
     }
     
@@ -109,56 +271,340 @@ public:
         const auto read_pos = read_idx_.load(memory_order::acquire);
         return ((write_pos + 1) & index_mask) == read_pos;
     }
+    
+private:
+    // Free slots from write_pos, refreshing the cached read index only
+    // when fewer than want are known to be free
+    size_t writable(size_t write_pos, size_t want) noexcept {
+        size_t free = (cached_read_ - write_pos - 1) & index_mask;
+        if (free < want) {
+            cached_read_ = read_idx_.load(memory_order::acquire);
+            free = (cached_read_ - write_pos - 1) & index_mask;
+        }
+        return free;
+    }
+    
+    // Filled slots from read_pos, same refresh rule on the consumer side
+    size_t readable(size_t read_pos, size_t want) noexcept {
+        size_t avail = (cached_write_ - read_pos) & index_mask;
+        if (avail < want) {
+            cached_write_ = write_idx_.load(memory_order::acquire);
+            avail = (cached_write_ - read_pos) & index_mask;
+        }
+        return avail;
+    }
+};
+
+// Bounded multi-producer multi-consumer ring queue (Vyukov).
+// Each cell carries a sequence number: seq == pos means free for the
+// producer holding ticket pos, seq == pos + 1 means full for the consumer
+// holding ticket pos. Producers and consumers only contend on their own
+// position counter (one CAS per operation or per bulk batch), and every
+// cell sits on its own cache line so neighbouring slots never false-share.
+template<typename T, size_t Size>
+    requires (Size >= 2) && ((Size & (Size - 1)) == 0)  // Power of 2
+class mpmc_queue : private cache_aligned<mpmc_queue<T, Size>> {
+public:
+    static constexpr size_t capacity = Size;
+    
+private:
+    struct alignas(64) cell {
+        atomic<size_t> sequence;
+        T data;
+    };
+    
+    alignas(64) atomic<size_t> enqueue_pos_{0};
+    alignas(64) atomic<size_t> dequeue_pos_{0};
+    cell cells_[Size];
+    
+    static constexpr size_t index_mask = Size - 1;
+    
+public:
+    mpmc_queue() noexcept {
+        for (size_t i = 0; i < Size; ++i) {
+            cells_[i].sequence.store(i, memory_order::relaxed);
+        }
+    }
+    
+    // Producer interface
+    [[nodiscard]] bool try_push(const T& item) noexcept {
+        size_t pos = enqueue_pos_.load(memory_order::relaxed);
+        cell* c;
+        
+        for (;;) {
+            c = &cells_[pos & index_mask];
+            const size_t seq = c->sequence.load(memory_order::acquire);
+            const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, memory_order::relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;  // Queue full
+            } else {
+                pos = enqueue_pos_.load(memory_order::relaxed);
+            }
+        }
+        
+        c->data = item;
+        c->sequence.store(pos + 1, memory_order::release);
+        return true;
+    }
+    
+    // Consumer interface
+    [[nodiscard]] bool try_pop(T& item) noexcept {
+        size_t pos = dequeue_pos_.load(memory_order::relaxed);
+        cell* c;
+        
+        for (;;) {
+            c = &cells_[pos & index_mask];
+            const size_t seq = c->sequence.load(memory_order::acquire);
+            const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, memory_order::relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;  // Queue empty
+            } else {
+                pos = dequeue_pos_.load(memory_order::relaxed);
+            }
+        }
+        
+        item = move(c->data);
+        c->sequence.store(pos + Size, memory_order::release);
+        return true;
+    }
+    
+    // Bulk operations: claim a run of consecutive cells with one CAS.
+    // Returns how many items were pushed (possibly fewer than count; 0
+    // only when the queue is full or count is 0).
+    [[nodiscard]] size_t try_push_bulk(const T* items, size_t count) noexcept {
+        if (count == 0) return 0;
+        size_t pos = enqueue_pos_.load(memory_order::relaxed);
+        size_t claimed;
+        
+        for (;;) {
+            claimed = ready_run(pos, count, 0);
+            if (claimed > 0) {
+                // A failed CAS reloads pos
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + claimed, memory_order::relaxed)) break;
+            } else if (behind(pos, 0)) {
+                return 0;  // Queue full
+            } else {
+                pos = enqueue_pos_.load(memory_order::relaxed);  // Another producer took pos
+            }
+        }
+        
+        for (size_t i = 0; i < claimed; ++i) {
+            cell& c = cells_[(pos + i) & index_mask];
+            c.data = items[i];
+            c.sequence.store(pos + i + 1, memory_order::release);
+        }
+        return claimed;
+    }
+    
+    // Returns how many items were popped (possibly fewer than count; 0
+    // only when the queue is empty or count is 0)
+    [[nodiscard]] size_t try_pop_bulk(T* items, size_t count) noexcept {
+        if (count == 0) return 0;
+        size_t pos = dequeue_pos_.load(memory_order::relaxed);
+        size_t claimed;
+        
+        for (;;) {
+            claimed = ready_run(pos, count, 1);
+            if (claimed > 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + claimed, memory_order::relaxed)) break;
+            } else if (behind(pos, 1)) {
+                return 0;  // Queue empty
+            } else {
+                pos = dequeue_pos_.load(memory_order::relaxed);  // Another consumer took pos
+            }
+        }
+        
+        for (size_t i = 0; i < claimed; ++i) {
+            cell& c = cells_[(pos + i) & index_mask];
+            items[i] = move(c.data);
+            c.sequence.store(pos + i + Size, memory_order::release);
+        }
+        return claimed;
+    }
+    
+    // Approximate: exact only while no operation is in flight
+    [[nodiscard]] size_t size() const noexcept {
+        const auto enqueue_pos = enqueue_pos_.load(memory_order::acquire);
+        const auto dequeue_pos = dequeue_pos_.load(memory_order::acquire);
+        return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+    }
+    
+    [[nodiscard]] bool empty() const noexcept {
+        return size() == 0;
+    }
+    
+private:
+    // Number of consecutive cells from ticket pos (at most count) whose
+    // sequence is pos + i + offset, i.e. ready for this side
+    size_t ready_run(size_t pos, size_t count, size_t offset) const noexcept {
+        const size_t limit = min(count, Size);
+        size_t run = 0;
+        while (run < limit &&
+               cells_[(pos + run) & index_mask].sequence.load(memory_order::acquire) == pos + run + offset) {
+            ++run;
+        }
+        return run;
+    }
+    
+    // Cell of ticket pos is a lap behind this side (full for producers,
+    // empty for consumers), as diff < 0 in try_push()/try_pop(); ahead
+    // of it means pos is stale
+    bool behind(size_t pos, size_t offset) const noexcept {
+        const size_t seq = cells_[pos & index_mask].sequence.load(memory_order::acquire);
+        return static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + offset) < 0;
+    }
 };
 
-// Multi-producer single consumer queue using CAS
+// Multi-producer single consumer queue (Vyukov intrusive MPSC).
+// Producers link nodes with a single exchange on head_; the consumer owns
+// tail_ and a permanent stub node keeps the list non-empty, so a push
+// that has exchanged head_ but not yet linked ->next only makes the queue
+// look empty for a moment instead of racing. Nodes come from a fixed
+// array and are recycled through a tagged lock-free free list, so the
+// queue never exhausts under sustained load.
 template<typename T, size_t Size>
+    requires (Size > 0) && (Size < 0xFFFFFFFFu)
 class mpsc_queue : private cache_aligned<mpsc_queue<T, Size>> {
+public:
+    static constexpr size_t capacity = Size;
+    
+private:
     struct node {
         atomic<node*> next{nullptr};
+        atomic<uint32_t> free_next{0};  // Free-list link: slot index + 1, 0 = end
         T data;
     };
     
     alignas(64) atomic<node*> head_;
     alignas(64) node* tail_;
-    static_pool<node, Size> pool_;
+    // Free list head: ABA tag in the upper 32 bits, slot index + 1 below
+    alignas(64) atomic<uint64_t> free_head_{0};
+    alignas(64) node stub_;
+    node nodes_[Size];
     
 public:
-    mpsc_queue() noexcept : head_(nullptr), tail_(nullptr) {}
+    mpsc_queue() noexcept : head_(&stub_), tail_(&stub_) {
+        for (size_t i = 0; i < Size; ++i) {
+            nodes_[i].free_next.store(i + 1 < Size ? static_cast<uint32_t>(i + 2) : 0,
+                                      memory_order::relaxed);
+        }
+        free_head_.store(1, memory_order::release);
+    }
     
     [[nodiscard]] bool try_push(const T& item) noexcept {
-        auto* new_node = pool_.allocate();
-        if (!new_node) return false;
-        
-        new_node->data = item;
-        new_node->next.store(nullptr, memory_order::relaxed);
-        
-        node* prev_head = head_.exchange(new_node, memory_order::acq_rel);
-        if (prev_head) {
-            prev_head->next.store(new_node, memory_order::release);
-        } else {
-            tail_ = new_node;
+        node* n = allocate();
+        if (!n) [[unlikely]] {
+            return false;  // All nodes in flight
         }
         
+        n->data = item;
+        push_node(n);
         return true;
     }
     
     [[nodiscard]] bool try_pop(T& item) noexcept {
-        if (!tail_) {
+        node* n = pop_node();
+        if (!n) {
             return false;
         }
         
-        item = move(tail_->data);
-        node* next = tail_->next.load(memory_order::acquire);
+        item = move(n->data);
+        release(n);
+        return true;
+    }
+    
+    // Consumer-side check; may report empty while a push is mid-link
+    [[nodiscard]] bool empty() const noexcept {
+        const node* tail = tail_;
+        if (tail == &stub_) {
+            tail = tail->next.load(memory_order::acquire);
+        }
+        return tail == nullptr;
+    }
+    
+private:
+    void push_node(node* n) noexcept {
+        n->next.store(nullptr, memory_order::relaxed);
+        node* prev = head_.exchange(n, memory_order::acq_rel);
+        prev->next.store(n, memory_order::release);
+    }
+    
+    node* pop_node() noexcept {
+        node* tail = tail_;
+        node* next = tail->next.load(memory_order::acquire);
+        
+        // Skip over the stub
+        if (tail == &stub_) {
+            if (!next) {
+                return nullptr;
+            }
+            tail_ = next;
+            tail = next;
+            next = next->next.load(memory_order::acquire);
+        }
         
-        pool_.deallocate(tail_);
-        tail_ = next;
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
         
-        if (!tail_) {
-            head_.store(nullptr, memory_order::release);
+        // tail is the last linked node; if head_ moved on, a producer is
+        // between its exchange and its link
+        if (tail != head_.load(memory_order::acquire)) {
+            return nullptr;
         }
         
-        return true;
+        // Re-insert the stub behind tail so tail can be handed out
+        push_node(&stub_);
+        next = tail->next.load(memory_order::acquire);
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+        return nullptr;
+    }
+    
+    node* allocate() noexcept {
+        uint64_t head = free_head_.load(memory_order::acquire);
+        for (;;) {
+            const auto index = static_cast<uint32_t>(head);
+            if (index == 0) {
+                return nullptr;
+            }
+            
+            node* n = &nodes_[index - 1];
+            // May read a stale link if n was taken and recycled meanwhile;
+            // the tag makes the CAS fail in that case
+            const uint64_t next = n->free_next.load(memory_order::relaxed);
+            const uint64_t tag = (head >> 32) + 1;
+            if (free_head_.compare_exchange_weak(head, (tag << 32) | next, memory_order::acq_rel)) {
+                return n;
+            }
+            // Failed CAS loads relaxed; order the retry's link read after it
+            atomic_thread_fence(memory_order::acquire);
+        }
+    }
+    
+    void release(node* n) noexcept {
+        const auto index = static_cast<uint64_t>(n - nodes_) + 1;
+        uint64_t head = free_head_.load(memory_order::relaxed);
+        for (;;) {
+            n->free_next.store(static_cast<uint32_t>(head), memory_order::relaxed);
+            const uint64_t tag = (head >> 32) + 1;
+            if (free_head_.compare_exchange_weak(head, (tag << 32) | index, memory_order::acq_rel)) {
+                return;
+            }
+        }
     }
 };
 
@@ -48,48 +48,255 @@ protected:
 };
 
 // Hardware features detection
+// SIMD bits are only set when XCR0 shows the OS (boot64.S) enabled the state
 struct cpu_features {
     bool avx512f : 1;
     bool avx512dq : 1;
     bool avx512vl : 1;
     bool tsx : 1;
     bool cet : 1;
-    uint8_t reserved : 3;
+    bool avx : 1;
+    bool avx2 : 1;
+    bool fma : 1;
     
     static cpu_features detect() noexcept;
 };
 
-// Timestamp counter wrapper
+// Unsigned value * num / den as a multiply and a shift, for conversions
+// on hot paths. The factor is computed once with 64-bit divisions only
+// (no libgcc helpers); apply() is one 128-bit multiply.
+struct ratio_scale {
+    uint64_t mult = 0;
+    uint32_t shift = 0;
+
+    // Largest shift (up to 63) that keeps mult below 2^63, so any 64-bit
+    // value times mult fits the 128-bit product
+    [[nodiscard]] static constexpr ratio_scale from_ratio(uint64_t num, uint64_t den) noexcept {
+        if (den == 0 || num / den >= (uint64_t{1} << 63)) return {};
+
+        // Binary long division of num * 2^shift by den, one bit at a time
+        uint64_t quotient = num / den;
+        uint64_t rem = num % den;
+        uint32_t shift = 0;
+        while (shift < 63 && quotient < (uint64_t{1} << 62)) {
+            const bool carry = rem >= (uint64_t{1} << 63);
+            rem <<= 1;
+            quotient <<= 1;
+            if (carry || rem >= den) {
+                rem -= den;
+                quotient |= 1;
+            }
+            ++shift;
+        }
+        return {quotient, shift};
+    }
+
+    [[nodiscard]] constexpr uint64_t apply(uint64_t value) const noexcept {
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(value) * mult) >> shift);
+    }
+};
+
+// Timestamp counter wrapper.
+// now() is unordered (cheapest, for timestamps); start() and stop()
+// bracket a measured region so the instructions being timed cannot move
+// across them. Conversions to nanoseconds need the frequency, which
+// hft.tsc measures at boot and installs with calibrate(); the wall
+// clock is the RTC at boot plus elapsed TSC time.
 class tsc_clock {
 public:
     using rep = uint64_t;
-    
+
     static rep now() noexcept {
         uint32_t lo, hi;
-        // Fixed: Added '=' to the "d" constraint
         asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
         return (static_cast<rep>(hi) << 32) | lo;
     }
+
+    // Before a measured region: earlier instructions have completed, and
+    // the region does not start before the read
+    static rep start() noexcept {
+        uint32_t lo, hi;
+        asm volatile("lfence\n rdtsc\n lfence" : "=a"(lo), "=d"(hi) :: "memory");
+        return (static_cast<rep>(hi) << 32) | lo;
+    }
+
+    // After a measured region: RDTSCP waits for the region to complete,
+    // the LFENCE keeps later instructions out of it. Without RDTSCP the
+    // leading LFENCE of start() does the same.
+    static rep stop() noexcept {
+        if (!rdtscp_) [[unlikely]] return start();
+        uint32_t lo, hi;
+        asm volatile("rdtscp\n lfence" : "=a"(lo), "=d"(hi) :: "rcx", "memory");
+        return (static_cast<rep>(hi) << 32) | lo;
+    }
+
+    // Invariant TSC (CPUID 0x80000007 EDX bit 8): constant rate in every
+    // P-, C- and T-state, so TSC deltas are time
+    static bool invariant() noexcept {
+        uint32_t eax = 0x80000000, ebx, ecx = 0, edx;
+        asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+        if (eax < 0x80000007) return false;
+
+        eax = 0x80000007;
+        ecx = 0;
+        asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+        return (edx >> 8) & 1;
+    }
+
+    // Install the measured frequency (once, on the boot processor, before
+    // any conversion is used)
+    static void calibrate(uint64_t hz) noexcept {
+        uint32_t eax = 0x80000001, ebx, ecx = 0, edx;
+        asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+        rdtscp_ = (edx >> 27) & 1;
+
+        hz_ = hz;
+        ns_per_cycle_ = ratio_scale::from_ratio(1000000000, hz);
+        cycles_per_ns_ = ratio_scale::from_ratio(hz, 1000000000);
+    }
+
+    // Correlate TSC value tsc with unix_ns nanoseconds since the epoch
+    static void set_epoch(rep tsc, uint64_t unix_ns) noexcept {
+        epoch_tsc_ = tsc;
+        epoch_ns_ = unix_ns;
+    }
+
+    [[nodiscard]] static uint64_t hz() noexcept { return hz_; }
+    [[nodiscard]] static uint64_t to_ns(rep cycles) noexcept { return ns_per_cycle_.apply(cycles); }
+    [[nodiscard]] static rep from_ns(uint64_t ns) noexcept { return cycles_per_ns_.apply(ns); }
+
+    // Nanoseconds since the Unix epoch at TSC value tsc (at or after the
+    // epoch point)
+    [[nodiscard]] static uint64_t wall_ns(rep tsc) noexcept {
+        return epoch_ns_ + to_ns(tsc - epoch_tsc_);
+    }
+
+    [[nodiscard]] static uint64_t now_ns() noexcept { return wall_ns(now()); }
+
+private:
+    static inline bool rdtscp_ = false;
+    static inline uint64_t hz_ = 0;
+    static inline ratio_scale ns_per_cycle_{};
+    static inline ratio_scale cycles_per_ns_{};
+    static inline rep epoch_tsc_ = 0;
+    static inline uint64_t epoch_ns_ = 0;
+};
+
+// Non-owning view of a contiguous run of elements (no std::span here)
+template<typename T>
+class span {
+    T* data_ = nullptr;
+    size_t size_ = 0;
+    
+public:
+    constexpr span() noexcept = default;
+    constexpr span(T* data, size_t size) noexcept : data_(data), size_(size) {}
+    
+    constexpr T& operator[](size_t idx) const noexcept { return data_[idx]; }
+    
+    [[nodiscard]] constexpr T* data() const noexcept { return data_; }
+    [[nodiscard]] constexpr size_t size() const noexcept { return size_; }
+    [[nodiscard]] constexpr bool empty() const noexcept { return size_ == 0; }
+    
+    constexpr T* begin() const noexcept { return data_; }
+    constexpr T* end() const noexcept { return data_ + size_; }
+};
+
+// Smallest power of two >= value (for sizing hash tables and rings)
+constexpr size_t next_power_of_two(size_t value) noexcept {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+// Signed Q32.32 fixed point for integer-only signal math.
+// Only 64-bit integer division is used (no libgcc helpers), and products
+// go through a 128-bit intermediate so they stay inline.
+struct q32 {
+    int64_t raw;
+    
+    static constexpr int fraction_bits = 32;
+    static constexpr int64_t one_raw = int64_t{1} << fraction_bits;
+    static constexpr int64_t max_raw = 0x7FFFFFFFFFFFFFFF;
+    
+    [[nodiscard]] static constexpr q32 from_int(int64_t value) noexcept {
+        return {value * one_raw};
+    }
+    
+    // num / den, saturating at the representable range (zero for den == 0)
+    [[nodiscard]] static constexpr q32 from_ratio(int64_t num, uint64_t den) noexcept {
+        if (den == 0) return {0};
+        
+        const bool negative = num < 0;
+        const uint64_t magnitude = negative ? 0 - static_cast<uint64_t>(num)
+                                            : static_cast<uint64_t>(num);
+        const uint64_t whole = magnitude / den;
+        if (whole >= (uint64_t{1} << 31)) {
+            return {negative ? -max_raw : max_raw};
+        }
+        
+        // Scale remainder and divisor down until the remainder can take a
+        // 32-bit shift without overflowing
+        uint64_t rem = magnitude % den;
+        uint64_t div = den;
+        const int shift = (64 - __builtin_clzll(div)) - 32;
+        if (shift > 0) {
+            rem >>= shift;
+            div >>= shift;
+        }
+        
+        const int64_t raw = static_cast<int64_t>((whole << fraction_bits) + (rem << fraction_bits) / div);
+        return {negative ? -raw : raw};
+    }
+    
+    [[nodiscard]] constexpr int64_t to_int() const noexcept { return raw >> fraction_bits; }
+    
+    constexpr q32 operator-() const noexcept { return {-raw}; }
+    constexpr q32 operator+(q32 o) const noexcept { return {raw + o.raw}; }
+    constexpr q32 operator-(q32 o) const noexcept { return {raw - o.raw}; }
+    constexpr q32 operator*(q32 o) const noexcept {
+        return {static_cast<int64_t>((static_cast<__int128>(raw) * o.raw) >> fraction_bits)};
+    }
+    
+    // No <compare> in the freestanding tree, so comparisons are spelled out
+    constexpr bool operator==(q32 o) const noexcept { return raw == o.raw; }
+    constexpr bool operator!=(q32 o) const noexcept { return raw != o.raw; }
+    constexpr bool operator<(q32 o) const noexcept { return raw < o.raw; }
+    constexpr bool operator>(q32 o) const noexcept { return raw > o.raw; }
+    constexpr bool operator<=(q32 o) const noexcept { return raw <= o.raw; }
+    constexpr bool operator>=(q32 o) const noexcept { return raw >= o.raw; }
 };
 
 // Using C++26 constexpr placement new (P2747R2)
+// Single-threaded: freed slots go on a LIFO stack and are reused first
 template<typename T, size_t N>
 class static_pool {
     alignas(T) unsigned char storage[sizeof(T) * N];
+    size_t free_slots[N];
     size_t next_free = 0;
+    size_t free_count = 0;
     
 public:
     [[nodiscard]] constexpr T* allocate() noexcept {
-        if (next_free >= N) [[unlikely]] {
+        size_t slot;
+        if (free_count > 0) {
+            slot = free_slots[--free_count];
+        } else if (next_free < N) [[likely]] {
+            slot = next_free++;
+        } else {
             return nullptr;
         }
         return construct_at(
-            reinterpret_cast<T*>(&storage[sizeof(T) * next_free++])
+            reinterpret_cast<T*>(&storage[sizeof(T) * slot])
         );
     }
     
     constexpr void deallocate(T* ptr) noexcept {
         destroy_at(ptr);
+        const auto offset = reinterpret_cast<unsigned char*>(ptr) - storage;
+        free_slots[free_count++] = static_cast<size_t>(offset) / sizeof(T);
     }
 };
 
@@ -101,6 +308,155 @@ public:
     static cpu_features get_cpu_features() noexcept;
 };
 
+// Model-specific register access
+inline uint64_t read_msr(uint32_t msr) noexcept {
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+}
+
+inline void write_msr(uint32_t msr, uint64_t value) noexcept {
+    asm volatile("wrmsr" :: "c"(msr), "a"(static_cast<uint32_t>(value)),
+                                      "d"(static_cast<uint32_t>(value >> 32)) : "memory");
+}
+
+// Bulk fills through the string instructions. With fast strings (ERMSB)
+// the microcode stores whole lines and touches no vector state, so these
+// are safe under the kernel's general-register-only profile.
+inline void fill_words(uint64_t* dest, uint64_t value, size_t count) noexcept {
+    asm volatile("rep stosq" : "+D"(dest), "+c"(count) : "a"(value) : "memory");
+}
+
+inline void zero_bytes(void* dest, size_t count) noexcept {
+    asm volatile("rep stosb" : "+D"(dest), "+c"(count) : "a"(0) : "memory");
+}
+
+// Rewrite the first byte of every line in [p, p + bytes) with itself, so
+// each page's translation has been walked and each line sits dirty in
+// this core's cache before the hot path reaches it. Contents do not
+// change, but nothing else may be writing the range meanwhile.
+inline void prefault(void* p, size_t bytes) noexcept {
+    auto* bytes_at = static_cast<volatile uint8_t*>(p);
+    for (size_t offset = 0; offset < bytes; offset += 64) {
+        bytes_at[offset] = bytes_at[offset];
+    }
+}
+
+// Per-CPU data block, reached through the GS base (IA32_GS_BASE).
+// Subsystems that need more per-core state embed this as the first member
+// of their own block (see hft.smp).
+struct cpu_local {
+    cpu_local* self;    // %gs:0 yields the block's own address
+    uint32_t index;     // Dense CPU number, 0 = boot processor
+    uint32_t apic_id;
+    uint32_t node;
+};
+
+// NUMA topology, filled in from ACPI SRAT/SLIT at boot (hft.acpi).
+// Until then, or without an SRAT, everything is node 0.
+namespace topology {
+    constexpr size_t MAX_NODES = 8;
+    constexpr size_t MAX_CPUS = 64;          // Cores brought up by hft.smp
+    constexpr size_t MAX_APIC_IDS = 256;
+    constexpr uint8_t LOCAL_DISTANCE = 10;   // SLIT convention
+    constexpr uint8_t REMOTE_DISTANCE = 20;
+
+    inline uint32_t node_count = 1;
+    inline uint8_t apic_node[MAX_APIC_IDS];             // APIC ID -> node
+    inline uint8_t node_distance[MAX_NODES][MAX_NODES]; // 0 = no SLIT entry
+
+    // Initial APIC ID of the executing core (CPUID.1 EBX[31:24])
+    inline uint32_t current_apic_id() noexcept {
+        uint32_t eax = 1, ebx, ecx = 0, edx;
+        asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+        return ebx >> 24;
+    }
+
+    // Set once RDTSCP is known to work; until then current_cpu() uses CPUID
+    inline bool tsc_aux_bound = false;
+
+    // Record the executing core's APIC ID in IA32_TSC_AUX, so
+    // current_cpu() can read it with RDTSCP instead of a serializing CPUID.
+    // Each core calls this once at bring-up.
+    inline void bind_current_cpu() noexcept {
+        uint32_t eax = 0x80000001, ebx, ecx = 0, edx;
+        asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+        if (!((edx >> 27) & 1)) return;  // No RDTSCP
+        
+        write_msr(0xC0000103, current_apic_id());
+        tsc_aux_bound = true;
+    }
+
+    // Set once the boot processor has a GS block. Every other core installs
+    // its own before running anything that asks for current_cpu().
+    inline bool gs_bound = false;
+
+#ifdef HFT_HOSTED
+    // Hosted builds (make host-bench) have no GS base to own: each thread
+    // installs its block here instead
+    inline thread_local cpu_local* thread_cpu_local = nullptr;
+#endif
+
+    // Point the executing core's GS base at its per-CPU block. Loading the
+    // GS selector afterwards clears the base again (gdt::load does).
+    inline void install_cpu_local(cpu_local* local) noexcept {
+        local->self = local;
+#ifdef HFT_HOSTED
+        thread_cpu_local = local;
+#else
+        write_msr(0xC0000101, reinterpret_cast<uint64_t>(local));
+#endif
+        gs_bound = true;
+    }
+
+    inline cpu_local* this_cpu() noexcept {
+#ifdef HFT_HOSTED
+        return thread_cpu_local;
+#else
+        cpu_local* local;
+        asm volatile("movq %%gs:0, %0" : "=r"(local));
+        return local;
+#endif
+    }
+
+    // APIC ID of the executing core, as an index below MAX_APIC_IDS
+    inline uint32_t current_cpu() noexcept {
+#ifdef HFT_HOSTED
+        if (gs_bound) return this_cpu()->apic_id & (MAX_APIC_IDS - 1);
+#else
+        if (gs_bound) {
+            uint32_t id;
+            asm volatile("movl %%gs:%c1, %0" : "=r"(id) : "i"(__builtin_offsetof(cpu_local, apic_id)));
+            return id & (MAX_APIC_IDS - 1);
+        }
+#endif
+        if (!tsc_aux_bound) return current_apic_id();
+        
+        uint32_t aux;
+        asm volatile("rdtscp" : "=c"(aux) :: "rax", "rdx");
+        return aux & (MAX_APIC_IDS - 1);
+    }
+
+    inline uint32_t current_node() noexcept {
+#ifdef HFT_HOSTED
+        if (gs_bound) return this_cpu()->node;
+#else
+        if (gs_bound) {
+            uint32_t node;
+            asm volatile("movl %%gs:%c1, %0" : "=r"(node) : "i"(__builtin_offsetof(cpu_local, node)));
+            return node;
+        }
+#endif
+        return apic_node[current_cpu()];
+    }
+
+    inline uint8_t distance(uint32_t from, uint32_t to) noexcept {
+        const uint8_t d = node_distance[from][to];
+        if (d != 0) return d;
+        return from == to ? LOCAL_DISTANCE : REMOTE_DISTANCE;
+    }
+}
+
 // Terminal output for early boot
 namespace terminal {
     void write(const char* str) noexcept;
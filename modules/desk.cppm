@@ -0,0 +1,235 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+#include "../include/freestanding/atomic.hpp"
+
+export module hft.desk;
+import hft.core;
+import hft.smp;
+import hft.timer;
+import hft.sched;
+import hft.virtio_net;
+import hft.net;
+import hft.registry;
+import hft.gateway;
+import hft.risk;
+import hft.trading;
+import hft.trace;
+
+// Wiring for the trading cores: the feed, strategy and gateway loops and
+// the setup they need.
+// A plan names the instruments, the multicast lines of each feed and
+// the order-entry session. setup(), before the prefault stage, declares
+// and builds the registry with the feed core as every book's writer,
+// builds the gateway templates and subscribes the groups. start(), after
+// it, isolates the cores from timers and pins an event loop with one
+// task on each: the feed task drives the NIC and routes order-entry
+// responses to the gateway and market data to the plan's handler, the
+// strategy task hands reports and passes to the plan's strategy, and the
+// gateway task sends what the strategy queued, through the risk gate
+// setup() configures from the plan. With too few cores the tasks share
+// loops, down to all on the boot processor.
+export namespace hft::desk {
+
+constexpr uint8_t RESPONSE_FEED = net::MAX_FEEDS - 1;  // Order-entry responses, raw framing
+constexpr uint32_t STRATEGY_SOURCE = 0;                // Strategy core's gateway queues
+constexpr uint32_t TASK_BUDGET = 32;
+
+// Market data, on the feed core (which may write the registry books)
+using feed_handler = void (*)(const net::datagram& d) noexcept;
+
+// Strategy hooks, on the strategy core. poll is a sched::poll_fn: it
+// reads books through registry::read() and submits orders with
+// desk::submit().
+struct strategy {
+    void (*on_report)(const gateway::report& r) noexcept;
+    sched::poll_fn poll;
+    void* ctx;
+};
+
+// An instrument the strategy may trade, in gateway template slot slot
+// (below gateway::MAX_INSTRUMENTS, and its risk gate instrument index).
+// Its orders are checked against limits and the touch of registry book
+// book.
+struct traded {
+    uint32_t slot;
+    const char* symbol;
+    uint16_t book;
+    risk::limits limits;
+};
+
+struct plan {
+    span<const registry::instrument> instruments;
+    span<const net::group> groups;         // Market data lines, MoldUDP64 framed
+    span<const traded> traded_instruments;
+    const gateway::session* session;       // nullptr: no order entry
+    uint32_t session_orders_per_second;    // Whole risk gate; 0: no session rate limit
+    uint32_t session_burst;
+    feed_handler on_market_data;           // nullptr: datagrams are only counted
+    strategy hooks;
+    bool nic;                              // virtio_net::init() succeeded
+};
+
+struct cores {
+    uint32_t feed;
+    uint32_t strategy;
+    uint32_t gateway;
+};
+
+} // namespace hft::desk
+
+namespace hft::desk {
+
+inline cores chosen = {0, 0, 0};
+inline feed_handler market_data = nullptr;
+inline strategy hooks = {};
+inline bool nic_up = false;
+inline uint64_t unhandled = 0;  // Market data datagrams with no handler
+inline uint32_t traded_books[gateway::MAX_INSTRUMENTS] = {};  // Registry id + 1 per slot (0: none)
+inline atomic<uint64_t> last_market{0};  // NIC receive TSC of the last market data handled
+
+// gateway::market_fn: the touch of a traded slot's registry book, empty
+// (so refused as no_market) for a slot without one
+trading::spread_info market_of(uint32_t slot) noexcept {
+    trading::spread_info s = {};
+    if (slot >= gateway::MAX_INSTRUMENTS || traded_books[slot] == 0) return s;
+    (void)registry::read(static_cast<uint16_t>(traded_books[slot] - 1),
+                         [&s](const auto& book) { s = book.get_spread(); });
+    return s;
+}
+
+uint32_t poll_feed(void*, uint32_t budget) noexcept {
+    if (!nic_up) return 0;
+    virtio_net::poll();
+    return static_cast<uint32_t>(net::receive([](const net::datagram& d) noexcept {
+        if (d.feed == RESPONSE_FEED) {
+            gateway::on_datagram(d.payload, d.length, tsc_clock::wall_ns(d.timestamp));
+        } else if (market_data) {
+            // rx at the NIC stamp, decoded once the MoldUDP64 framing is
+            // off, book after the handler has applied it
+            trace::tick_timer timer;
+            timer.mark(trace::feed_rx, d.timestamp);
+            timer.mark(trace::feed_decoded);
+            market_data(d);
+            timer.mark(trace::book_updated);
+            timer.finish();
+            trace::hit<trace::book_updated>(d.feed);
+            last_market.store(d.timestamp, memory_order::relaxed);
+        } else {
+            ++unhandled;
+        }
+    }, budget));
+}
+
+uint32_t poll_strategy(void*, uint32_t budget) noexcept {
+    uint32_t done = 0;
+    gateway::report r;
+    while (done < budget && gateway::next_report(STRATEGY_SOURCE, r)) {
+        if (hooks.on_report) hooks.on_report(r);
+        ++done;
+    }
+    return hooks.poll ? done + hooks.poll(hooks.ctx, budget) : done;
+}
+
+uint32_t poll_gateway(void*, uint32_t budget) noexcept {
+    return static_cast<uint32_t>(gateway::poll(budget));
+}
+
+// Feed, strategy and gateway on cores 2, 3 and 4, after the housekeeping
+// core (1); with fewer cores the later roles take the previous role's
+// core, and the feed falls back to the boot processor
+cores choose_cores() noexcept {
+    const uint32_t count = smp::cpu_count();
+    const uint32_t feed = count > 2 ? 2 : 0;
+    const uint32_t strategy_core = count > 3 ? 3 : feed;
+    return {feed, strategy_core, count > 4 ? 4 : strategy_core};
+}
+
+} // namespace hft::desk
+
+export namespace hft::desk {
+
+// Boot processor, after smp and the NIC are up and before the prefault
+// stage. false if an instrument, group, traded slot or the registry
+// build was refused; what could be set up still is.
+bool setup(const plan& p) noexcept {
+    chosen = choose_cores();
+    market_data = p.on_market_data;
+    hooks = p.hooks;
+    nic_up = p.nic;
+
+    bool ok = true;
+    for (const registry::instrument& i : p.instruments) {
+        ok = registry::declare(i) && ok;
+    }
+    const uint32_t feed_cores[] = {chosen.feed};
+    ok = registry::build(span<const uint32_t>(feed_cores, 1)) && ok;
+
+    for (const net::group& g : p.groups) {
+        if (g.feed == RESPONSE_FEED || !net::subscribe(g)) {
+            ok = false;
+            continue;
+        }
+        net::set_framing(g.feed, net::framing::moldudp64);
+    }
+
+    if (p.session) {
+        gateway::configure(*p.session);
+        gateway::set_market(market_of);
+        ok = net::subscribe({p.session->local.address, p.session->local.port, RESPONSE_FEED, 0}) && ok;
+        net::set_framing(RESPONSE_FEED, net::framing::raw);
+
+        // gateway::poll() checks every entry against the gateway core's gate
+        risk::gate& gate = risk::on(chosen.gateway);
+        gate.configure_session(p.session_orders_per_second, p.session_burst);
+        for (const traded& t : p.traded_instruments) {
+            const bool added = gateway::add_instrument(t.slot, t.symbol) &&
+                               gate.configure(t.slot, t.limits) && registry::contains(t.book);
+            if (added) traded_books[t.slot] = t.book + 1u;
+            ok = added && ok;
+        }
+    }
+    return ok;
+}
+
+// After the prefault stage: add the three tasks and start every loop
+// that is not the boot processor's, isolated and spinning when idle.
+// Tasks left on the boot processor run once main calls
+// sched::on(0).run(). false if a core could not be started.
+bool start() noexcept {
+    const sched::task tasks[] = {
+        {"feed.rx", poll_feed, nullptr, TASK_BUDGET},
+        {"strategy", poll_strategy, nullptr, TASK_BUDGET},
+        {"gateway.tx", poll_gateway, nullptr, TASK_BUDGET},
+    };
+    const uint32_t where[] = {chosen.feed, chosen.strategy, chosen.gateway};
+
+    bool ok = true;
+    for (size_t i = 0; i < 3; ++i) {
+        ok = sched::on(where[i]).add(tasks[i]) && ok;
+    }
+    for (size_t i = 0; i < 3; ++i) {
+        const uint32_t cpu = where[i];
+        if (cpu == 0 || (i > 0 && cpu == where[i - 1])) continue;  // Boot loop, or started
+        timer::set_isolated(cpu, true);
+        sched::on(cpu).set_idle(sched::idle_mode::spin);
+        ok = sched::start(cpu) && ok;
+    }
+    return ok;
+}
+
+// Where setup() put each role
+[[nodiscard]] cores placement() noexcept {
+    return chosen;
+}
+
+// Strategy core: queue r on STRATEGY_SOURCE, stamped with the receive
+// time of the latest market data the feed core handled (unless the
+// strategy set market_tsc itself) so the gateway can trace it through
+// to the wire. False if the queue is full.
+[[nodiscard]] bool submit(gateway::request r) noexcept {
+    if (r.market_tsc == 0) r.market_tsc = last_market.load(memory_order::relaxed);
+    return gateway::submit(STRATEGY_SOURCE, r);
+}
+
+} // namespace hft::desk
@@ -0,0 +1,635 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+#include "../include/freestanding/atomic.hpp"
+
+export module hft.gateway;
+import hft.core;
+import hft.concurrent;
+import hft.wire;
+import hft.trading;
+import hft.virtio_net;
+import hft.capture;
+import hft.risk;
+import hft.trace;
+
+// Order entry: OUCH 4.2 over UDP (the exchange's UFO-style transport;
+// there is no TCP stack here), one message per frame.
+//
+// Strategy cores submit() orders into their own SPSC queue. The gateway
+// core's poll() copies a pre-built frame for the instrument and side
+// (Ethernet, IPv4, UDP and session headers, every constant OUCH field
+// already in place) into a NIC transmit buffer. It then patches the
+// token, shares and price, and finishes the UDP checksum from a
+// precomputed partial sum over the bytes that never change. Responses
+// from the exchange arrive through on_datagram() and go back to the
+// submitting core as reports.
+//
+// Every order passes the gateway core's risk gate (risk::local()) before
+// its frame is built; refused orders are dropped and reported back as
+// event::refused. Responses are parsed on the core that receives them
+// and handed to the gateway core, which settles fills, cancels and
+// rejects against the gate's exposure before passing them on.
+export namespace hft::gateway {
+
+constexpr size_t MAX_SOURCES = 8;        // Submitting cores
+constexpr size_t MAX_INSTRUMENTS = 64;
+constexpr size_t QUEUE_DEPTH = 256;
+constexpr size_t MAX_WORKING = 4096;     // Orders tracked for the risk gate
+
+struct endpoint {
+    uint8_t mac[6];
+    uint32_t address;  // Host order
+    uint16_t port;
+};
+
+struct session {
+    endpoint local;
+    endpoint exchange;   // MAC of the next hop, address and port of the exchange
+    char firm[4];
+};
+
+enum class request_kind : uint8_t {
+    enter,
+    cancel    // order.quantity is the size to leave open (0: cancel outright)
+};
+
+struct request {
+    trading::order order;
+    uint32_t instrument;
+    request_kind kind;
+    uint64_t market_tsc;  // NIC receive TSC of the market data acted on (0: unknown)
+    uint64_t signal_tsc;  // When the strategy decided; submit() stamps it if 0
+};
+
+enum class event : uint8_t {
+    accepted,    // execution.fill_quantity: accepted size, fill_price: price
+    executed,
+    cancelled,   // execution.fill_quantity: size taken off the book
+    rejected,    // reason: OUCH reject reason
+    refused      // Never sent. risk: risk::reason mask, 0 if the order could
+                 // not be tracked (id already working, or MAX_WORKING reached)
+};
+
+struct report {
+    trading::execution execution;  // order_id, price, quantity, receive wall_ns
+    event kind;
+    char reason;
+    uint32_t risk;
+};
+
+// Opposite touch the risk gate checks an order for instrument against
+using market_fn = trading::spread_info (*)(uint32_t instrument) noexcept;
+
+struct gateway_stats {
+    uint64_t sent;
+    uint64_t tx_full;        // poll() found no free transmit buffer
+    uint64_t unknown_instrument;
+    uint64_t risk_refused;   // Refused by the risk gate or not trackable
+    uint64_t reports;
+    uint64_t report_drops;   // A source's report queue, or the response queue, was full
+    uint64_t malformed;
+};
+
+} // namespace hft::gateway
+
+namespace hft::gateway {
+
+// Frame layout: Ethernet, IPv4 (no options), UDP, then the session
+// header (2-byte length, type 'U' for unsequenced data) and one message
+constexpr size_t IP = 14;
+constexpr size_t UDP = IP + 20;
+constexpr size_t SESSION = UDP + 8;
+constexpr size_t MESSAGE = SESSION + 3;
+
+constexpr size_t TOKEN_LENGTH = 14;
+
+// Client to exchange
+struct enter_order {
+    static constexpr uint8_t type = 'O';
+    static constexpr size_t length = 49;
+    using side = wire::field<char, 15>;
+    using shares = wire::field<uint32_t, 16>;
+    using stock = wire::field<uint64_t, 20, 8, wire::byte_order::little>;
+    using price = wire::field<uint32_t, 28>;
+    using time_in_force = wire::field<uint32_t, 32>;
+    static constexpr size_t firm = 36;  // Four characters
+    using display = wire::field<char, 40>;
+    using capacity = wire::field<char, 41>;
+    using sweep = wire::field<char, 42>;
+    using min_quantity = wire::field<uint32_t, 43>;
+    using cross = wire::field<char, 47>;
+    using customer = wire::field<char, 48>;
+    static_assert(wire::fits<length, side, shares, stock, price, time_in_force, display,
+                             capacity, sweep, min_quantity, cross, customer>);
+};
+
+struct cancel_order {
+    static constexpr uint8_t type = 'X';
+    static constexpr size_t length = 19;
+    using shares = wire::field<uint32_t, 15>;
+    static_assert(wire::fits<length, shares>);
+};
+
+// Exchange to client: type, 8-byte timestamp, then the token
+using token_offset = wire::field<char, 9>;
+
+struct accepted {
+    static constexpr uint8_t type = 'A';
+    static constexpr size_t length = 66;
+    using shares = wire::field<uint32_t, 24>;
+    using price = wire::field<uint32_t, 36>;
+    static_assert(wire::fits<length, shares, price>);
+};
+
+struct executed {
+    static constexpr uint8_t type = 'E';
+    static constexpr size_t length = 40;
+    using shares = wire::field<uint32_t, 23>;
+    using price = wire::field<uint32_t, 27>;
+    static_assert(wire::fits<length, shares, price>);
+};
+
+struct cancelled {
+    static constexpr uint8_t type = 'C';
+    static constexpr size_t length = 28;
+    using shares = wire::field<uint32_t, 23>;
+    using reason = wire::field<char, 27>;
+    static_assert(wire::fits<length, shares, reason>);
+};
+
+struct rejected {
+    static constexpr uint8_t type = 'J';
+    static constexpr size_t length = 24;
+    using reason = wire::field<char, 23>;
+    static_assert(wire::fits<length, reason>);
+};
+
+constexpr uint32_t TIF_DAY = 99999;  // System hours
+
+constexpr size_t ENTER_FRAME = MESSAGE + enter_order::length;
+constexpr size_t CANCEL_FRAME = MESSAGE + cancel_order::length;
+
+// Template frames for one instrument, both sides, with the UDP checksum
+// partial sum over everything but the patched fields
+struct alignas(64) instrument_templates {
+    uint8_t enter[2][ENTER_FRAME];  // [0] sell, [1] buy
+    uint32_t enter_sum[2];
+    bool configured;
+};
+
+struct alignas(64) source_queues {
+    concurrent::spsc_queue<request, QUEUE_DEPTH> requests;  // Source -> gateway
+    concurrent::spsc_queue<report, QUEUE_DEPTH> reports;    // Gateway -> source
+};
+
+// Counts kept by the core receiving exchange responses
+struct receive_counters {
+    atomic<uint64_t> report_drops;  // Response queue to the gateway core was full
+    atomic<uint64_t> malformed;
+};
+
+inline instrument_templates instruments[MAX_INSTRUMENTS] = {};
+alignas(64) inline uint8_t cancel_frame[CANCEL_FRAME] = {};
+inline uint32_t cancel_sum = 0;
+inline source_queues sources[MAX_SOURCES];
+// One writer per block: counters the gateway core, received the core
+// calling on_datagram() (atomic, so stats() can read it from the gateway
+// core)
+alignas(64) inline gateway_stats counters = {};
+alignas(64) inline receive_counters received = {};
+inline market_fn market = nullptr;
+
+// Single-writer increment: a plain load and store, no LOCK prefix
+void bump(atomic<uint64_t>& counter) noexcept {
+    counter.store(counter.load(memory_order::relaxed) + 1, memory_order::relaxed);
+}
+
+// A response for source's order, parsed on the receiving core
+struct response {
+    report r;
+    uint32_t source;
+};
+
+alignas(64) inline concurrent::spsc_queue<response, QUEUE_DEPTH * 4> responses;  // Receiver -> gateway
+
+// Sent orders with open quantity, keyed by source and token order id;
+// slots are bump allocated, then recycled through a free stack
+struct working_order {
+    trading::order order;  // quantity: still open
+    uint32_t instrument;
+};
+
+inline working_order working[MAX_WORKING];
+inline uint32_t working_free[MAX_WORKING];
+inline uint32_t working_free_count = 0;
+inline uint32_t working_used = 0;
+inline trading::flat_index<MAX_WORKING * 2> working_index;
+
+// One's-complement sum of frame[begin, end) as 16-bit words aligned to
+// the start of the frame (every header above starts on an even offset)
+constexpr uint32_t ones_sum(const uint8_t* frame, size_t begin, size_t end) noexcept {
+    uint32_t sum = 0;
+    if (begin & 1) sum += frame[begin++];
+    for (; begin + 1 < end; begin += 2) {
+        sum += (static_cast<uint32_t>(frame[begin]) << 8) | frame[begin + 1];
+    }
+    if (begin < end) sum += static_cast<uint32_t>(frame[begin]) << 8;
+    return sum;
+}
+
+constexpr uint16_t fold(uint32_t sum) noexcept {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return static_cast<uint16_t>(sum);
+}
+
+// ~fold(sum), with 0 sent as 0xFFFF (0 means "no checksum" in UDP)
+constexpr uint16_t finish(uint32_t sum) noexcept {
+    const uint16_t checksum = static_cast<uint16_t>(~fold(sum));
+    return checksum ? checksum : 0xFFFF;
+}
+
+// Ethernet, IPv4, UDP and session headers for a frame of size bytes;
+// returns the UDP pseudo-header and header sum (checksum field zero)
+uint32_t build_headers(uint8_t* frame, size_t size, const session& s, uint8_t message_type) noexcept {
+    memcpy(frame, s.exchange.mac, 6);
+    memcpy(frame + 6, s.local.mac, 6);
+    wire::field<uint16_t, 12>::write(frame, 0x0800);
+
+    uint8_t* ip = frame + IP;
+    const auto ip_length = static_cast<uint16_t>(size - IP);
+    ip[0] = 0x45;
+    wire::field<uint16_t, 2>::write(ip, ip_length);
+    wire::field<uint16_t, 6>::write(ip, 0x4000);  // Don't fragment; ID stays 0
+    ip[8] = 64;
+    ip[9] = 17;
+    wire::field<uint32_t, 12>::write(ip, s.local.address);
+    wire::field<uint32_t, 16>::write(ip, s.exchange.address);
+    wire::field<uint16_t, 10>::write(ip, 0);  // A rebuilt template still holds the old checksum
+    wire::field<uint16_t, 10>::write(ip, static_cast<uint16_t>(~fold(ones_sum(ip, 0, 20))));
+
+    uint8_t* udp = frame + UDP;
+    const auto udp_length = static_cast<uint16_t>(size - UDP);
+    wire::field<uint16_t, 0>::write(udp, s.local.port);
+    wire::field<uint16_t, 2>::write(udp, s.exchange.port);
+    wire::field<uint16_t, 4>::write(udp, udp_length);
+
+    wire::field<uint16_t, 0>::write(frame + SESSION, static_cast<uint16_t>(size - SESSION - 2));
+    frame[SESSION + 2] = 'U';
+    frame[MESSAGE] = message_type;
+
+    // Pseudo-header: addresses, protocol, UDP length
+    return ones_sum(ip, 12, 20) + 17 + udp_length + ones_sum(frame, UDP, UDP + 8);
+}
+
+inline session config = {};
+
+// Token: 'A' + source, then the order id as 13 hex digits (52 bits)
+void encode_token(uint8_t* token, uint32_t source, trading::order_id_t id) noexcept {
+    constexpr char digits[] = "0123456789ABCDEF";
+    token[0] = static_cast<uint8_t>('A' + source);
+    for (size_t i = TOKEN_LENGTH - 1; i > 0; --i) {
+        token[i] = static_cast<uint8_t>(digits[id & 0xF]);
+        id >>= 4;
+    }
+}
+
+// Source index (MAX_SOURCES if not one of ours) and order id of a token
+uint32_t decode_token(const uint8_t* token, trading::order_id_t& id) noexcept {
+    id = 0;
+    for (size_t i = 1; i < TOKEN_LENGTH; ++i) {
+        const uint8_t c = token[i];
+        id = (id << 4) | ((c & 0xF) + 9 * (c >> 6));  // '0'-'9', 'A'-'F'
+    }
+    const uint32_t source = static_cast<uint32_t>(token[0]) - 'A';
+    return source < MAX_SOURCES ? source : MAX_SOURCES;
+}
+
+// The token carries 52 bits of the order id
+constexpr uint64_t working_key(uint32_t source, trading::order_id_t id) noexcept {
+    return (static_cast<uint64_t>(source) << 52) | (id & ((uint64_t{1} << 52) - 1));
+}
+
+// Start tracking a passed order; false if it cannot be
+bool track(uint32_t source, const request& r) noexcept {
+    const uint64_t key = working_key(source, r.order.id);
+    if (working_index.find(key) != trading::flat_index<MAX_WORKING * 2>::npos) return false;
+
+    uint32_t idx;
+    if (working_free_count > 0) {
+        idx = working_free[--working_free_count];
+    } else if (working_used < MAX_WORKING) {
+        idx = working_used++;
+    } else {
+        return false;
+    }
+    working[idx] = {r.order, r.instrument};
+    working_index.insert(key, idx);
+    return true;
+}
+
+void untrack(uint64_t key, uint32_t idx) noexcept {
+    working_index.erase(key);
+    working_free[working_free_count++] = idx;
+}
+
+// Report to source (the gateway core is the only producer of reports)
+void deliver(uint32_t source, const report& r) noexcept {
+    if (!sources[source].reports.try_push(r)) [[unlikely]] {
+        ++counters.report_drops;
+        return;
+    }
+    ++counters.reports;
+}
+
+// Drop an order the gate refused and tell its source
+void refuse(uint32_t source, const request& r, uint32_t reasons) noexcept {
+    ++counters.risk_refused;
+    const trading::execution e{r.order.id, r.order.price, r.order.quantity, tsc_clock::now_ns()};
+    deliver(source, report{e, event::refused, 0, reasons});
+}
+
+// Apply a response to the gate's exposure and the working order, then
+// pass it on. Accepts change nothing: exposure was reserved by check().
+void settle(const response& in) noexcept {
+    const uint64_t key = working_key(in.source, in.r.execution.order_id);
+    const uint32_t idx = working_index.find(key);
+    if (idx != trading::flat_index<MAX_WORKING * 2>::npos) {
+        working_order& w = working[idx];
+        risk::gate& gate = risk::local();
+        const trading::quantity_t quantity = min(in.r.execution.fill_quantity, w.order.quantity);
+        switch (in.r.kind) {
+            case event::executed:
+                gate.filled(w.instrument, w.order, quantity);
+                w.order.quantity -= quantity;
+                break;
+            case event::cancelled:
+                gate.released(w.instrument, w.order, quantity);
+                w.order.quantity -= quantity;
+                break;
+            case event::rejected:
+                gate.released(w.instrument, w.order, w.order.quantity);
+                w.order.quantity = 0;
+                break;
+            default:
+                break;
+        }
+        if (w.order.quantity == 0) untrack(key, idx);
+    }
+    deliver(in.source, in.r);
+}
+
+// Build one frame in a transmit buffer; false if there is none free.
+// Entries pass the risk gate first; a free buffer is checked for before
+// it, so an entry retried on the next poll is never checked twice.
+bool send(const request& r, uint32_t source) noexcept {
+    const bool enter = r.kind == request_kind::enter;
+    const instrument_templates& t = instruments[r.instrument < MAX_INSTRUMENTS ? r.instrument : 0];
+    if (enter && (r.instrument >= MAX_INSTRUMENTS || !t.configured)) [[unlikely]] {
+        ++counters.unknown_instrument;
+        return true;  // Consumed: dropping it is the only option
+    }
+
+    auto& tx_free = virtio_net::tx_free();
+    const span<virtio_net::packet> free = tx_free.peek(1);
+    if (free.empty()) [[unlikely]] {
+        ++counters.tx_full;
+        return false;
+    }
+
+    if (enter) {
+        const trading::spread_info touch = market ? market(r.instrument) : trading::spread_info{};
+        risk::gate& gate = risk::local();
+        const uint32_t reasons = gate.check(r.instrument, r.order, touch);
+        if (reasons != risk::reason::none) [[unlikely]] {
+            refuse(source, r, reasons);
+            return true;
+        }
+        if (!track(source, r)) [[unlikely]] {
+            gate.released(r.instrument, r.order, r.order.quantity);
+            refuse(source, r, 0);
+            return true;
+        }
+    }
+
+    virtio_net::packet p = free[0];
+    tx_free.release(1);
+
+    uint8_t* frame = p.data;
+    uint8_t* message = frame + MESSAGE;
+    const auto shares = static_cast<uint32_t>(r.order.quantity);
+
+    uint32_t sum;
+    const size_t token_end = MESSAGE + 1 + TOKEN_LENGTH;
+    if (enter) {
+        const size_t side = r.order.is_buy ? 1 : 0;
+        memcpy(frame, t.enter[side], ENTER_FRAME);
+        encode_token(message + 1, source, r.order.id);
+        enter_order::shares::write(message, shares);
+        enter_order::price::write(message, static_cast<uint32_t>(r.order.price));
+        sum = t.enter_sum[side] + ones_sum(frame, MESSAGE + 1, token_end) +
+              ones_sum(frame, MESSAGE + enter_order::shares::offset, MESSAGE + enter_order::shares::end) +
+              ones_sum(frame, MESSAGE + enter_order::price::offset, MESSAGE + enter_order::price::end);
+        p.length = ENTER_FRAME;
+    } else {
+        memcpy(frame, cancel_frame, CANCEL_FRAME);
+        encode_token(message + 1, source, r.order.id);
+        cancel_order::shares::write(message, shares);
+        sum = cancel_sum + ones_sum(frame, MESSAGE + 1, token_end) +
+              ones_sum(frame, MESSAGE + cancel_order::shares::offset, MESSAGE + cancel_order::shares::end);
+        p.length = CANCEL_FRAME;
+    }
+    wire::field<uint16_t, UDP + 6>::write(frame, finish(sum));
+    (void)capture::append(capture::kind::outbound, static_cast<uint16_t>(source), frame, p.length);
+
+    (void)virtio_net::tx_ready().try_push(p);  // Holds every buffer
+    ++counters.sent;
+
+    // feed_rx -> signal_ready -> order_sent, from the stamps the request
+    // carried across cores
+    if constexpr (trace::enabled) {
+        trace::tick_timer timer;
+        if (r.market_tsc != 0) timer.mark(trace::feed_rx, r.market_tsc);
+        timer.mark(trace::signal_ready, r.signal_tsc);
+        timer.mark(trace::order_sent);
+        timer.finish();
+        trace::hit<trace::order_sent>(static_cast<uint32_t>(r.order.id));
+    }
+    return true;
+}
+
+// Turns exchange responses into reports for the submitting source
+struct response_parser {
+    uint64_t receive_ns;
+
+    template<typename Message>
+    void deliver(wire::view<Message> m, event kind, uint32_t price, uint32_t shares, char reason) noexcept {
+        trading::order_id_t id;
+        const uint32_t source = decode_token(m.data + token_offset::offset, id);
+        if (source == MAX_SOURCES) [[unlikely]] {
+            bump(received.malformed);
+            return;
+        }
+
+        const report r{{id, static_cast<trading::price_t>(price), shares, receive_ns}, kind, reason, 0};
+        if (!responses.try_push({r, source})) [[unlikely]] {
+            bump(received.report_drops);
+        }
+    }
+
+    void operator()(wire::view<accepted> m) noexcept {
+        deliver(m, event::accepted, m.get<accepted::price>(), m.get<accepted::shares>(), 0);
+    }
+
+    void operator()(wire::view<executed> m) noexcept {
+        deliver(m, event::executed, m.get<executed::price>(), m.get<executed::shares>(), 0);
+    }
+
+    void operator()(wire::view<cancelled> m) noexcept {
+        deliver(m, event::cancelled, 0, m.get<cancelled::shares>(), m.get<cancelled::reason>());
+    }
+
+    void operator()(wire::view<rejected> m) noexcept {
+        deliver(m, event::rejected, 0, 0, m.get<rejected::reason>());
+    }
+};
+
+using response_dispatcher = wire::dispatcher<response_parser, accepted, executed, cancelled, rejected>;
+
+} // namespace hft::gateway
+
+export namespace hft::gateway {
+
+// Set the session addresses and rebuild the cancel template; call
+// before add_instrument()
+void configure(const session& s) noexcept {
+    config = s;
+    cancel_sum = build_headers(cancel_frame, CANCEL_FRAME, s, cancel_order::type) +
+                 ones_sum(cancel_frame, SESSION, MESSAGE + 1);
+}
+
+// Build the entry templates for an instrument (symbol: up to 8
+// characters, space padded on the wire)
+bool add_instrument(uint32_t instrument, const char* symbol) noexcept {
+    if (instrument >= MAX_INSTRUMENTS) return false;
+    instrument_templates& t = instruments[instrument];
+
+    for (size_t side = 0; side < 2; ++side) {
+        uint8_t* frame = t.enter[side];
+        memset(frame, 0, ENTER_FRAME);
+        const uint32_t headers = build_headers(frame, ENTER_FRAME, config, enter_order::type);
+
+        uint8_t* message = frame + MESSAGE;
+        enter_order::side::write(message, side ? 'B' : 'S');
+        uint8_t* stock = message + enter_order::stock::offset;
+        size_t i = 0;
+        for (; i < 8 && symbol[i]; ++i) stock[i] = static_cast<uint8_t>(symbol[i]);
+        for (; i < 8; ++i) stock[i] = ' ';
+        enter_order::time_in_force::write(message, TIF_DAY);
+        memcpy(message + enter_order::firm, config.firm, 4);
+        enter_order::display::write(message, 'Y');
+        enter_order::capacity::write(message, 'P');
+        enter_order::sweep::write(message, 'N');
+        enter_order::cross::write(message, 'N');
+        enter_order::customer::write(message, 'N');
+
+        // Token, shares and price are still zero here, so they add nothing
+        t.enter_sum[side] = headers + ones_sum(frame, SESSION, ENTER_FRAME);
+    }
+    t.configured = true;
+    return true;
+}
+
+// Where the risk gate reads the market for an instrument; without one
+// every entry is refused (risk::reason::no_market). Before trading starts.
+void set_market(market_fn f) noexcept {
+    market = f;
+}
+
+// Strategy side: queue an order or cancel for the gateway core (source
+// is the caller's own queue index). False if the queue is full. Entries
+// the risk gate refuses come back as event::refused reports. Stamps
+// signal_tsc here when the caller left it 0.
+[[nodiscard]] bool submit(uint32_t source, const request& r) noexcept {
+    if (source >= MAX_SOURCES) return false;
+    if constexpr (trace::enabled) {
+        if (r.signal_tsc == 0) {
+            request stamped = r;
+            stamped.signal_tsc = tsc_clock::now();
+            return sources[source].requests.try_push(stamped);
+        }
+    }
+    return sources[source].requests.try_push(r);
+}
+
+// Strategy side: next report for source's orders
+[[nodiscard]] bool next_report(uint32_t source, report& out) noexcept {
+    return source < MAX_SOURCES && sources[source].reports.try_pop(out);
+}
+
+// Gateway core: settle the responses received so far, then send up to
+// budget queued requests. The only producer on the NIC transmit queues
+// and of the report queues. Returns the number of requests handled.
+size_t poll(size_t budget = 32) noexcept {
+    response in;
+    for (size_t settled = 0; settled < budget && responses.try_pop(in); ++settled) {
+        settle(in);
+    }
+
+    size_t sent = 0;
+    for (uint32_t source = 0; source < MAX_SOURCES && sent < budget; ++source) {
+        auto& queue = sources[source].requests;
+        while (sent < budget) {
+            const span<request> next = queue.peek(1);
+            if (next.empty()) break;
+            if (!send(next[0], source)) return sent;  // Retried on the next poll
+            queue.release(1);
+            ++sent;
+        }
+    }
+    return sent;
+}
+
+// One datagram from the exchange's address and port (its UDP payload, as
+// net::receive() delivers it); receive_ns stamps the reports, which reach
+// their sources through the gateway core's next poll(). Call from one
+// core only.
+void on_datagram(const uint8_t* payload, size_t length, uint64_t receive_ns) noexcept {
+    response_parser parser{receive_ns};
+    size_t offset = 0;
+    while (offset + 3 <= length) {
+        const size_t size = wire::field<uint16_t, 0>::read(payload + offset);
+        if (size == 0 || offset + 2 + size > length) [[unlikely]] {
+            bump(received.malformed);
+            return;
+        }
+        const uint8_t type = payload[offset + 2];
+        if ((type == 'S' || type == 'U') &&
+            !response_dispatcher::dispatch(parser, payload + offset + 3, size - 1)) [[unlikely]] {
+            bump(received.malformed);
+        }
+        offset += 2 + size;
+    }
+}
+
+// Read every template line so the first orders after a quiet spell do
+// not miss in cache; cheap enough for an idle loop
+void warm() noexcept {
+    for (const instrument_templates& t : instruments) {
+        if (!t.configured) continue;
+        const auto* bytes = reinterpret_cast<const volatile uint8_t*>(&t);
+        for (size_t line = 0; line < sizeof(t); line += 64) (void)bytes[line];
+    }
+    (void)*reinterpret_cast<const volatile uint8_t*>(cancel_frame);
+}
+
+// Gateway core only; the receiving core's counts may be a few events stale
+[[nodiscard]] gateway_stats stats() noexcept {
+    gateway_stats s = counters;
+    s.report_drops += received.report_drops.load(memory_order::relaxed);
+    s.malformed += received.malformed.load(memory_order::relaxed);
+    return s;
+}
+
+} // namespace hft::gateway
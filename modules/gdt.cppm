@@ -5,7 +5,7 @@ export module hft.gdt;
 export namespace hft::gdt {
 using namespace hft;
 
-// GDT entry structure
+// GDT entry structure (code/data segments)
 struct [[gnu::packed]] descriptor {
     uint16_t limit_low;
     uint16_t base_low;
@@ -13,10 +13,16 @@ struct [[gnu::packed]] descriptor {
     uint8_t access;
     uint8_t flags_limit_high;
     uint8_t base_high;
+};
+static_assert(sizeof(descriptor) == 8);
+
+// System descriptor (TSS): 16 bytes, occupies two GDT slots
+struct [[gnu::packed]] system_descriptor {
+    descriptor low;
     uint32_t base_upper;
     uint32_t reserved;
 };
-static_assert(sizeof(descriptor) == 16);
+static_assert(sizeof(system_descriptor) == 16);
 
 // GDT pointer structure
 struct [[gnu::packed]] gdtr {
@@ -47,19 +53,39 @@ enum segment : uint16_t {
     tss_segment = 0x28
 };
 
-// Global GDT and TSS - CHANGED: static -> inline
-alignas(16) inline descriptor gdt[7];
-alignas(16) inline tss system_tss;
-inline gdtr gdt_pointer;
+// Interrupt stack table slots (IDT ist field; 0 = no switch)
+enum ist_slot : uint8_t {
+    ist_double_fault = 1,
+    ist_nmi = 2
+};
+
+// One core's GDT and TSS. Every core needs its own TSS (ltr marks the
+// descriptor busy), so each gets a private copy of the whole table.
+struct alignas(16) cpu_tables {
+    descriptor entries[5];          // null, kernel code/data, user code/data
+    system_descriptor tss_entry;    // Selector 0x28
+    tss task_state;
+    gdtr pointer;
+};
+
+// Stacks a core runs interrupts and faults on
+struct interrupt_stacks {
+    uint64_t kernel;        // rsp0: entry from ring 3
+    uint64_t double_fault;  // IST1
+    uint64_t nmi;           // IST2
+};
 
-// Stack for interrupts (16KB) - CHANGED: static -> inline
+// Boot processor tables and stacks
+inline cpu_tables bsp_tables;
 alignas(16) inline uint8_t interrupt_stack[16384];
+alignas(16) inline uint8_t double_fault_stack[4096];
+alignas(16) inline uint8_t nmi_stack[4096];
 
 // Create a GDT entry
-constexpr descriptor make_descriptor(uint64_t base, uint32_t limit, 
+constexpr descriptor make_descriptor(uint64_t base, uint32_t limit,
                                      uint8_t access, uint8_t flags) {
     descriptor desc{};
-    
+
     // For 64-bit code/data segments, base and limit are ignored
     desc.limit_low = limit & 0xFFFF;
     desc.base_low = base & 0xFFFF;
@@ -67,60 +93,53 @@ constexpr descriptor make_descriptor(uint64_t base, uint32_t limit,
     desc.access = access;
     desc.flags_limit_high = ((limit >> 16) & 0x0F) | (flags << 4);
     desc.base_high = (base >> 24) & 0xFF;
-    desc.base_upper = (base >> 32) & 0xFFFFFFFF;
-    desc.reserved = 0;
-    
+
     return desc;
 }
 
 // Create a TSS descriptor (special case, spans two GDT entries)
-void set_tss_descriptor(uint64_t tss_addr, uint32_t tss_size) {
-    // TSS descriptor is 16 bytes (two GDT entries)
-    uint64_t base = tss_addr;
-    uint32_t limit = tss_size - 1;
-    
-    // Lower 8 bytes
-    gdt[5].limit_low = limit & 0xFFFF;
-    gdt[5].base_low = base & 0xFFFF;
-    gdt[5].base_middle = (base >> 16) & 0xFF;
-    gdt[5].access = 0x89;  // Present, TSS available
-    gdt[5].flags_limit_high = ((limit >> 16) & 0x0F) | 0x00;
-    gdt[5].base_high = (base >> 24) & 0xFF;
-    
-    // Upper 8 bytes
-    gdt[5].base_upper = (base >> 32) & 0xFFFFFFFF;
-    gdt[5].reserved = 0;
+constexpr system_descriptor make_tss_descriptor(uint64_t tss_addr, uint32_t tss_size) {
+    system_descriptor desc{};
+
+    desc.low = make_descriptor(tss_addr, tss_size - 1, 0x89, 0x0);  // Present, TSS available
+    desc.base_upper = (tss_addr >> 32) & 0xFFFFFFFF;
+    desc.reserved = 0;
+
+    return desc;
 }
 
-// Initialize the GDT
-void init() noexcept {
+// Build and load a core's GDT and TSS. Reloading GS clears the GS base,
+// so per-CPU data must be installed after this.
+void load(cpu_tables& tables, const interrupt_stacks& stacks) noexcept {
     // Null segment
-    gdt[0] = make_descriptor(0, 0, 0, 0);
-    
+    tables.entries[0] = make_descriptor(0, 0, 0, 0);
+
     // Kernel code segment (64-bit)
-    gdt[1] = make_descriptor(0, 0xFFFFF, 0x9A, 0xA);  // Present, DPL0, Code, Executable, Readable
-    
+    tables.entries[1] = make_descriptor(0, 0xFFFFF, 0x9A, 0xA);  // Present, DPL0, Code, Executable, Readable
+
     // Kernel data segment
-    gdt[2] = make_descriptor(0, 0xFFFFF, 0x92, 0xC);  // Present, DPL0, Data, Writable
-    
+    tables.entries[2] = make_descriptor(0, 0xFFFFF, 0x92, 0xC);  // Present, DPL0, Data, Writable
+
     // User code segment (64-bit)
-    gdt[3] = make_descriptor(0, 0xFFFFF, 0xFA, 0xA);  // Present, DPL3, Code
-    
+    tables.entries[3] = make_descriptor(0, 0xFFFFF, 0xFA, 0xA);  // Present, DPL3, Code
+
     // User data segment
-    gdt[4] = make_descriptor(0, 0xFFFFF, 0xF2, 0xC);  // Present, DPL3, Data
-    
+    tables.entries[4] = make_descriptor(0, 0xFFFFF, 0xF2, 0xC);  // Present, DPL3, Data
+
     // Initialize TSS
-    memset(&system_tss, 0, sizeof(tss));
-    system_tss.rsp0 = reinterpret_cast<uint64_t>(&interrupt_stack[16384]);
-    system_tss.iopb_offset = sizeof(tss);
-    
+    memset(&tables.task_state, 0, sizeof(tss));
+    tables.task_state.rsp0 = stacks.kernel;
+    tables.task_state.ist[ist_double_fault - 1] = stacks.double_fault;
+    tables.task_state.ist[ist_nmi - 1] = stacks.nmi;
+    tables.task_state.iopb_offset = sizeof(tss);
+
     // Set TSS descriptor
-    set_tss_descriptor(reinterpret_cast<uint64_t>(&system_tss), sizeof(tss));
-    
+    tables.tss_entry = make_tss_descriptor(reinterpret_cast<uint64_t>(&tables.task_state), sizeof(tss));
+
     // Load GDT
-    gdt_pointer.limit = sizeof(gdt) - 1;
-    gdt_pointer.base = reinterpret_cast<uint64_t>(&gdt);
-    
+    tables.pointer.limit = sizeof(tables.entries) + sizeof(tables.tss_entry) - 1;
+    tables.pointer.base = reinterpret_cast<uint64_t>(&tables.entries);
+
     asm volatile(
         "lgdt %0\n"
         "pushq %1\n"              // Push code segment
@@ -135,10 +154,10 @@ void init() noexcept {
         "movw %%ax, %%gs\n"
         "movw %%ax, %%ss\n"
         :
-        : "m"(gdt_pointer), "i"(kernel_code), "i"(kernel_data)
+        : "m"(tables.pointer), "i"(kernel_code), "i"(kernel_data)
         : "rax", "memory"
     );
-    
+
     // Load TSS
     asm volatile(
         "movw %0, %%ax\n"
@@ -149,9 +168,18 @@ void init() noexcept {
     );
 }
 
+// Initialize the boot processor's GDT
+void init() noexcept {
+    load(bsp_tables, {
+        reinterpret_cast<uint64_t>(&interrupt_stack[sizeof(interrupt_stack)]),
+        reinterpret_cast<uint64_t>(&double_fault_stack[sizeof(double_fault_stack)]),
+        reinterpret_cast<uint64_t>(&nmi_stack[sizeof(nmi_stack)])
+    });
+}
+
 // Set kernel stack for interrupts
-void set_kernel_stack(uint64_t stack_ptr) noexcept {
-    system_tss.rsp0 = stack_ptr;
+void set_kernel_stack(cpu_tables& tables, uint64_t stack_ptr) noexcept {
+    tables.task_state.rsp0 = stack_ptr;
 }
 
 // Get current code segment
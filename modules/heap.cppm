@@ -3,6 +3,8 @@ module;
 #include "../include/freestanding/atomic.hpp"
 
 export module hft.heap;
+import hft.core;
+import hft.concurrent;
 import hft.vmm;
 import hft.pmm;
 
@@ -10,14 +12,38 @@ export namespace hft::heap {
 using namespace hft;
 
 constexpr size_t slab_sizes[] = {
-    16, 32, 64, 128, 256, 512, 1024, 2048, 4096
+    16, 32, 64, 128, 256, 512, 1024, 2048
 };
 constexpr size_t num_slabs = sizeof(slab_sizes) / sizeof(slab_sizes[0]);
+constexpr size_t max_slab_size = slab_sizes[num_slabs - 1];
+
+// Size class for each 16-byte step of request size, indexed by
+// (size - 1) >> 4
+constexpr auto size_class_table = [] {
+    struct table {
+        uint8_t index[max_slab_size / 16];
+    } t{};
+    size_t cls = 0;
+    for (size_t i = 0; i < max_slab_size / 16; ++i) {
+        while (slab_sizes[cls] < (i + 1) * 16) {
+            ++cls;
+        }
+        t.index[i] = static_cast<uint8_t>(cls);
+    }
+    return t;
+}();
+
+// Per-CPU magazines: each core caches up to magazine_size free objects
+// per size class and moves magazine_batch at a time to or from the shared
+// slab lists, so a typical kmalloc/kfree touches only core-local lines.
+constexpr size_t magazine_size = 32;
+constexpr size_t magazine_batch = magazine_size / 2;
 
 class slab_allocator {
 private:
     struct slab_header {
         slab_header* next;
+        slab_header* prev;
         size_t size;
         size_t free_count;
         uint64_t free_bitmap[8];
@@ -25,35 +51,136 @@ private:
     
     size_t object_size;
     size_t objects_per_slab;
+    uint32_t node;  // NUMA node slab pages come from
+    concurrent::spinlock lock_;  // Guards the slab lists and counters
     slab_header* partial_slabs;
     slab_header* full_slabs;
     slab_header* empty_slabs;
-    atomic<size_t> total_objects;
+    atomic<size_t> total_objects;  // Written under lock_, read without it
     atomic<size_t> free_objects;
-    
+
 public:
-    void init(size_t size) noexcept;
+    void init(size_t size, uint32_t numa_node) noexcept;
     void* allocate() noexcept;
     void free(void* ptr) noexcept;
+    
+    // Move up to count objects out of / back into the slabs under a
+    // single lock hold (magazine refill and flush)
+    size_t allocate_batch(void** out, size_t count) noexcept;
+    void free_batch(void* const* objects, size_t count) noexcept;
+    
     size_t get_object_size() const noexcept { return object_size; }
-    size_t get_free_objects() const noexcept { 
-        return free_objects.load(memory_order::relaxed); 
+    uint32_t get_node() const noexcept { return node; }
+    size_t get_free_objects() const noexcept {
+        return free_objects.load(memory_order::relaxed);
     }
-    size_t get_total_objects() const noexcept { 
-        return total_objects.load(memory_order::relaxed); 
+    size_t get_total_objects() const noexcept {
+        return total_objects.load(memory_order::relaxed);
     }
-    
+
 private:
     slab_header* create_slab() noexcept;
-    void* allocate_from_slab(slab_header* slab) noexcept;
-    void move_slab_to_list(slab_header* slab, slab_header** list) noexcept;
+    void* take_object() noexcept;
+    void put_object(void* ptr) noexcept;
+    void push(slab_header* slab, slab_header** list) noexcept;
+    void unlink(slab_header* slab, slab_header** list) noexcept;
 };
 
-struct large_allocation {
-    large_allocation* next;
-    large_allocation* prev;
-    size_t size;
-    size_t pages;
+// What a heap page is used for
+enum class page_kind : uint8_t {
+    unused,
+    slab,   // Slab page of one size class
+    large   // First page of a page-granular allocation
+};
+
+struct page_descriptor {
+    page_kind kind;
+    uint32_t pages;             // large: pages in the allocation
+    union {
+        slab_allocator* slab;   // slab: owning size class
+        size_t size;            // large: requested bytes
+    };
+};
+
+// Descriptors for heap pages, indexed by virtual page number through a
+// three-level radix map over the vmm region space. Tables are allocated
+// on first use; lookups take no lock.
+class page_map {
+    static constexpr size_t leaf_bits = 8;    // 256 descriptors: one page
+    static constexpr size_t mid_bits = 9;     // 512 pointers: one page
+    static constexpr size_t root_bits = 12;
+    
+    struct leaf {
+        page_descriptor entries[1 << leaf_bits];
+    };
+    struct mid {
+        atomic<leaf*> leaves[1 << mid_bits];
+    };
+    
+    atomic<mid*> root_[1 << root_bits];
+    
+    static uint64_t page_index(uint64_t virt) noexcept {
+        return (virt - vmm::REGION_BASE) >> 12;
+    }
+    
+    template<typename T>
+    static T* create_table() noexcept;
+    
+public:
+    // 2 TiB of region space above vmm::REGION_BASE
+    static constexpr uint64_t span = 1ULL << (12 + leaf_bits + mid_bits + root_bits);
+    
+    // Descriptor for the page holding virt, or nullptr if it was never
+    // recorded (not heap memory)
+    [[nodiscard]] page_descriptor* find(uint64_t virt) const noexcept {
+        if (virt < vmm::REGION_BASE || virt - vmm::REGION_BASE >= span) return nullptr;
+        
+        const uint64_t index = page_index(virt);
+        mid* m = root_[index >> (leaf_bits + mid_bits)].load(memory_order::acquire);
+        if (!m) return nullptr;
+        
+        leaf* l = m->leaves[(index >> leaf_bits) & ((1 << mid_bits) - 1)].load(memory_order::acquire);
+        if (!l) return nullptr;
+        
+        return &l->entries[index & ((1 << leaf_bits) - 1)];
+    }
+    
+    // Descriptor for virt, creating tables as needed (nullptr when out of
+    // range or out of memory). Caller holds page_lock.
+    [[nodiscard]] page_descriptor* get(uint64_t virt) noexcept {
+        if (virt < vmm::REGION_BASE || virt - vmm::REGION_BASE >= span) return nullptr;
+        
+        const uint64_t index = page_index(virt);
+        auto& m_slot = root_[index >> (leaf_bits + mid_bits)];
+        mid* m = m_slot.load(memory_order::relaxed);
+        if (!m) {
+            if (!(m = create_table<mid>())) return nullptr;
+            m_slot.store(m, memory_order::release);
+        }
+        
+        auto& l_slot = m->leaves[(index >> leaf_bits) & ((1 << mid_bits) - 1)];
+        leaf* l = l_slot.load(memory_order::relaxed);
+        if (!l) {
+            if (!(l = create_table<leaf>())) return nullptr;
+            l_slot.store(l, memory_order::release);
+        }
+        
+        return &l->entries[index & ((1 << leaf_bits) - 1)];
+    }
+};
+
+// A core's magazine for one size class (a LIFO stack, hottest on top)
+struct magazine {
+    size_t count;
+    void* objects[magazine_size];
+};
+
+// Per-CPU heap state, allocated on first use from the core's own node.
+// Only the owning core writes it; get_stats() reads it from anywhere.
+struct cpu_cache {
+    magazine magazines[num_slabs];
+    uint32_t node;
+    atomic<int64_t> used;  // Bytes allocated minus bytes freed on this core
 };
 
 struct heap_stats {
@@ -63,20 +190,37 @@ struct heap_stats {
     size_t slab_total[num_slabs];
 };
 
-inline slab_allocator slabs[num_slabs];
-inline large_allocation* large_allocations;
-inline atomic<size_t> heap_used;
+// One set of size classes per NUMA node, so objects come from local pages
+inline slab_allocator slabs[pmm::MAX_NODES][num_slabs];
+inline atomic<cpu_cache*> cpu_caches[topology::MAX_APIC_IDS];
+inline page_map page_table;
+inline concurrent::spinlock page_lock;   // Serializes heap calls into vmm/pmm
+                                         // and page_table updates
+inline atomic<int64_t> shared_used;      // Usage by cores without a cache
 inline atomic<size_t> heap_allocated;
 
 void init() noexcept;
 void* kmalloc(size_t size) noexcept;
+void* kmalloc_node(size_t size, uint32_t node) noexcept;
 void kfree(void* ptr) noexcept;
 heap_stats get_stats() noexcept;
-slab_allocator* find_slab(size_t size) noexcept;
+slab_allocator* find_slab(size_t size, uint32_t node) noexcept;
 
 // Implementation inline in module
-void slab_allocator::init(size_t size) noexcept {
+template<typename T>
+T* page_map::create_table() noexcept {
+    static_assert(sizeof(T) == pmm::PAGE_SIZE);
+    
+    const uint64_t virt = vmm::allocate_region(1);
+    if (!virt) return nullptr;
+    
+    memset(reinterpret_cast<void*>(virt), 0, pmm::PAGE_SIZE);
+    return reinterpret_cast<T*>(virt);
+}
+
+void slab_allocator::init(size_t size, uint32_t numa_node) noexcept {
     object_size = size;
+    node = numa_node;
     objects_per_slab = (pmm::PAGE_SIZE - sizeof(slab_header)) / size;
     if (objects_per_slab > 512) objects_per_slab = 512;
     
@@ -88,27 +232,84 @@ void slab_allocator::init(size_t size) noexcept {
 }
 
 void* slab_allocator::allocate() noexcept {
-    if (partial_slabs) return allocate_from_slab(partial_slabs);
+    concurrent::spin_guard guard(lock_);
     
-    if (empty_slabs) {
-        slab_header* slab = empty_slabs;
-        empty_slabs = slab->next;
-        slab->next = partial_slabs;
-        partial_slabs = slab;
-        return allocate_from_slab(slab);
+    void* ptr = take_object();
+    if (ptr) {
+        free_objects.store(free_objects.load(memory_order::relaxed) - 1, memory_order::relaxed);
     }
-    
-    slab_header* slab = create_slab();
-    if (!slab) return nullptr;
-    
-    slab->next = partial_slabs;
-    partial_slabs = slab;
-    return allocate_from_slab(slab);
+    return ptr;
 }
 
 void slab_allocator::free(void* ptr) noexcept {
     if (!ptr) return;
     
+    concurrent::spin_guard guard(lock_);
+    put_object(ptr);
+    free_objects.store(free_objects.load(memory_order::relaxed) + 1, memory_order::relaxed);
+}
+
+size_t slab_allocator::allocate_batch(void** out, size_t count) noexcept {
+    concurrent::spin_guard guard(lock_);
+    
+    size_t taken = 0;
+    while (taken < count) {
+        void* ptr = take_object();
+        if (!ptr) break;
+        out[taken++] = ptr;
+    }
+    free_objects.store(free_objects.load(memory_order::relaxed) - taken, memory_order::relaxed);
+    return taken;
+}
+
+void slab_allocator::free_batch(void* const* objects, size_t count) noexcept {
+    concurrent::spin_guard guard(lock_);
+    
+    for (size_t i = 0; i < count; ++i) {
+        put_object(objects[i]);
+    }
+    free_objects.store(free_objects.load(memory_order::relaxed) + count, memory_order::relaxed);
+}
+
+// Lock held: one object from a partial, empty or new slab
+void* slab_allocator::take_object() noexcept {
+    slab_header* slab = partial_slabs;
+    
+    if (!slab && empty_slabs) {
+        slab = empty_slabs;
+        unlink(slab, &empty_slabs);
+        push(slab, &partial_slabs);
+    }
+    
+    if (!slab) {
+        slab = create_slab();
+        if (!slab) return nullptr;
+        push(slab, &partial_slabs);
+    }
+    
+    for (size_t i = 0; i < 8; ++i) {
+        if (slab->free_bitmap[i]) {
+            int bit = __builtin_ctzll(slab->free_bitmap[i]);
+            slab->free_bitmap[i] &= ~(1ULL << bit);
+            slab->free_count--;
+            
+            uint64_t slab_addr = reinterpret_cast<uint64_t>(slab);
+            uint64_t obj_addr = slab_addr + sizeof(slab_header) +
+                               (i * 64 + bit) * object_size;
+            
+            if (slab->free_count == 0) {
+                unlink(slab, &partial_slabs);
+                push(slab, &full_slabs);
+            }
+            
+            return reinterpret_cast<void*>(obj_addr);
+        }
+    }
+    return nullptr;
+}
+
+// Lock held: return an object to its slab
+void slab_allocator::put_object(void* ptr) noexcept {
     uint64_t addr = reinterpret_cast<uint64_t>(ptr);
     uint64_t slab_addr = addr & ~(pmm::PAGE_SIZE - 1);
     slab_header* slab = reinterpret_cast<slab_header*>(slab_addr);
@@ -119,186 +320,459 @@ void slab_allocator::free(void* ptr) noexcept {
     size_t bitmap_idx = obj_idx / 64;
     size_t bit_idx = obj_idx % 64;
     slab->free_bitmap[bitmap_idx] |= (1ULL << bit_idx);
-    slab->free_count++;
-    free_objects.fetch_add(1, memory_order::relaxed);
     
+    const bool was_full = slab->free_count++ == 0;
     if (slab->free_count == objects_per_slab) {
-        move_slab_to_list(slab, &empty_slabs);
-    } else if (slab->free_count == 1) {
-        move_slab_to_list(slab, &partial_slabs);
+        unlink(slab, was_full ? &full_slabs : &partial_slabs);
+        push(slab, &empty_slabs);
+    } else if (was_full) {
+        unlink(slab, &full_slabs);
+        push(slab, &partial_slabs);
     }
 }
 
 slab_allocator::slab_header* slab_allocator::create_slab() noexcept {
-    uint64_t virt = vmm::allocate_region(1);
-    if (!virt) return nullptr;
+    uint64_t virt;
+    {
+        concurrent::spin_guard guard(page_lock);
+        virt = vmm::allocate_region(1, vmm::present | vmm::writable, node);
+        if (!virt) return nullptr;
+        
+        page_descriptor* desc = page_table.get(virt);
+        if (!desc) {
+            vmm::free_region(virt, 1);
+            return nullptr;
+        }
+        desc->kind = page_kind::slab;
+        desc->slab = this;
+    }
     
     slab_header* slab = reinterpret_cast<slab_header*>(virt);
     slab->next = nullptr;
+    slab->prev = nullptr;
     slab->size = object_size;
     slab->free_count = objects_per_slab;
     
     for (size_t i = 0; i < 8; ++i) {
         if (i * 64 < objects_per_slab) {
-            slab->free_bitmap[i] = (objects_per_slab - i * 64 >= 64) ? 
-                0xFFFFFFFFFFFFFFFF : 
+            slab->free_bitmap[i] = (objects_per_slab - i * 64 >= 64) ?
+                0xFFFFFFFFFFFFFFFF :
                 (1ULL << (objects_per_slab - i * 64)) - 1;
         } else {
             slab->free_bitmap[i] = 0;
         }
     }
     
-    total_objects.fetch_add(objects_per_slab, memory_order::relaxed);
-    free_objects.fetch_add(objects_per_slab, memory_order::relaxed);
+    total_objects.store(total_objects.load(memory_order::relaxed) + objects_per_slab,
+                        memory_order::relaxed);
+    free_objects.store(free_objects.load(memory_order::relaxed) + objects_per_slab,
+                       memory_order::relaxed);
     
     return slab;
 }
 
-void* slab_allocator::allocate_from_slab(slab_header* slab) noexcept {
-    for (size_t i = 0; i < 8; ++i) {
-        if (slab->free_bitmap[i]) {
-            int bit = __builtin_ctzll(slab->free_bitmap[i]);
-            slab->free_bitmap[i] &= ~(1ULL << bit);
-            slab->free_count--;
-            free_objects.fetch_add(-1, memory_order::relaxed);
-            
-            uint64_t slab_addr = reinterpret_cast<uint64_t>(slab);
-            uint64_t obj_addr = slab_addr + sizeof(slab_header) + 
-                               (i * 64 + bit) * object_size;
-            
-            if (slab->free_count == 0) {
-                move_slab_to_list(slab, &full_slabs);
-            }
-            
-            return reinterpret_cast<void*>(obj_addr);
-        }
+void slab_allocator::push(slab_header* slab, slab_header** list) noexcept {
+    slab->prev = nullptr;
+    slab->next = *list;
+    if (*list) (*list)->prev = slab;
+    *list = slab;
+}
+
+void slab_allocator::unlink(slab_header* slab, slab_header** list) noexcept {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
     }
-    return nullptr;
+    if (slab->next) slab->next->prev = slab->prev;
 }
 
-void slab_allocator::move_slab_to_list(slab_header* slab, slab_header** list) noexcept {
-    if (slab == partial_slabs) {
-        partial_slabs = slab->next;
-    } else if (slab == full_slabs) {
-        full_slabs = slab->next;
-    } else if (slab == empty_slabs) {
-        empty_slabs = slab->next;
+} // namespace hft::heap
+
+namespace hft::heap {
+
+void add_used(cpu_cache* cache, int64_t bytes) noexcept {
+    if (cache) {
+        // Single writer: a plain load/store, no locked RMW
+        cache->used.store(cache->used.load(memory_order::relaxed) + bytes, memory_order::relaxed);
+    } else {
+        shared_used.fetch_add(bytes, memory_order::relaxed);
     }
+}
+
+[[gnu::noinline]] cpu_cache* create_cache(uint32_t cpu) noexcept {
+    uint32_t node = topology::apic_node[cpu];
+    if (node >= pmm::node_count) node = 0;
     
-    slab->next = *list;
-    *list = slab;
+    uint64_t virt;
+    {
+        concurrent::spin_guard guard(page_lock);
+        virt = vmm::allocate_region((sizeof(cpu_cache) + pmm::PAGE_SIZE - 1) / pmm::PAGE_SIZE,
+                                    vmm::present | vmm::writable, node);
+    }
+    if (!virt) return nullptr;
+    
+    auto* cache = reinterpret_cast<cpu_cache*>(virt);
+    memset(cache, 0, sizeof(cpu_cache));
+    cache->node = node;
+    cpu_caches[cpu].store(cache, memory_order::release);
+    return cache;
 }
 
-void init() noexcept {
-    for (size_t i = 0; i < num_slabs; ++i) {
-        slabs[i].init(slab_sizes[i]);
+// Calling core's cache (created on its first allocation), or nullptr if
+// no memory could be found for it
+inline cpu_cache* local_cache() noexcept {
+    const uint32_t cpu = topology::current_cpu();
+    cpu_cache* cache = cpu_caches[cpu].load(memory_order::relaxed);
+    if (!cache) [[unlikely]] {
+        cache = create_cache(cpu);
     }
+    return cache;
+}
+
+// Page-granular allocation for requests above the largest size class;
+// the pointer is page aligned and the length lives in its descriptor
+void* allocate_large(size_t size, uint32_t node) noexcept {
+    const size_t pages = (size + pmm::PAGE_SIZE - 1) / pmm::PAGE_SIZE;
     
-    large_allocations = nullptr;
-    heap_used.store(0, memory_order::relaxed);
-    heap_allocated.store(0, memory_order::relaxed);
+    concurrent::spin_guard guard(page_lock);
+    const uint64_t virt = vmm::allocate_region(pages, vmm::present | vmm::writable, node);
+    if (!virt) return nullptr;
+    
+    page_descriptor* desc = page_table.get(virt);
+    if (!desc) {
+        vmm::free_region(virt, pages);
+        return nullptr;
+    }
+    desc->kind = page_kind::large;
+    desc->pages = static_cast<uint32_t>(pages);
+    desc->size = size;
+    
+    heap_allocated.fetch_add(pages * pmm::PAGE_SIZE, memory_order::relaxed);
+    return reinterpret_cast<void*>(virt);
 }
 
-void* kmalloc(size_t size) noexcept {
+void free_large(uint64_t virt, page_descriptor* desc) noexcept {
+    concurrent::spin_guard guard(page_lock);
+    
+    const size_t pages = desc->pages;
+    desc->kind = page_kind::unused;
+    heap_allocated.fetch_add(-pages * pmm::PAGE_SIZE, memory_order::relaxed);
+    
+    vmm::free_region(virt, pages);
+}
+
+void* allocate_on(cpu_cache* cache, size_t size, uint32_t node) noexcept {
     if (size == 0) return nullptr;
+    if (node >= pmm::node_count) node = 0;
     
     size_t alloc_size = size + sizeof(size_t);
+    if (alloc_size > max_slab_size) {
+        void* ptr = allocate_large(size, node);
+        if (ptr) add_used(cache, static_cast<int64_t>(size));
+        return ptr;
+    }
     
-    if (alloc_size <= 4096) {
-        slab_allocator* slab = find_slab(alloc_size);
-        if (!slab) return nullptr;
-        
-        void* ptr = slab->allocate();
-        if (!ptr) return nullptr;
-        
-        *static_cast<size_t*>(ptr) = size;
-        heap_used.fetch_add(size, memory_order::relaxed);
-        
-        return static_cast<uint8_t*>(ptr) + sizeof(size_t);
+    slab_allocator* slab = find_slab(alloc_size, node);
+    void* ptr;
+    
+    if (cache && cache->node == node) [[likely]] {
+        magazine& mag = cache->magazines[slab - slabs[node]];
+        if (mag.count == 0) {
+            mag.count = slab->allocate_batch(mag.objects, magazine_batch);
+        }
+        ptr = mag.count ? mag.objects[--mag.count] : nullptr;
     } else {
-        size_t pages = (alloc_size + pmm::PAGE_SIZE - 1) / pmm::PAGE_SIZE;
-        uint64_t virt = vmm::allocate_region(pages);
-        if (!virt) return nullptr;
-        
-        auto* header = reinterpret_cast<large_allocation*>(virt);
-        header->next = large_allocations;
-        header->prev = nullptr;
-        header->size = size;
-        header->pages = pages;
-        
-        if (large_allocations) {
-            large_allocations->prev = header;
+        ptr = slab->allocate();  // Remote node: straight from its slabs
+    }
+    if (!ptr) return nullptr;
+    
+    *static_cast<size_t*>(ptr) = size;
+    add_used(cache, static_cast<int64_t>(size));
+    
+    return static_cast<uint8_t*>(ptr) + sizeof(size_t);
+}
+
+} // namespace hft::heap
+
+export namespace hft::heap {
+
+void init() noexcept {
+    for (uint32_t node = 0; node < pmm::MAX_NODES; ++node) {
+        for (size_t i = 0; i < num_slabs; ++i) {
+            slabs[node][i].init(slab_sizes[i], node);
         }
-        large_allocations = header;
-        
-        heap_used.fetch_add(size, memory_order::relaxed);
-        heap_allocated.fetch_add(pages * pmm::PAGE_SIZE, memory_order::relaxed);
-        
-        return header + 1;
     }
+    for (size_t cpu = 0; cpu < topology::MAX_APIC_IDS; ++cpu) {
+        cpu_caches[cpu].store(nullptr, memory_order::relaxed);
+    }
+    
+    shared_used.store(0, memory_order::relaxed);
+    heap_allocated.store(0, memory_order::relaxed);
+}
+
+// Allocate from the calling core's NUMA node.
+// Safe on any core; not for use from interrupt handlers, which could
+// interrupt the same core's magazine mid-update.
+void* kmalloc(size_t size) noexcept {
+    cpu_cache* cache = local_cache();
+    return allocate_on(cache, size, cache ? cache->node : topology::current_node());
+}
+
+// Allocate backed by memory on a given NUMA node (falling back to the
+// nearest node with free pages). Only the caller's own node goes through
+// the per-CPU magazines.
+void* kmalloc_node(size_t size, uint32_t node) noexcept {
+    return allocate_on(local_cache(), size, node);
 }
 
+// O(1): the page descriptor says whether ptr is a slab object or a large
+// allocation; pointers the heap never handed out are ignored
 void kfree(void* ptr) noexcept {
     if (!ptr) return;
     
     uint64_t addr = reinterpret_cast<uint64_t>(ptr);
-    uint64_t page_addr = addr & ~(pmm::PAGE_SIZE - 1);
+    page_descriptor* desc = page_table.find(addr);
+    if (!desc || desc->kind == page_kind::unused) return;
     
-    if (addr - page_addr == sizeof(large_allocation)) {
-        auto* header = static_cast<large_allocation*>(ptr) - 1;
+    cpu_cache* cache = local_cache();
+    
+    if (desc->kind == page_kind::large) {
+        if (addr & (pmm::PAGE_SIZE - 1)) return;  // Not the allocation start
         
-        for (auto* alloc = large_allocations; alloc; alloc = alloc->next) {
-            if (alloc == header) {
-                if (header->prev) {
-                    header->prev->next = header->next;
-                } else {
-                    large_allocations = header->next;
-                }
-                if (header->next) {
-                    header->next->prev = header->prev;
-                }
-                
-                heap_used.fetch_add(-header->size, memory_order::relaxed);
-                heap_allocated.fetch_add(-header->pages * pmm::PAGE_SIZE, memory_order::relaxed);
-                
-                vmm::free_region(reinterpret_cast<uint64_t>(header), header->pages);
-                return;
-            }
-        }
+        add_used(cache, -static_cast<int64_t>(desc->size));
+        free_large(addr, desc);
+        return;
     }
     
     uint8_t* real_ptr = static_cast<uint8_t*>(ptr) - sizeof(size_t);
     size_t size = *reinterpret_cast<size_t*>(real_ptr);
+    add_used(cache, -static_cast<int64_t>(size));
     
-    heap_used.fetch_add(-size, memory_order::relaxed);
+    // Objects go back to the node they came from, not the caller's
+    slab_allocator* owner = desc->slab;
+    if (!cache || owner->get_node() != cache->node) {
+        owner->free(real_ptr);
+        return;
+    }
     
-    size_t alloc_size = size + sizeof(size_t);
-    slab_allocator* slab = find_slab(alloc_size);
-    if (slab) {
-        slab->free(real_ptr);
+    // Full magazine: flush the coldest half (the bottom) to the slabs
+    magazine& mag = cache->magazines[owner - slabs[cache->node]];
+    if (mag.count == magazine_size) {
+        owner->free_batch(mag.objects, magazine_batch);
+        memcpy(mag.objects, mag.objects + magazine_batch,
+               (magazine_size - magazine_batch) * sizeof(void*));
+        mag.count -= magazine_batch;
     }
+    mag.objects[mag.count++] = real_ptr;
 }
 
+// Totals across cores; per-CPU parts are read without stopping them, so
+// the snapshot is approximate while allocations are in flight
 heap_stats get_stats() noexcept {
     heap_stats stats;
-    stats.used = heap_used.load(memory_order::relaxed);
+    int64_t used = shared_used.load(memory_order::relaxed);
     stats.allocated = heap_allocated.load(memory_order::relaxed);
     
     for (size_t i = 0; i < num_slabs; ++i) {
-        stats.slab_free[i] = slabs[i].get_free_objects();
-        stats.slab_total[i] = slabs[i].get_total_objects();
+        stats.slab_free[i] = 0;
+        stats.slab_total[i] = 0;
+        for (uint32_t node = 0; node < pmm::node_count; ++node) {
+            stats.slab_free[i] += slabs[node][i].get_free_objects();
+            stats.slab_total[i] += slabs[node][i].get_total_objects();
+        }
+    }
+    
+    // Objects parked in magazines are free as well
+    for (size_t cpu = 0; cpu < topology::MAX_APIC_IDS; ++cpu) {
+        const cpu_cache* cache = cpu_caches[cpu].load(memory_order::acquire);
+        if (!cache) continue;
+        
+        used += cache->used.load(memory_order::relaxed);
+        for (size_t i = 0; i < num_slabs; ++i) {
+            stats.slab_free[i] += *static_cast<const volatile size_t*>(&cache->magazines[i].count);
+        }
     }
     
+    stats.used = used > 0 ? static_cast<size_t>(used) : 0;
     return stats;
 }
 
-slab_allocator* find_slab(size_t size) noexcept {
-    for (size_t i = 0; i < num_slabs; ++i) {
-        if (slab_sizes[i] >= size) {
-            return &slabs[i];
+slab_allocator* find_slab(size_t size, uint32_t node) noexcept {
+    if (size == 0 || size > max_slab_size) return nullptr;
+    return &slabs[node][size_class_table.index[(size - 1) >> 4]];
+}
+
+// Monotonic allocator over one virtual region, for scratch memory that
+// dies together (a message, a session). allocate() bumps an offset;
+// reset() and rewind() release everything after a point in O(1). Nothing
+// goes near the slab lists, and no destructors run on release.
+// Not thread-safe: use one arena per core or per session.
+class arena : non_copyable {
+    uint64_t base_ = 0;
+    size_t capacity_ = 0;
+    size_t used_ = 0;
+    size_t high_water_ = 0;
+    vmm::page_size page_ = vmm::page_size::small;
+    
+public:
+    // Position to rewind to; later allocations are released together
+    struct mark {
+        size_t offset;
+    };
+    
+    arena() noexcept = default;
+    ~arena() { destroy(); }
+    
+    // Back the arena with at least bytes of mapped memory, optionally on
+    // 2 MiB / 1 GiB pages (one TLB entry per page). Memory is mapped up
+    // front, so allocation never faults into the page allocator.
+    [[nodiscard]] bool init(size_t bytes, vmm::page_size page = vmm::page_size::small,
+                            uint32_t node = topology::current_node()) noexcept {
+        if (base_) return false;
+        if (page == vmm::page_size::huge && !vmm::huge_pages_supported()) {
+            page = vmm::page_size::large;  // Free with the size actually mapped
+        }
+        
+        const uint64_t unit = vmm::page_bytes(page);
+        const size_t rounded = (bytes + unit - 1) & ~(unit - 1);
+        
+        uint64_t virt;
+        {
+            concurrent::spin_guard guard(page_lock);
+            virt = vmm::allocate_large_region(rounded, page, vmm::present | vmm::writable, node);
         }
+        if (!virt) return false;
+        
+        base_ = virt;
+        capacity_ = rounded;
+        used_ = 0;
+        high_water_ = 0;
+        page_ = page;
+        return true;
     }
-    return nullptr;
-}
+    
+    void destroy() noexcept {
+        if (!base_) return;
+        
+        concurrent::spin_guard guard(page_lock);
+        vmm::free_large_region(base_, capacity_, page_);
+        base_ = 0;
+        capacity_ = used_ = 0;
+    }
+    
+    // bytes aligned to align (a power of two), or nullptr when full
+    [[nodiscard]] void* allocate(size_t bytes, size_t align = 16) noexcept {
+        const size_t offset = (used_ + align - 1) & ~(align - 1);
+        if (offset + bytes > capacity_ || offset + bytes < offset) [[unlikely]] {
+            return nullptr;
+        }
+        
+        used_ = offset + bytes;
+        return reinterpret_cast<void*>(base_ + offset);
+    }
+    
+    template<typename T>
+    [[nodiscard]] T* allocate_array(size_t count) noexcept {
+        if (count > capacity_ / sizeof(T)) return nullptr;
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+    
+    template<typename T, typename... Args>
+    [[nodiscard]] T* create(Args&&... args) noexcept {
+        void* ptr = allocate(sizeof(T), alignof(T));
+        return ptr ? construct_at(static_cast<T*>(ptr), static_cast<Args&&>(args)...) : nullptr;
+    }
+    
+    [[nodiscard]] mark get_mark() const noexcept { return {used_}; }
+    
+    void rewind(mark m) noexcept {
+        if (m.offset < used_) {
+            high_water_ = max(high_water_, used_);
+            used_ = m.offset;
+        }
+    }
+    
+    void reset() noexcept { rewind({0}); }
+    
+    [[nodiscard]] void* base() const noexcept { return reinterpret_cast<void*>(base_); }
+    [[nodiscard]] size_t used() const noexcept { return used_; }
+    [[nodiscard]] size_t capacity() const noexcept { return capacity_; }
+    [[nodiscard]] size_t remaining() const noexcept { return capacity_ - used_; }
+    
+    // Peak usage across resets, for sizing
+    [[nodiscard]] size_t high_water() const noexcept { return max(high_water_, used_); }
+};
+
+// Nested scope on an arena: everything allocated while it is alive is
+// released when it ends
+class arena_scope : non_copyable {
+    arena& arena_;
+    arena::mark mark_;
+    
+public:
+    explicit arena_scope(arena& a) noexcept : arena_(a), mark_(a.get_mark()) {}
+    ~arena_scope() { arena_.rewind(mark_); }
+};
+
+// Typed pool with an intrusive free list. Slots are carved from an arena
+// chunk_size at a time and destroy() puts them back for reuse, so steady
+// state create/destroy is a pointer pop/push. Resetting the source arena
+// invalidates the pool; call reset() on it as well.
+template<typename T>
+class object_pool : non_copyable {
+    union slot {
+        slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+    
+    arena& source_;
+    slot* free_ = nullptr;
+    size_t chunk_size_;
+    size_t live_ = 0;
+    
+    [[gnu::noinline]] bool refill() noexcept {
+        slot* chunk = source_.allocate_array<slot>(chunk_size_);
+        if (!chunk) return false;
+        
+        for (size_t i = chunk_size_; i-- > 0;) {
+            chunk[i].next = free_;
+            free_ = &chunk[i];
+        }
+        return true;
+    }
+    
+public:
+    explicit object_pool(arena& source, size_t chunk_size = 64) noexcept
+        : source_(source), chunk_size_(chunk_size ? chunk_size : 1) {}
+    
+    template<typename... Args>
+    [[nodiscard]] T* create(Args&&... args) noexcept {
+        if (!free_ && !refill()) [[unlikely]] return nullptr;
+        
+        slot* s = free_;
+        free_ = s->next;
+        ++live_;
+        return construct_at(reinterpret_cast<T*>(s->storage), static_cast<Args&&>(args)...);
+    }
+    
+    void destroy(T* object) noexcept {
+        if (!object) return;
+        
+        destroy_at(object);
+        slot* s = reinterpret_cast<slot*>(object);
+        s->next = free_;
+        free_ = s;
+        --live_;
+    }
+    
+    // Forget every slot (after the source arena was reset or rewound)
+    void reset() noexcept {
+        free_ = nullptr;
+        live_ = 0;
+    }
+    
+    [[nodiscard]] size_t live() const noexcept { return live_; }
+};
 
 } // namespace hft::heap
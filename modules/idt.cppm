@@ -4,6 +4,7 @@ module;
 
 export module hft.idt;
 import hft.gdt;
+import hft.apic;
 
 export namespace hft::idt {
 
@@ -133,8 +134,15 @@ extern "C" {
     void irq4(); void irq5(); void irq6(); void irq7();
     void irq8(); void irq9(); void irq10(); void irq11();
     void irq12(); void irq13(); void irq14(); void irq15();
+    
+    void isr_apic_timer();
+    void isr_spurious();
 }
 
+// Local APIC vectors, above every device vector so they win on priority
+constexpr uint8_t apic_timer_vector = 0xEF;
+constexpr uint8_t spurious_vector = 0xFF;  // No EOI is sent for it
+
 // Set an IDT entry
 void set_gate(uint8_t num, uint64_t handler_addr, uint16_t selector, 
               uint8_t type, uint8_t ist = 0) noexcept {
@@ -161,20 +169,16 @@ extern "C" void interrupt_handler_common(cpu_context* ctx) {
         // For now, just acknowledge the interrupt
     }
     
-    // Send EOI to PIC if this was an IRQ
-    if (ctx->int_no >= 32 && ctx->int_no < 48) {
-        // Send EOI to master PIC
-        asm volatile("movb $0x20, %%al; outb %%al, $0x20" ::: "al");
-        
-        // Send EOI to slave PIC if necessary
-        if (ctx->int_no >= 40) {
-            asm volatile("movb $0x20, %%al; outb %%al, $0xA0" ::: "al");
-        }
+    // Interrupts from the local APIC or I/O APIC need an EOI
+    if (ctx->int_no >= 32 && ctx->int_no != spurious_vector) {
+        apic::eoi();
     }
 }
 
-// Initialize PIC (8259A)
-void init_pic() noexcept {
+// Take the 8259A PICs out of the way: remap them above the exception
+// vectors (a spurious IRQ 7/15 then lands on 39/47, not on a fault) and
+// mask every line. Device interrupts go through the I/O APIC instead.
+void disable_pic() noexcept {
     // ICW1 - begin initialization
     asm volatile(
         "movb $0x11, %%al\n"
@@ -209,7 +213,7 @@ void init_pic() noexcept {
         ::: "al"
     );
     
-    // Mask all interrupts initially
+    // Mask everything
     asm volatile(
         "movb $0xFF, %%al\n"
         "outb %%al, $0x21\n"
@@ -218,59 +222,6 @@ void init_pic() noexcept {
     );
 }
 
-// Enable/disable specific IRQ
-void enable_irq(uint8_t irq_num) noexcept {
-    uint16_t port;
-    uint8_t value;
-    
-    if (irq_num < 8) {
-        port = 0x21;
-    } else {
-        port = 0xA1;
-        irq_num -= 8;
-    }
-    
-    asm volatile(
-        "inb %w1, %%al\n"
-        : "=a"(value)
-        : "Nd"(port)
-    );
-    
-    value &= ~(1 << irq_num);
-    
-    asm volatile(
-        "outb %%al, %w0\n"
-        :
-        : "Nd"(port), "a"(value)
-    );
-}
-
-void disable_irq(uint8_t irq_num) noexcept {
-    uint16_t port;
-    uint8_t value;
-    
-    if (irq_num < 8) {
-        port = 0x21;
-    } else {
-        port = 0xA1;
-        irq_num -= 8;
-    }
-    
-    asm volatile(
-        "inb %w1, %%al\n"
-        : "=a"(value)
-        : "Nd"(port)
-    );
-    
-    value |= (1 << irq_num);
-    
-    asm volatile(
-        "outb %%al, %w0\n"
-        :
-        : "Nd"(port), "a"(value)
-    );
-}
-
 // Initialize the IDT
 void init() noexcept {
     // Clear all handlers
@@ -279,13 +230,13 @@ void init() noexcept {
     // Set up exception handlers (0-31)
     set_gate(0, reinterpret_cast<uint64_t>(isr0), gdt::kernel_code, interrupt_gate);
     set_gate(1, reinterpret_cast<uint64_t>(isr1), gdt::kernel_code, interrupt_gate);
-    set_gate(2, reinterpret_cast<uint64_t>(isr2), gdt::kernel_code, interrupt_gate);
+    set_gate(2, reinterpret_cast<uint64_t>(isr2), gdt::kernel_code, interrupt_gate, gdt::ist_nmi);
     set_gate(3, reinterpret_cast<uint64_t>(isr3), gdt::kernel_code, trap_gate);
     set_gate(4, reinterpret_cast<uint64_t>(isr4), gdt::kernel_code, trap_gate);
     set_gate(5, reinterpret_cast<uint64_t>(isr5), gdt::kernel_code, interrupt_gate);
     set_gate(6, reinterpret_cast<uint64_t>(isr6), gdt::kernel_code, interrupt_gate);
     set_gate(7, reinterpret_cast<uint64_t>(isr7), gdt::kernel_code, interrupt_gate);
-    set_gate(8, reinterpret_cast<uint64_t>(isr8), gdt::kernel_code, interrupt_gate, 1);  // Double fault uses IST1
+    set_gate(8, reinterpret_cast<uint64_t>(isr8), gdt::kernel_code, interrupt_gate, gdt::ist_double_fault);
     set_gate(9, reinterpret_cast<uint64_t>(isr9), gdt::kernel_code, interrupt_gate);
     set_gate(10, reinterpret_cast<uint64_t>(isr10), gdt::kernel_code, interrupt_gate);
     set_gate(11, reinterpret_cast<uint64_t>(isr11), gdt::kernel_code, interrupt_gate);
@@ -323,8 +274,10 @@ void init() noexcept {
     set_gate(46, reinterpret_cast<uint64_t>(irq14), gdt::kernel_code, interrupt_gate);
     set_gate(47, reinterpret_cast<uint64_t>(irq15), gdt::kernel_code, interrupt_gate);
     
-    // Initialize PIC
-    init_pic();
+    set_gate(apic_timer_vector, reinterpret_cast<uint64_t>(isr_apic_timer), gdt::kernel_code, interrupt_gate);
+    set_gate(spurious_vector, reinterpret_cast<uint64_t>(isr_spurious), gdt::kernel_code, interrupt_gate);
+    
+    disable_pic();
     
     // Load IDT
     idt_pointer.limit = sizeof(idt) - 1;
@@ -333,6 +286,12 @@ void init() noexcept {
     asm volatile("lidt %0" : : "m"(idt_pointer));
 }
 
+// Load the shared IDT on an application processor (after init() on the BSP).
+// Gates only name the IST slot, so each core's own TSS supplies the stacks.
+void load() noexcept {
+    asm volatile("lidt %0" : : "m"(idt_pointer));
+}
+
 // Enable interrupts
 void enable() noexcept {
     asm volatile("sti");
@@ -0,0 +1,126 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+
+export module hft.ioapic;
+import hft.core;
+import hft.concurrent;
+import hft.vmm;
+import hft.acpi;
+
+// I/O APIC routing for device interrupts, replacing the 8259 PICs.
+// Every input starts masked; a driver routes its IRQ to a vector and a
+// destination core, normally a housekeeping core so that isolated cores
+// never see device interrupts.
+export namespace hft::ioapic {
+
+// Redirection entry bits
+enum redirection : uint32_t {
+    active_low = 1 << 13,
+    level_triggered = 1 << 15,
+    masked = 1 << 16
+};
+
+} // namespace hft::ioapic
+
+namespace hft::ioapic {
+
+constexpr uint32_t REG_VERSION = 0x01;
+constexpr uint32_t REG_REDIRECTION = 0x10;  // Two registers per input
+
+struct controller {
+    volatile uint32_t* registers;  // IOREGSEL at +0x00, IOWIN at +0x10
+    uint32_t gsi_base;
+    uint32_t inputs;
+};
+
+inline controller controllers[acpi::MAX_IO_APICS];
+inline size_t controller_count = 0;
+inline concurrent::spinlock lock;  // IOREGSEL/IOWIN pairs are not atomic
+
+uint32_t read(const controller& c, uint32_t reg) noexcept {
+    c.registers[0] = reg;
+    return c.registers[4];
+}
+
+void write(const controller& c, uint32_t reg, uint32_t value) noexcept {
+    c.registers[0] = reg;
+    c.registers[4] = value;
+}
+
+controller* controller_for(uint32_t gsi) noexcept {
+    for (size_t i = 0; i < controller_count; ++i) {
+        controller& c = controllers[i];
+        if (gsi >= c.gsi_base && gsi - c.gsi_base < c.inputs) return &c;
+    }
+    return nullptr;
+}
+
+// Redirection entry flags from MPS INTI flags; ISA defaults to edge,
+// active high
+uint32_t entry_flags(uint16_t inti) noexcept {
+    uint32_t flags = 0;
+    if ((inti & 0x3) == 0x3) flags |= active_low;
+    if (((inti >> 2) & 0x3) == 0x3) flags |= level_triggered;
+    return flags;
+}
+
+void set_mask(uint8_t irq, bool mask) noexcept {
+    const acpi::isa_route route = acpi::isa_irq_route(irq);
+    controller* c = controller_for(route.gsi);
+    if (!c) return;
+
+    const uint32_t reg = REG_REDIRECTION + 2 * (route.gsi - c->gsi_base);
+    concurrent::spin_guard guard(lock);
+    const uint32_t low = read(*c, reg);
+    write(*c, reg, mask ? (low | masked) : (low & ~masked));
+}
+
+} // namespace hft::ioapic
+
+export namespace hft::ioapic {
+
+// Map every I/O APIC from the MADT and mask all of its inputs. Returns
+// false if there is none (device IRQs then stay unavailable).
+bool init() noexcept {
+    for (const acpi::io_apic_info& info : acpi::io_apics()) {
+        const uint64_t virt = vmm::map_mmio(info.address, 4096);
+        if (virt == 0) continue;
+
+        controller& c = controllers[controller_count++];
+        c.registers = reinterpret_cast<volatile uint32_t*>(virt);
+        c.gsi_base = info.gsi_base;
+        c.inputs = ((read(c, REG_VERSION) >> 16) & 0xFF) + 1;
+
+        for (uint32_t input = 0; input < c.inputs; ++input) {
+            write(c, REG_REDIRECTION + 2 * input, masked);
+            write(c, REG_REDIRECTION + 2 * input + 1, 0);
+        }
+    }
+    return controller_count > 0;
+}
+
+// Deliver ISA IRQ irq (after MADT overrides) as vector to the core with
+// the given APIC ID, and unmask it
+bool route(uint8_t irq, uint8_t vector, uint32_t apic_id) noexcept {
+    const acpi::isa_route isa = acpi::isa_irq_route(irq);
+    controller* c = controller_for(isa.gsi);
+    if (!c) return false;
+
+    const uint32_t reg = REG_REDIRECTION + 2 * (isa.gsi - c->gsi_base);
+    concurrent::spin_guard guard(lock);
+    write(*c, reg, masked);
+    write(*c, reg + 1, apic_id << 24);  // Physical destination mode
+    write(*c, reg, vector | entry_flags(isa.flags));
+    return true;
+}
+
+void enable_irq(uint8_t irq) noexcept {
+    set_mask(irq, false);
+}
+
+void disable_irq(uint8_t irq) noexcept {
+    set_mask(irq, true);
+}
+
+} // namespace hft::ioapic
@@ -0,0 +1,245 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+
+export module hft.itch;
+import hft.core;
+import hft.wire;
+import hft.trading;
+
+// Nasdaq TotalView-ITCH 5.0 over MoldUDP64, decoded in place into a book.
+// Only the messages that move the book (and the directory that names the
+// instruments) have layouts; the dispatcher skips the rest by their type
+// byte. Prices are ITCH's fixed point (four implied decimals) unchanged,
+// so they feed price_t directly.
+export namespace hft::itch {
+
+// Common header: type (0), stock locate (1), tracking number (3), ns since
+// midnight (5, six bytes)
+using locate = wire::field<uint16_t, 1>;
+using timestamp = wire::field<uint64_t, 5, 6>;
+
+struct system_event {
+    static constexpr uint8_t type = 'S';
+    static constexpr size_t length = 12;
+    using event = wire::field<char, 11>;
+};
+
+struct stock_directory {
+    static constexpr uint8_t type = 'R';
+    static constexpr size_t length = 39;
+    using stock = wire::field<uint64_t, 11, 8, wire::byte_order::little>;  // Space-padded ASCII
+};
+
+struct add_order {
+    static constexpr uint8_t type = 'A';
+    static constexpr size_t length = 36;
+    using reference = wire::field<uint64_t, 11>;
+    using side = wire::field<char, 19>;  // 'B' or 'S'
+    using shares = wire::field<uint32_t, 20>;
+    using stock = wire::field<uint64_t, 24, 8, wire::byte_order::little>;
+    using price = wire::field<uint32_t, 32>;
+    static_assert(wire::fits<length, locate, timestamp, reference, side, shares, stock, price>);
+};
+
+// Add order with market participant attribution
+struct add_order_mpid : add_order {
+    static constexpr uint8_t type = 'F';
+    static constexpr size_t length = 40;
+};
+
+struct order_executed {
+    static constexpr uint8_t type = 'E';
+    static constexpr size_t length = 31;
+    using reference = wire::field<uint64_t, 11>;
+    using shares = wire::field<uint32_t, 19>;
+    using match = wire::field<uint64_t, 23>;
+    static_assert(wire::fits<length, reference, shares, match>);
+};
+
+// Executed at a price other than the order's (book effect is the same)
+struct order_executed_price : order_executed {
+    static constexpr uint8_t type = 'C';
+    static constexpr size_t length = 36;
+    using price = wire::field<uint32_t, 32>;
+    static_assert(wire::fits<length, price>);
+};
+
+// Partial cancel
+struct order_cancel {
+    static constexpr uint8_t type = 'X';
+    static constexpr size_t length = 23;
+    using reference = wire::field<uint64_t, 11>;
+    using shares = wire::field<uint32_t, 19>;
+    static_assert(wire::fits<length, reference, shares>);
+};
+
+struct order_delete {
+    static constexpr uint8_t type = 'D';
+    static constexpr size_t length = 19;
+    using reference = wire::field<uint64_t, 11>;
+    static_assert(wire::fits<length, reference>);
+};
+
+// Cancel the original and add the new reference on the same side
+struct order_replace {
+    static constexpr uint8_t type = 'U';
+    static constexpr size_t length = 35;
+    using original = wire::field<uint64_t, 11>;
+    using reference = wire::field<uint64_t, 19>;
+    using shares = wire::field<uint32_t, 27>;
+    using price = wire::field<uint32_t, 31>;
+    static_assert(wire::fits<length, original, reference, shares, price>);
+};
+
+template<typename Handler>
+using dispatcher = wire::dispatcher<Handler, system_event, stock_directory, add_order,
+                                    add_order_mpid, order_executed, order_executed_price,
+                                    order_cancel, order_delete, order_replace>;
+
+constexpr size_t MOLD_HEADER = 20;  // Session (10), sequence (8), message count (2)
+
+struct packet_result {
+    uint32_t decoded;    // Messages handed to the dispatcher
+    bool malformed;      // A block ran past the end of the datagram
+};
+
+// Walk the message blocks of one MoldUDP64 datagram (2-byte big-endian
+// length, then the message), skipping the first `skip` and dispatching at
+// most `count` after them (what net's arbitration says is new).
+template<typename Handler>
+packet_result decode_packet(Handler& handler, const uint8_t* payload, size_t length,
+                            uint32_t skip, uint32_t count) noexcept {
+    packet_result result{0, false};
+    size_t offset = MOLD_HEADER;
+    for (uint32_t block = 0; block < skip + count; ++block) {
+        if (offset + 2 > length) [[unlikely]] {
+            result.malformed = true;
+            break;
+        }
+        const size_t size = wire::field<uint16_t, 0>::read(payload + offset);
+        offset += 2;
+        if (offset + size > length) [[unlikely]] {
+            result.malformed = true;
+            break;
+        }
+        if (block >= skip) {
+            if (!dispatcher<Handler>::dispatch(handler, payload + offset, size)) [[unlikely]] {
+                result.malformed = true;
+            } else {
+                ++result.decoded;
+            }
+        }
+        offset += size;
+    }
+    return result;
+}
+
+struct builder_stats {
+    uint64_t packets;
+    uint64_t messages;    // Book messages for this instrument
+    uint64_t rejected;    // The book refused the event (unknown id, full pool)
+    uint64_t malformed;
+};
+
+// Applies one instrument's order events to an l3_book (or anything with
+// its add/cancel/execute/modify/find interface). Each datagram is one
+// batch on the book, so readers see one seqlock publish per packet however
+// many messages it carries.
+template<typename Book>
+class book_builder {
+public:
+    book_builder(Book& book, uint16_t instrument) noexcept
+        : book_{book}, locate_{instrument} {}
+
+    // Decode one datagram; receive_ns stamps the orders it adds
+    // (tsc_clock::wall_ns of the receive timestamp)
+    uint32_t on_packet(const uint8_t* payload, size_t length, uint32_t skip,
+                       uint32_t count, uint64_t receive_ns) noexcept {
+        receive_ns_ = receive_ns;
+        book_.begin_batch();
+        const packet_result result = decode_packet(*this, payload, length, skip, count);
+        book_.end_batch();
+
+        ++stats_.packets;
+        stats_.malformed += result.malformed;
+        return result.decoded;
+    }
+
+    void operator()(wire::view<add_order> m) noexcept { add(m); }
+    void operator()(wire::view<add_order_mpid> m) noexcept { add(m); }
+
+    void operator()(wire::view<order_executed> m) noexcept {
+        if (!mine(m)) return;
+        count(book_.execute(m.template get<order_executed::reference>(),
+                            m.template get<order_executed::shares>()));
+    }
+
+    void operator()(wire::view<order_executed_price> m) noexcept {
+        if (!mine(m)) return;
+        count(book_.execute(m.template get<order_executed_price::reference>(),
+                            m.template get<order_executed_price::shares>()));
+    }
+
+    void operator()(wire::view<order_cancel> m) noexcept {
+        if (!mine(m)) return;
+        const trading::order_id_t id = m.template get<order_cancel::reference>();
+        const trading::order* o = book_.find(id);
+        if (!o) [[unlikely]] {
+            count(false);
+            return;
+        }
+        // A reduction at the same price keeps queue priority
+        const trading::quantity_t cancelled = m.template get<order_cancel::shares>();
+        const trading::quantity_t remaining = cancelled < o->quantity ? o->quantity - cancelled : 0;
+        count(book_.modify(id, o->price, remaining));
+    }
+
+    void operator()(wire::view<order_delete> m) noexcept {
+        if (!mine(m)) return;
+        count(book_.cancel(m.template get<order_delete::reference>()));
+    }
+
+    void operator()(wire::view<order_replace> m) noexcept {
+        if (!mine(m)) return;
+        const trading::order* o = book_.find(m.template get<order_replace::original>());
+        if (!o) [[unlikely]] {
+            count(false);
+            return;
+        }
+        const bool is_buy = o->is_buy;
+        (void)book_.cancel(o->id);
+        count(book_.add(m.template get<order_replace::reference>(), is_buy,
+                        m.template get<order_replace::price>(),
+                        m.template get<order_replace::shares>(), receive_ns_));
+    }
+
+    [[nodiscard]] const builder_stats& stats() const noexcept { return stats_; }
+
+private:
+    template<typename Message>
+    bool mine(wire::view<Message> m) const noexcept {
+        return m.template get<locate>() == locate_;
+    }
+
+    template<typename Message>
+    void add(wire::view<Message> m) noexcept {
+        if (!mine(m)) return;
+        count(book_.add(m.template get<add_order::reference>(),
+                        m.template get<add_order::side>() == 'B',
+                        m.template get<add_order::price>(),
+                        m.template get<add_order::shares>(), receive_ns_));
+    }
+
+    void count(bool applied) noexcept {
+        ++stats_.messages;
+        stats_.rejected += !applied;
+    }
+
+    Book& book_;
+    uint16_t locate_;
+    uint64_t receive_ns_ = 0;
+    builder_stats stats_ = {};
+};
+
+} // namespace hft::itch
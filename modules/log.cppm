@@ -0,0 +1,269 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+#include "../include/freestanding/atomic.hpp"
+
+export module hft.log;
+import hft.core;
+import hft.concurrent;
+import hft.serial;
+
+// Deferred binary logging.
+// write() copies the format string's address and up to MAX_ARGS raw
+// 64-bit arguments into the executing core's SPSC queue and returns: no
+// formatting and no UART access on the calling core, and a full queue
+// drops the record rather than waiting. A drain on a housekeeping core
+// (run() pinned there, or poll() from an idle loop) merges the queues in
+// TSC order, formats each record and feeds the UART FIFO in bursts.
+//
+// Formats take %d %u %x %p %s %c and %%; %s arguments must point to
+// strings that live forever (literals, names tables). write() is for
+// thread context only: an interrupt handler logging on the same core
+// would be a second producer on its queue.
+export namespace hft::log {
+
+constexpr size_t MAX_ARGS = 4;
+constexpr size_t QUEUE_DEPTH = 256;  // Records per core
+
+struct record {
+    const char* format;  // Doubles as the message id
+    uint64_t tsc;
+    uint64_t args[MAX_ARGS];
+    uint32_t cpu;
+    uint32_t arg_count;
+};
+
+} // namespace hft::log
+
+namespace hft::log {
+
+constexpr size_t TX_BUFFER = 4096;  // Power of two
+constexpr size_t MAX_LINE = 256;
+
+struct alignas(64) core_log {
+    concurrent::spsc_queue<record, QUEUE_DEPTH> queue;
+    atomic<uint64_t> dropped{0};  // Written by the producer
+    uint64_t reported = 0;        // Drain side
+};
+
+inline core_log cores[topology::MAX_CPUS];
+inline atomic<uint32_t> active_cpus{1};
+inline atomic<bool> stop_requested{false};
+
+// Drain side: formatted text waiting for the UART
+inline char tx[TX_BUFFER];
+inline size_t tx_head = 0;
+inline size_t tx_tail = 0;
+
+template<typename T>
+uint64_t to_arg(T* value) noexcept {
+    return reinterpret_cast<uintptr_t>(value);
+}
+
+template<typename T>
+    requires requires(T value) { static_cast<uint64_t>(value); }
+uint64_t to_arg(T value) noexcept {
+    if constexpr (T(-1) < T(0)) {
+        return static_cast<uint64_t>(static_cast<int64_t>(value));  // Sign-extend for %d
+    } else {
+        return static_cast<uint64_t>(value);
+    }
+}
+
+size_t tx_free() noexcept {
+    return TX_BUFFER - (tx_head - tx_tail);
+}
+
+void emit(char c) noexcept {
+    if (c == '\n') tx[tx_head++ % TX_BUFFER] = '\r';
+    tx[tx_head++ % TX_BUFFER] = c;
+}
+
+void emit(const char* s) noexcept {
+    while (*s) emit(*s++);
+}
+
+void emit_unsigned(uint64_t value, uint32_t base, uint32_t min_digits = 1) noexcept {
+    char digits[20];
+    uint32_t count = 0;
+    do {
+        const auto digit = static_cast<uint32_t>(value % base);
+        digits[count++] = static_cast<char>(digit < 10 ? '0' + digit : 'a' + digit - 10);
+        value /= base;
+    } while (value > 0 || count < min_digits);
+    while (count > 0) emit(digits[--count]);
+}
+
+// "[seconds.nanoseconds] cpuN " then the message, bounded by MAX_LINE
+// (longer expansions are cut off)
+void format(const record& r) noexcept {
+    const size_t start = tx_head;
+    auto room = [&] { return tx_head - start < MAX_LINE - 24; };
+
+    const uint64_t ns = tsc_clock::to_ns(r.tsc);
+    emit('[');
+    emit_unsigned(ns / 1000000000, 10);
+    emit('.');
+    emit_unsigned(ns % 1000000000, 10, 9);
+    emit("] cpu");
+    emit_unsigned(r.cpu, 10);
+    emit(' ');
+
+    uint32_t next = 0;
+    for (const char* p = r.format; *p && room(); ++p) {
+        if (*p != '%') {
+            emit(*p);
+            continue;
+        }
+        if (*++p == '\0') break;
+        if (*p == '%') {
+            emit('%');
+            continue;
+        }
+
+        const uint64_t arg = next < r.arg_count ? r.args[next++] : 0;
+        switch (*p) {
+            case 'd': {
+                const auto value = static_cast<int64_t>(arg);
+                if (value < 0) emit('-');
+                emit_unsigned(value < 0 ? 0 - arg : arg, 10);
+                break;
+            }
+            case 'u': emit_unsigned(arg, 10); break;
+            case 'x': emit_unsigned(arg, 16); break;
+            case 'p': emit("0x"); emit_unsigned(arg, 16, 16); break;
+            case 'c': emit(static_cast<char>(arg)); break;
+            case 's': {
+                const char* s = reinterpret_cast<const char*>(arg);
+                if (!s) s = "(null)";
+                while (*s && room()) emit(*s++);
+                break;
+            }
+            default: emit('%'); emit(*p); break;
+        }
+    }
+}
+
+// Oldest pending record across the cores, or -1
+int32_t oldest_core(uint32_t cpus) noexcept {
+    int32_t best = -1;
+    uint64_t best_tsc = 0;
+    for (uint32_t cpu = 0; cpu < cpus; ++cpu) {
+        const span<record> head = cores[cpu].queue.peek(1);
+        if (head.empty()) continue;
+        if (best < 0 || head[0].tsc < best_tsc) {
+            best = static_cast<int32_t>(cpu);
+            best_tsc = head[0].tsc;
+        }
+    }
+    return best;
+}
+
+void report_drops(uint32_t cpus) noexcept {
+    for (uint32_t cpu = 0; cpu < cpus && tx_free() >= MAX_LINE; ++cpu) {
+        core_log& core = cores[cpu];
+        const uint64_t dropped = core.dropped.load(memory_order::relaxed);
+        if (dropped == core.reported) continue;
+
+        emit("[log] cpu");
+        emit_unsigned(cpu, 10);
+        emit(" dropped ");
+        emit_unsigned(dropped - core.reported, 10);
+        emit(" records\n");
+        core.reported = dropped;
+    }
+}
+
+// Hand as much buffered text to the UART as it takes right now; returns
+// the bytes taken
+size_t transmit() noexcept {
+    const size_t before = tx_tail;
+    while (tx_tail != tx_head) {
+        const size_t offset = tx_tail % TX_BUFFER;
+        const size_t contiguous = min(tx_head - tx_tail, TX_BUFFER - offset);
+        const size_t sent = serial::write_burst(&tx[offset], contiguous);
+        if (sent == 0) break;
+        tx_tail += sent;
+    }
+    return tx_tail - before;
+}
+
+} // namespace hft::log
+
+export namespace hft::log {
+
+// Log from the executing core: the record is queued, formatted later on
+// the drain core. Returns false (and counts a drop) if the queue is full.
+template<typename... Args>
+bool write(const char* format, Args... args) noexcept {
+    static_assert(sizeof...(Args) <= MAX_ARGS, "log::write takes at most MAX_ARGS arguments");
+
+    const uint32_t cpu = topology::this_cpu()->index;
+    core_log& core = cores[cpu];
+    const span<record> slot = core.queue.claim(1);
+    if (slot.empty()) [[unlikely]] {
+        core.dropped.store(core.dropped.load(memory_order::relaxed) + 1, memory_order::relaxed);
+        return false;
+    }
+
+    record& r = slot[0];
+    r.format = format;
+    r.tsc = tsc_clock::now();
+    r.cpu = cpu;
+    r.arg_count = sizeof...(Args);
+    size_t i = 0;
+    ((r.args[i++] = to_arg(args)), ...);
+    core.queue.commit(1);
+    return true;
+}
+
+// Number of cores whose queues the drain looks at (smp::cpu_count())
+void set_cpu_count(uint32_t cpus) noexcept {
+    active_cpus.store(min<uint32_t>(cpus, topology::MAX_CPUS), memory_order::release);
+}
+
+// One drain step: format queued records while there is buffer space and
+// push what the UART FIFO takes. Never waits; call it from one core only.
+// Returns the work done (records formatted plus bytes sent), 0 when
+// there was nothing to do.
+size_t poll() noexcept {
+    const uint32_t cpus = active_cpus.load(memory_order::acquire);
+    size_t work = transmit();
+    report_drops(cpus);
+
+    while (tx_free() >= MAX_LINE) {
+        const int32_t cpu = oldest_core(cpus);
+        if (cpu < 0) break;
+
+        concurrent::spsc_queue<record, QUEUE_DEPTH>& queue = cores[cpu].queue;
+        format(queue.peek(1)[0]);
+        queue.release(1);
+        ++work;
+    }
+    return work + transmit();
+}
+
+// Drain task for a housekeeping core (a smp::task_fn); returns after
+// stop() once everything queued has been sent
+void run(void*) noexcept {
+    while (!stop_requested.load(memory_order::acquire)) {
+        poll();
+        asm volatile("pause");
+    }
+    while (tx_tail != tx_head || oldest_core(active_cpus.load(memory_order::acquire)) >= 0) {
+        poll();
+    }
+}
+
+void stop() noexcept {
+    stop_requested.store(true, memory_order::release);
+}
+
+// This core's queue resident and dirty; before run() is pinned, while no
+// drain side touches it
+void prefault_local() noexcept {
+    core_log& c = cores[topology::this_cpu()->index];
+    prefault(&c, sizeof(c));
+}
+
+} // namespace hft::log
@@ -0,0 +1,412 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+
+export module hft.net;
+import hft.core;
+import hft.concurrent;
+import hft.virtio_net;
+import hft.capture;
+
+// UDP multicast receive path for market data.
+// Frames from the NIC are parsed in place (Ethernet, optional 802.1Q
+// tag, IPv4 without options, unfragmented UDP) and matched against the
+// subscribed groups in one pass. For feeds carried as MoldUDP64, which
+// exchanges send twice over independent A and B lines, the first copy
+// of every sequence number is delivered and the second is dropped
+// before anything downstream sees it. Holes in one line are tracked as
+// open gaps so the other line's copy can still fill them; holes neither
+// line fills are counted as lost. Handlers get pointers into the NIC
+// buffer, valid until they return.
+export namespace hft::net {
+
+constexpr size_t MAX_GROUPS = 16;
+constexpr size_t MAX_FEEDS = 8;
+constexpr size_t MAX_GAPS = 8;  // Open gaps per feed
+
+enum class framing : uint8_t {
+    raw,        // No sequence numbers: every datagram is delivered
+    moldudp64   // Session, sequence number and message count up front
+};
+
+// One multicast group (address and port in host order, 239.1.2.3 is
+// 0xEF010203) feeding line A (0) or B (1) of a feed
+struct group {
+    uint32_t address;
+    uint16_t port;
+    uint8_t feed;
+    uint8_t line;
+};
+
+// What one datagram adds: messages [first, first + count) of its payload
+// (MoldUDP64 numbering within the packet) are new
+struct datagram {
+    const uint8_t* payload;  // UDP payload, in the NIC buffer
+    uint16_t length;
+    uint8_t feed;
+    uint8_t line;
+    uint64_t timestamp;      // Receive TSC
+    uint64_t sequence;       // Sequence number of payload message 0 (moldudp64)
+    uint16_t first;          // New messages start here
+    uint16_t count;          // Number of new messages (0 for raw framing)
+    bool recovered;          // Fills an earlier gap: arrives out of order
+};
+
+struct feed_stats {
+    uint64_t delivered;
+    uint64_t duplicates;     // Copies from the slower line, dropped
+    uint64_t gaps;           // Holes opened in the sequence
+    uint64_t recovered;      // Messages filled in later by the other line
+    uint64_t lost;           // Messages no line delivered (gap table overflow or expiry)
+};
+
+struct rx_stats {
+    uint64_t frames;
+    uint64_t unmatched;      // Not IPv4/UDP or not a subscribed group
+    uint64_t malformed;      // Truncated or inconsistent lengths
+};
+
+// Sequence arbitration between the two lines of one feed. Messages are
+// numbered; offer() says which messages of a packet are new.
+class arbiter {
+public:
+    struct verdict {
+        uint64_t first;   // First new sequence number
+        uint64_t count;   // New messages (0: duplicate)
+        bool recovered;
+        // Part of a packet running past next_expected() that also fills
+        // a gap below it (count 0: none)
+        uint64_t late_first = 0;
+        uint64_t late_count = 0;
+    };
+
+    verdict offer(uint64_t sequence, uint64_t count) noexcept {
+        if (count == 0) return {sequence, 0, false};  // Heartbeat
+        const uint64_t end = sequence + count;
+
+        if (next_ == 0) {  // First packet fixes the starting point
+            next_ = end;
+            return {sequence, count, false};
+        }
+
+        if (end <= next_) return fill(sequence, end);
+
+        // New data, possibly after a hole and possibly overlapping what
+        // was already delivered; the overlap can still fill an open gap
+        if (sequence > next_) open_gap(next_, sequence);
+        const verdict late = sequence < next_ ? fill(sequence, next_) : verdict{sequence, 0, false};
+        const uint64_t first = max(sequence, next_);
+        next_ = end;
+        return {first, end - first, false, late.first, late.count};
+    }
+
+    // Give up on gaps opened before sequence (e.g. after a timeout or a
+    // snapshot); returns the messages they were missing
+    uint64_t expire(uint64_t before) noexcept {
+        uint64_t lost = 0;
+        for (size_t i = 0; i < gap_count_;) {
+            if (gaps_[i].end <= before) {
+                lost += gaps_[i].end - gaps_[i].begin;
+                gaps_[i] = gaps_[--gap_count_];
+            } else {
+                ++i;
+            }
+        }
+        lost_ += lost;
+        return lost;
+    }
+
+    [[nodiscard]] uint64_t next_expected() const noexcept { return next_; }
+    [[nodiscard]] size_t open_gaps() const noexcept { return gap_count_; }
+    [[nodiscard]] uint64_t gap_total() const noexcept { return gaps_opened_; }
+    [[nodiscard]] uint64_t lost() const noexcept { return lost_; }
+
+private:
+    struct range {
+        uint64_t begin;
+        uint64_t end;  // Exclusive
+    };
+
+    void open_gap(uint64_t begin, uint64_t end) noexcept {
+        ++gaps_opened_;
+        if (gap_count_ == MAX_GAPS) {
+            // Oldest gap (lowest begin) is written off
+            size_t oldest = 0;
+            for (size_t i = 1; i < gap_count_; ++i) {
+                if (gaps_[i].begin < gaps_[oldest].begin) oldest = i;
+            }
+            lost_ += gaps_[oldest].end - gaps_[oldest].begin;
+            gaps_[oldest] = gaps_[--gap_count_];
+        }
+        gaps_[gap_count_++] = {begin, end};
+    }
+
+    // Old sequence numbers: new only where they fall into an open gap.
+    // A packet overlapping several gaps fills the first one found; the
+    // rest stay open for another copy.
+    verdict fill(uint64_t sequence, uint64_t end) noexcept {
+        for (size_t i = 0; i < gap_count_; ++i) {
+            range& gap = gaps_[i];
+            const uint64_t first = max(sequence, gap.begin);
+            const uint64_t last = min(end, gap.end);
+            if (first >= last) continue;
+
+            if (first == gap.begin && last == gap.end) {
+                gaps_[i] = gaps_[--gap_count_];
+            } else if (first == gap.begin) {
+                gap.begin = last;
+            } else if (last == gap.end) {
+                gap.end = first;
+            } else if (gap_count_ < MAX_GAPS) {
+                gaps_[gap_count_++] = {last, gap.end};  // Split around the fill
+                gap.end = first;
+            } else {
+                lost_ += gap.end - last;  // No room for the tail: written off
+                gap.end = first;
+            }
+            return {first, last - first, true};
+        }
+        return {sequence, 0, false};
+    }
+
+    uint64_t next_ = 0;  // Next sequence number expected (0 before the first)
+    range gaps_[MAX_GAPS] = {};
+    size_t gap_count_ = 0;
+    uint64_t gaps_opened_ = 0;
+    uint64_t lost_ = 0;
+};
+
+} // namespace hft::net
+
+namespace hft::net {
+
+constexpr size_t ETHERNET_HEADER = 14;
+constexpr size_t VLAN_TAG = 4;
+constexpr size_t IPV4_HEADER = 20;
+constexpr size_t UDP_HEADER = 8;
+constexpr size_t MOLD_HEADER = 20;  // Session (10), sequence (8), count (2)
+constexpr uint16_t MOLD_END_OF_SESSION = 0xFFFF;  // Count of the final packet
+
+constexpr uint16_t ETHERTYPE_IPV4 = 0x0800;
+constexpr uint16_t ETHERTYPE_VLAN = 0x8100;
+constexpr uint8_t IPV4_NO_OPTIONS = 0x45;
+constexpr uint8_t PROTO_UDP = 17;
+
+struct feed_state {
+    framing kind = framing::raw;
+    arbiter arb;
+    feed_stats counters = {};
+    bool ended = false;  // A MoldUDP64 end-of-session packet arrived
+};
+
+// Match keys: (address << 16) | port, 0 for an unused slot. Kept apart
+// from the rest so the match loop reads one cache line.
+inline uint64_t group_keys[MAX_GROUPS] = {};
+inline group groups[MAX_GROUPS] = {};
+inline size_t group_count = 0;
+inline feed_state feeds[MAX_FEEDS];
+inline rx_stats counters = {};
+
+inline uint16_t load_be16(const uint8_t* p) noexcept {
+    uint16_t value;
+    memcpy(&value, p, sizeof(value));
+    return __builtin_bswap16(value);
+}
+
+inline uint32_t load_be32(const uint8_t* p) noexcept {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return __builtin_bswap32(value);
+}
+
+inline uint64_t load_be64(const uint8_t* p) noexcept {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return __builtin_bswap64(value);
+}
+
+// Index of the subscribed group with this key, or MAX_GROUPS. Fixed trip
+// count and a conditional move per slot, no data-dependent branches.
+inline size_t match(uint64_t key) noexcept {
+    size_t found = MAX_GROUPS;
+    for (size_t i = 0; i < MAX_GROUPS; ++i) {
+        found = (group_keys[i] == key) & (i < group_count) ? i : found;  // Unused slots hold 0
+    }
+    return found;
+}
+
+// Parse frame down to its UDP payload and match it; false for anything
+// that is not a subscribed datagram. Header checks are combined into one
+// test, taken once per frame.
+inline bool classify(const uint8_t* frame, size_t length, datagram& out) noexcept {
+    if (length < ETHERNET_HEADER + IPV4_HEADER + UDP_HEADER) [[unlikely]] {
+        ++counters.malformed;
+        return false;
+    }
+
+    const bool tagged = load_be16(frame + 12) == ETHERTYPE_VLAN;
+    const size_t l3 = ETHERNET_HEADER + (tagged ? VLAN_TAG : 0);
+    if (length < l3 + IPV4_HEADER + UDP_HEADER) [[unlikely]] {
+        ++counters.malformed;
+        return false;
+    }
+
+    const uint8_t* ip = frame + l3;
+    const uint8_t* udp = ip + IPV4_HEADER;
+    const bool ipv4_udp = (load_be16(frame + l3 - 2) == ETHERTYPE_IPV4) &
+                          (ip[0] == IPV4_NO_OPTIONS) &
+                          (ip[9] == PROTO_UDP) &
+                          ((load_be16(ip + 6) & 0x3FFF) == 0);  // Not a fragment
+
+    const uint64_t key = (static_cast<uint64_t>(load_be32(ip + 16)) << 16) | load_be16(udp + 2);
+    const size_t index = match(key);
+    if (!ipv4_udp || index == MAX_GROUPS) {
+        ++counters.unmatched;
+        return false;
+    }
+
+    const size_t udp_length = load_be16(udp + 4);
+    if (udp_length < UDP_HEADER || l3 + IPV4_HEADER + udp_length > length) [[unlikely]] {
+        ++counters.malformed;
+        return false;
+    }
+
+    const group& g = groups[index];
+    out.payload = udp + UDP_HEADER;
+    out.length = static_cast<uint16_t>(udp_length - UDP_HEADER);
+    out.feed = g.feed;
+    out.line = g.line;
+    return true;
+}
+
+// Sequence arbitration; false if the datagram brings nothing new
+// (duplicates, heartbeats and end of session). late.count is set when part of it fills a
+// gap below the new messages, delivered as a datagram of its own.
+inline bool arbitrate(datagram& d, datagram& late) noexcept {
+    feed_state& feed = feeds[d.feed];
+    late.count = 0;
+    if (feed.kind == framing::raw) {
+        d.sequence = 0;
+        d.first = 0;
+        d.count = 0;
+        d.recovered = false;
+        return true;
+    }
+
+    if (d.length < MOLD_HEADER) [[unlikely]] {
+        ++counters.malformed;
+        return false;
+    }
+
+    const uint64_t sequence = load_be64(d.payload + 10);
+    const uint16_t messages = load_be16(d.payload + 18);
+    if (messages == MOLD_END_OF_SESSION) {  // Carries no messages, like a heartbeat
+        feed.ended = true;
+        return false;
+    }
+    const uint64_t gaps_before = feed.arb.gap_total();
+    const arbiter::verdict v = feed.arb.offer(sequence, messages);
+    feed.counters.gaps += feed.arb.gap_total() - gaps_before;
+    feed.counters.lost = feed.arb.lost();
+
+    if (v.count == 0) {
+        if (messages != 0) ++feed.counters.duplicates;
+        return false;
+    }
+
+    if (v.late_count) {
+        late = d;
+        late.sequence = sequence;
+        late.first = static_cast<uint16_t>(v.late_first - sequence);
+        late.count = static_cast<uint16_t>(v.late_count);
+        late.recovered = true;
+        feed.counters.recovered += v.late_count;
+    }
+
+    d.sequence = sequence;
+    d.first = static_cast<uint16_t>(v.first - sequence);
+    d.count = static_cast<uint16_t>(v.count);
+    d.recovered = v.recovered;
+    if (v.recovered) feed.counters.recovered += v.count;
+    return true;
+}
+
+} // namespace hft::net
+
+export namespace hft::net {
+
+// Add a group; returns false if the table is full or feed is out of
+// range. Configure before receive() runs.
+bool subscribe(const group& g) noexcept {
+    if (group_count == MAX_GROUPS || g.feed >= MAX_FEEDS || g.line > 1) return false;
+    groups[group_count] = g;
+    group_keys[group_count] = (static_cast<uint64_t>(g.address) << 16) | g.port;
+    ++group_count;
+    return true;
+}
+
+void set_framing(uint8_t feed, framing kind) noexcept {
+    if (feed < MAX_FEEDS) feeds[feed].kind = kind;
+}
+
+// Process up to budget received frames: handler(const datagram&) runs
+// for every datagram that adds messages (every datagram under raw
+// framing), twice for one that also fills a gap below them, the
+// recovered part first. Heartbeats, duplicates and everything else are
+// returned to the NIC right away. Call on the core that owns the NIC queues (after
+// virtio_net::poll()). Returns the number of frames taken.
+template<typename Handler>
+size_t receive(Handler&& handler, size_t budget = 32) noexcept {
+    auto& ready = virtio_net::rx_ready();
+    auto& done = virtio_net::rx_done();
+
+    size_t taken = 0;
+    while (taken < budget) {
+        const span<virtio_net::packet> batch = ready.peek(budget - taken);
+        if (batch.empty()) break;
+
+        for (const virtio_net::packet& p : batch) {
+            ++counters.frames;
+            (void)capture::append(capture::kind::inbound, 0, p.data, p.length, p.timestamp);
+            datagram d;
+            datagram late;
+            if (classify(p.data, p.length, d) && arbitrate(d, late)) {
+                d.timestamp = p.timestamp;
+                if (late.count) {
+                    late.timestamp = p.timestamp;
+                    handler(static_cast<const datagram&>(late));
+                }
+                handler(static_cast<const datagram&>(d));
+                ++feeds[d.feed].counters.delivered;
+            }
+            (void)done.try_push(p.id);  // Sized for every buffer
+        }
+        ready.release(batch.size());
+        taken += batch.size();
+    }
+    return taken;
+}
+
+// Write off gaps in feed opened before sequence; returns messages lost
+uint64_t expire_gaps(uint8_t feed, uint64_t before) noexcept {
+    if (feed >= MAX_FEEDS) return 0;
+    const uint64_t lost = feeds[feed].arb.expire(before);
+    feeds[feed].counters.lost = feeds[feed].arb.lost();
+    return lost;
+}
+
+[[nodiscard]] feed_stats feed_counters(uint8_t feed) noexcept {
+    return feed < MAX_FEEDS ? feeds[feed].counters : feed_stats{};
+}
+
+// Whether an end-of-session packet has arrived on feed (MoldUDP64
+// framing): the exchange sends no further messages in this session
+[[nodiscard]] bool session_ended(uint8_t feed) noexcept {
+    return feed < MAX_FEEDS && feeds[feed].ended;
+}
+
+[[nodiscard]] rx_stats receive_counters() noexcept {
+    return counters;
+}
+
+} // namespace hft::net
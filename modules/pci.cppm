@@ -0,0 +1,184 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+
+export module hft.pci;
+import hft.core;
+
+// PCI configuration space through I/O ports 0xCF8/0xCFC (configuration
+// mechanism #1), enough to find a device, read its BARs and walk its
+// capability list. Used at boot only; drivers run on MMIO afterwards.
+export namespace hft::pci {
+
+struct device {
+    uint8_t bus = 0;
+    uint8_t slot = 0;
+    uint8_t function = 0;
+    uint16_t vendor_id = 0xFFFF;
+    uint16_t device_id = 0xFFFF;
+    uint8_t class_code = 0;
+    uint8_t subclass = 0;
+
+    [[nodiscard]] bool valid() const noexcept { return vendor_id != 0xFFFF; }
+};
+
+// Command register bits
+enum command : uint16_t {
+    io_space = 1 << 0,
+    memory_space = 1 << 1,
+    bus_master = 1 << 2,
+    interrupt_disable = 1 << 10
+};
+
+constexpr uint8_t REG_COMMAND = 0x04;
+constexpr uint8_t REG_BAR0 = 0x10;
+constexpr uint8_t REG_CAPABILITIES = 0x34;
+
+constexpr uint8_t CAP_VENDOR = 0x09;
+constexpr uint8_t CAP_MSIX = 0x11;
+
+} // namespace hft::pci
+
+namespace hft::pci {
+
+constexpr uint16_t CONFIG_ADDRESS = 0xCF8;
+constexpr uint16_t CONFIG_DATA = 0xCFC;
+constexpr uint8_t REG_STATUS = 0x06;
+constexpr uint8_t REG_HEADER_TYPE = 0x0E;
+constexpr uint16_t STATUS_CAPABILITIES = 1 << 4;
+
+void select(const device& d, uint8_t offset) noexcept {
+    const uint32_t address = (1u << 31) | (static_cast<uint32_t>(d.bus) << 16) |
+                             (static_cast<uint32_t>(d.slot) << 11) |
+                             (static_cast<uint32_t>(d.function) << 8) | (offset & 0xFC);
+    asm volatile("outl %0, %1" : : "a"(address), "Nd"(CONFIG_ADDRESS));
+}
+
+} // namespace hft::pci
+
+export namespace hft::pci {
+
+uint32_t read32(const device& d, uint8_t offset) noexcept {
+    select(d, offset);
+    uint32_t value;
+    asm volatile("inl %1, %0" : "=a"(value) : "Nd"(CONFIG_DATA));
+    return value;
+}
+
+uint16_t read16(const device& d, uint8_t offset) noexcept {
+    return static_cast<uint16_t>(read32(d, offset) >> ((offset & 2) * 8));
+}
+
+uint8_t read8(const device& d, uint8_t offset) noexcept {
+    return static_cast<uint8_t>(read32(d, offset) >> ((offset & 3) * 8));
+}
+
+void write32(const device& d, uint8_t offset, uint32_t value) noexcept {
+    select(d, offset);
+    asm volatile("outl %0, %1" : : "a"(value), "Nd"(CONFIG_DATA));
+}
+
+void write16(const device& d, uint8_t offset, uint16_t value) noexcept {
+    const uint32_t shift = (offset & 2) * 8;
+    const uint32_t old = read32(d, offset);
+    write32(d, offset, (old & ~(0xFFFFu << shift)) | (static_cast<uint32_t>(value) << shift));
+}
+
+// Device at bus/slot/function, or an invalid one if nothing answers
+device probe(uint8_t bus, uint8_t slot, uint8_t function) noexcept {
+    device d{bus, slot, function};
+    const uint32_t id = read32(d, 0x00);
+    if ((id & 0xFFFF) == 0xFFFF) return d;
+
+    const uint32_t class_reg = read32(d, 0x08);
+    d.vendor_id = static_cast<uint16_t>(id);
+    d.device_id = static_cast<uint16_t>(id >> 16);
+    d.class_code = static_cast<uint8_t>(class_reg >> 24);
+    d.subclass = static_cast<uint8_t>(class_reg >> 16);
+    return d;
+}
+
+// The index-th device (in bus order) matching vendor and any of the
+// device IDs, or an invalid one
+device find(uint16_t vendor, span<const uint16_t> device_ids, uint32_t index = 0) noexcept {
+    for (uint32_t bus = 0; bus < 256; ++bus) {
+        for (uint8_t slot = 0; slot < 32; ++slot) {
+            const device first = probe(static_cast<uint8_t>(bus), slot, 0);
+            if (!first.valid()) continue;
+
+            const bool multifunction = read8(first, REG_HEADER_TYPE) & 0x80;
+            for (uint8_t function = 0; function < (multifunction ? 8 : 1); ++function) {
+                const device d = function == 0 ? first : probe(static_cast<uint8_t>(bus), slot, function);
+                if (!d.valid() || d.vendor_id != vendor) continue;
+
+                for (const uint16_t id : device_ids) {
+                    if (d.device_id == id && index-- == 0) return d;
+                }
+            }
+        }
+    }
+    return {};
+}
+
+// Physical address of memory BAR bar (combining the two halves of a
+// 64-bit BAR), or 0 for an I/O or unimplemented BAR
+uint64_t bar_address(const device& d, uint8_t bar) noexcept {
+    const uint8_t offset = static_cast<uint8_t>(REG_BAR0 + bar * 4);
+    const uint32_t low = read32(d, offset);
+    if (low & 1) return 0;  // I/O space
+
+    uint64_t address = low & ~0xFULL;
+    if (((low >> 1) & 0x3) == 0x2 && bar < 5) {
+        address |= static_cast<uint64_t>(read32(d, static_cast<uint8_t>(offset + 4))) << 32;
+    }
+    return address;
+}
+
+void set_command(const device& d, uint16_t set, uint16_t clear = 0) noexcept {
+    const uint16_t value = read16(d, REG_COMMAND);
+    write16(d, REG_COMMAND, static_cast<uint16_t>((value & ~clear) | set));
+}
+
+// Size in bytes of memory BAR bar, found by writing all ones with memory
+// decoding off; 0 for an I/O or unimplemented BAR
+uint64_t bar_size(const device& d, uint8_t bar) noexcept {
+    const uint8_t offset = static_cast<uint8_t>(REG_BAR0 + bar * 4);
+    const uint32_t low = read32(d, offset);
+    if (low & 1) return 0;
+    const bool wide = ((low >> 1) & 0x3) == 0x2 && bar < 5;
+    const auto high_offset = static_cast<uint8_t>(offset + 4);
+
+    const uint16_t command = read16(d, REG_COMMAND);
+    write16(d, REG_COMMAND, static_cast<uint16_t>(command & ~memory_space));
+
+    write32(d, offset, 0xFFFFFFFF);
+    uint64_t mask = read32(d, offset) & ~0xFULL;
+    write32(d, offset, low);
+    if (wide) {
+        const uint32_t high = read32(d, high_offset);
+        write32(d, high_offset, 0xFFFFFFFF);
+        mask |= static_cast<uint64_t>(read32(d, high_offset)) << 32;
+        write32(d, high_offset, high);
+    } else {
+        mask |= 0xFFFFFFFF00000000ULL;
+    }
+
+    write16(d, REG_COMMAND, command);
+    return wide || (mask & 0xFFFFFFFF) != 0 ? ~mask + 1 : 0;
+}
+
+// Config-space offset of the first capability with the given ID at or
+// after start (0 = the head of the list), or 0 if there is none
+uint8_t find_capability(const device& d, uint8_t id, uint8_t start = 0) noexcept {
+    if (!(read16(d, REG_STATUS) & STATUS_CAPABILITIES)) return 0;
+
+    uint8_t offset = start ? read8(d, static_cast<uint8_t>(start + 1)) : read8(d, REG_CAPABILITIES);
+    for (uint32_t guard = 0; offset >= 0x40 && guard < 48; ++guard) {
+        offset &= 0xFC;
+        if (read8(d, offset) == id) return offset;
+        offset = read8(d, static_cast<uint8_t>(offset + 1));
+    }
+    return 0;
+}
+
+} // namespace hft::pci
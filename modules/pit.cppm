@@ -0,0 +1,53 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+
+export module hft.pit;
+import hft.core;
+
+// Legacy 8254 PIT, used only as a reference clock for boot-time delays
+// and calibration. Channel 2 (the speaker gate) is polled, so channel 0
+// and IRQ 0 stay unused: nothing in the kernel takes a periodic PIT tick.
+export namespace hft::pit {
+
+constexpr uint64_t FREQUENCY_HZ = 1193182;
+
+} // namespace hft::pit
+
+namespace hft::pit {
+
+void outb(uint16_t port, uint8_t value) noexcept {
+    asm volatile("outb %0, %1" : : "a"(value), "Nd"(port));
+}
+
+uint8_t inb(uint16_t port) noexcept {
+    uint8_t value;
+    asm volatile("inb %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+} // namespace hft::pit
+
+export namespace hft::pit {
+
+// Busy-wait for us microseconds
+void wait_us(uint64_t us) noexcept {
+    constexpr uint64_t MAX_CHUNK_US = 50000;  // 16-bit count
+
+    while (us > 0) {
+        const uint64_t chunk = min(us, MAX_CHUNK_US);
+        const uint64_t count = max<uint64_t>(chunk * FREQUENCY_HZ / 1000000, 1);
+
+        outb(0x61, (inb(0x61) & ~0x02) | 0x01);  // Gate on, speaker off
+        outb(0x43, 0xB0);                        // Channel 2, lo/hi, mode 0
+        outb(0x42, count & 0xFF);
+        outb(0x42, (count >> 8) & 0xFF);
+        while (!(inb(0x61) & 0x20)) {            // OUT2 rises at terminal count
+            asm volatile("pause");
+        }
+
+        us -= chunk;
+    }
+}
+
+} // namespace hft::pit
@@ -2,6 +2,9 @@ module;
 #include "../include/freestanding/types.hpp"
 #include "../include/freestanding/atomic.hpp"
 export module hft.pmm;
+import hft.core;
+import hft.acpi;
+import hft.concurrent;
 
 export namespace hft::pmm {
 using namespace hft;
@@ -11,6 +14,10 @@ constexpr size_t PAGE_SIZE = 4096;
 constexpr size_t PAGE_SHIFT = 12;
 constexpr size_t ENTRIES_PER_PAGE = PAGE_SIZE / sizeof(uint64_t);
 
+// Real-mode memory (IVT, BIOS data, EBDA, the AP startup trampoline) is
+// never handed out
+constexpr uint64_t LOW_MEMORY_END = 0x100000;
+
 // Memory zone types
 enum class zone_type {
     dma,        // 0-16MB for legacy DMA
@@ -42,27 +49,217 @@ struct memory_region {
     uint32_t reserved;
 };
 
-// Bitmap allocator for physical pages
+// RAM the memory map lists (usable, ACPI reclaimable, ACPI NVS): what the
+// kernel's page tables map
+struct ram_range {
+    uint64_t base;
+    uint64_t end;
+};
+
+constexpr size_t MAX_RAM_RANGES = 64;
+constexpr size_t MAX_KEPT_RANGES = 8;
+
+// 64-ary bit tree: a leaf bitset plus summary levels where bit i of a
+// word means "child word i is non-zero", so the first set leaf is found
+// in one word per level (at most 6 levels for 2^36 leaves).
+class bit_tree {
+    static constexpr size_t max_levels = 6;
+    
+    uint64_t* words;
+    size_t level_offset[max_levels];
+    size_t levels;
+    
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    
+    static size_t words_needed(size_t bits) noexcept {
+        size_t total = 0;
+        size_t count = (bits + 63) / 64;
+        for (;;) {
+            total += count;
+            if (count <= 1) return total;
+            count = (count + 63) / 64;
+        }
+    }
+    
+    // storage must hold words_needed(bits) words; all bits start clear
+    void init(uint64_t* storage, size_t bits) noexcept {
+        words = storage;
+        levels = 0;
+        
+        size_t offset = 0;
+        size_t count = (bits + 63) / 64;
+        for (;;) {
+            level_offset[levels++] = offset;
+            offset += count;
+            if (count <= 1) break;
+            count = (count + 63) / 64;
+        }
+        fill_words(words, 0, offset);
+    }
+    
+    bool test(size_t bit) const noexcept {
+        return (words[bit / 64] >> (bit % 64)) & 1;
+    }
+    
+    void set(size_t bit) noexcept {
+        for (size_t level = 0; level < levels; ++level) {
+            uint64_t& word = words[level_offset[level] + bit / 64];
+            const uint64_t old = word;
+            word = old | (1ULL << (bit % 64));
+            if (old != 0) return;  // Parents already mark this word
+            bit /= 64;
+        }
+    }
+    
+    void clear(size_t bit) noexcept {
+        for (size_t level = 0; level < levels; ++level) {
+            uint64_t& word = words[level_offset[level] + bit / 64];
+            word &= ~(1ULL << (bit % 64));
+            if (word != 0) return;  // Word still non-empty
+            bit /= 64;
+        }
+    }
+    
+    size_t find_first() const noexcept {
+        size_t idx = 0;
+        for (size_t level = levels; level-- > 0;) {
+            const uint64_t word = words[level_offset[level] + idx];
+            if (word == 0) return npos;
+            idx = idx * 64 + __builtin_ctzll(word);
+        }
+        return idx;
+    }
+};
+
+// Buddy index over a zone: free_blocks[k] holds every maximal free block
+// of 2^k pages. Blocks are aligned in frame-number space (the zone's base
+// frame modulo 2^MAX_ORDER is added to page numbers), so an order-k block
+// is also 2^k-page aligned physically. Runs longer than the largest block
+// are taken as consecutive free top-order blocks (see take_run).
+class buddy_index {
+public:
+    static constexpr size_t MAX_ORDER = 18;  // 2^18 pages = 1 GiB
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    
+private:
+    bit_tree free_blocks[MAX_ORDER + 1];
+    size_t span;  // Indexed pages including the alignment offset
+    
+public:
+    static size_t words_needed(size_t pages) noexcept {
+        size_t total = 0;
+        for (size_t order = 0; order <= MAX_ORDER; ++order) {
+            total += bit_tree::words_needed((pages >> order) + 2);
+        }
+        return total;
+    }
+    
+    // Consumes words_needed(pages) words; starts with no free blocks
+    void init(uint64_t* storage, size_t pages) noexcept {
+        span = pages;
+        for (size_t order = 0; order <= MAX_ORDER; ++order) {
+            const size_t blocks = (pages >> order) + 2;  // Room for the last buddy
+            free_blocks[order].init(storage, blocks);
+            storage += bit_tree::words_needed(blocks);
+        }
+    }
+    
+    // Add the (used) 2^order block at index, merging with free buddies
+    void insert(size_t index, size_t order) noexcept {
+        size_t block = index >> order;
+        while (order < MAX_ORDER && free_blocks[order].test(block ^ 1)) {
+            free_blocks[order].clear(block ^ 1);
+            block >>= 1;
+            ++order;
+        }
+        free_blocks[order].set(block);
+    }
+    
+    // Take a free 2^order block, splitting a larger one if needed.
+    // Smallest sufficient blocks are used first to keep large runs intact.
+    size_t take(size_t order) noexcept {
+        for (size_t from = order; from <= MAX_ORDER; ++from) {
+            size_t block = free_blocks[from].find_first();
+            if (block == bit_tree::npos) continue;
+            
+            free_blocks[from].clear(block);
+            // Hand back the upper half at each level on the way down
+            for (size_t k = from; k > order; --k) {
+                block <<= 1;
+                free_blocks[k - 1].set(block | 1);
+            }
+            return block << order;
+        }
+        return npos;
+    }
+    
+    // Take n consecutive free 2^MAX_ORDER blocks for a run too long for
+    // one block. A linear scan, but the top order has one bit per GiB.
+    size_t take_run(size_t n) noexcept {
+        const size_t blocks = (span >> MAX_ORDER) + 2;
+        size_t run = 0;
+        for (size_t block = 0; block < blocks; ++block) {
+            run = free_blocks[MAX_ORDER].test(block) ? run + 1 : 0;
+            if (run < n) continue;
+            
+            const size_t first = block + 1 - n;
+            for (size_t b = first; b <= block; ++b) {
+                free_blocks[MAX_ORDER].clear(b);
+            }
+            return first << MAX_ORDER;
+        }
+        return npos;
+    }
+    
+    // Carve a single free page out of whichever block contains it
+    void remove_page(size_t index) noexcept {
+        size_t order = 0;
+        while (order <= MAX_ORDER && !free_blocks[order].test(index >> order)) {
+            ++order;
+        }
+        if (order > MAX_ORDER) return;  // Not free
+        
+        free_blocks[order].clear(index >> order);
+        for (size_t k = order; k > 0; --k) {
+            free_blocks[k - 1].set((index >> (k - 1)) ^ 1);
+        }
+    }
+    
+    size_t get_span() const noexcept { return span; }
+};
+
+// Physical page allocator for one zone.
+// The bitmap is the source of truth for each page (1 = used); the buddy
+// index mirrors it as maximal aligned free blocks, so aligned 2^k-page
+// allocations and frees are O(MAX_ORDER) instead of a bitmap scan.
 class bitmap_allocator {
 private:
     uint64_t* bitmap;
     size_t bitmap_size;
     size_t total_pages;
-    size_t first_free_page;
+    size_t phase;  // Base frame number modulo 2^MAX_ORDER
+    buddy_index buddy;
     atomic<size_t> free_pages;
     
 public:
-    void init(uint64_t* bitmap_addr, size_t num_pages) noexcept {
-        bitmap = bitmap_addr;
+    // Words of metadata (bitmap + buddy index) a zone needs
+    static size_t storage_words(size_t num_pages, size_t base_page) noexcept {
+        const size_t offset = base_page & ((1ULL << buddy_index::MAX_ORDER) - 1);
+        return (num_pages + 63) / 64 + buddy_index::words_needed(offset + num_pages);
+    }
+    
+    void init(uint64_t* storage, size_t num_pages, size_t base_page) noexcept {
+        bitmap = storage;
         total_pages = num_pages;
         bitmap_size = (num_pages + 63) / 64;  // Round up to 64-bit words
-        first_free_page = 0;
+        phase = base_page & ((1ULL << buddy_index::MAX_ORDER) - 1);
         free_pages.store(0, memory_order::relaxed);
         
         // Mark all pages as used initially
-        for (size_t i = 0; i < bitmap_size; ++i) {
-            bitmap[i] = 0xFFFFFFFFFFFFFFFF;
-        }
+        fill_words(bitmap, 0xFFFFFFFFFFFFFFFF, bitmap_size);
+        
+        buddy.init(storage + bitmap_size, phase + num_pages);
     }
     
     void mark_free(size_t page_num) noexcept {
@@ -77,10 +274,7 @@ public:
         if (old_val != new_val) {
             bitmap[idx] = new_val;
             free_pages.fetch_add(1, memory_order::relaxed);
-            
-            if (page_num < first_free_page) {
-                first_free_page = page_num;
-            }
+            buddy.insert(page_num + phase, 0);
         }
     }
     
@@ -96,66 +290,87 @@ public:
         if (old_val != new_val) {
             bitmap[idx] = new_val;
             free_pages.fetch_add(-1, memory_order::relaxed);
+            buddy.remove_page(page_num + phase);
         }
     }
     
-    size_t allocate() noexcept {
-        // Start searching from the first known free page
-        for (size_t i = first_free_page / 64; i < bitmap_size; ++i) {
-            uint64_t word = bitmap[i];
-            if (word != 0xFFFFFFFFFFFFFFFF) {
-                // Find first clear bit using builtin
-                int bit = __builtin_ctzll(~word);
-                size_t page_num = i * 64 + bit;
-                
-                if (page_num < total_pages) {
-                    mark_used(page_num);
-                    
-                    // Update first_free_page hint
-                    if (page_num == first_free_page) {
-                        first_free_page = page_num + 1;
-                    }
-                    
-                    return page_num;
+    // Free a run of pages in aligned chunks, coalescing as it goes
+    void mark_free_range(size_t start, size_t count) noexcept {
+        if (start >= total_pages) return;
+        count = min(count, total_pages - start);
+        
+        size_t index = start + phase;
+        while (count > 0) {
+            size_t order = index ? min<size_t>(__builtin_ctzll(index), buddy_index::MAX_ORDER)
+                                 : buddy_index::MAX_ORDER;
+            while ((1ULL << order) > count) {
+                --order;
+            }
+            
+            if (range_used(index - phase, 1ULL << order)) {
+                release_block(index - phase, order);
+            } else {
+                // Partly free already; fall back to page by page
+                for (size_t i = 0; i < (1ULL << order); ++i) {
+                    mark_free(index - phase + i);
                 }
             }
+            index += 1ULL << order;
+            count -= 1ULL << order;
+        }
+    }
+    
+    size_t allocate() noexcept {
+        return allocate_block(0);
+    }
+    
+    // 2^order pages aligned to 2^order frames, or -1
+    size_t allocate_block(size_t order) noexcept {
+        if (order > buddy_index::MAX_ORDER) return static_cast<size_t>(-1);
+        
+        const size_t index = buddy.take(order);
+        if (index == buddy_index::npos) {
+            return static_cast<size_t>(-1);  // No free block large enough
         }
         
-        return static_cast<size_t>(-1);  // No free pages
+        const size_t page_num = index - phase;
+        set_range(page_num, 1ULL << order, true);
+        free_pages.fetch_add(-(1ULL << order), memory_order::relaxed);
+        return page_num;
+    }
+    
+    // Free a block from allocate_block, coalescing with its buddies
+    void free_block(size_t page_num, size_t order) noexcept {
+        release_block(page_num, order);
     }
     
     size_t allocate_contiguous(size_t count) noexcept {
-        if (count == 0) return static_cast<size_t>(-1);
-        if (count == 1) return allocate();
-        
-        size_t consecutive = 0;
-        size_t start_page = 0;
+        return allocate_aligned(count, 1);
+    }
+    
+    // count pages starting on an align-page boundary (align a power of
+    // two, at most 2^MAX_ORDER, or -1). The rounded-up block's tail is
+    // returned. Counts above 2^MAX_ORDER pages take whole top-order
+    // blocks, so they come out 2^MAX_ORDER aligned.
+    size_t allocate_aligned(size_t count, size_t align) noexcept {
+        if (count == 0 || align == 0 || (align & (align - 1)) != 0 ||
+            align > (1ULL << buddy_index::MAX_ORDER)) {
+            return static_cast<size_t>(-1);
+        }
+        if (count > (1ULL << buddy_index::MAX_ORDER)) {
+            return allocate_run(count);
+        }
         
-        for (size_t page = 0; page < total_pages; ++page) {
-            size_t idx = page / 64;
-            size_t bit = page % 64;
-            
-            if ((bitmap[idx] & (1ULL << bit)) == 0) {
-                // Page is free
-                if (consecutive == 0) {
-                    start_page = page;
-                }
-                consecutive++;
-                
-                if (consecutive == count) {
-                    // Found enough contiguous pages
-                    for (size_t i = 0; i < count; ++i) {
-                        mark_used(start_page + i);
-                    }
-                    return start_page;
-                }
-            } else {
-                // Page is used, reset counter
-                consecutive = 0;
-            }
+        size_t order = 0;
+        while ((1ULL << order) < count || (1ULL << order) < align) {
+            ++order;
         }
         
-        return static_cast<size_t>(-1);  // Not enough contiguous pages
+        const size_t page_num = allocate_block(order);
+        if (page_num != static_cast<size_t>(-1) && count < (1ULL << order)) {
+            mark_free_range(page_num + count, (1ULL << order) - count);
+        }
+        return page_num;
     }
     
     void free(size_t page_num) noexcept {
@@ -163,9 +378,7 @@ public:
     }
     
     void free_contiguous(size_t start_page, size_t count) noexcept {
-        for (size_t i = 0; i < count; ++i) {
-            mark_free(start_page + i);
-        }
+        mark_free_range(start_page, count);
     }
     
     size_t get_free_pages() const noexcept {
@@ -175,14 +388,314 @@ public:
     size_t get_total_pages() const noexcept {
         return total_pages;
     }
+    
+private:
+    size_t allocate_run(size_t count) noexcept {
+        constexpr size_t block = 1ULL << buddy_index::MAX_ORDER;
+        const size_t blocks = (count + block - 1) / block;
+        
+        const size_t index = buddy.take_run(blocks);
+        if (index == buddy_index::npos) return static_cast<size_t>(-1);
+        
+        const size_t page_num = index - phase;
+        set_range(page_num, blocks * block, true);
+        free_pages.fetch_add(-(blocks * block), memory_order::relaxed);
+        if (count < blocks * block) {
+            mark_free_range(page_num + count, blocks * block - count);
+        }
+        return page_num;
+    }
+    
+    void release_block(size_t page_num, size_t order) noexcept {
+        set_range(page_num, 1ULL << order, false);
+        free_pages.fetch_add(1ULL << order, memory_order::relaxed);
+        buddy.insert(page_num + phase, order);
+    }
+    
+    bool range_used(size_t start, size_t count) const noexcept {
+        const size_t end = start + count;
+        size_t page = start;
+        
+        while (page < end) {
+            if (page % 64 == 0 && end - page >= 64) {
+                if (bitmap[page / 64] != 0xFFFFFFFFFFFFFFFF) return false;
+                page += 64;
+            } else {
+                if (!((bitmap[page / 64] >> (page % 64)) & 1)) return false;
+                ++page;
+            }
+        }
+        return true;
+    }
+    
+    // Set or clear a run of bitmap bits: partial words at the edges, one
+    // string fill for the whole words between them
+    void set_range(size_t start, size_t count, bool used) noexcept {
+        const size_t end = start + count;
+        const auto apply = [&](size_t word, uint64_t mask) noexcept {
+            bitmap[word] = used ? bitmap[word] | mask : bitmap[word] & ~mask;
+        };
+        
+        const size_t first = start / 64;
+        const size_t last = end / 64;
+        const uint64_t head = ~0ULL << (start % 64);
+        const uint64_t tail = end % 64 ? ~0ULL >> (64 - end % 64) : 0;
+        
+        if (first == last) {
+            apply(first, head & tail);
+            return;
+        }
+        size_t whole = first;
+        if (start % 64) apply(whole++, head);
+        fill_words(bitmap + whole, used ? 0xFFFFFFFFFFFFFFFF : 0, last - whole);
+        if (tail) apply(last, tail);
+    }
 };
 
 // Global physical memory manager state
-inline bitmap_allocator zones[3];  // DMA, Normal, High zones
+constexpr size_t MAX_NODES = topology::MAX_NODES;
+
+// One NUMA node's memory, split into the standard zones. Each allocator
+// covers [start, end) of its zone on this node and numbers pages from
+// start; zones the node has no memory in are empty.
+struct node_memory {
+    bitmap_allocator zones[3];  // DMA, Normal, High zones
+    uint64_t start[3];
+    uint64_t end[3];
+};
+
+inline node_memory nodes[MAX_NODES];
+inline concurrent::spinlock lock;  // Allocations and frees come from every core
+inline uint32_t node_count = 1;
+inline uint8_t node_order[MAX_NODES][MAX_NODES];  // Nodes by SLIT distance
 inline memory_stats stats;
 inline uint64_t memory_size;
 inline uint64_t kernel_start;
 inline uint64_t kernel_end;
+inline uint64_t metadata_start;  // Zone bitmaps and buddy indices
+inline uint64_t metadata_end;
+inline ram_range ram[MAX_RAM_RANGES];
+inline size_t ram_count = 0;
+inline ram_range kept[MAX_KEPT_RANGES];  // Loader data init() must not touch
+inline size_t kept_count = 0;
+
+constexpr size_t npos = static_cast<size_t>(-1);
+
+// Physical base address of each zone
+constexpr uint64_t zone_base(zone_type zone) noexcept {
+    return zone == zone_type::dma    ? 0 :
+           zone == zone_type::normal ? 16ULL * 1024 * 1024 :
+                                       4ULL * 1024 * 1024 * 1024;
+}
+
+// Physical end address of each zone (high memory ends with the node)
+constexpr uint64_t zone_limit(zone_type zone) noexcept {
+    return zone == zone_type::dma    ? 16ULL * 1024 * 1024 :
+           zone == zone_type::normal ? 4ULL * 1024 * 1024 * 1024 :
+                                       ~0ULL;
+}
+
+constexpr zone_type zone_of(uint64_t addr) noexcept {
+    return addr < zone_limit(zone_type::dma)    ? zone_type::dma :
+           addr < zone_limit(zone_type::normal) ? zone_type::normal :
+                                                  zone_type::high;
+}
+
+// Node owning a physical address: the SRAT range containing it, or node
+// 0 when the firmware gave no affinity information
+uint32_t node_of(uint64_t addr) noexcept {
+    for (const auto& range : acpi::memory_ranges()) {
+        if (addr >= range.base && addr - range.base < range.length) {
+            return range.node;
+        }
+    }
+    return 0;
+}
+
+// Physical span [lo, hi) of a node's memory
+void node_span(uint32_t node, uint64_t& lo, uint64_t& hi) noexcept {
+    const auto ranges = acpi::memory_ranges();
+    if (ranges.empty()) {
+        lo = 0;
+        hi = memory_size;
+        return;
+    }
+    
+    lo = ~0ULL;
+    hi = 0;
+    for (const auto& range : ranges) {
+        if (range.node != node) continue;
+        lo = min(lo, range.base);
+        hi = max(hi, range.base + range.length);
+    }
+    if (lo >= hi) lo = hi = 0;
+}
+
+// Bytes of zone bitmaps and buddy indices for every node
+uint64_t metadata_bytes() noexcept {
+    uint64_t bytes = 0;
+    for (uint32_t n = 0; n < node_count; ++n) {
+        uint64_t lo, hi;
+        node_span(n, lo, hi);
+        lo = (lo + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        hi &= ~(PAGE_SIZE - 1);
+        
+        for (int z = 0; z < 3; ++z) {
+            const auto type = static_cast<zone_type>(z);
+            uint64_t start = max(lo, zone_base(type));
+            uint64_t end = min(hi, zone_limit(type));
+            if (start >= end) start = end = zone_base(type);
+            bytes += bitmap_allocator::storage_words((end - start) / PAGE_SIZE, start / PAGE_SIZE) *
+                     sizeof(uint64_t);
+        }
+    }
+    return bytes;
+}
+
+// Lowest page-aligned address from at or above which bytes fit clear of
+// every kept range
+uint64_t clear_of_kept(uint64_t from, uint64_t bytes) noexcept {
+    from = (from + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    for (bool moved = true; moved;) {
+        moved = false;
+        for (size_t i = 0; i < kept_count; ++i) {
+            if (from < kept[i].end && from + bytes > kept[i].base) {
+                from = (kept[i].end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+                moved = true;
+            }
+        }
+    }
+    return from;
+}
+
+// Place each node's zone bitmaps and buddy indices after the kernel,
+// past any kept range they would overlap (GRUB puts modules and the
+// multiboot information right after the kernel), and order the other
+// nodes by distance for fallback
+void init_zones() noexcept {
+    node_count = acpi::memory_ranges().empty() ? 1 : topology::node_count;
+    uint64_t cursor = clear_of_kept(kernel_end, metadata_bytes());
+    metadata_start = cursor;
+    
+    for (uint32_t n = 0; n < node_count; ++n) {
+        uint64_t lo, hi;
+        node_span(n, lo, hi);
+        lo = (lo + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        hi &= ~(PAGE_SIZE - 1);
+        
+        for (int z = 0; z < 3; ++z) {
+            const auto type = static_cast<zone_type>(z);
+            uint64_t start = max(lo, zone_base(type));
+            uint64_t end = min(hi, zone_limit(type));
+            if (start >= end) start = end = zone_base(type);
+            
+            const size_t pages = (end - start) / PAGE_SIZE;
+            const size_t base_page = start / PAGE_SIZE;
+            
+            nodes[n].start[z] = start;
+            nodes[n].end[z] = end;
+            nodes[n].zones[z].init(reinterpret_cast<uint64_t*>(cursor), pages, base_page);
+            cursor += bitmap_allocator::storage_words(pages, base_page) * sizeof(uint64_t);
+        }
+        
+        // Insertion sort by distance; the node itself (10) comes first
+        for (uint32_t i = 0; i < node_count; ++i) {
+            uint32_t j = i;
+            while (j > 0 && topology::distance(n, node_order[n][j - 1]) > topology::distance(n, i)) {
+                node_order[n][j] = node_order[n][j - 1];
+                --j;
+            }
+            node_order[n][j] = static_cast<uint8_t>(i);
+        }
+    }
+    
+    metadata_end = (cursor + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+// Release [start, end) of one node's memory to the zones it overlaps
+void free_node_range(uint32_t node, uint64_t start, uint64_t end) noexcept {
+    for (int z = 0; z < 3; ++z) {
+        const uint64_t lo = max(start, nodes[node].start[z]);
+        const uint64_t hi = min(end, nodes[node].end[z]);
+        if (lo >= hi) continue;
+        
+        auto& zone = nodes[node].zones[z];
+        const size_t before = zone.get_free_pages();
+        zone.free_contiguous((lo - nodes[node].start[z]) / PAGE_SIZE, (hi - lo) / PAGE_SIZE);
+        stats.free_pages.fetch_add(zone.get_free_pages() - before, memory_order::relaxed);
+    }
+}
+
+// One of the kernel, the PMM metadata and the kept ranges that
+// overlaps [start, end), as [lo, hi); false if none does
+bool excluded(uint64_t start, uint64_t end, uint64_t& lo, uint64_t& hi) noexcept {
+    const auto overlaps = [&](uint64_t base, uint64_t limit) {
+        if (start >= limit || end <= base) return false;
+        lo = base;
+        hi = limit;
+        return true;
+    };
+    if (overlaps(kernel_start, kernel_end) || overlaps(metadata_start, metadata_end)) return true;
+    for (size_t i = 0; i < kept_count; ++i) {
+        if (overlaps(kept[i].base, kept[i].end)) return true;
+    }
+    return false;
+}
+
+// Release usable RAM in [start, end) to the nodes and zones it overlaps,
+// skipping low memory (which also keeps page 0, the failure value, out),
+// the kernel, the PMM metadata and the kept ranges
+void free_physical_range(uint64_t start, uint64_t end) noexcept {
+    start = max<uint64_t>((start + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1), LOW_MEMORY_END);
+    end &= ~(PAGE_SIZE - 1);
+    if (start >= end) return;
+    
+    uint64_t lo, hi;
+    if (excluded(start, end, lo, hi)) {
+        if (start < lo) free_physical_range(start, lo);
+        if (end > hi) free_physical_range(hi, end);
+        return;
+    }
+    
+    const auto ranges = acpi::memory_ranges();
+    if (ranges.empty()) {
+        free_node_range(0, start, end);
+        return;
+    }
+    
+    // RAM outside every SRAT range has no node and stays unused
+    for (const auto& range : ranges) {
+        const uint64_t lo = max(start, range.base);
+        const uint64_t hi = min(end, range.base + range.length);
+        if (lo < hi) free_node_range(range.node, lo, hi);
+    }
+}
+
+// Note [base, end) as RAM, joined to the previous range when they touch
+// (the map is sorted by address)
+void record_ram(uint64_t base, uint64_t end) noexcept {
+    if (ram_count > 0 && ram[ram_count - 1].end == base) {
+        ram[ram_count - 1].end = end;
+    } else if (ram_count < MAX_RAM_RANGES) {
+        ram[ram_count++] = {base, end};
+    }
+}
+
+// Highest end address of usable RAM in the memory map
+uint64_t scan_memory_size(void* mmap_addr, uint32_t mmap_length) noexcept {
+    auto* entry = static_cast<memory_region*>(mmap_addr);
+    auto* end = reinterpret_cast<memory_region*>(
+        reinterpret_cast<uint8_t*>(mmap_addr) + mmap_length
+    );
+    
+    uint64_t size = 0;
+    for (; entry < end; ++entry) {
+        if (entry->type == 1) {
+            size = max(size, entry->base + entry->length);
+        }
+    }
+    return size;
+}
 
 // Multiboot memory map parsing
 void parse_memory_map(void* mmap_addr, uint32_t mmap_length) noexcept {
@@ -194,77 +707,52 @@ void parse_memory_map(void* mmap_addr, uint32_t mmap_length) noexcept {
     memory_size = 0;
     
     while (entry < end) {
+        if (entry->type == 1 || entry->type == 3 || entry->type == 4) {
+            record_ram(entry->base, entry->base + entry->length);
+        }
+        
         if (entry->type == 1) {  // Available RAM
-            uint64_t base = entry->base;
-            uint64_t length = entry->length;
-            uint64_t end_addr = base + length;
+            uint64_t end_addr = entry->base + entry->length;
             
             // Track total memory
             if (end_addr > memory_size) {
                 memory_size = end_addr;
             }
             
-            // Mark pages as free in appropriate zone
-            size_t start_page = (base + PAGE_SIZE - 1) / PAGE_SIZE;
-            size_t end_page = end_addr / PAGE_SIZE;
-            
-            for (size_t page = start_page; page < end_page; ++page) {
-                uint64_t addr = page * PAGE_SIZE;
-                
-                // Skip kernel pages
-                if (addr >= kernel_start && addr < kernel_end) {
-                    continue;
-                }
-                
-                // Determine zone and mark free
-                if (addr < 16 * 1024 * 1024) {
-                    zones[static_cast<int>(zone_type::dma)].mark_free(page);
-                } else if (addr < 4ULL * 1024 * 1024 * 1024) {
-                    size_t zone_page = (addr - 16 * 1024 * 1024) / PAGE_SIZE;
-                    zones[static_cast<int>(zone_type::normal)].mark_free(zone_page);
-                } else {
-                    size_t zone_page = (addr - 4ULL * 1024 * 1024 * 1024) / PAGE_SIZE;
-                    zones[static_cast<int>(zone_type::high)].mark_free(zone_page);
-                }
-                
-                stats.free_pages.fetch_add(1, memory_order::relaxed);
-            }
-            
-            stats.total_pages.store(end_page, memory_order::relaxed);
+            // Whole runs go to the zones' buddy indices in aligned chunks
+            free_physical_range(entry->base, end_addr);
         }
         
         // Move to next entry
         entry++;
     }
+    
+    stats.total_pages.store(memory_size / PAGE_SIZE, memory_order::relaxed);
+}
+
+// Before init(): loader data in RAM that must outlive it (boot modules,
+// the multiboot information and the memory map inside it). The metadata
+// is laid out clear of it and its pages are never freed. false once
+// MAX_KEPT_RANGES are kept.
+bool keep(uint64_t start, uint64_t end) noexcept {
+    if (kept_count == MAX_KEPT_RANGES || start >= end) return false;
+    kept[kept_count++] = {start & ~(PAGE_SIZE - 1), (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)};
+    return true;
 }
 
-// Initialize physical memory manager
+// Initialize physical memory manager (after acpi::init, so zones can be
+// split by node)
 void init(void* mmap_addr, uint32_t mmap_length, 
           uint64_t kernel_phys_start, uint64_t kernel_phys_end) noexcept {
     kernel_start = kernel_phys_start;
     kernel_end = kernel_phys_end;
     
-    // Calculate bitmap locations (place after kernel)
-    uint64_t bitmap_start = (kernel_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
-    
-    // Initialize zones
-    size_t dma_pages = (16 * 1024 * 1024) / PAGE_SIZE;
-    size_t normal_pages = (4ULL * 1024 * 1024 * 1024 - 16 * 1024 * 1024) / PAGE_SIZE;
-    size_t high_pages = (16ULL * 1024 * 1024 * 1024 - 4ULL * 1024 * 1024 * 1024) / PAGE_SIZE;
-    
-    zones[static_cast<int>(zone_type::dma)].init(
-        reinterpret_cast<uint64_t*>(bitmap_start), dma_pages
-    );
-    
-    bitmap_start += (dma_pages + 63) / 64 * 8;
-    zones[static_cast<int>(zone_type::normal)].init(
-        reinterpret_cast<uint64_t*>(bitmap_start), normal_pages
-    );
+    // Zones are sized to the memory that exists
+    if (mmap_addr && mmap_length > 0) {
+        memory_size = scan_memory_size(mmap_addr, mmap_length);
+    }
     
-    bitmap_start += (normal_pages + 63) / 64 * 8;
-    zones[static_cast<int>(zone_type::high)].init(
-        reinterpret_cast<uint64_t*>(bitmap_start), high_pages
-    );
+    init_zones();
     
     // Parse memory map and mark free pages
     if (mmap_addr && mmap_length > 0) {
@@ -278,137 +766,148 @@ void init_fallback(uint64_t kernel_phys_start, uint64_t kernel_phys_end,
     kernel_start = kernel_phys_start;
     kernel_end = kernel_phys_end;
     memory_size = total_mem;
+    record_ram(0, total_mem);
     
-    // Calculate bitmap locations (place after kernel)
-    uint64_t bitmap_start = (kernel_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
-    
-    // Initialize zones
-    size_t dma_pages = (16 * 1024 * 1024) / PAGE_SIZE;
-    size_t normal_pages = (4ULL * 1024 * 1024 * 1024 - 16 * 1024 * 1024) / PAGE_SIZE;
-    size_t high_pages = (16ULL * 1024 * 1024 * 1024 - 4ULL * 1024 * 1024 * 1024) / PAGE_SIZE;
-    
-    zones[static_cast<int>(zone_type::dma)].init(
-        reinterpret_cast<uint64_t*>(bitmap_start), dma_pages
-    );
-    
-    bitmap_start += (dma_pages + 63) / 64 * 8;
-    zones[static_cast<int>(zone_type::normal)].init(
-        reinterpret_cast<uint64_t*>(bitmap_start), normal_pages
-    );
-    
-    bitmap_start += (normal_pages + 63) / 64 * 8;
-    zones[static_cast<int>(zone_type::high)].init(
-        reinterpret_cast<uint64_t*>(bitmap_start), high_pages
-    );
+    init_zones();
     
-    // Calculate bitmap end
-    uint64_t bitmap_end = bitmap_start + (high_pages + 63) / 64 * 8;
-    
-    // Mark 16MB-total_mem as free (excluding kernel and bitmaps)
-    for (uint64_t addr = 16 * 1024 * 1024; addr < total_mem; addr += PAGE_SIZE) {
-        // Skip kernel
-        if (addr >= kernel_start && addr < kernel_end) {
-            continue;
-        }
-        
-        // Skip bitmap area (starts right after kernel, page-aligned)
-        uint64_t bitmap_phys_start = (kernel_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
-        if (addr >= bitmap_phys_start && addr < bitmap_end) {
-            continue;
-        }
-        
-        // Mark page as free in normal zone
-        size_t zone_page = (addr - 16 * 1024 * 1024) / PAGE_SIZE;
-        zones[static_cast<int>(zone_type::normal)].mark_free(zone_page);
-        stats.free_pages.fetch_add(1, memory_order::relaxed);
-    }
+    // Mark 16MB-total_mem as free (excluding kernel and metadata)
+    free_physical_range(16 * 1024 * 1024, total_mem);
     
     stats.total_pages.store(total_mem / PAGE_SIZE, memory_order::relaxed);
 }
 
-// Allocate a physical page
-uint64_t allocate_page(zone_type zone = zone_type::normal) noexcept {
-    size_t page_num = zones[static_cast<int>(zone)].allocate();
-    
-    if (page_num == static_cast<size_t>(-1)) {
-        // Try other zones
-        if (zone != zone_type::high) {
-            page_num = zones[static_cast<int>(zone_type::high)].allocate();
-            if (page_num != static_cast<size_t>(-1)) {
-                zone = zone_type::high;
-            }
-        }
-        if (page_num == static_cast<size_t>(-1) && zone != zone_type::dma) {
-            page_num = zones[static_cast<int>(zone_type::dma)].allocate();
-            if (page_num != static_cast<size_t>(-1)) {
-                zone = zone_type::dma;
-            }
-        }
-    }
-    
-    if (page_num != static_cast<size_t>(-1)) {
-        stats.free_pages.fetch_add(-1, memory_order::relaxed);
+// Walk nodes nearest-first and each node's zones in the given order until
+// take() succeeds; returns the physical address or 0
+template<typename Take>
+uint64_t allocate_near(uint32_t node, const zone_type* order, size_t tries,
+                       size_t count, Take take) noexcept {
+    if (node >= node_count) node = 0;
+    
+    concurrent::spin_guard guard(lock);
+    for (uint32_t i = 0; i < node_count; ++i) {
+        node_memory& mem = nodes[node_order[node][i]];
         
-        // Convert page number to physical address based on zone
-        if (zone == zone_type::dma) {
-            return page_num * PAGE_SIZE;
-        } else if (zone == zone_type::normal) {
-            return 16 * 1024 * 1024 + page_num * PAGE_SIZE;
-        } else {
-            return 4ULL * 1024 * 1024 * 1024 + page_num * PAGE_SIZE;
+        for (size_t t = 0; t < tries; ++t) {
+            const int z = static_cast<int>(order[t]);
+            const size_t page_num = take(mem.zones[z]);
+            
+            if (page_num != npos) {
+                stats.free_pages.fetch_add(-count, memory_order::relaxed);
+                return mem.start[z] + page_num * PAGE_SIZE;
+            }
         }
     }
     
     return 0;  // Allocation failed
 }
 
-// Allocate contiguous physical pages
+// Allocate a physical page on a node, falling back to its other zones
+// (high, then DMA) and then to other nodes by distance
+uint64_t allocate_page(uint32_t node, zone_type zone = zone_type::normal) noexcept {
+    zone_type order[3];
+    size_t tries = 0;
+    order[tries++] = zone;
+    if (zone != zone_type::high) order[tries++] = zone_type::high;
+    if (zone != zone_type::dma) order[tries++] = zone_type::dma;
+    
+    return allocate_near(node, order, tries, 1, [](bitmap_allocator& a) noexcept {
+        return a.allocate();
+    });
+}
+
+// Allocate a physical page near the calling core
+uint64_t allocate_page(zone_type zone = zone_type::normal) noexcept {
+    return allocate_page(topology::current_node(), zone);
+}
+
+// Allocate contiguous physical pages from one zone, nearest node first
+uint64_t allocate_pages(uint32_t node, size_t count, zone_type zone = zone_type::normal) noexcept {
+    return allocate_near(node, &zone, 1, count, [count](bitmap_allocator& a) noexcept {
+        return a.allocate_contiguous(count);
+    });
+}
+
 uint64_t allocate_pages(size_t count, zone_type zone = zone_type::normal) noexcept {
-    size_t page_num = zones[static_cast<int>(zone)].allocate_contiguous(count);
-    
-    if (page_num != static_cast<size_t>(-1)) {
-        stats.free_pages.fetch_add(-count, memory_order::relaxed);
-        
-        // Convert page number to physical address
-        if (zone == zone_type::dma) {
-            return page_num * PAGE_SIZE;
-        } else if (zone == zone_type::normal) {
-            return 16 * 1024 * 1024 + page_num * PAGE_SIZE;
-        } else {
-            return 4ULL * 1024 * 1024 * 1024 + page_num * PAGE_SIZE;
+    return allocate_pages(topology::current_node(), count, zone);
+}
+
+// Allocate count contiguous pages whose physical address is aligned to
+// align bytes (a power of two up to 1 GiB, e.g. for large pages; larger
+// alignments fail). Runs over 1 GiB are found by scanning for free 1 GiB
+// blocks that sit next to each other.
+// Tries the requested zone first, then high memory, on each node from
+// the nearest outward.
+uint64_t allocate_aligned_pages(size_t count, size_t align, zone_type zone = zone_type::normal,
+                                uint32_t node = topology::current_node()) noexcept {
+    const size_t align_pages = align > PAGE_SIZE ? align / PAGE_SIZE : 1;
+    
+    const zone_type order[2] = {zone, zone_type::high};
+    const size_t tries = zone == zone_type::high ? 1 : 2;
+    
+    return allocate_near(node, order, tries, count, [=](bitmap_allocator& a) noexcept {
+        return a.allocate_aligned(count, align_pages);
+    });
+}
+
+// Take [start, end) back out of the free pages: data the loader left in
+// RAM (boot modules, regions kept across reboots), found after init()
+// released it. Returns false if any page in it was not free.
+bool reserve_range(uint64_t start, uint64_t end) noexcept {
+    start &= ~(PAGE_SIZE - 1);
+    end = (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    
+    concurrent::spin_guard guard(lock);
+    size_t taken = 0;
+    for (uint32_t n = 0; n < node_count; ++n) {
+        for (int z = 0; z < 3; ++z) {
+            const uint64_t lo = max(start, nodes[n].start[z]);
+            const uint64_t hi = min(end, nodes[n].end[z]);
+            if (lo >= hi) continue;
+            
+            auto& zone = nodes[n].zones[z];
+            const size_t before = zone.get_free_pages();
+            for (uint64_t page = lo; page < hi; page += PAGE_SIZE) {
+                zone.mark_used((page - nodes[n].start[z]) / PAGE_SIZE);
+            }
+            stats.free_pages.fetch_add(zone.get_free_pages() - before, memory_order::relaxed);
+            taken += before - zone.get_free_pages();
         }
     }
-    
-    return 0;  // Allocation failed
+    return taken == (end - start) / PAGE_SIZE;
 }
 
-// Free a physical page
 void free_page(uint64_t addr) noexcept {
     if (addr == 0) return;
     
-    size_t page_num;
-    zone_type zone;
-    
-    if (addr < 16 * 1024 * 1024) {
-        zone = zone_type::dma;
-        page_num = addr / PAGE_SIZE;
-    } else if (addr < 4ULL * 1024 * 1024 * 1024) {
-        zone = zone_type::normal;
-        page_num = (addr - 16 * 1024 * 1024) / PAGE_SIZE;
-    } else {
-        zone = zone_type::high;
-        page_num = (addr - 4ULL * 1024 * 1024 * 1024) / PAGE_SIZE;
-    }
+    const int z = static_cast<int>(zone_of(addr));
+    node_memory& mem = nodes[node_of(addr)];
     
-    zones[static_cast<int>(zone)].free(page_num);
+    concurrent::spin_guard guard(lock);
+    mem.zones[z].free((addr - mem.start[z]) / PAGE_SIZE);
     stats.free_pages.fetch_add(1, memory_order::relaxed);
 }
 
-// Free contiguous physical pages
+// Free contiguous physical pages (one zone), coalescing in the buddy index
 void free_pages(uint64_t addr, size_t count) noexcept {
-    for (size_t i = 0; i < count; ++i) {
-        free_page(addr + i * PAGE_SIZE);
+    if (addr == 0 || count == 0) return;
+    
+    const int z = static_cast<int>(zone_of(addr));
+    node_memory& mem = nodes[node_of(addr)];
+    
+    concurrent::spin_guard guard(lock);
+    mem.zones[z].free_contiguous((addr - mem.start[z]) / PAGE_SIZE, count);
+    stats.free_pages.fetch_add(count, memory_order::relaxed);
+}
+
+// Free pages on one node
+size_t get_node_free_pages(uint32_t node) noexcept {
+    if (node >= node_count) return 0;
+    
+    size_t free = 0;
+    for (int z = 0; z < 3; ++z) {
+        free += nodes[node].zones[z].get_free_pages();
     }
+    return free;
 }
 
 // Get memory statistics
@@ -426,4 +925,9 @@ uint64_t get_memory_size() noexcept {
     return memory_size;
 }
 
+// RAM ranges in address order, for building the kernel page tables
+span<const ram_range> ram_ranges() noexcept {
+    return {ram, ram_count};
+}
+
 } // namespace hft::pmm
@@ -0,0 +1,299 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+
+export module hft.registry;
+import hft.core;
+import hft.vmm;
+import hft.heap;
+import hft.smp;
+import hft.trading;
+
+// Instrument registry: instrument id -> order book.
+// Instruments are declared at startup with a depth class and, optionally,
+// the feed core that will own them; build() shards the rest across the
+// feed cores by book size, then lays each core's books out back to back
+// in one heap::arena on that core's NUMA node. Ids are 16-bit (ITCH
+// stock locate codes), so lookup is a direct index, no hashing. Every
+// book has exactly one writer: write() only runs on the owning core.
+export namespace hft::registry {
+
+constexpr uint32_t MAX_INSTRUMENTS = 4096;
+constexpr uint32_t MAX_IDS = 65536;
+constexpr uint32_t AUTO = 0xFFFFFFFF;  // Owner: let build() choose
+
+// Level capacity by instrument class: liquid names get deep ladders,
+// the long tail stays small enough to live in cache
+enum class depth : uint8_t {
+    shallow,   // 8 levels per side
+    standard,  // 32
+    deep       // 128
+};
+
+template<depth D>
+constexpr size_t levels = D == depth::deep ? 128 : D == depth::standard ? 32 : 8;
+
+template<depth D>
+using book = trading::order_book<levels<D>>;
+
+struct instrument {
+    uint16_t id;
+    uint64_t symbol;     // pack_symbol() form
+    depth depth_class;
+    uint32_t owner;      // Writer core index, or AUTO
+};
+
+// Up to 8 characters, space padded, as the bytes sit on the wire (the
+// form itch::stock_directory::stock and gateway templates use)
+constexpr uint64_t pack_symbol(const char* symbol) noexcept {
+    uint64_t packed = 0;
+    bool ended = false;
+    for (size_t i = 0; i < 8; ++i) {
+        ended = ended || symbol[i] == '\0';
+        const uint8_t c = ended ? ' ' : static_cast<uint8_t>(symbol[i]);
+        packed |= static_cast<uint64_t>(c) << (8 * i);
+    }
+    return packed;
+}
+
+} // namespace hft::registry
+
+namespace hft::registry {
+
+constexpr uint16_t NO_SLOT = 0xFFFF;
+constexpr depth LARGEST_FIRST[] = {depth::deep, depth::standard, depth::shallow};
+
+struct entry {
+    void* book;
+    uint64_t symbol;
+    uint32_t owner;
+    uint16_t id;
+    depth depth_class;
+    bool automatic;  // Declared AUTO: build() picked the owner
+};
+
+struct shard {
+    heap::arena* arena;     // Node-local, books back to back
+    uint64_t bytes;         // Book bytes assigned (before rounding to pages)
+    uint32_t instruments;
+};
+
+inline entry entries[MAX_INSTRUMENTS] = {};
+inline uint32_t entry_count = 0;
+inline uint16_t slots[MAX_IDS] = {};  // Id -> entry index + 1 (0: unknown)
+inline shard shards[topology::MAX_CPUS] = {};
+inline bool built = false;
+inline trading::flat_index<MAX_INSTRUMENTS * 2> by_symbol;
+
+constexpr size_t book_bytes(depth d) noexcept {
+    return d == depth::deep     ? sizeof(book<depth::deep>) :
+           d == depth::standard ? sizeof(book<depth::standard>) :
+                                  sizeof(book<depth::shallow>);
+}
+
+inline uint16_t slot_of(uint16_t id) noexcept {
+    return static_cast<uint16_t>(slots[id] - 1);  // Unknown ids wrap to NO_SLOT
+}
+
+// Call f with the entry's book as its concrete type
+template<typename F>
+void visit(const entry& e, F&& f) noexcept {
+    switch (e.depth_class) {
+        case depth::deep:     f(*static_cast<book<depth::deep>*>(e.book)); break;
+        case depth::standard: f(*static_cast<book<depth::standard>*>(e.book)); break;
+        case depth::shallow:  f(*static_cast<book<depth::shallow>*>(e.book)); break;
+    }
+}
+
+// Writers must be cores that came up: books are placed on their node
+// and only they may write
+bool online(uint32_t cpu) noexcept {
+    return cpu < smp::cpu_count() && smp::state(cpu) != smp::cpu_state::offline;
+}
+
+// Feed core with the least book memory so far
+uint32_t lightest(span<const uint32_t> feed_cores) noexcept {
+    uint32_t best = feed_cores[0];
+    for (const uint32_t cpu : feed_cores) {
+        if (shards[cpu].bytes < shards[best].bytes) best = cpu;
+    }
+    return best;
+}
+
+bool place_books(uint32_t cpu) noexcept {
+    shard& s = shards[cpu];
+    if (s.instruments == 0) return true;
+
+    const uint32_t node = smp::node(cpu);
+    void* storage = heap::kmalloc_node(sizeof(heap::arena), node);
+    if (!storage) return false;
+    s.arena = new (storage) heap::arena();
+
+    // Large pages once a shard fills one, so its books cost few TLB entries
+    const auto page = s.bytes >= vmm::LARGE_PAGE_SIZE ? vmm::page_size::large
+                                                      : vmm::page_size::small;
+    if (!s.arena->init(s.bytes, page, node)) return false;
+
+    // Grouped by class, deep first, so the small books of the long tail
+    // sit together at the end
+    for (const depth d : LARGEST_FIRST) {
+        for (uint32_t i = 0; i < entry_count; ++i) {
+            entry& e = entries[i];
+            if (e.owner != cpu || e.depth_class != d) continue;
+            switch (d) {
+                case depth::deep:     e.book = s.arena->create<book<depth::deep>>(); break;
+                case depth::standard: e.book = s.arena->create<book<depth::standard>>(); break;
+                case depth::shallow:  e.book = s.arena->create<book<depth::shallow>>(); break;
+            }
+            if (!e.book) return false;  // Padding for alignment did not fit
+        }
+    }
+    return true;
+}
+
+// Undo a build() that failed partway: free every arena and return AUTO
+// instruments to the pool so build() can be called again
+void unbuild() noexcept {
+    for (shard& s : shards) {
+        if (s.arena) {
+            destroy_at(s.arena);
+            heap::kfree(s.arena);
+        }
+        s = {};
+    }
+    for (uint32_t i = 0; i < entry_count; ++i) {
+        entries[i].book = nullptr;
+        if (entries[i].automatic) entries[i].owner = AUTO;
+    }
+}
+
+} // namespace hft::registry
+
+export namespace hft::registry {
+
+// Declare an instrument before build() (and after the APs are started);
+// false if the id or symbol is taken, the table is full, the owner is
+// not an online core or the registry is already built
+bool declare(const instrument& i) noexcept {
+    if (built || entry_count == MAX_INSTRUMENTS || slots[i.id] != 0) return false;
+    if (by_symbol.find(i.symbol) != trading::flat_index<MAX_INSTRUMENTS * 2>::npos) return false;
+    if (i.owner != AUTO && !online(i.owner)) return false;
+
+    entries[entry_count] = {nullptr, i.symbol, i.owner, i.id, i.depth_class, i.owner == AUTO};
+    slots[i.id] = static_cast<uint16_t>(entry_count + 1);
+    by_symbol.insert(i.symbol, entry_count);
+    ++entry_count;
+    return true;
+}
+
+// Assign AUTO instruments to feed_cores (deep books first, each to the
+// core with the least book memory so far) and allocate every core's
+// arena on its own node. Call once, on the boot core, before any feed
+// core starts writing. False, with nothing allocated, if a feed core or
+// declared owner is not online or an arena cannot be allocated.
+bool build(span<const uint32_t> feed_cores) noexcept {
+    if (built) return false;
+    for (const uint32_t cpu : feed_cores) {
+        if (!online(cpu)) return false;
+    }
+    for (uint32_t i = 0; i < entry_count; ++i) {
+        if (entries[i].owner != AUTO && !online(entries[i].owner)) return false;
+    }
+
+    for (uint32_t i = 0; i < entry_count; ++i) {
+        const entry& e = entries[i];
+        if (e.owner != AUTO) shards[e.owner].bytes += book_bytes(e.depth_class);
+    }
+    for (const depth d : LARGEST_FIRST) {
+        for (uint32_t i = 0; i < entry_count; ++i) {
+            entry& e = entries[i];
+            if (e.owner != AUTO || e.depth_class != d) continue;
+            if (feed_cores.empty()) {
+                unbuild();
+                return false;
+            }
+            e.owner = lightest(feed_cores);
+            shards[e.owner].bytes += book_bytes(d);
+        }
+    }
+    for (uint32_t i = 0; i < entry_count; ++i) {
+        ++shards[entries[i].owner].instruments;
+    }
+
+    for (uint32_t cpu = 0; cpu < topology::MAX_CPUS; ++cpu) {
+        if (!place_books(cpu)) {
+            unbuild();
+            return false;
+        }
+    }
+    built = true;
+    return true;
+}
+
+// Apply f(book&) to id's book on its owning core; false if id is unknown
+// or the caller is not the owner. Batch several updates with the book's
+// begin_batch()/end_batch() inside f.
+template<typename F>
+bool write(uint16_t id, F&& f) noexcept {
+    const uint16_t slot = slot_of(id);
+    if (slot == NO_SLOT) [[unlikely]] return false;
+    const entry& e = entries[slot];
+    if (e.owner != topology::this_cpu()->index) [[unlikely]] return false;
+    visit(e, f);
+    return true;
+}
+
+// Apply f(const book&) from any core (the books' reader methods copy
+// under their seqlock); false if id is unknown
+template<typename F>
+bool read(uint16_t id, F&& f) noexcept {
+    const uint16_t slot = slot_of(id);
+    if (slot == NO_SLOT) [[unlikely]] return false;
+    visit(entries[slot], [&f](const auto& b) { f(b); });
+    return true;
+}
+
+[[nodiscard]] bool contains(uint16_t id) noexcept {
+    return slot_of(id) != NO_SLOT;
+}
+
+// Writer core of id, or AUTO if unknown (or not yet built)
+[[nodiscard]] uint32_t owner(uint16_t id) noexcept {
+    const uint16_t slot = slot_of(id);
+    return slot == NO_SLOT ? AUTO : entries[slot].owner;
+}
+
+// Id for a symbol (startup and control paths); false if not declared
+[[nodiscard]] bool find(uint64_t symbol, uint16_t& id) noexcept {
+    const uint32_t slot = by_symbol.find(symbol);
+    if (slot == trading::flat_index<MAX_INSTRUMENTS * 2>::npos) return false;
+    id = entries[slot].id;
+    return true;
+}
+
+// Touch every book the executing core owns, after build() and before its
+// feed loop starts, so the first messages find them resident
+void prefault_local() noexcept {
+    const heap::arena* arena = shards[topology::this_cpu()->index].arena;
+    if (arena) prefault(arena->base(), arena->used());
+}
+
+// Ids written by cpu, for its feed loop; returns how many were stored
+size_t owned_by(uint32_t cpu, span<uint16_t> out) noexcept {
+    size_t n = 0;
+    for (uint32_t i = 0; i < entry_count && n < out.size(); ++i) {
+        if (entries[i].owner == cpu) out[n++] = entries[i].id;
+    }
+    return n;
+}
+
+[[nodiscard]] uint32_t instrument_count() noexcept {
+    return entry_count;
+}
+
+// Bytes of book memory assigned to cpu
+[[nodiscard]] uint64_t shard_bytes(uint32_t cpu) noexcept {
+    return cpu < topology::MAX_CPUS ? shards[cpu].bytes : 0;
+}
+
+} // namespace hft::registry
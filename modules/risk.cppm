@@ -0,0 +1,233 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+#include "../include/freestanding/atomic.hpp"
+
+export module hft.risk;
+import hft.core;
+import hft.trading;
+
+// Pre-trade risk checks, inline on the order path.
+// Each trading core owns a gate holding its instruments' limits and
+// exposure, so a check reads and writes only that core's lines: no
+// locks, no RMW atomics. Every rule is evaluated on every order and the
+// failures are OR-ed into one mask, so the cost does not depend on which
+// rule trips. Exposure is reserved when an order passes and given back
+// through filled()/released() as the gateway learns its fate.
+export namespace hft::risk {
+
+constexpr size_t MAX_INSTRUMENTS = 64;  // Per gate (per trading core)
+
+// Reasons an order was refused; check() returns them OR-ed together
+enum reason : uint32_t {
+    none = 0,
+    killed = 1 << 0,
+    unknown_instrument = 1 << 1,
+    bad_order = 1 << 2,        // Zero quantity or non-positive price
+    order_size = 1 << 3,       // Quantity or notional above the per-order cap
+    price_band = 1 << 4,       // Too far through the opposite touch (fat finger)
+    no_market = 1 << 5,        // No opposite quote to check the price against
+    position = 1 << 6,         // Could breach the position limit if everything fills
+    exposure = 1 << 7,         // Open notional limit
+    session_rate = 1 << 8,     // Order rate for the whole gate
+    instrument_rate = 1 << 9
+};
+
+// Rate limit as a token bucket (kept as GCRA: one theoretical arrival
+// time instead of a token count), clocked in TSC cycles
+class token_bucket {
+public:
+    // rate orders per second, bursts of up to burst orders
+    void configure(uint64_t rate, uint64_t burst) noexcept {
+        interval_ = rate ? tsc_clock::from_ns(1000000000 / rate) : 0;
+        tolerance_ = interval_ * (burst ? burst - 1 : 0);
+        next_ = 0;
+    }
+
+    [[nodiscard]] bool admits(uint64_t now) const noexcept {
+        return max(next_, now) - now <= tolerance_;
+    }
+
+    void take(uint64_t now) noexcept {
+        next_ = max(next_, now) + interval_;
+    }
+
+private:
+    uint64_t interval_ = 0;   // Cycles per token (0: unlimited)
+    uint64_t tolerance_ = 0;  // Burst allowance in cycles
+    uint64_t next_ = 0;       // Theoretical arrival time of the next order
+};
+
+struct limits {
+    int64_t max_position;          // Absolute net position
+    trading::quantity_t max_order_quantity;
+    uint64_t max_order_notional;   // price * quantity, in price units
+    uint64_t max_open_notional;    // Sum over working orders
+    uint32_t band_bps;             // Allowed distance through the opposite touch
+    uint32_t orders_per_second;    // 0: no rate limit
+    uint32_t burst;
+};
+
+} // namespace hft::risk
+
+namespace hft::risk {
+
+// One instrument's limits and live exposure, on lines of its own
+struct alignas(64) instrument_state {
+    limits limit = {};
+    bool configured = false;
+    int64_t position = 0;
+    trading::quantity_t open_buy = 0;
+    trading::quantity_t open_sell = 0;
+    uint64_t open_notional = 0;
+    token_bucket rate;
+};
+
+} // namespace hft::risk
+
+export namespace hft::risk {
+
+// Per-core risk gate. One core calls check(), filled() and released();
+// kill() may come from any core.
+class alignas(64) gate {
+public:
+    // Set up an instrument's limits before trading starts
+    bool configure(uint32_t instrument, const limits& l) noexcept {
+        if (instrument >= MAX_INSTRUMENTS) return false;
+        instrument_state& s = instruments_[instrument];
+        s.limit = l;
+        s.rate.configure(l.orders_per_second, l.burst);
+        s.configured = true;
+        return true;
+    }
+
+    void configure_session(uint64_t orders_per_second, uint64_t burst) noexcept {
+        session_.configure(orders_per_second, burst);
+    }
+
+    // Check one order against the instrument's limits and the current
+    // market; on success its exposure is reserved and a token taken.
+    // Returns none or the failed reasons.
+    [[nodiscard]] uint32_t check(uint32_t instrument, const trading::order& o,
+                                 const trading::spread_info& market,
+                                 uint64_t now = tsc_clock::now()) noexcept {
+        const uint32_t index = instrument < MAX_INSTRUMENTS ? instrument : 0;
+        instrument_state& s = instruments_[index];
+        const limits& l = s.limit;
+
+        // Opposite touch: a buy may pay at most band_bps over the ask, a
+        // sell may give at most band_bps under the bid
+        const trading::price_t touch = o.is_buy ? market.ask_price : market.bid_price;
+        const trading::price_t band = touch * static_cast<trading::price_t>(l.band_bps) / 10000;
+        const bool outside = o.is_buy ? o.price > touch + band : o.price < touch - band;
+
+        // Worst case: every open order on this side fills as well
+        const auto quantity = static_cast<int64_t>(o.quantity);
+        const int64_t worst = o.is_buy
+            ? s.position + static_cast<int64_t>(s.open_buy) + quantity
+            : s.position - static_cast<int64_t>(s.open_sell) - quantity;
+        const uint64_t notional = static_cast<uint64_t>(o.price) * o.quantity;
+
+        uint32_t failed = 0;
+        failed |= when(killed_.load(memory_order::acquire), reason::killed);
+        failed |= when(instrument >= MAX_INSTRUMENTS || !s.configured, reason::unknown_instrument);
+        failed |= when(o.quantity == 0 || o.price <= 0, reason::bad_order);
+        failed |= when(o.quantity > l.max_order_quantity || notional > l.max_order_notional, reason::order_size);
+        failed |= when(touch <= 0, reason::no_market) | when(touch > 0 && outside, reason::price_band);
+        failed |= when(worst > l.max_position || worst < -l.max_position, reason::position);
+        failed |= when(s.open_notional + notional > l.max_open_notional, reason::exposure);
+        failed |= when(!session_.admits(now), reason::session_rate);
+        failed |= when(!s.rate.admits(now), reason::instrument_rate);
+
+        if (failed) [[unlikely]] {
+            ++rejected_;
+            return failed;
+        }
+
+        (o.is_buy ? s.open_buy : s.open_sell) += o.quantity;
+        s.open_notional += notional;
+        session_.take(now);
+        s.rate.take(now);
+        ++passed_;
+        return reason::none;
+    }
+
+    // quantity of a passed order executed
+    void filled(uint32_t instrument, const trading::order& o, trading::quantity_t quantity) noexcept {
+        if (instrument >= MAX_INSTRUMENTS) return;
+        release(instruments_[instrument], o, quantity);
+        instruments_[instrument].position += o.is_buy ? static_cast<int64_t>(quantity)
+                                                      : -static_cast<int64_t>(quantity);
+    }
+
+    // quantity of a passed order will never fill (cancelled, rejected by
+    // the exchange, expired)
+    void released(uint32_t instrument, const trading::order& o, trading::quantity_t quantity) noexcept {
+        if (instrument >= MAX_INSTRUMENTS) return;
+        release(instruments_[instrument], o, quantity);
+    }
+
+    // Refuse every order from now on, until revive(). Release pairs with
+    // the acquire in check(): a check that sees the flag also sees what
+    // the killing core wrote before it.
+    void kill() noexcept { killed_.store(true, memory_order::release); }
+    void revive() noexcept { killed_.store(false, memory_order::release); }
+    [[nodiscard]] bool is_killed() const noexcept { return killed_.load(memory_order::acquire); }
+
+    [[nodiscard]] int64_t position(uint32_t instrument) const noexcept {
+        return instrument < MAX_INSTRUMENTS ? instruments_[instrument].position : 0;
+    }
+
+    [[nodiscard]] uint64_t passed() const noexcept { return passed_; }
+    [[nodiscard]] uint64_t rejected() const noexcept { return rejected_; }
+
+private:
+    static constexpr uint32_t when(bool failed, reason r) noexcept {
+        return failed ? static_cast<uint32_t>(r) : 0u;
+    }
+
+    static void release(instrument_state& s, const trading::order& o,
+                        trading::quantity_t quantity) noexcept {
+        trading::quantity_t& open = o.is_buy ? s.open_buy : s.open_sell;
+        quantity = min(quantity, open);
+        open -= quantity;
+        s.open_notional -= min(s.open_notional, static_cast<uint64_t>(o.price) * quantity);
+    }
+
+    instrument_state instruments_[MAX_INSTRUMENTS];
+    token_bucket session_;
+    uint64_t passed_ = 0;
+    uint64_t rejected_ = 0;
+    alignas(64) atomic<bool> killed_{false};  // Only written by kill()/revive()
+};
+
+} // namespace hft::risk
+
+namespace hft::risk {
+
+inline gate gates[topology::MAX_CPUS];
+
+} // namespace hft::risk
+
+export namespace hft::risk {
+
+// The executing core's gate
+[[nodiscard]] gate& local() noexcept {
+    return gates[topology::this_cpu()->index];
+}
+
+[[nodiscard]] gate& on(uint32_t cpu) noexcept {
+    return gates[cpu < topology::MAX_CPUS ? cpu : 0];
+}
+
+// The executing core's gate resident and dirty, before trading starts
+void prefault_local() noexcept {
+    prefault(&local(), sizeof(gate));
+}
+
+// Kill switch for every core
+void kill_all() noexcept {
+    for (gate& g : gates) g.kill();
+}
+
+} // namespace hft::risk
@@ -0,0 +1,131 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+
+export module hft.rtc;
+import hft.core;
+
+// CMOS real-time clock, read once at boot to anchor the TSC wall clock.
+// It only has whole seconds, so read_at_edge() waits for the start of a
+// new second: the TSC taken right then is correlated to that second to
+// within the update cycle (a few milliseconds at worst).
+export namespace hft::rtc {
+
+struct date_time {
+    uint32_t year;
+    uint8_t month;
+    uint8_t day;
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+};
+
+} // namespace hft::rtc
+
+namespace hft::rtc {
+
+constexpr uint16_t CMOS_INDEX = 0x70;
+constexpr uint16_t CMOS_DATA = 0x71;
+
+constexpr uint8_t REG_SECOND = 0x00;
+constexpr uint8_t REG_MINUTE = 0x02;
+constexpr uint8_t REG_HOUR = 0x04;
+constexpr uint8_t REG_DAY = 0x07;
+constexpr uint8_t REG_MONTH = 0x08;
+constexpr uint8_t REG_YEAR = 0x09;
+constexpr uint8_t REG_STATUS_A = 0x0A;
+constexpr uint8_t REG_STATUS_B = 0x0B;
+constexpr uint8_t REG_CENTURY = 0x32;  // Where ACPI's FADT century field usually points
+
+constexpr uint8_t STATUS_A_UPDATING = 0x80;
+constexpr uint8_t STATUS_B_24_HOUR = 0x02;
+constexpr uint8_t STATUS_B_BINARY = 0x04;
+
+uint8_t read_register(uint8_t reg) noexcept {
+    uint8_t value;
+    asm volatile("outb %0, %1" : : "a"(reg), "Nd"(CMOS_INDEX));  // Bit 7 clear: NMIs stay enabled
+    asm volatile("inb %1, %0" : "=a"(value) : "Nd"(CMOS_DATA));
+    return value;
+}
+
+bool updating() noexcept {
+    return read_register(REG_STATUS_A) & STATUS_A_UPDATING;
+}
+
+uint8_t from_bcd(uint8_t value) noexcept {
+    return static_cast<uint8_t>((value & 0x0F) + (value >> 4) * 10);
+}
+
+// Registers are stable for almost a second after an update ends
+date_time read_registers() noexcept {
+    const uint8_t status = read_register(REG_STATUS_B);
+    uint8_t second = read_register(REG_SECOND);
+    uint8_t minute = read_register(REG_MINUTE);
+    uint8_t hour = read_register(REG_HOUR);
+    uint8_t day = read_register(REG_DAY);
+    uint8_t month = read_register(REG_MONTH);
+    uint8_t year = read_register(REG_YEAR);
+    uint8_t century = read_register(REG_CENTURY);
+
+    const bool pm = hour & 0x80;
+    hour &= 0x7F;
+    if (!(status & STATUS_B_BINARY)) {
+        second = from_bcd(second);
+        minute = from_bcd(minute);
+        hour = from_bcd(hour);
+        day = from_bcd(day);
+        month = from_bcd(month);
+        year = from_bcd(year);
+        century = from_bcd(century);
+    }
+    if (!(status & STATUS_B_24_HOUR)) {
+        hour = static_cast<uint8_t>(hour % 12 + (pm ? 12 : 0));
+    }
+    if (century < 19 || century > 99) century = 20;  // No century register
+
+    return {century * 100u + year, month, day, hour, minute, second};
+}
+
+} // namespace hft::rtc
+
+export namespace hft::rtc {
+
+// Current date and time. Waits out an update in progress, so it returns
+// within one update cycle.
+date_time read() noexcept {
+    while (updating()) {
+        asm volatile("pause");
+    }
+    return read_registers();
+}
+
+// Wait for the next second to begin, then call mark() (e.g. to take the
+// TSC) and return the time it began. Takes up to a second.
+template<typename Mark>
+date_time read_at_edge(Mark&& mark) noexcept {
+    while (!updating()) {  // Set 244 us before the update
+        asm volatile("pause");
+    }
+    while (updating()) {
+        asm volatile("pause");
+    }
+    mark();
+    return read_registers();
+}
+
+// Seconds since 1970-01-01 00:00:00 UTC (the RTC is assumed to run UTC)
+uint64_t to_unix_seconds(const date_time& t) noexcept {
+    // Days from civil (proleptic Gregorian), with March-based years so
+    // the leap day falls last
+    const int64_t y = static_cast<int64_t>(t.year) - (t.month <= 2 ? 1 : 0);
+    const int64_t era = y / 400;
+    const int64_t year_of_era = y - era * 400;
+    const int64_t m = t.month;
+    const int64_t day_of_year = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + t.day - 1;
+    const int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    const int64_t days = era * 146097 + day_of_era - 719468;
+
+    return static_cast<uint64_t>(days) * 86400 + t.hour * 3600u + t.minute * 60u + t.second;
+}
+
+} // namespace hft::rtc
@@ -0,0 +1,519 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+#include "../include/freestanding/atomic.hpp"
+#include "../include/freestanding/coroutine.hpp"
+
+export module hft.sched;
+import hft.core;
+import hft.smp;
+import hft.trace;
+
+// Per-core run-to-completion scheduling.
+// Each core owns an event loop: a fixed array of polling tasks (feed RX,
+// book update, strategy, gateway TX) run round-robin, each with a work
+// budget per pass, plus coroutine flows for multi-step work such as
+// cancel-replace, resumed once per pass when what they wait for is
+// ready. Nothing preempts a task and no interrupt is needed to move
+// work along; a pass that finds nothing to do idles with pause or
+// umwait. Housekeeping cores can also join a pool that runs jobs from
+// any core, stealing from each other's deques (Chase-Lev) to balance.
+// Trading cores never join it.
+export namespace hft::sched {
+
+constexpr size_t MAX_TASKS = 16;
+constexpr size_t MAX_FLOWS = 32;       // Live flows per core
+constexpr size_t FRAME_BYTES = 1024;   // Largest flow frame
+constexpr size_t DEQUE_SIZE = 1024;    // Jobs per housekeeping core, power of two
+constexpr uint32_t JOB_BUDGET = 8;     // Jobs per pass
+
+// Do up to budget units of work (messages, orders, frames); return how
+// many were done, 0 when there was nothing
+using poll_fn = uint32_t (*)(void* ctx, uint32_t budget) noexcept;
+
+struct task {
+    const char* name;
+    poll_fn poll;
+    void* ctx;
+    uint32_t budget;
+};
+
+struct task_stats {
+    uint64_t runs;
+    uint64_t work;
+    uint64_t max_cycles;  // Longest single call (tracing builds only)
+};
+
+struct loop_stats {
+    uint64_t passes;
+    uint64_t idle_passes;
+    uint64_t resumes;       // Flow resumptions
+    uint64_t jobs;          // Jobs run here
+    uint64_t stolen;        // Of those, taken from another core's deque
+};
+
+// What a pass with no work does
+enum class idle_mode : uint8_t {
+    spin,    // Nothing: lowest wake-up latency, the hot path's default
+    pause,   // One pause, easing the sibling hyperthread
+    umwait   // Light sleep (C0.1) until poked or a deadline; pause without WAITPKG
+};
+
+// Housekeeping work for the pool. The submitter keeps the job alive
+// until run is called (on some housekeeping core, exactly once).
+struct job {
+    void (*run)(job* self) noexcept;
+    job* next = nullptr;  // Inbox link, owned by the pool
+};
+
+} // namespace hft::sched
+
+namespace hft::sched {
+
+constexpr uint32_t NO_WORKER = 0xFFFFFFFF;
+
+// Flow frames come from a pool per core: a flow is created, run and
+// destroyed on the same core, so the pool needs no atomics
+struct alignas(64) frame_pool {
+    alignas(64) uint8_t frames[MAX_FLOWS][FRAME_BYTES];
+    uint32_t free_slots[MAX_FLOWS];
+    uint32_t free_count = 0;
+    uint32_t used = 0;  // Slots ever handed out
+};
+
+inline frame_pool pools[topology::MAX_CPUS];
+
+void* allocate_frame(size_t bytes) noexcept {
+    if (bytes > FRAME_BYTES) return nullptr;
+    frame_pool& p = pools[topology::this_cpu()->index];
+    if (p.free_count) return p.frames[p.free_slots[--p.free_count]];
+    if (p.used < MAX_FLOWS) return p.frames[p.used++];
+    return nullptr;
+}
+
+void free_frame(void* frame) noexcept {
+    const auto offset = static_cast<uint64_t>(static_cast<uint8_t*>(frame) - &pools[0].frames[0][0]);
+    frame_pool& p = pools[offset / sizeof(frame_pool)];
+    p.free_slots[p.free_count++] = static_cast<uint32_t>((offset % sizeof(frame_pool)) / FRAME_BYTES);
+}
+
+// Chase-Lev work-stealing deque of job pointers: the owner pushes and
+// pops at the bottom, thieves take from the top with one CAS
+class work_deque {
+public:
+    // Owner only; false when full
+    bool push(job* j) noexcept {
+        const int64_t b = bottom_.load(memory_order::relaxed);
+        const int64_t t = top_.load(memory_order::acquire);
+        if (b - t >= static_cast<int64_t>(DEQUE_SIZE)) return false;
+        slots_[b & MASK].store(j, memory_order::relaxed);
+        bottom_.store(b + 1, memory_order::release);
+        return true;
+    }
+
+    // Owner only: newest job first
+    job* pop() noexcept {
+        const int64_t b = bottom_.load(memory_order::relaxed) - 1;
+        bottom_.store(b, memory_order::relaxed);
+        atomic_thread_fence(memory_order::seq_cst);  // Publish bottom before reading top
+        int64_t t = top_.load(memory_order::relaxed);
+
+        if (t > b) {  // Empty
+            bottom_.store(b + 1, memory_order::relaxed);
+            return nullptr;
+        }
+        job* j = slots_[b & MASK].load(memory_order::relaxed);
+        if (t == b) {
+            // Last job: whoever moves top first gets it. Strong, so a
+            // spurious failure cannot give up a job no thief took.
+            if (!top_.compare_exchange_strong(t, t + 1, memory_order::seq_cst)) j = nullptr;
+            bottom_.store(b + 1, memory_order::relaxed);
+        }
+        return j;
+    }
+
+    // Any core: oldest job, or nullptr if empty or another thief won
+    job* steal() noexcept {
+        int64_t t = top_.load(memory_order::acquire);
+        atomic_thread_fence(memory_order::seq_cst);
+        const int64_t b = bottom_.load(memory_order::acquire);
+        if (t >= b) return nullptr;
+
+        job* j = slots_[t & MASK].load(memory_order::relaxed);
+        if (!top_.compare_exchange_weak(t, t + 1, memory_order::seq_cst)) return nullptr;
+        return j;
+    }
+
+private:
+    static constexpr int64_t MASK = DEQUE_SIZE - 1;
+
+    alignas(64) atomic<int64_t> top_{0};     // Thieves' line
+    alignas(64) atomic<int64_t> bottom_{0};  // Owner's line
+    alignas(64) atomic<job*> slots_[DEQUE_SIZE] = {};
+};
+
+static_assert((DEQUE_SIZE & (DEQUE_SIZE - 1)) == 0);
+
+// One housekeeping core's share of the pool
+struct alignas(64) worker {
+    atomic<job*> inbox{nullptr};  // Submitted from any core (a Treiber stack)
+    uint32_t cpu = 0;
+    work_deque deque;
+};
+
+inline worker workers[topology::MAX_CPUS];
+inline atomic<uint32_t> worker_count{0};
+inline atomic<uint32_t> next_worker{0};
+
+bool waitpkg_supported() noexcept {
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0), "c"(0));
+    if (eax < 7) return false;
+
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+    return (ecx >> 5) & 1;
+}
+
+} // namespace hft::sched
+
+export namespace hft::sched {
+
+// A coroutine run by an event loop. It starts suspended; spawn() hands
+// it to the loop, which resumes it on each pass once what it awaits
+// (yield(), until(), sleep_ns()) is ready and destroys it when it
+// returns.
+class [[nodiscard]] flow {
+public:
+    struct promise_type;
+    using handle = std::coroutine_handle<promise_type>;
+
+    struct promise_type {
+        bool (*ready)(void* state) noexcept = nullptr;  // nullptr: resume on the next pass
+        void* state = nullptr;
+
+        static void* operator new(::size_t bytes) noexcept { return allocate_frame(bytes); }
+        static void operator delete(void* frame) noexcept { free_frame(frame); }
+        static flow get_return_object_on_allocation_failure() noexcept { return flow{}; }
+
+        flow get_return_object() noexcept { return flow{handle::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept {}
+    };
+
+    flow() noexcept = default;
+    flow(flow&& other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+    flow(const flow&) = delete;
+    flow& operator=(const flow&) = delete;
+    ~flow() { if (handle_) handle_.destroy(); }
+
+    // Empty when the frame pool was exhausted
+    explicit operator bool() const noexcept { return static_cast<bool>(handle_); }
+
+    handle release() noexcept {
+        const handle h = handle_;
+        handle_ = nullptr;
+        return h;
+    }
+
+private:
+    explicit flow(handle h) noexcept : handle_(h) {}
+
+    handle handle_;
+};
+
+// co_await yield(): let the rest of the loop run, continue on the next pass
+struct yield {
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(flow::handle h) const noexcept { h.promise().ready = nullptr; }
+    void await_resume() const noexcept {}
+};
+
+// co_await until(pred): continue on the first pass where pred() holds
+template<typename Pred>
+struct until {
+    Pred pred;
+
+    bool await_ready() noexcept { return pred(); }
+    void await_suspend(flow::handle h) noexcept {
+        h.promise().ready = [](void* self) noexcept -> bool { return static_cast<until*>(self)->pred(); };
+        h.promise().state = this;
+    }
+    void await_resume() const noexcept {}
+};
+
+template<typename Pred>
+until(Pred) -> until<Pred>;
+
+// co_await sleep_ns(n): continue on the first pass n ns from now
+struct sleep_ns {
+    uint64_t deadline;
+
+    explicit sleep_ns(uint64_t ns) noexcept : deadline(tsc_clock::now() + tsc_clock::from_ns(ns)) {}
+
+    bool await_ready() const noexcept { return tsc_clock::now() >= deadline; }
+    void await_suspend(flow::handle h) noexcept {
+        h.promise().ready = [](void* self) noexcept -> bool {
+            return tsc_clock::now() >= static_cast<sleep_ns*>(self)->deadline;
+        };
+        h.promise().state = this;
+    }
+    void await_resume() const noexcept {}
+};
+
+// One core's loop. Set it up (add, set_idle, join_pool) before it
+// starts; after that only its own core touches it, except stop(),
+// poke() and the pool's submissions.
+class alignas(64) event_loop {
+public:
+    // Append a polling task; false when full or already running
+    bool add(const task& t) noexcept {
+        if (task_count_ == MAX_TASKS || !t.poll || running_) return false;
+        tasks_[task_count_] = t;
+        task_stats_[task_count_] = {};
+        ++task_count_;
+        return true;
+    }
+
+    // Hand a flow to this loop. Flows live on the core that creates them,
+    // so call this on the loop's own core (during setup on the boot
+    // processor for its loop, or from a task or flow). False if f is
+    // empty or every flow slot is taken; f is destroyed then.
+    bool spawn(flow f) noexcept {
+        if (!f || flow_count_ == MAX_FLOWS) return false;
+        flows_[flow_count_++] = f.release();
+        return true;
+    }
+
+    void set_idle(idle_mode mode, uint64_t max_sleep_ns = 20000) noexcept {
+        idle_ = mode == idle_mode::umwait && !waitpkg_supported() ? idle_mode::pause : mode;
+        sleep_cycles_ = tsc_clock::from_ns(max_sleep_ns);
+    }
+
+    // Run with interrupts masked: not even this core's one-shot timers
+    // (hft.timer) get in; the loop must not depend on them
+    void set_interrupts_off(bool off) noexcept { interrupts_off_ = off; }
+
+    // Make this a housekeeping core that runs and steals pool jobs; false
+    // if it already is one. Before the loop starts, on the boot processor.
+    bool join_pool(uint32_t cpu) noexcept {
+        if (worker_ != NO_WORKER) return false;
+        worker_ = worker_count.load(memory_order::relaxed);
+        workers[worker_].cpu = cpu;
+        worker_count.store(worker_ + 1, memory_order::release);
+        return true;
+    }
+
+    // One pass over tasks, flows and jobs; idles if none of them had
+    // work. Returns whether any did.
+    bool run_once() noexcept {
+        const uint32_t seen = wake_.load(memory_order::acquire);
+        uint64_t work = 0;
+
+        for (uint32_t i = 0; i < task_count_; ++i) {
+            work += run_task(i);
+        }
+        work += resume_flows();
+        if (worker_ != NO_WORKER) work += run_jobs();
+
+        ++stats_.passes;
+        if (work == 0) {
+            ++stats_.idle_passes;
+            idle(seen);
+        }
+        return work != 0;
+    }
+
+    // Loop until stop(); a smp::task_fn wrapper is sched::run
+    void run() noexcept {
+        running_ = true;
+        if (interrupts_off_) asm volatile("cli" ::: "memory");
+        while (!stop_.load(memory_order::acquire)) {
+            run_once();
+        }
+        if (interrupts_off_) asm volatile("sti" ::: "memory");
+        running_ = false;
+    }
+
+    // From any core
+    void stop() noexcept {
+        stop_.store(true, memory_order::release);
+        poke();
+    }
+
+    // End an umwait early: work was handed over from another core
+    void poke() noexcept {
+        wake_.fetch_add(1, memory_order::release);
+    }
+
+    [[nodiscard]] uint32_t task_count() const noexcept { return task_count_; }
+    [[nodiscard]] const task& task_at(uint32_t i) const noexcept { return tasks_[i]; }
+    [[nodiscard]] const task_stats& stats_of(uint32_t i) const noexcept { return task_stats_[i]; }
+    [[nodiscard]] const loop_stats& stats() const noexcept { return stats_; }
+    [[nodiscard]] uint32_t flow_count() const noexcept { return flow_count_; }
+
+private:
+    uint32_t run_task(uint32_t i) noexcept {
+        const task& t = tasks_[i];
+        task_stats& s = task_stats_[i];
+        uint32_t done;
+        if constexpr (trace::enabled) {
+            const uint64_t start = tsc_clock::now();
+            done = t.poll(t.ctx, t.budget);
+            s.max_cycles = max(s.max_cycles, tsc_clock::now() - start);
+        } else {
+            done = t.poll(t.ctx, t.budget);
+        }
+        ++s.runs;
+        s.work += done;
+        return done;
+    }
+
+    // Resume every flow whose wait is over; finished ones are destroyed
+    // and their slot filled from the end
+    uint32_t resume_flows() noexcept {
+        uint32_t resumed = 0;
+        for (uint32_t i = 0; i < flow_count_;) {
+            const flow::handle h = flows_[i];
+            flow::promise_type& p = h.promise();
+            if (p.ready && !p.ready(p.state)) {
+                ++i;
+                continue;
+            }
+            p.ready = nullptr;
+            h.resume();
+            ++resumed;
+            if (h.done()) {
+                h.destroy();
+                flows_[i] = flows_[--flow_count_];
+            } else {
+                ++i;
+            }
+        }
+        stats_.resumes += resumed;
+        return resumed;
+    }
+
+    // Move submissions into the deque (oldest first), then run up to
+    // JOB_BUDGET jobs: our own newest first, else the oldest of another
+    // worker's, trying each in turn from the next one
+    uint32_t run_jobs() noexcept {
+        worker& self = workers[worker_];
+        uint32_t done = 0;
+
+        job* list = self.inbox.exchange(nullptr, memory_order::acquire);
+        job* oldest = nullptr;
+        while (list) {
+            job* next = list->next;
+            list->next = oldest;
+            oldest = list;
+            list = next;
+        }
+        while (oldest) {
+            job* next = oldest->next;
+            if (!self.deque.push(oldest)) {
+                oldest->run(oldest);  // Deque full: run it here and now
+                ++done;
+            }
+            oldest = next;
+        }
+
+        const uint32_t count = worker_count.load(memory_order::acquire);
+        while (done < JOB_BUDGET) {
+            job* j = self.deque.pop();
+            for (uint32_t k = 1; !j && k < count; ++k) {
+                j = workers[(worker_ + k) % count].deque.steal();
+                if (j) ++stats_.stolen;
+            }
+            if (!j) break;
+            j->run(j);
+            ++done;
+        }
+        stats_.jobs += done;
+        return done;
+    }
+
+    void idle(uint32_t seen) noexcept {
+        switch (idle_) {
+            case idle_mode::spin:
+                break;
+            case idle_mode::pause:
+                asm volatile("pause");
+                break;
+            case idle_mode::umwait: {
+                // Armed before the re-check, so a poke() after it still wakes us
+                asm volatile("umonitor %0" :: "r"(&wake_) : "memory");
+                if (wake_.load(memory_order::acquire) != seen) break;
+                const uint64_t deadline = tsc_clock::now() + sleep_cycles_;
+                asm volatile("umwait %%ecx"
+                             :: "c"(1u),  // C0.1: the faster wake-up
+                                "a"(static_cast<uint32_t>(deadline)),
+                                "d"(static_cast<uint32_t>(deadline >> 32))
+                             : "memory", "cc");
+                break;
+            }
+        }
+    }
+
+    task tasks_[MAX_TASKS] = {};
+    task_stats task_stats_[MAX_TASKS] = {};
+    uint32_t task_count_ = 0;
+    flow::handle flows_[MAX_FLOWS] = {};
+    uint32_t flow_count_ = 0;
+    uint32_t worker_ = NO_WORKER;
+    idle_mode idle_ = idle_mode::spin;
+    bool interrupts_off_ = false;
+    bool running_ = false;
+    uint64_t sleep_cycles_ = 0;
+    loop_stats stats_ = {};
+    atomic<bool> stop_{false};
+    alignas(64) atomic<uint32_t> wake_{0};  // The line umwait monitors
+};
+
+} // namespace hft::sched
+
+namespace hft::sched {
+
+inline event_loop loops[topology::MAX_CPUS];
+
+} // namespace hft::sched
+
+export namespace hft::sched {
+
+[[nodiscard]] event_loop& on(uint32_t cpu) noexcept {
+    return loops[cpu < topology::MAX_CPUS ? cpu : 0];
+}
+
+// The executing core's loop
+[[nodiscard]] event_loop& local() noexcept {
+    return loops[topology::this_cpu()->index];
+}
+
+// smp::task_fn running an event_loop
+void run(void* loop) noexcept {
+    static_cast<event_loop*>(loop)->run();
+}
+
+// Start cpu's loop on that core (an AP); the boot processor calls
+// on(0).run() itself
+bool start(uint32_t cpu) noexcept {
+    return smp::pin(cpu, run, &on(cpu));
+}
+
+// Queue j for the housekeeping pool, from any core; false if no core has
+// joined it
+bool submit(job* j) noexcept {
+    const uint32_t count = worker_count.load(memory_order::acquire);
+    if (count == 0) return false;
+
+    worker& w = workers[next_worker.fetch_add(1, memory_order::relaxed) % count];
+    job* head = w.inbox.load(memory_order::relaxed);
+    do {
+        j->next = head;
+    } while (!w.inbox.compare_exchange_weak(head, j, memory_order::release));
+    on(w.cpu).poke();
+    return true;
+}
+
+} // namespace hft::sched
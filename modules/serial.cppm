@@ -0,0 +1,105 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+
+export module hft.serial;
+import hft.core;
+
+// 16550 UART on COM1.
+// putc()/puts() wait for the transmitter on every byte and are only for
+// boot messages and panics. Once hft.log's drain is running, everything
+// else goes through it, and only the drain calls write_burst(), which
+// never waits: it fills the 16-byte FIFO when it is empty and returns.
+export namespace hft::serial {
+
+constexpr uint16_t COM1 = 0x3F8;
+constexpr size_t FIFO_SIZE = 16;
+
+} // namespace hft::serial
+
+namespace hft::serial {
+
+constexpr uint16_t LINE_STATUS = COM1 + 5;
+constexpr uint8_t TRANSMIT_EMPTY = 0x20;  // THR (and so the FIFO) is empty
+
+void outb(uint16_t port, uint8_t value) noexcept {
+    asm volatile("outb %0, %1" : : "a"(value), "Nd"(port));
+}
+
+uint8_t inb(uint16_t port) noexcept {
+    uint8_t value;
+    asm volatile("inb %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+} // namespace hft::serial
+
+export namespace hft::serial {
+
+void init() noexcept {
+    outb(COM1 + 1, 0x00);  // No UART interrupts
+    outb(COM1 + 3, 0x80);  // DLAB
+    outb(COM1 + 0, 0x03);  // 38400 baud
+    outb(COM1 + 1, 0x00);
+    outb(COM1 + 3, 0x03);  // 8N1
+    outb(COM1 + 2, 0xC7);  // FIFOs on and cleared, 14-byte receive threshold
+    outb(COM1 + 4, 0x0B);
+}
+
+void putc(char c) noexcept {
+    while ((inb(LINE_STATUS) & TRANSMIT_EMPTY) == 0) {
+        asm volatile("pause");
+    }
+    outb(COM1, c);
+}
+
+void puts(const char* str) noexcept {
+    while (*str) {
+        if (*str == '\n') {
+            putc('\r');
+        }
+        putc(*str++);
+    }
+}
+
+void put_hex(uint64_t val) noexcept {
+    puts("0x");
+    for (int i = 60; i >= 0; i -= 4) {
+        int digit = (val >> i) & 0xF;
+        putc(digit < 10 ? '0' + digit : 'a' + digit - 10);
+    }
+}
+
+void put_number(int64_t val) noexcept {
+    uint64_t magnitude = static_cast<uint64_t>(val);
+    if (val < 0) {
+        putc('-');
+        magnitude = 0 - magnitude;
+    }
+
+    char buf[20];
+    int i = 0;
+    do {
+        buf[i++] = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    while (i > 0) {
+        putc(buf[--i]);
+    }
+}
+
+// Queue up to FIFO_SIZE bytes of data if the transmitter is idle, without
+// waiting. Returns how many were taken (0 while the FIFO still drains).
+// Bytes go out as given: callers add their own '\r'.
+size_t write_burst(const char* data, size_t size) noexcept {
+    if ((inb(LINE_STATUS) & TRANSMIT_EMPTY) == 0) return 0;
+
+    const size_t count = min(size, FIFO_SIZE);
+    for (size_t i = 0; i < count; ++i) {
+        outb(COM1, static_cast<uint8_t>(data[i]));
+    }
+    return count;
+}
+
+} // namespace hft::serial
@@ -0,0 +1,301 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+
+export module hft.signals;
+import hft.core;
+import hft.trading;
+
+// Integer-only trading signals.
+// Values are Q32.32 and every parameter (depth, thresholds, level weights)
+// is a template argument, so each parameterization folds to constants.
+// Built with the kernel FP profile: nothing here may use float or double.
+export namespace hft::signals {
+
+using trading::price_t;
+using trading::quantity_t;
+using trading::level_snapshot;
+using trading::book_snapshot;
+
+enum class signal { strong_buy, buy, neutral, sell, strong_sell };
+
+// Strong beyond the threshold, mild beyond half of it
+[[nodiscard]] constexpr signal classify(q32 value, q32 threshold) noexcept {
+    const q32 half{threshold.raw / 2};
+
+    if (value > threshold) return signal::strong_buy;
+    if (value > half) return signal::buy;
+    if (value < -threshold) return signal::strong_sell;
+    if (value < -half) return signal::sell;
+    return signal::neutral;
+}
+
+// Per-level weights, index 0 = top of book (structural, usable as a
+// template argument)
+template<size_t N>
+struct level_weights {
+    q32 weight[N];
+};
+
+template<size_t N>
+[[nodiscard]] constexpr level_weights<N> uniform_weights() noexcept {
+    level_weights<N> w{};
+    for (size_t i = 0; i < N; ++i) {
+        w.weight[i] = q32::from_int(1);
+    }
+    return w;
+}
+
+// Level i weighs (N - i) / N
+template<size_t N>
+[[nodiscard]] constexpr level_weights<N> linear_weights() noexcept {
+    level_weights<N> w{};
+    for (size_t i = 0; i < N; ++i) {
+        w.weight[i] = q32::from_ratio(static_cast<int64_t>(N - i), N);
+    }
+    return w;
+}
+
+} // namespace hft::signals
+
+namespace hft::signals {
+
+using wide_sum = unsigned __int128;
+
+// num / den for 128-bit accumulators: both are scaled down together until
+// they fit the 64-bit q32 conversion
+constexpr q32 ratio(__int128 num, wide_sum den) noexcept {
+    const bool negative = num < 0;
+    wide_sum magnitude = negative ? static_cast<wide_sum>(-num) : static_cast<wide_sum>(num);
+
+    while ((magnitude | den) >> 63) {
+        magnitude >>= 1;
+        den >>= 1;
+    }
+
+    const int64_t n = static_cast<int64_t>(magnitude);
+    return q32::from_ratio(negative ? -n : n, static_cast<uint64_t>(den));
+}
+
+// Accumulator chain for a pipeline; each stage only sees its own depth
+template<typename... Stages>
+struct stage_chain {
+    constexpr void bid(size_t, const level_snapshot&) noexcept {}
+    constexpr void ask(size_t, const level_snapshot&) noexcept {}
+};
+
+template<typename Stage, typename... Rest>
+struct stage_chain<Stage, Rest...> {
+    Stage head{};
+    stage_chain<Rest...> tail{};
+
+    constexpr void bid(size_t i, const level_snapshot& level) noexcept {
+        if (i < Stage::depth) head.bid(i, level);
+        tail.bid(i, level);
+    }
+
+    constexpr void ask(size_t i, const level_snapshot& level) noexcept {
+        if (i < Stage::depth) head.ask(i, level);
+        tail.ask(i, level);
+    }
+
+    template<size_t I>
+    [[nodiscard]] constexpr const auto& at() const noexcept {
+        if constexpr (I == 0) {
+            return head;
+        } else {
+            return tail.template at<I - 1>();
+        }
+    }
+};
+
+} // namespace hft::signals
+
+export namespace hft::signals {
+
+// Depth-weighted order imbalance (bid - ask) / (bid + ask), in [-1, 1]
+template<size_t Depth = 5,
+         q32 Threshold = q32::from_ratio(65, 100),
+         level_weights<Depth> Weights = uniform_weights<Depth>()>
+class imbalance {
+public:
+    static constexpr size_t depth = Depth;
+
+    struct result {
+        q32 value;
+        signal direction;
+    };
+
+    constexpr void bid(size_t i, const level_snapshot& level) noexcept {
+        bid_ += static_cast<wide_sum>(level.quantity) * static_cast<uint64_t>(Weights.weight[i].raw);
+    }
+
+    constexpr void ask(size_t i, const level_snapshot& level) noexcept {
+        ask_ += static_cast<wide_sum>(level.quantity) * static_cast<uint64_t>(Weights.weight[i].raw);
+    }
+
+    [[nodiscard]] constexpr result finish() const noexcept {
+        const q32 value = ratio(static_cast<__int128>(bid_) - static_cast<__int128>(ask_), bid_ + ask_);
+        return {value, classify(value, Threshold)};
+    }
+
+private:
+    wide_sum bid_ = 0;
+    wide_sum ask_ = 0;
+};
+
+// Depth-weighted microprice relative to mid, in half-spreads.
+// Each side's VWAP over Depth levels is weighted by the opposite side's
+// size; +1 means the microprice sits on the best ask, -1 on the best bid.
+template<size_t Depth = 5, q32 Threshold = q32::from_ratio(1, 2)>
+class microprice_skew {
+public:
+    static constexpr size_t depth = Depth;
+
+    struct result {
+        q32 value;
+        signal direction;
+    };
+
+    // Levels arrive best first, so level 0 fixes the reference price and
+    // deeper levels accumulate their distance from it
+    constexpr void bid(size_t i, const level_snapshot& level) noexcept {
+        if (i == 0) best_bid_ = level.price;
+        bid_qty_ += level.quantity;
+        bid_offset_ += static_cast<wide_sum>(level.quantity) * static_cast<uint64_t>(best_bid_ - level.price);
+    }
+
+    constexpr void ask(size_t i, const level_snapshot& level) noexcept {
+        if (i == 0) best_ask_ = level.price;
+        ask_qty_ += level.quantity;
+        ask_offset_ += static_cast<wide_sum>(level.quantity) * static_cast<uint64_t>(level.price - best_ask_);
+    }
+
+    [[nodiscard]] constexpr result finish() const noexcept {
+        const int64_t spread = best_ask_ - best_bid_;
+        if (bid_qty_ == 0 || ask_qty_ == 0 || spread <= 0) {
+            return {{0}, signal::neutral};
+        }
+
+        // Prices relative to mid, in ticks
+        const q32 half = q32::from_ratio(spread, 2);
+        const q32 bid_vwap = -(half + ratio(static_cast<__int128>(bid_offset_), bid_qty_));
+        const q32 ask_vwap = half + ratio(static_cast<__int128>(ask_offset_), ask_qty_);
+
+        const q32 bid_weight = ratio(static_cast<__int128>(ask_qty_), bid_qty_ + ask_qty_);
+        const q32 micro = bid_weight * bid_vwap + (q32::from_int(1) - bid_weight) * ask_vwap;
+
+        // In half-spreads; multiplied before the divide, in 128 bits
+        const q32 value{static_cast<int64_t>(static_cast<__int128>(micro.raw) * 2 / spread)};
+        return {value, classify(value, Threshold)};
+    }
+
+private:
+    price_t best_bid_ = 0;
+    price_t best_ask_ = 0;
+    wide_sum bid_qty_ = 0;
+    wide_sum ask_qty_ = 0;
+    wide_sum bid_offset_ = 0;
+    wide_sum ask_offset_ = 0;
+};
+
+enum class regime { one_sided, crossed, tight, normal, wide };
+
+// Top-of-book spread classification; Tight and Wide are in price units
+template<price_t Tight = 1, price_t Wide = 4>
+    requires (Tight < Wide)
+class spread_regime {
+public:
+    static constexpr size_t depth = 1;
+
+    struct result {
+        price_t spread;
+        regime state;
+    };
+
+    constexpr void bid(size_t, const level_snapshot& level) noexcept {
+        best_bid_ = level.price;
+        has_bid_ = true;
+    }
+
+    constexpr void ask(size_t, const level_snapshot& level) noexcept {
+        best_ask_ = level.price;
+        has_ask_ = true;
+    }
+
+    [[nodiscard]] constexpr result finish() const noexcept {
+        if (!has_bid_ || !has_ask_) return {0, regime::one_sided};
+
+        const price_t spread = best_ask_ - best_bid_;
+        if (spread <= 0) return {spread, regime::crossed};
+        if (spread <= Tight) return {spread, regime::tight};
+        if (spread >= Wide) return {spread, regime::wide};
+        return {spread, regime::normal};
+    }
+
+private:
+    price_t best_bid_ = 0;
+    price_t best_ask_ = 0;
+    bool has_bid_ = false;
+    bool has_ask_ = false;
+};
+
+// Evaluates a set of signals in a single pass.
+// The book is copied once under its seqlock (up to the deepest signal's
+// depth) and every level is then fed to all signals in order, so adding
+// parameterizations adds arithmetic, not book reads.
+template<typename... Signals>
+    requires (sizeof...(Signals) > 0)
+class signal_pipeline {
+public:
+    static constexpr size_t depth = [] {
+        size_t d = 0;
+        ((d = max(d, Signals::depth)), ...);
+        return d;
+    }();
+
+    struct evaluation {
+        uint64_t sequence;  // Book sequence the signals were computed from
+        stage_chain<Signals...> stages;
+
+        // Result of the I-th signal in the pipeline
+        template<size_t I>
+        [[nodiscard]] constexpr auto get() const noexcept {
+            return stages.template at<I>().finish();
+        }
+    };
+
+    template<size_t N>
+    [[nodiscard]] static constexpr evaluation evaluate(const book_snapshot<N>& snap) noexcept {
+        evaluation out{snap.sequence, {}};
+
+        const size_t bids = min(min(depth, N), snap.bid_depth);
+        const size_t asks = min(min(depth, N), snap.ask_depth);
+        for (size_t i = 0; i < bids; ++i) {
+            out.stages.bid(i, snap.bids[i]);
+        }
+        for (size_t i = 0; i < asks; ++i) {
+            out.stages.ask(i, snap.asks[i]);
+        }
+        return out;
+    }
+
+    // Works with any book exposing read_snapshot<N>()
+    template<typename OrderBook>
+    [[nodiscard]] static evaluation evaluate_book(const OrderBook& book) noexcept {
+        return evaluate(book.template read_snapshot<depth>());
+    }
+};
+
+// Order imbalance signal generator (single-signal pipeline)
+template<size_t Depth = 5, q32 Threshold = q32::from_ratio(65, 100)>
+class imbalance_signal {
+public:
+    template<typename OrderBook>
+    [[nodiscard]] signal generate(const OrderBook& book) const noexcept {
+        using pipeline = signal_pipeline<imbalance<Depth, Threshold>>;
+        return pipeline::evaluate_book(book).template get<0>().direction;
+    }
+};
+
+} // namespace hft::signals
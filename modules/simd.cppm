@@ -0,0 +1,339 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+
+export module hft.simd;
+import hft.core;
+
+// Vectorized depth kernels for structure-of-arrays books.
+// Built with the trading FP profile (SSE2 baseline); AVX2 and AVX-512
+// variants are compiled per function with target attributes and one table
+// is selected at boot from cpu_features, so a single kernel image runs on
+// any x86-64 part.
+export namespace hft::simd {
+
+// Sum of quantities and of price * quantity over a run of levels
+struct depth_sums {
+    double quantity;
+    double notional;
+};
+
+// Kernel dispatch table
+struct kernel_table {
+    const char* name;
+    uint64_t (*sum_quantity)(const uint64_t* qty, size_t n) noexcept;
+    double (*weighted_depth)(const uint64_t* qty, const double* weights, size_t n) noexcept;
+    depth_sums (*sum_depth)(const int64_t* price, const uint64_t* qty, size_t n) noexcept;
+    double (*vwap_to_depth)(const int64_t* price, const uint64_t* qty, size_t n,
+                            uint64_t target) noexcept;
+};
+
+} // namespace hft::simd
+
+namespace hft::simd {
+
+template<size_t Lanes>
+struct lanes {
+    typedef double f64 __attribute__((vector_size(Lanes * 8)));
+    typedef int64_t i64 __attribute__((vector_size(Lanes * 8)));
+    typedef uint64_t u64 __attribute__((vector_size(Lanes * 8)));
+};
+
+// Exact int64 -> double for |x| < 2^51 without AVX-512DQ conversions:
+// add the bit pattern of 2^52 + 2^51 and subtract it back as a double
+constexpr int64_t magic_bits = 0x4338000000000000LL;
+constexpr double magic_value = 6755399441055744.0;
+
+// Helpers take vectors by reference: they are always inlined, and passing
+// wide vectors by value from a baseline-ISA function would change the ABI
+template<size_t L, typename T>
+[[gnu::always_inline]] inline void load_double(typename lanes<L>::f64& out, const T* src) noexcept {
+    typename lanes<L>::i64 x;
+    __builtin_memcpy(&x, src, sizeof(x));
+    out = reinterpret_cast<typename lanes<L>::f64>(x + magic_bits) - magic_value;
+}
+
+template<size_t L, typename V, typename T>
+[[gnu::always_inline]] inline void load(V& out, const T* src) noexcept {
+    __builtin_memcpy(&out, src, sizeof(out));
+}
+
+template<size_t L, typename V>
+[[gnu::always_inline]] inline auto horizontal_sum(const V& v) noexcept {
+    auto sum = v[0];
+    for (size_t k = 1; k < L; ++k) {
+        sum += v[k];
+    }
+    return sum;
+}
+
+template<size_t L>
+[[gnu::always_inline]] inline uint64_t sum_quantity_impl(const uint64_t* qty, size_t n) noexcept {
+    using u64 = typename lanes<L>::u64;
+
+    u64 acc = {};
+    size_t i = 0;
+    for (; i + L <= n; i += L) {
+        u64 q;
+        load<L>(q, qty + i);
+        acc += q;
+    }
+
+    uint64_t sum = horizontal_sum<L>(acc);
+    for (; i < n; ++i) {
+        sum += qty[i];
+    }
+    return sum;
+}
+
+template<size_t L>
+[[gnu::always_inline]] inline double weighted_depth_impl(const uint64_t* qty, const double* weights,
+                                                         size_t n) noexcept {
+    using f64 = typename lanes<L>::f64;
+
+    f64 acc = {};
+    size_t i = 0;
+    for (; i + L <= n; i += L) {
+        f64 q, w;
+        load_double<L>(q, qty + i);
+        load<L>(w, weights + i);
+        acc += q * w;
+    }
+
+    double sum = horizontal_sum<L>(acc);
+    for (; i < n; ++i) {
+        sum += static_cast<double>(qty[i]) * weights[i];
+    }
+    return sum;
+}
+
+template<size_t L>
+[[gnu::always_inline]] inline depth_sums sum_depth_impl(const int64_t* price, const uint64_t* qty,
+                                                        size_t n) noexcept {
+    using f64 = typename lanes<L>::f64;
+
+    f64 q_acc = {};
+    f64 pq_acc = {};
+    size_t i = 0;
+    for (; i + L <= n; i += L) {
+        f64 q, p;
+        load_double<L>(q, qty + i);
+        load_double<L>(p, price + i);
+        q_acc += q;
+        pq_acc += p * q;
+    }
+
+    depth_sums sums{horizontal_sum<L>(q_acc), horizontal_sum<L>(pq_acc)};
+    for (; i < n; ++i) {
+        sums.quantity += static_cast<double>(qty[i]);
+        sums.notional += static_cast<double>(price[i]) * static_cast<double>(qty[i]);
+    }
+    return sums;
+}
+
+// Whole blocks are consumed while they fit; the block that crosses the
+// target is finished level by level
+template<size_t L>
+[[gnu::always_inline]] inline double vwap_to_depth_impl(const int64_t* price, const uint64_t* qty,
+                                                        size_t n, uint64_t target) noexcept {
+    using f64 = typename lanes<L>::f64;
+    using u64 = typename lanes<L>::u64;
+
+    uint64_t filled = 0;
+    double notional = 0.0;
+    size_t i = 0;
+
+    for (; i + L <= n; i += L) {
+        u64 q;
+        load<L>(q, qty + i);
+        const uint64_t block = horizontal_sum<L>(q);
+        if (filled + block > target) break;
+
+        f64 qd, pd;
+        load_double<L>(qd, qty + i);
+        load_double<L>(pd, price + i);
+        notional += horizontal_sum<L>(pd * qd);
+        filled += block;
+    }
+
+    for (; i < n && filled < target; ++i) {
+        const uint64_t take = min(qty[i], target - filled);
+        notional += static_cast<double>(price[i]) * static_cast<double>(take);
+        filled += take;
+    }
+
+    return filled > 0 ? notional / static_cast<double>(filled) : 0.0;
+}
+
+// Scalar baseline
+uint64_t sum_quantity_scalar(const uint64_t* qty, size_t n) noexcept {
+    return sum_quantity_impl<1>(qty, n);
+}
+double weighted_depth_scalar(const uint64_t* qty, const double* weights, size_t n) noexcept {
+    return weighted_depth_impl<1>(qty, weights, n);
+}
+depth_sums sum_depth_scalar(const int64_t* price, const uint64_t* qty, size_t n) noexcept {
+    return sum_depth_impl<1>(price, qty, n);
+}
+double vwap_to_depth_scalar(const int64_t* price, const uint64_t* qty, size_t n,
+                            uint64_t target) noexcept {
+    return vwap_to_depth_impl<1>(price, qty, n, target);
+}
+
+// AVX2: 4 x 64-bit lanes
+[[gnu::target("avx2,fma")]]
+uint64_t sum_quantity_avx2(const uint64_t* qty, size_t n) noexcept {
+    return sum_quantity_impl<4>(qty, n);
+}
+[[gnu::target("avx2,fma")]]
+double weighted_depth_avx2(const uint64_t* qty, const double* weights, size_t n) noexcept {
+    return weighted_depth_impl<4>(qty, weights, n);
+}
+[[gnu::target("avx2,fma")]]
+depth_sums sum_depth_avx2(const int64_t* price, const uint64_t* qty, size_t n) noexcept {
+    return sum_depth_impl<4>(price, qty, n);
+}
+[[gnu::target("avx2,fma")]]
+double vwap_to_depth_avx2(const int64_t* price, const uint64_t* qty, size_t n,
+                          uint64_t target) noexcept {
+    return vwap_to_depth_impl<4>(price, qty, n, target);
+}
+
+// AVX-512: 8 x 64-bit lanes
+[[gnu::target("avx512f,avx512dq")]]
+uint64_t sum_quantity_avx512(const uint64_t* qty, size_t n) noexcept {
+    return sum_quantity_impl<8>(qty, n);
+}
+[[gnu::target("avx512f,avx512dq")]]
+double weighted_depth_avx512(const uint64_t* qty, const double* weights, size_t n) noexcept {
+    return weighted_depth_impl<8>(qty, weights, n);
+}
+[[gnu::target("avx512f,avx512dq")]]
+depth_sums sum_depth_avx512(const int64_t* price, const uint64_t* qty, size_t n) noexcept {
+    return sum_depth_impl<8>(price, qty, n);
+}
+[[gnu::target("avx512f,avx512dq")]]
+double vwap_to_depth_avx512(const int64_t* price, const uint64_t* qty, size_t n,
+                            uint64_t target) noexcept {
+    return vwap_to_depth_impl<8>(price, qty, n, target);
+}
+
+constexpr kernel_table scalar_kernels{
+    "scalar", sum_quantity_scalar, weighted_depth_scalar, sum_depth_scalar, vwap_to_depth_scalar
+};
+constexpr kernel_table avx2_kernels{
+    "avx2", sum_quantity_avx2, weighted_depth_avx2, sum_depth_avx2, vwap_to_depth_avx2
+};
+constexpr kernel_table avx512_kernels{
+    "avx512", sum_quantity_avx512, weighted_depth_avx512, sum_depth_avx512, vwap_to_depth_avx512
+};
+
+const kernel_table* active_kernels = &scalar_kernels;
+
+// Agreement checks: power-of-two weights, so every product is exact
+constexpr size_t CHECK_LEVELS = 128;
+constexpr auto check_weights = [] {
+    struct table {
+        double weight[CHECK_LEVELS];
+    } t{};
+    for (size_t i = 0; i < CHECK_LEVELS; ++i) {
+        t.weight[i] = 1.0 / static_cast<double>(1u << (i % 4));
+    }
+    return t;
+}();
+
+} // namespace hft::simd
+
+export namespace hft::simd {
+
+// Pick the widest kernel set the CPU and boot-time XCR0 setup allow
+void select(const cpu_features& features) noexcept {
+    if (features.avx512f && features.avx512dq) {
+        active_kernels = &avx512_kernels;
+    } else if (features.avx2 && features.fma) {
+        active_kernels = &avx2_kernels;
+    } else {
+        active_kernels = &scalar_kernels;
+    }
+}
+
+[[nodiscard]] const kernel_table& kernels() noexcept {
+    return *active_kernels;
+}
+
+// Whether the selected kernels return exactly what the scalar ones do on
+// one run of levels (only its first CHECK_LEVELS are checked). Integer
+// sums below 2^53 are exact in double whatever the lane count, so for
+// book-sized prices and quantities the results must be bit-identical.
+[[nodiscard]] bool matches_scalar(const int64_t* price, const uint64_t* qty, size_t n) noexcept {
+    n = min(n, CHECK_LEVELS);
+    const kernel_table& k = kernels();
+    const kernel_table& s = scalar_kernels;
+    const double* weights = check_weights.weight;
+
+    const uint64_t total = s.sum_quantity(qty, n);
+    bool same = k.sum_quantity(qty, n) == total &&
+                k.weighted_depth(qty, weights, n) == s.weighted_depth(qty, weights, n);
+
+    const depth_sums vector = k.sum_depth(price, qty, n);
+    const depth_sums scalar = s.sum_depth(price, qty, n);
+    same = same && vector.quantity == scalar.quantity && vector.notional == scalar.notional;
+
+    // Inside the first level, inside a block, exactly all, and beyond the run
+    const uint64_t targets[] = {1, total / 3, total, total + 1};
+    for (const uint64_t target : targets) {
+        same = same && k.vwap_to_depth(price, qty, n, target) == s.vwap_to_depth(price, qty, n, target);
+    }
+    return same;
+}
+
+// Boot check of the selected kernels on a fixed ladder whose length
+// leaves a scalar tail after the vector blocks of every width
+[[nodiscard]] bool self_test() noexcept {
+    constexpr size_t LEVELS = 37;
+    int64_t price[LEVELS];
+    uint64_t qty[LEVELS];
+    for (size_t i = 0; i < LEVELS; ++i) {
+        price[i] = 1000000 - 100 * static_cast<int64_t>(i);  // $100.00 down by cents
+        qty[i] = 100 + (i * 7919) % 5000;
+    }
+    return matches_scalar(price, qty, LEVELS) && matches_scalar(price, qty, 3);
+}
+
+// Order imbalance in [-1, 1] over bid and ask quantity runs
+[[nodiscard]] double imbalance(const uint64_t* bid_qty, size_t bid_n,
+                               const uint64_t* ask_qty, size_t ask_n) noexcept {
+    const auto& k = kernels();
+    const double bid = static_cast<double>(k.sum_quantity(bid_qty, bid_n));
+    const double ask = static_cast<double>(k.sum_quantity(ask_qty, ask_n));
+    const double total = bid + ask;
+    return total > 0.0 ? (bid - ask) / total : 0.0;
+}
+
+// Depth-weighted microprice: each side's VWAP weighted by the opposite
+// side's size, so the price leans toward the thinner side
+[[nodiscard]] double microprice(const int64_t* bid_price, const uint64_t* bid_qty, size_t bid_n,
+                                const int64_t* ask_price, const uint64_t* ask_qty, size_t ask_n) noexcept {
+    const auto& k = kernels();
+    const depth_sums bid = k.sum_depth(bid_price, bid_qty, bid_n);
+    const depth_sums ask = k.sum_depth(ask_price, ask_qty, ask_n);
+    if (bid.quantity <= 0.0 || ask.quantity <= 0.0) {
+        return 0.0;
+    }
+
+    const double bid_vwap = bid.notional / bid.quantity;
+    const double ask_vwap = ask.notional / ask.quantity;
+    return (bid_vwap * ask.quantity + ask_vwap * bid.quantity) / (bid.quantity + ask.quantity);
+}
+
+[[nodiscard]] double weighted_depth(const uint64_t* qty, const double* weights, size_t n) noexcept {
+    return kernels().weighted_depth(qty, weights, n);
+}
+
+// Average price paid to take `target` quantity walking the levels in order
+[[nodiscard]] double vwap_to_depth(const int64_t* price, const uint64_t* qty, size_t n,
+                                   uint64_t target) noexcept {
+    return kernels().vwap_to_depth(price, qty, n, target);
+}
+
+} // namespace hft::simd
@@ -0,0 +1,235 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+#include "../include/freestanding/atomic.hpp"
+
+export module hft.smp;
+import hft.core;
+import hft.gdt;
+import hft.idt;
+import hft.acpi;
+import hft.apic;
+import hft.pit;
+import hft.timer;
+import hft.tsc;
+
+// Application processor bring-up and per-core run loops.
+// Every processor in the MADT is started with INIT-SIPI-SIPI, gets its own
+// GDT, TSS, stacks and GS block, and then polls a mailbox. pin() hands a
+// core one task (a busy-polling run loop: feed, strategy, gateway); the
+// core runs it until it returns and then goes back to polling. The only
+// interrupts an AP takes are its own one-shot timers (hft.timer); device
+// IRQs are routed to the boot processor.
+export namespace hft::smp {
+
+constexpr size_t MAX_CPUS = topology::MAX_CPUS;
+constexpr uint64_t AP_TRAMPOLINE_ADDR = 0x8000;  // Below pmm::LOW_MEMORY_END, page aligned
+constexpr size_t STACK_SIZE = 16384;
+constexpr size_t IST_STACK_SIZE = 4096;
+
+// A run loop pinned to a core; it owns the core until it returns
+using task_fn = void (*)(void* arg);
+
+enum class cpu_state : uint32_t {
+    offline,    // Not started, or did not answer the STARTUP IPI
+    idle,       // Polling its mailbox
+    claimed,    // A pin() is filling in the mailbox
+    assigned,   // Task published, not yet picked up
+    running     // Running a task (always, for the boot processor)
+};
+
+} // namespace hft::smp
+
+namespace hft::smp {
+
+// Layout shared with boot/ap_trampoline.S
+struct trampoline_params {
+    uint64_t cr3;
+    uint64_t stack;
+    uint64_t entry;
+    uint64_t arg;
+};
+
+extern "C" {
+    extern const uint8_t ap_trampoline_start[];
+    extern const uint8_t ap_trampoline_end[];
+    extern const uint8_t ap_trampoline_params[];
+}
+
+// Everything one core owns. cpu_local comes first, so the GS base points
+// at both.
+struct alignas(64) cpu {
+    cpu_local local;
+    atomic<cpu_state> state;
+    task_fn task;
+    void* task_arg;
+    gdt::cpu_tables tables;
+    alignas(16) uint8_t stack[STACK_SIZE];
+    alignas(16) uint8_t double_fault_stack[IST_STACK_SIZE];
+    alignas(16) uint8_t nmi_stack[IST_STACK_SIZE];
+};
+
+// Index 0 is the boot processor, which keeps the boot stack and GDT
+inline cpu cpus[MAX_CPUS];
+inline uint32_t cpu_count_ = 1;
+
+bool wait_online(const cpu& c, uint64_t us) noexcept {
+    constexpr uint64_t STEP_US = 100;
+
+    for (uint64_t waited = 0; waited < us; waited += STEP_US) {
+        if (c.state.load(memory_order::acquire) != cpu_state::offline) return true;
+        pit::wait_us(STEP_US);
+    }
+    return c.state.load(memory_order::acquire) != cpu_state::offline;
+}
+
+// Mailbox loop every AP ends up in
+[[noreturn]] void run_loop(cpu* self) noexcept {
+    while (true) {
+        if (self->state.load(memory_order::acquire) == cpu_state::assigned) {
+            self->state.store(cpu_state::running, memory_order::relaxed);
+            self->task(self->task_arg);
+            self->task = nullptr;
+            self->state.store(cpu_state::idle, memory_order::release);
+        }
+        asm volatile("pause");
+    }
+}
+
+// Called by the trampoline on the AP's own stack, in long mode on the boot
+// processor's page tables
+extern "C" [[noreturn]] void ap_entry(cpu* self) noexcept {
+    gdt::load(self->tables, {
+        reinterpret_cast<uint64_t>(&self->stack[STACK_SIZE]),
+        reinterpret_cast<uint64_t>(&self->double_fault_stack[IST_STACK_SIZE]),
+        reinterpret_cast<uint64_t>(&self->nmi_stack[IST_STACK_SIZE])
+    });
+    idt::load();
+    topology::install_cpu_local(&self->local);  // After gdt::load reset GS
+    topology::bind_current_cpu();
+    apic::init_local();
+    timer::init_local();
+    // Interrupts on: all that reaches an AP is its own one-shot timer
+    // (hft.timer), device IRQs stay on the boot processor. A loop that
+    // must not be interrupted at all masks them itself (sched's
+    // set_interrupts_off).
+    asm volatile("sti");
+
+    self->state.store(cpu_state::idle, memory_order::release);
+    tsc::answer_sync();  // The boot processor measures our TSC next
+    run_loop(self);
+}
+
+// INIT, 10 ms, STARTUP; a second STARTUP if the first was not taken
+// (the universal startup algorithm from the Intel SDM)
+bool start_ap(cpu& c) noexcept {
+    apic::send_init(c.local.apic_id);
+    pit::wait_us(10000);
+
+    apic::send_startup(c.local.apic_id, AP_TRAMPOLINE_ADDR >> 12);
+    if (wait_online(c, 200)) return true;
+
+    apic::send_startup(c.local.apic_id, AP_TRAMPOLINE_ADDR >> 12);
+    return wait_online(c, 100000);
+}
+
+} // namespace hft::smp
+
+export namespace hft::smp {
+
+// Give the boot processor its per-CPU block. Call after gdt::init (which
+// resets GS); everything using per-CPU state comes after.
+void init() noexcept {
+    cpu& bsp = cpus[0];
+    bsp.local.index = 0;
+    bsp.local.apic_id = topology::current_apic_id();
+    bsp.local.node = topology::apic_node[bsp.local.apic_id & (topology::MAX_APIC_IDS - 1)];
+    bsp.state.store(cpu_state::running, memory_order::relaxed);
+    topology::install_cpu_local(&bsp.local);
+    cpu_count_ = 1;
+}
+
+// Start every other processor the MADT lists, one at a time (they share
+// the trampoline parameters), bringing each one's TSC in line with the
+// boot processor's. Call after idt::init, tsc::init and timer::init on
+// the boot processor. Returns the number of cores online, including it.
+uint32_t start_secondary() noexcept {
+    const cpu& bsp = cpus[0];
+
+    const auto ids = acpi::processor_apic_ids();
+    if (ids.size() <= 1) return cpu_count_;
+
+    const size_t size = static_cast<size_t>(ap_trampoline_end - ap_trampoline_start);
+    memcpy(reinterpret_cast<void*>(AP_TRAMPOLINE_ADDR), ap_trampoline_start, size);
+
+    auto* params = reinterpret_cast<volatile trampoline_params*>(
+        AP_TRAMPOLINE_ADDR + static_cast<uint64_t>(ap_trampoline_params - ap_trampoline_start));
+
+    uint64_t cr3;
+    asm volatile("movq %%cr3, %0" : "=r"(cr3));
+
+    for (const uint32_t id : ids) {
+        if (id == bsp.local.apic_id) continue;
+        if (cpu_count_ >= MAX_CPUS) break;
+
+        cpu& c = cpus[cpu_count_];
+        c.local.index = cpu_count_;
+        c.local.apic_id = id;
+        c.local.node = topology::apic_node[id];
+        c.state.store(cpu_state::offline, memory_order::relaxed);
+
+        params->cr3 = cr3;
+        params->stack = reinterpret_cast<uint64_t>(&c.stack[STACK_SIZE]);
+        params->entry = reinterpret_cast<uint64_t>(&ap_entry);
+        params->arg = reinterpret_cast<uint64_t>(&c);
+
+        // A core that missed its deadline may still be in the trampoline,
+        // so the parameters cannot be reused for the next one
+        if (!start_ap(c)) break;
+        tsc::sync_with(cpu_count_);
+        ++cpu_count_;
+    }
+
+    return cpu_count_;
+}
+
+// Cores brought up, including the boot processor (index 0)
+[[nodiscard]] uint32_t cpu_count() noexcept {
+    return cpu_count_;
+}
+
+// Index of the executing core
+[[nodiscard]] uint32_t current() noexcept {
+    return topology::this_cpu()->index;
+}
+
+[[nodiscard]] uint32_t apic_id(uint32_t index) noexcept {
+    return cpus[index].local.apic_id;
+}
+
+[[nodiscard]] uint32_t node(uint32_t index) noexcept {
+    return cpus[index].local.node;
+}
+
+[[nodiscard]] cpu_state state(uint32_t index) noexcept {
+    return cpus[index].state.load(memory_order::acquire);
+}
+
+// Run task(arg) on an idle AP. Returns false for the boot processor, an
+// index that is not online, or a core that already has a task.
+bool pin(uint32_t index, task_fn task, void* arg) noexcept {
+    if (index == 0 || index >= cpu_count_ || !task) return false;
+
+    cpu& c = cpus[index];
+    cpu_state expected = cpu_state::idle;
+    while (!c.state.compare_exchange_weak(expected, cpu_state::claimed, memory_order::acquire)) {
+        if (expected != cpu_state::idle) return false;
+    }
+
+    c.task = task;
+    c.task_arg = arg;
+    c.state.store(cpu_state::assigned, memory_order::release);
+    return true;
+}
+
+} // namespace hft::smp
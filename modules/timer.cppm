@@ -0,0 +1,429 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+#include "../include/freestanding/atomic.hpp"
+
+export module hft.timer;
+import hft.core;
+import hft.idt;
+import hft.apic;
+import hft.pit;
+
+// Tickless per-core one-shot timers on the local APIC.
+// There is no periodic tick anywhere: each core keeps its pending timers
+// in a timer wheel and programs its LAPIC timer for the earliest one only,
+// in TSC-deadline mode when the CPU has it (one WRMSR, no conversion) or
+// as an LAPIC one-shot count otherwise. A core with nothing pending takes
+// no timer interrupts at all, and an isolated core refuses timers, so a
+// pinned polling loop there is never interrupted. Callbacks run in the
+// timer interrupt, which saves the enabled FPU/vector state around them,
+// so they may be built with either the kernel or the trading profile.
+export namespace hft::timer {
+
+using callback = void (*)(void* arg);
+
+constexpr uint64_t NO_DEADLINE = ~0ULL;
+constexpr uint32_t WHEEL_SLOTS = 256;
+constexpr uint32_t OVERFLOW_SLOT = WHEEL_SLOTS;
+constexpr uint32_t DUE_SLOT = WHEEL_SLOTS + 1;  // Expired, callback not run yet
+constexpr uint32_t NOT_QUEUED = WHEEL_SLOTS + 2;
+
+// One pending timer, owned by the caller and linked into the wheel of the
+// core that armed it
+struct event {
+    uint64_t deadline = 0;  // TSC
+    callback fn = nullptr;
+    void* arg = nullptr;
+    event* next = nullptr;
+    event** pprev = nullptr;
+    uint32_t slot = NOT_QUEUED;
+
+    [[nodiscard]] bool pending() const noexcept { return slot != NOT_QUEUED; }
+};
+
+// Hashed timer wheel over TSC time. Slot i holds the timers due in one
+// granule (2^granule_shift cycles) of the next WHEEL_SLOTS granules;
+// timers further out wait on an overflow list that is moved into the
+// wheel once its earliest entry comes into range. Expired timers wait on
+// a due list until take_expired() hands them out one at a time, so a
+// callback may re-arm or cancel any of them. Single core, not thread
+// safe: callers keep interrupts off around it.
+class timer_wheel {
+public:
+    void init(uint32_t granule_shift, uint64_t now) noexcept {
+        shift_ = granule_shift;
+        current_ = now >> shift_;
+        for (auto& head : slots_) head = nullptr;
+        for (auto& word : occupied_) word = 0;
+        overflow_ = nullptr;
+        overflow_min_ = NO_DEADLINE;
+        due_ = nullptr;
+    }
+
+    void add(event& e) noexcept {
+        const uint64_t granule = max(e.deadline >> shift_, current_);
+        if (granule - current_ >= WHEEL_SLOTS) {
+            push(overflow_, e, OVERFLOW_SLOT);
+            overflow_min_ = min(overflow_min_, e.deadline);
+            return;
+        }
+
+        const auto index = static_cast<uint32_t>(granule % WHEEL_SLOTS);
+        push(slots_[index], e, index);
+        occupied_[index / 64] |= 1ULL << (index % 64);
+    }
+
+    void remove(event& e) noexcept {
+        if (!e.pending()) return;
+
+        const uint32_t slot = e.slot;
+        unlink(e);
+
+        if (slot == OVERFLOW_SLOT) {
+            if (e.deadline == overflow_min_) overflow_min_ = list_min(overflow_);
+        } else if (slot != DUE_SLOT && !slots_[slot]) {
+            occupied_[slot / 64] &= ~(1ULL << (slot % 64));
+        }
+    }
+
+    // Earliest pending deadline, or NO_DEADLINE
+    [[nodiscard]] uint64_t next_deadline() const noexcept {
+        const auto start = static_cast<uint32_t>(current_ % WHEEL_SLOTS);
+        uint32_t index = first_occupied(start, WHEEL_SLOTS);
+        if (index == WHEEL_SLOTS) index = first_occupied(0, start);
+
+        if (index == WHEEL_SLOTS) return overflow_min_;
+        return min(list_min(slots_[index]), overflow_min_);
+    }
+
+    // Move every timer due at now to the due list; whether it has any
+    [[nodiscard]] bool expire(uint64_t now) noexcept {
+        const uint64_t target = now >> shift_;
+        const uint64_t span = target >= current_ ? min<uint64_t>(target - current_ + 1, WHEEL_SLOTS) : 1;
+
+        for (uint64_t i = 0; i < span; ++i) {
+            const auto index = static_cast<uint32_t>((current_ + i) % WHEEL_SLOTS);
+            if (occupied_[index / 64] & (1ULL << (index % 64))) {
+                collect(index, now);
+            }
+        }
+        current_ = max(current_, target);
+
+        if (overflow_ && (overflow_min_ >> shift_) < current_ + WHEEL_SLOTS) {
+            migrate(now);
+        }
+        return due_ != nullptr;
+    }
+
+    // Unlink and return the next expired timer, nullptr once none is left
+    [[nodiscard]] event* take_expired() noexcept {
+        event* e = due_;
+        if (e) unlink(*e);
+        return e;
+    }
+
+private:
+    static void push(event*& head, event& e, uint32_t slot) noexcept {
+        e.next = head;
+        e.pprev = &head;
+        if (head) head->pprev = &e.next;
+        head = &e;
+        e.slot = slot;
+    }
+
+    static void unlink(event& e) noexcept {
+        *e.pprev = e.next;
+        if (e.next) e.next->pprev = e.pprev;
+        e.next = nullptr;
+        e.pprev = nullptr;
+        e.slot = NOT_QUEUED;
+    }
+
+    static uint64_t list_min(const event* e) noexcept {
+        uint64_t best = NO_DEADLINE;
+        for (; e; e = e->next) best = min(best, e->deadline);
+        return best;
+    }
+
+    // First occupied slot in [from, to), or WHEEL_SLOTS
+    uint32_t first_occupied(uint32_t from, uint32_t to) const noexcept {
+        for (uint32_t index = from; index < to;) {
+            const uint64_t bits = occupied_[index / 64] >> (index % 64);
+            if (bits) {
+                const uint32_t found = index + static_cast<uint32_t>(__builtin_ctzll(bits));
+                return found < to ? found : WHEEL_SLOTS;
+            }
+            index = (index / 64 + 1) * 64;
+        }
+        return WHEEL_SLOTS;
+    }
+
+    void collect(uint32_t index, uint64_t now) noexcept {
+        for (event* e = slots_[index]; e;) {
+            event* next = e->next;
+            if (e->deadline <= now) {
+                unlink(*e);
+                push(due_, *e, DUE_SLOT);
+            }
+            e = next;
+        }
+        if (!slots_[index]) occupied_[index / 64] &= ~(1ULL << (index % 64));
+    }
+
+    void migrate(uint64_t now) noexcept {
+        event* list = overflow_;
+        overflow_ = nullptr;
+        overflow_min_ = NO_DEADLINE;
+
+        while (list) {
+            event* e = list;
+            list = e->next;
+            e->next = nullptr;
+            e->pprev = nullptr;
+            e->slot = NOT_QUEUED;
+
+            if (e->deadline <= now) {
+                push(due_, *e, DUE_SLOT);
+            } else {
+                add(*e);
+            }
+        }
+    }
+
+    uint32_t shift_ = 0;
+    uint64_t current_ = 0;  // Granule the wheel has been expired up to
+    event* slots_[WHEEL_SLOTS] = {};
+    uint64_t occupied_[WHEEL_SLOTS / 64] = {};
+    event* overflow_ = nullptr;
+    uint64_t overflow_min_ = NO_DEADLINE;
+    event* due_ = nullptr;
+};
+
+} // namespace hft::timer
+
+namespace hft::timer {
+
+constexpr uint32_t TSC_DEADLINE_MSR = 0x6E0;
+constexpr uint32_t LVT_MASKED = 1 << 16;
+constexpr uint32_t LVT_TSC_DEADLINE = 2 << 17;
+constexpr uint32_t DIVIDE_BY_16 = 0x3;
+constexpr uint64_t CALIBRATION_US = 10000;
+constexpr uint64_t GRANULE_NS = 16000;  // Wheel slot width, roughly
+
+// XSAVE area for the state boot64.S can enable in XCR0 (x87, SSE, AVX,
+// AVX-512: 2688 bytes in the standard layout), or the 512-byte FXSAVE
+// area without XSAVE
+constexpr size_t VECTOR_STATE_BYTES = 2688;
+
+struct alignas(64) core_timers {
+    timer_wheel wheel;
+    uint64_t programmed = NO_DEADLINE;  // Deadline currently in the LAPIC
+    atomic<bool> isolated{false};
+    alignas(64) uint8_t vector_state[VECTOR_STATE_BYTES];  // Interrupted code's, during callbacks
+};
+
+inline core_timers cores[topology::MAX_CPUS];
+inline bool deadline_mode = false;
+inline bool use_xsave = false;
+inline q32 apic_ticks_per_cycle{0};  // LAPIC timer (after divide-by-16) per TSC cycle
+inline uint32_t granule_shift = 0;
+
+// value * ratio, through a 128-bit product (no 128-bit division helpers
+// in the kernel)
+uint64_t scale(uint64_t value, q32 ratio) noexcept {
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(value) * static_cast<uint64_t>(ratio.raw)) >> q32::fraction_bits);
+}
+
+core_timers& local() noexcept {
+    return cores[topology::this_cpu()->index];
+}
+
+bool tsc_deadline_supported() noexcept {
+    uint32_t eax = 1, ebx, ecx = 0, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    return (ecx >> 24) & 1;
+}
+
+// Interrupt flag save/restore around wheel updates from thread context
+uint64_t irq_save() noexcept {
+    uint64_t flags;
+    asm volatile("pushfq\n popq %0\n cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+void irq_restore(uint64_t flags) noexcept {
+    if (flags & 0x200) asm volatile("sti" ::: "memory");
+}
+
+void program(core_timers& core, uint64_t deadline) noexcept {
+    if (deadline == core.programmed) return;
+    core.programmed = deadline;
+
+    if (deadline_mode) {
+        write_msr(TSC_DEADLINE_MSR, deadline == NO_DEADLINE ? 0 : deadline);
+        return;
+    }
+
+    if (deadline == NO_DEADLINE) {
+        apic::write(apic::reg::timer_initial, 0);
+        return;
+    }
+
+    // Too-far deadlines are clipped; the early interrupt just re-arms
+    const uint64_t now = tsc_clock::now();
+    const uint64_t cycles = deadline > now ? deadline - now : 1;
+    const uint64_t ticks = scale(cycles, apic_ticks_per_cycle);
+    apic::write(apic::reg::timer_initial, static_cast<uint32_t>(min<uint64_t>(max<uint64_t>(ticks, 1), 0xFFFFFFFF)));
+}
+
+// The interrupt stubs save only general registers. Callbacks may be
+// trading code that uses XMM/YMM/ZMM registers, so the interrupted
+// code's vector state is kept aside while they run.
+void save_vector_state(uint8_t* area) noexcept {
+    if (use_xsave) {
+        asm volatile("xsave64 (%0)" :: "r"(area), "a"(0xFFFFFFFF), "d"(0xFFFFFFFF) : "memory");
+    } else {
+        asm volatile("fxsave64 (%0)" :: "r"(area) : "memory");
+    }
+}
+
+void restore_vector_state(const uint8_t* area) noexcept {
+    if (use_xsave) {
+        asm volatile("xrstor64 (%0)" :: "r"(area), "a"(0xFFFFFFFF), "d"(0xFFFFFFFF) : "memory");
+    } else {
+        asm volatile("fxrstor64 (%0)" :: "r"(area) : "memory");
+    }
+}
+
+void handle_interrupt(idt::cpu_context*) noexcept {
+    core_timers& core = local();
+    core.programmed = NO_DEADLINE;  // The hardware timer has fired
+
+    if (core.wheel.expire(tsc_clock::now())) {
+        save_vector_state(core.vector_state);
+        while (event* e = core.wheel.take_expired()) {
+            e->fn(e->arg);
+        }
+        restore_vector_state(core.vector_state);
+    }
+
+    program(core, core.wheel.next_deadline());
+}
+
+// XSAVE when boot64.S enabled it (CR4.OSXSAVE); XCR0 then holds at most
+// the components VECTOR_STATE_BYTES is sized for
+bool xsave_enabled() noexcept {
+    uint64_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    return (cr4 >> 18) & 1;
+}
+
+// Wheel granule from the TSC frequency (hft.tsc) and, without
+// TSC-deadline, the LAPIC timer rate against the TSC over a PIT interval
+void calibrate() noexcept {
+    const uint64_t granule_cycles = max<uint64_t>(tsc_clock::from_ns(GRANULE_NS), 1);
+    granule_shift = 63 - static_cast<uint32_t>(__builtin_clzll(granule_cycles));
+    if (deadline_mode) return;
+
+    apic::write(apic::reg::timer_divide, DIVIDE_BY_16);
+    apic::write(apic::reg::lvt_timer, LVT_MASKED);
+    apic::write(apic::reg::timer_initial, 0xFFFFFFFF);
+
+    const uint64_t start = tsc_clock::start();
+    pit::wait_us(CALIBRATION_US);
+    const uint64_t end = tsc_clock::stop();
+
+    const uint32_t elapsed = 0xFFFFFFFF - apic::read(apic::reg::timer_current);
+    apic::write(apic::reg::timer_initial, 0);
+    apic_ticks_per_cycle = q32::from_ratio(elapsed, end - start);
+}
+
+} // namespace hft::timer
+
+export namespace hft::timer {
+
+// Set up the executing core's LAPIC timer and wheel, disarmed. The boot
+// processor gets this from init(); each AP calls it at bring-up.
+void init_local() noexcept {
+    core_timers& core = local();
+    core.wheel.init(granule_shift, tsc_clock::now());
+    core.programmed = NO_DEADLINE;
+
+    if (deadline_mode) {
+        apic::write(apic::reg::lvt_timer, idt::apic_timer_vector | LVT_TSC_DEADLINE);
+        asm volatile("mfence; lfence" ::: "memory");  // LVT write before the first deadline
+        write_msr(TSC_DEADLINE_MSR, 0);
+    } else {
+        apic::write(apic::reg::timer_divide, DIVIDE_BY_16);
+        apic::write(apic::reg::lvt_timer, idt::apic_timer_vector);  // One-shot
+        apic::write(apic::reg::timer_initial, 0);
+    }
+}
+
+// Choose the timer mode, calibrate and set up the boot processor. Call
+// after apic::init, smp::init and tsc::init, before interrupts are
+// enabled and before APs start.
+void init() noexcept {
+    deadline_mode = tsc_deadline_supported();
+    use_xsave = xsave_enabled();
+    calibrate();
+    idt::register_handler(idt::apic_timer_vector, handle_interrupt);
+    init_local();
+}
+
+[[nodiscard]] bool tsc_deadline_mode() noexcept {
+    return deadline_mode;
+}
+
+// Mark a core isolated (or not). Isolated cores refuse new timers, so
+// once their pending ones have fired they take no timer interrupts;
+// isolate a core before pinning its task to it.
+void set_isolated(uint32_t cpu, bool isolated) noexcept {
+    cores[cpu].isolated.store(isolated, memory_order::release);
+}
+
+[[nodiscard]] bool is_isolated(uint32_t cpu) noexcept {
+    return cores[cpu].isolated.load(memory_order::acquire);
+}
+
+// Arm e to call fn(arg) on the executing core at TSC time deadline
+// (re-arming if already pending). fn runs in interrupt context, with the
+// interrupted code's vector registers saved, and may re-arm or cancel e
+// or any other timer of this core, expired ones included. Returns false
+// on an isolated core.
+bool arm(event& e, uint64_t deadline, callback fn, void* arg) noexcept {
+    const uint64_t flags = irq_save();
+    core_timers& core = local();
+    if (core.isolated.load(memory_order::relaxed)) {
+        irq_restore(flags);
+        return false;
+    }
+
+    core.wheel.remove(e);
+    e.deadline = deadline;
+    e.fn = fn;
+    e.arg = arg;
+    core.wheel.add(e);
+
+    if (deadline < core.programmed) program(core, deadline);
+    irq_restore(flags);
+    return true;
+}
+
+// Arm e to fire ns nanoseconds from now
+bool arm_after(event& e, uint64_t ns, callback fn, void* arg) noexcept {
+    return arm(e, tsc_clock::now() + tsc_clock::from_ns(ns), fn, arg);
+}
+
+// Cancel e; must run on the core that armed it
+void cancel(event& e) noexcept {
+    const uint64_t flags = irq_save();
+    core_timers& core = local();
+    if (e.pending()) {
+        core.wheel.remove(e);
+        if (e.deadline <= core.programmed) program(core, core.wheel.next_deadline());
+    }
+    irq_restore(flags);
+}
+
+} // namespace hft::timer
@@ -0,0 +1,389 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+#include "../include/freestanding/atomic.hpp"
+
+// Build with -DHFT_TRACE=0 to compile every tracepoint and histogram
+// record out
+#ifndef HFT_TRACE
+#define HFT_TRACE 1
+#endif
+
+export module hft.trace;
+import hft.core;
+
+// Hot-path instrumentation that never blocks the core being measured.
+// Tracepoints append {TSC, id, arg} to the executing core's flight
+// recorder ring; latency histograms count TSC deltas in per-core,
+// log-linear buckets. Recording is core-local (no locked instructions,
+// no shared lines written); a housekeeping core drains rings and merges
+// histograms, and formats them for the serial port or copies them out to
+// shared memory. tick_timer stamps the feed -> book -> signal -> order
+// stages of one event and records the breakdown.
+export namespace hft::trace {
+
+inline constexpr bool enabled = HFT_TRACE != 0;
+
+constexpr size_t RING_ENTRIES = 1024;  // Per core, power of two
+constexpr uint16_t MAX_POINTS = 256;
+
+// Built-in tracepoints, one per tick-to-trade stage; drivers and
+// strategies name their own from first_user up
+enum point : uint16_t {
+    feed_rx,        // Packet taken off the NIC ring
+    feed_decoded,   // Market data message decoded
+    book_updated,   // Order book changed
+    signal_ready,   // Strategy decided
+    order_sent,     // Order handed to the NIC
+    first_user = 16
+};
+
+constexpr uint32_t STAGES = order_sent + 1;
+
+struct entry {
+    uint64_t tsc;
+    uint16_t id;
+    uint16_t cpu;
+    uint32_t arg;
+};
+
+using writer = void (*)(const char* text) noexcept;
+
+// HdrHistogram-style log-linear buckets over unsigned values (TSC
+// cycles here): values below 2^SubBits get one bucket each, every power
+// of two above that is split into 2^(SubBits-1) buckets, so a bucket is
+// at most 2^-(SubBits-1) of its value wide. Values at or above 2^MaxBits
+// land in the last bucket. One writer (the owning core); readers on
+// other cores see counts that are at worst a few samples stale.
+template<uint32_t SubBits = 5, uint32_t MaxBits = 40>
+    requires (SubBits >= 2) && (MaxBits > SubBits) && (MaxBits < 64)
+class histogram {
+public:
+    static constexpr uint32_t sub_count = 1u << SubBits;
+    static constexpr uint32_t half_count = sub_count / 2;
+    static constexpr uint32_t buckets = (MaxBits - SubBits + 1) * half_count + half_count;
+
+    static constexpr uint32_t index_of(uint64_t value) noexcept {
+        if (value < sub_count) return static_cast<uint32_t>(value);
+        if (value >= (uint64_t{1} << MaxBits)) return buckets - 1;
+
+        const uint32_t msb = 63 - static_cast<uint32_t>(__builtin_clzll(value));
+        const uint32_t exponent = msb - (SubBits - 1);
+        return exponent * half_count + static_cast<uint32_t>(value >> exponent);
+    }
+
+    // Smallest and largest value counted in bucket index
+    static constexpr uint64_t lowest(uint32_t index) noexcept {
+        if (index < sub_count) return index;
+        const uint32_t exponent = index / half_count - 1;
+        return static_cast<uint64_t>(index - exponent * half_count) << exponent;
+    }
+
+    static constexpr uint64_t highest(uint32_t index) noexcept {
+        if (index < sub_count) return index;
+        const uint32_t exponent = index / half_count - 1;
+        return lowest(index) + (uint64_t{1} << exponent) - 1;
+    }
+
+    void record(uint64_t value) noexcept {
+        bump(counts_[index_of(value)]);
+        bump(total_);
+        if (value > max_.load(memory_order::relaxed)) max_.store(value, memory_order::relaxed);
+    }
+
+    // Add other's counts into this one (snapshots, per-core merging)
+    void merge(const histogram& other) noexcept {
+        for (uint32_t i = 0; i < buckets; ++i) {
+            add(counts_[i], other.counts_[i].load(memory_order::relaxed));
+        }
+        add(total_, other.total_.load(memory_order::relaxed));
+        const uint64_t other_max = other.max_.load(memory_order::relaxed);
+        if (other_max > max_.load(memory_order::relaxed)) max_.store(other_max, memory_order::relaxed);
+    }
+
+    void reset() noexcept {
+        for (auto& count : counts_) count.store(0, memory_order::relaxed);
+        total_.store(0, memory_order::relaxed);
+        max_.store(0, memory_order::relaxed);
+    }
+
+    [[nodiscard]] uint64_t count() const noexcept { return total_.load(memory_order::relaxed); }
+    [[nodiscard]] uint64_t max_value() const noexcept { return max_.load(memory_order::relaxed); }
+
+    // Highest value equivalent to the given quantile, in parts per
+    // million (500000 = median, 999000 = p99.9); 0 when empty
+    [[nodiscard]] uint64_t value_at(uint32_t per_million) const noexcept {
+        const uint64_t total = count();
+        if (total == 0) return 0;
+
+        // Rank of the sample, rounded up; totals stay far below 2^44
+        const uint64_t rank = max<uint64_t>((total * per_million + 999999) / 1000000, 1);
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < buckets; ++i) {
+            seen += counts_[i].load(memory_order::relaxed);
+            if (seen >= rank) return min(highest(i), max_value());
+        }
+        return max_value();
+    }
+
+private:
+    // Single-writer increment: a plain load and store, no LOCK prefix
+    static void bump(atomic<uint64_t>& counter) noexcept {
+        counter.store(counter.load(memory_order::relaxed) + 1, memory_order::relaxed);
+    }
+
+    static void add(atomic<uint64_t>& counter, uint64_t value) noexcept {
+        counter.store(counter.load(memory_order::relaxed) + value, memory_order::relaxed);
+    }
+
+    atomic<uint64_t> counts_[buckets];
+    atomic<uint64_t> total_{0};
+    atomic<uint64_t> max_{0};
+};
+
+using latency_histogram = histogram<>;
+
+// One histogram per core; record() touches only the executing core's
+template<typename Histogram = latency_histogram>
+class per_core_histogram {
+public:
+    void record(uint64_t value) noexcept {
+        if constexpr (enabled) {
+            cores_[topology::this_cpu()->index].value.record(value);
+        }
+    }
+
+    // Merge every core's counts into out (which is reset first)
+    void snapshot(Histogram& out) const noexcept {
+        out.reset();
+        for (const auto& core : cores_) out.merge(core.value);
+    }
+
+    [[nodiscard]] const Histogram& core(uint32_t cpu) const noexcept {
+        return cores_[cpu].value;
+    }
+
+private:
+    struct alignas(64) slot {
+        Histogram value;
+    };
+    slot cores_[topology::MAX_CPUS];
+};
+
+} // namespace hft::trace
+
+namespace hft::trace {
+
+constexpr size_t RING_MASK = RING_ENTRIES - 1;
+// The slot after head may be mid-write, so one fewer entry is readable
+constexpr uint64_t READABLE = RING_ENTRIES - 1;
+
+// Written only by its core; head is published for the drainer
+struct alignas(64) core_ring {
+    atomic<uint64_t> head{0};
+    alignas(64) uint64_t tail = 0;  // Drainer's line from here
+    uint64_t dropped = 0;           // Entries overwritten before they were drained
+    alignas(64) entry entries[RING_ENTRIES];
+};
+
+inline core_ring rings[topology::MAX_CPUS];
+inline const char* point_names[MAX_POINTS] = {
+    "feed.rx", "feed.decoded", "book.updated", "signal.ready", "order.sent"
+};
+
+// Per stage: latency from the previous stamped stage, with the slot of
+// the first stage (feed_rx) holding the whole tick-to-trade
+inline per_core_histogram<> stage_latency[STAGES];
+
+void record_point(uint16_t id, uint32_t arg) noexcept {
+    const cpu_local* local = topology::this_cpu();
+    core_ring& ring = rings[local->index];
+    const uint64_t head = ring.head.load(memory_order::relaxed);
+    ring.entries[head & RING_MASK] = {tsc_clock::now(), id, static_cast<uint16_t>(local->index), arg};
+    ring.head.store(head + 1, memory_order::release);
+}
+
+// Decimal and hex formatting into a caller buffer, NUL-terminated
+char* format_decimal(char* out, uint64_t value) noexcept {
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (count > 0) *out++ = digits[--count];
+    *out = '\0';
+    return out;
+}
+
+} // namespace hft::trace
+
+export namespace hft::trace {
+
+// Before the run loop starts: make this core's ring resident and dirty
+void prefault_local() noexcept {
+    core_ring& ring = rings[topology::this_cpu()->index];
+    prefault(&ring, sizeof(ring));
+}
+
+void write_number(writer out, uint64_t value) noexcept {
+    char buffer[21];
+    format_decimal(buffer, value);
+    out(buffer);
+}
+
+// Name a tracepoint for dumps; names must outlive the trace
+void set_name(uint16_t id, const char* name) noexcept {
+    if (id < MAX_POINTS) point_names[id] = name;
+}
+
+[[nodiscard]] const char* name(uint16_t id) noexcept {
+    const char* n = id < MAX_POINTS ? point_names[id] : nullptr;
+    return n ? n : "?";
+}
+
+// Tracepoint: one TSC read and the entry store into this core's ring;
+// nothing at all with HFT_TRACE=0
+template<uint16_t Id>
+[[gnu::always_inline]] inline void hit(uint32_t arg = 0) noexcept {
+    if constexpr (enabled) {
+        record_point(Id, arg);
+    }
+}
+
+// Stamps of one event through the pipeline, kept on the stack of the
+// core handling it (or carried along with the event to the next core);
+// finish() records each stage's latency from the previous stamped
+// stage, and the end-to-end tick-to-trade latency when both feed_rx and
+// order_sent were stamped
+class tick_timer {
+public:
+    [[gnu::always_inline]] void mark(point stage) noexcept {
+        if constexpr (enabled) {
+            mark(stage, tsc_clock::now());
+        }
+    }
+
+    // Stamp taken elsewhere, e.g. the NIC receive time of a packet
+    [[gnu::always_inline]] void mark(point stage, uint64_t tsc) noexcept {
+        if constexpr (enabled) {
+            stamps_[stage] = tsc;
+            marked_ |= 1u << stage;
+        }
+    }
+
+    void finish() noexcept {
+        if constexpr (enabled) {
+            uint32_t first = STAGES;
+            uint32_t previous = STAGES;
+            for (uint32_t s = 0; s < STAGES; ++s) {
+                if (!(marked_ & (1u << s))) continue;
+                if (previous != STAGES) {
+                    stage_latency[s].record(stamps_[s] - stamps_[previous]);
+                } else {
+                    first = s;
+                }
+                previous = s;
+            }
+            if (first == feed_rx && previous == order_sent) {
+                stage_latency[feed_rx].record(stamps_[previous] - stamps_[first]);
+            }
+            marked_ = 0;
+        }
+    }
+
+private:
+    uint64_t stamps_[STAGES];
+    uint32_t marked_ = 0;
+};
+
+[[nodiscard]] const per_core_histogram<>& stage_histogram(point stage) noexcept {
+    return stage_latency[stage];
+}
+
+// Copy up to max entries recorded by core cpu since the last drain into
+// out (ordinary memory or a shared-memory dump area). Entries the core
+// overwrote before they could be copied are skipped and counted in
+// dropped(). One drainer at a time per core.
+size_t drain(uint32_t cpu, entry* out, size_t max) noexcept {
+    core_ring& ring = rings[cpu];
+    const uint64_t head = ring.head.load(memory_order::acquire);
+    if (head - ring.tail > READABLE) {
+        ring.dropped += head - READABLE - ring.tail;
+        ring.tail = head - READABLE;
+    }
+
+    const size_t count = static_cast<size_t>(min<uint64_t>(head - ring.tail, max));
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = ring.entries[(ring.tail + i) & RING_MASK];
+    }
+
+    // The core kept writing while we copied: anything it lapped is torn
+    atomic_thread_fence(memory_order::acquire);
+    const uint64_t now_head = ring.head.load(memory_order::relaxed);
+    size_t skip = 0;
+    if (now_head - ring.tail > READABLE) {
+        skip = static_cast<size_t>(min<uint64_t>(now_head - READABLE - ring.tail, count));
+        ring.dropped += skip;
+        for (size_t i = skip; i < count; ++i) out[i - skip] = out[i];
+    }
+
+    ring.tail += count;
+    return count - skip;
+}
+
+[[nodiscard]] uint64_t dropped(uint32_t cpu) noexcept {
+    return rings[cpu].dropped;
+}
+
+// Drain every core below cpus and print one line per entry:
+// "cpu <n> <wall-clock ns> <name> <arg>"
+void dump(writer out, uint32_t cpus) noexcept {
+    entry batch[64];
+    for (uint32_t cpu = 0; cpu < cpus; ++cpu) {
+        size_t count;
+        while ((count = drain(cpu, batch, 64)) > 0) {
+            for (size_t i = 0; i < count; ++i) {
+                out("cpu ");
+                write_number(out, batch[i].cpu);
+                out(" ");
+                write_number(out, tsc_clock::wall_ns(batch[i].tsc));
+                out(" ");
+                out(name(batch[i].id));
+                out(" ");
+                write_number(out, batch[i].arg);
+                out("\n");
+            }
+        }
+    }
+}
+
+// Print count, p50, p99, p99.9 and max for h (TSC cycles) in nanoseconds
+void print(writer out, const char* label, const latency_histogram& h) noexcept {
+    out(label);
+    out(": n=");
+    write_number(out, h.count());
+    out(" p50=");
+    write_number(out, tsc_clock::to_ns(h.value_at(500000)));
+    out(" p99=");
+    write_number(out, tsc_clock::to_ns(h.value_at(990000)));
+    out(" p99.9=");
+    write_number(out, tsc_clock::to_ns(h.value_at(999000)));
+    out(" max=");
+    write_number(out, tsc_clock::to_ns(h.max_value()));
+    out(" ns\n");
+}
+
+// Tick-to-trade breakdown over every core. scratch holds the merged
+// histogram (too large for a housekeeping stack).
+void report(writer out, latency_histogram& scratch) noexcept {
+    static constexpr const char* labels[STAGES] = {
+        "tick-to-trade", "  decode", "  book", "  signal", "  order out"
+    };
+    for (uint32_t s = 0; s < STAGES; ++s) {
+        stage_latency[s].snapshot(scratch);
+        if (scratch.count() > 0) print(out, labels[s], scratch);
+    }
+}
+
+} // namespace hft::trace
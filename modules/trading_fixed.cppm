@@ -5,6 +5,8 @@ module;
 
 export module hft.trading;
 import hft.core;
+import hft.concurrent;
+import hft.simd;
 
 export namespace hft::trading {
 
@@ -26,17 +28,16 @@ struct array {
     constexpr const T* end() const noexcept { return data + N; }
 };
 
-// Price level in the order book
+// Price level on one side of the order book.
+// Fields are atomics so readers on other cores can copy them under the
+// book's seqlock without a data race; the writer uses relaxed stores.
 struct price_level : cache_aligned<price_level> {
-    price_t price;
-    atomic<quantity_t> bid_quantity;
-    atomic<quantity_t> ask_quantity;
-    atomic<uint32_t> bid_count;
-    atomic<uint32_t> ask_count;
+    atomic<price_t> price;
+    atomic<quantity_t> quantity;
+    atomic<uint32_t> order_count;
     
     constexpr price_level() noexcept 
-        : price{0}, bid_quantity{0}, ask_quantity{0}, 
-          bid_count{0}, ask_count{0} {}
+        : price{0}, quantity{0}, order_count{0} {}
 };
 
 // Simple lower_bound implementation
@@ -61,119 +62,740 @@ It lower_bound(It first, It last, const T& value, Compare comp) {
     return first;
 }
 
-// Using C++26 structured binding as condition (P0963R3)
+// Consistent copy of one price level
+struct level_snapshot {
+    price_t price;
+    quantity_t quantity;
+    uint32_t order_count;
+};
+
+// Consistent copy of the top N levels of both sides
+template<size_t N>
+struct book_snapshot {
+    uint64_t sequence;
+    size_t bid_depth;   // Valid entries in bids, at most N
+    size_t ask_depth;   // Valid entries in asks, at most N
+    level_snapshot bids[N];
+    level_snapshot asks[N];
+};
+
+// Best bid/ask with sizes (zero price and size for an empty side)
+struct spread_info {
+    price_t bid_price;
+    price_t ask_price;
+    quantity_t bid_size;
+    quantity_t ask_size;
+};
+
+// Two-sided order book with separate sorted ladders per side.
+// Index 0 of each ladder is the top of book on that side. One writer core
+// applies updates inside a seqlock write section; reader cores copy state
+// out with read_snapshot()/get_spread() and never touch the writer's lines
+// with RMW atomics.
 template<size_t MaxLevels = 32>
 class order_book {
 public:
     static constexpr size_t max_levels = MaxLevels;
     
 private:
-    array<price_level, max_levels> levels_;
+    using ladder = array<price_level, max_levels>;
+    
+    ladder bids_;  // Sorted descending by price
+    ladder asks_;  // Sorted ascending by price
     atomic<size_t> bid_depth_{0};
     atomic<size_t> ask_depth_{0};
-    atomic<uint64_t> sequence_{0};
+    alignas(64) concurrent::seqlock sequence_;
+    
+    struct bid_better {
+        constexpr bool operator()(price_t a, price_t b) const noexcept { return a > b; }
+    };
+    
+    struct ask_better {
+        constexpr bool operator()(price_t a, price_t b) const noexcept { return a < b; }
+    };
     
 public:
-    // Update bid side
-    void update_bid(price_t price, quantity_t quantity) noexcept {
-        if (auto [idx, found] = find_or_insert_price(price); found) {
-            levels_[idx].bid_quantity.store(quantity, memory_order::relaxed);
-        }
-        sequence_.fetch_add(1, memory_order::release);
+    // Update bid side (zero quantity removes the level)
+    void update_bid(price_t price, quantity_t quantity, uint32_t order_count = 0) noexcept {
+        const concurrent::seqlock_writer section{sequence_};
+        update_level(bids_, bid_depth_, price, quantity, order_count, bid_better{});
     }
     
-    // Update ask side  
-    void update_ask(price_t price, quantity_t quantity) noexcept {
-        if (auto [idx, found] = find_or_insert_price(price); found) {
-            levels_[idx].ask_quantity.store(quantity, memory_order::relaxed);
+    // Update ask side (zero quantity removes the level)
+    void update_ask(price_t price, quantity_t quantity, uint32_t order_count = 0) noexcept {
+        const concurrent::seqlock_writer section{sequence_};
+        update_level(asks_, ask_depth_, price, quantity, order_count, ask_better{});
+    }
+
+    // Group updates into one publish: readers see none or all of them.
+    // Updates inside the batch join its write section.
+    void begin_batch() noexcept { sequence_.write_begin(); }
+    void end_batch() noexcept { sequence_.write_end(); }
+    
+    // Consistent copy of the top N levels of each side
+    template<size_t N = 5>
+    [[nodiscard]] book_snapshot<N> read_snapshot() const noexcept {
+        book_snapshot<N> snap;
+        for (;;) {
+            const uint64_t seq = sequence_.read_begin();
+            
+            snap.bid_depth = min(N, bid_depth_.load(memory_order::relaxed));
+            snap.ask_depth = min(N, ask_depth_.load(memory_order::relaxed));
+            for (size_t i = 0; i < snap.bid_depth; ++i) {
+                snap.bids[i] = copy_level(bids_[i]);
+            }
+            for (size_t i = 0; i < snap.ask_depth; ++i) {
+                snap.asks[i] = copy_level(asks_[i]);
+            }
+            
+            if (!sequence_.read_retry(seq)) {
+                snap.sequence = seq >> 1;
+                return snap;
+            }
         }
-        sequence_.fetch_add(1, memory_order::release);
     }
     
-    // Calculate order imbalance
+    // Calculate order imbalance over the top `depth` levels of each side
     [[nodiscard]] double calculate_imbalance(size_t depth = 5) const noexcept {
-        double bid_volume = 0.0;
-        double ask_volume = 0.0;
+        struct volumes {
+            quantity_t bid;
+            quantity_t ask;
+        };
         
-        for (size_t i = 0; i < depth && i < max_levels; ++i) {
-            bid_volume += levels_[i].bid_quantity.load(memory_order::relaxed);
-            ask_volume += levels_[i].ask_quantity.load(memory_order::relaxed);
-        }
+        const auto v = sequence_.read([&] {
+            volumes sums{0, 0};
+            const size_t bids = min(depth, bid_depth_.load(memory_order::relaxed));
+            const size_t asks = min(depth, ask_depth_.load(memory_order::relaxed));
+            
+            for (size_t i = 0; i < bids; ++i) {
+                sums.bid += bids_[i].quantity.load(memory_order::relaxed);
+            }
+            for (size_t i = 0; i < asks; ++i) {
+                sums.ask += asks_[i].quantity.load(memory_order::relaxed);
+            }
+            return sums;
+        });
         
+        double bid_volume = static_cast<double>(v.bid);
+        double ask_volume = static_cast<double>(v.ask);
         double total = bid_volume + ask_volume;
         return total > 0.0 ? (bid_volume - ask_volume) / total : 0.0;
     }
     
-    // Get best bid/ask spread
-    [[nodiscard]] constexpr auto get_spread() const noexcept {
-        struct spread_info {
-            price_t bid_price;
-            price_t ask_price;
-            quantity_t bid_size;
-            quantity_t ask_size;
-        };
-        
-        return spread_info{
-            .bid_price = levels_[0].price,
-            .ask_price = levels_[0].price,
-            .bid_size = levels_[0].bid_quantity.load(memory_order::acquire),
-            .ask_size = levels_[0].ask_quantity.load(memory_order::acquire)
-        };
+    // Get best bid/ask spread as one consistent pair
+    [[nodiscard]] spread_info get_spread() const noexcept {
+        return sequence_.read([this] {
+            spread_info info{0, 0, 0, 0};
+            if (bid_depth_.load(memory_order::relaxed) > 0) {
+                info.bid_price = bids_[0].price.load(memory_order::relaxed);
+                info.bid_size = bids_[0].quantity.load(memory_order::relaxed);
+            }
+            if (ask_depth_.load(memory_order::relaxed) > 0) {
+                info.ask_price = asks_[0].price.load(memory_order::relaxed);
+                info.ask_size = asks_[0].quantity.load(memory_order::relaxed);
+            }
+            return info;
+        });
     }
     
-    // Get sequence number for tracking updates
+    // Writer-side level access by distance from the top of book (0 = best).
+    // Readers on other cores must use read_snapshot() instead.
+    [[nodiscard]] const price_level& bid_level(size_t idx) const noexcept { return bids_[idx]; }
+    [[nodiscard]] const price_level& ask_level(size_t idx) const noexcept { return asks_[idx]; }
+    
+    [[nodiscard]] size_t bid_depth() const noexcept {
+        return bid_depth_.load(memory_order::acquire);
+    }
+    
+    [[nodiscard]] size_t ask_depth() const noexcept {
+        return ask_depth_.load(memory_order::acquire);
+    }
+    
+    // Get sequence number (completed updates) for tracking changes
     [[nodiscard]] uint64_t get_sequence() const noexcept {
-        return sequence_.load(memory_order::acquire);
+        return sequence_.sequence();
     }
     
 private:
-    struct pair {
-        size_t first;
-        bool second;
-    };
+    static level_snapshot copy_level(const price_level& level) noexcept {
+        return {
+            level.price.load(memory_order::relaxed),
+            level.quantity.load(memory_order::relaxed),
+            level.order_count.load(memory_order::relaxed)
+        };
+    }
+    
+    static void move_level(price_level& dst, const price_level& src) noexcept {
+        const level_snapshot copy = copy_level(src);
+        dst.price.store(copy.price, memory_order::relaxed);
+        dst.quantity.store(copy.quantity, memory_order::relaxed);
+        dst.order_count.store(copy.order_count, memory_order::relaxed);
+    }
     
-    pair find_or_insert_price(price_t price) noexcept {
-        // Binary search for price level
-        auto it = lower_bound(levels_.begin(), levels_.end(), price,
-            [](const price_level& level, price_t p) {
-                return level.price < p;
+    template<typename Better>
+    static void update_level(ladder& levels, atomic<size_t>& depth_ref,
+                             price_t price, quantity_t quantity,
+                             uint32_t order_count, Better better) noexcept {
+        const size_t depth = depth_ref.load(memory_order::relaxed);
+        
+        // Binary search for the first level not better than price
+        auto* first = levels.begin();
+        auto* it = lower_bound(first, first + depth, price,
+            [better](const price_level& level, price_t p) {
+                return better(level.price.load(memory_order::relaxed), p);
             });
+        const size_t idx = static_cast<size_t>(it - first);
+        
+        if (idx < depth && it->price.load(memory_order::relaxed) == price) {
+            if (quantity != 0) {
+                it->quantity.store(quantity, memory_order::relaxed);
+                it->order_count.store(order_count, memory_order::relaxed);
+                return;
+            }
+            
+            // Delete level and close the gap
+            for (size_t i = idx; i + 1 < depth; ++i) {
+                move_level(levels[i], levels[i + 1]);
+            }
+            depth_ref.store(depth - 1, memory_order::relaxed);
+            return;
+        }
         
-        if (it != levels_.end() && it->price == price) {
-            return {static_cast<size_t>(it - levels_.begin()), true};
+        // Removing an untracked level, or new level is beyond our depth
+        if (quantity == 0 || idx >= max_levels) {
+            return;
         }
         
-        // Insert new level if space available
-        auto dist = it - levels_.begin();
-        if (dist < max_levels) {
-            // Shift levels and insert
-            for (auto p = levels_.end() - 1; p > it; --p) {
-                *p = *(p - 1);
+        // Insert new level, dropping the worst level if the ladder is full
+        const size_t new_depth = depth < max_levels ? depth + 1 : max_levels;
+        for (size_t i = new_depth - 1; i > idx; --i) {
+            move_level(levels[i], levels[i - 1]);
+        }
+        
+        levels[idx].price.store(price, memory_order::relaxed);
+        levels[idx].quantity.store(quantity, memory_order::relaxed);
+        levels[idx].order_count.store(order_count, memory_order::relaxed);
+        depth_ref.store(new_depth, memory_order::relaxed);
+    }
+};
+
+// Structure-of-arrays order book.
+// Same sorted-ladder semantics as order_book, but prices, quantities and
+// order counts live in contiguous per-side arrays so the top N levels span
+// a few cache lines and the depth kernels in hft.simd can load them as
+// vectors. Readers run the kernels inside a seqlock read section and
+// discard any result computed over a torn copy.
+template<size_t MaxLevels = 32>
+class soa_order_book {
+public:
+    static constexpr size_t max_levels = MaxLevels;
+    
+private:
+    struct side {
+        alignas(64) price_t price[max_levels];
+        alignas(64) quantity_t quantity[max_levels];
+        alignas(64) uint32_t order_count[max_levels];
+        size_t depth;
+    };
+    
+    side bids_{};  // Sorted descending by price
+    side asks_{};  // Sorted ascending by price
+    alignas(64) concurrent::seqlock sequence_;
+    
+    struct bid_better {
+        constexpr bool operator()(price_t a, price_t b) const noexcept { return a > b; }
+    };
+    
+    struct ask_better {
+        constexpr bool operator()(price_t a, price_t b) const noexcept { return a < b; }
+    };
+    
+public:
+    // Update bid side (zero quantity removes the level)
+    void update_bid(price_t price, quantity_t quantity, uint32_t order_count = 0) noexcept {
+        const concurrent::seqlock_writer section{sequence_};
+        update_level(bids_, price, quantity, order_count, bid_better{});
+    }
+    
+    // Update ask side (zero quantity removes the level)
+    void update_ask(price_t price, quantity_t quantity, uint32_t order_count = 0) noexcept {
+        const concurrent::seqlock_writer section{sequence_};
+        update_level(asks_, price, quantity, order_count, ask_better{});
+    }
+
+    // One publish for a group of updates, as in order_book
+    void begin_batch() noexcept { sequence_.write_begin(); }
+    void end_batch() noexcept { sequence_.write_end(); }
+    
+    // Consistent copy of the top N levels of each side
+    template<size_t N = 5>
+    [[nodiscard]] book_snapshot<N> read_snapshot() const noexcept {
+        book_snapshot<N> snap;
+        for (;;) {
+            const uint64_t seq = sequence_.read_begin();
+            
+            snap.bid_depth = min(N, read_depth(bids_));
+            snap.ask_depth = min(N, read_depth(asks_));
+            for (size_t i = 0; i < snap.bid_depth; ++i) {
+                snap.bids[i] = {bids_.price[i], bids_.quantity[i], bids_.order_count[i]};
+            }
+            for (size_t i = 0; i < snap.ask_depth; ++i) {
+                snap.asks[i] = {asks_.price[i], asks_.quantity[i], asks_.order_count[i]};
+            }
+            
+            if (!sequence_.read_retry(seq)) {
+                snap.sequence = seq >> 1;
+                return snap;
+            }
+        }
+    }
+    
+    // Order imbalance over the top `depth` levels of each side
+    [[nodiscard]] double calculate_imbalance(size_t depth = 5) const noexcept {
+        return sequence_.read([&] {
+            return simd::imbalance(bids_.quantity, min(depth, read_depth(bids_)),
+                                   asks_.quantity, min(depth, read_depth(asks_)));
+        });
+    }
+    
+    // Depth-weighted microprice over the top `depth` levels (0 if a side is empty)
+    [[nodiscard]] double calculate_microprice(size_t depth = 5) const noexcept {
+        return sequence_.read([&] {
+            return simd::microprice(bids_.price, bids_.quantity, min(depth, read_depth(bids_)),
+                                    asks_.price, asks_.quantity, min(depth, read_depth(asks_)));
+        });
+    }
+    
+    // Sum of bid (or ask) quantity times weights[i] over the first n levels
+    [[nodiscard]] double weighted_bid_depth(const double* weights, size_t n) const noexcept {
+        return sequence_.read([&] {
+            return simd::weighted_depth(bids_.quantity, weights, min(n, read_depth(bids_)));
+        });
+    }
+    
+    [[nodiscard]] double weighted_ask_depth(const double* weights, size_t n) const noexcept {
+        return sequence_.read([&] {
+            return simd::weighted_depth(asks_.quantity, weights, min(n, read_depth(asks_)));
+        });
+    }
+    
+    // Average price to sell (hit bids) or buy (lift asks) `quantity`
+    [[nodiscard]] double bid_vwap_to_depth(quantity_t quantity) const noexcept {
+        return sequence_.read([&] {
+            return simd::vwap_to_depth(bids_.price, bids_.quantity, read_depth(bids_), quantity);
+        });
+    }
+    
+    [[nodiscard]] double ask_vwap_to_depth(quantity_t quantity) const noexcept {
+        return sequence_.read([&] {
+            return simd::vwap_to_depth(asks_.price, asks_.quantity, read_depth(asks_), quantity);
+        });
+    }
+    
+    // Get best bid/ask spread as one consistent pair
+    [[nodiscard]] spread_info get_spread() const noexcept {
+        return sequence_.read([this] {
+            spread_info info{0, 0, 0, 0};
+            if (read_depth(bids_) > 0) {
+                info.bid_price = bids_.price[0];
+                info.bid_size = bids_.quantity[0];
+            }
+            if (read_depth(asks_) > 0) {
+                info.ask_price = asks_.price[0];
+                info.ask_size = asks_.quantity[0];
+            }
+            return info;
+        });
+    }
+    
+    // Writer-side views of the ladders (index 0 = best).
+    // Readers on other cores must use read_snapshot() or the kernels above.
+    [[nodiscard]] const price_t* bid_prices() const noexcept { return bids_.price; }
+    [[nodiscard]] const quantity_t* bid_quantities() const noexcept { return bids_.quantity; }
+    [[nodiscard]] const price_t* ask_prices() const noexcept { return asks_.price; }
+    [[nodiscard]] const quantity_t* ask_quantities() const noexcept { return asks_.quantity; }
+    
+    [[nodiscard]] size_t bid_depth() const noexcept { return read_depth(bids_); }
+    [[nodiscard]] size_t ask_depth() const noexcept { return read_depth(asks_); }
+    
+    // Get sequence number (completed updates) for tracking changes
+    [[nodiscard]] uint64_t get_sequence() const noexcept {
+        return sequence_.sequence();
+    }
+    
+private:
+    // Depth is re-read on every pass; clamp so a torn value never indexes
+    // past the arrays before the seqlock rejects the pass
+    static size_t read_depth(const side& s) noexcept {
+        const size_t depth = *static_cast<const volatile size_t*>(&s.depth);
+        return min(depth, max_levels);
+    }
+    
+    static void copy_level(side& s, size_t dst, size_t src) noexcept {
+        s.price[dst] = s.price[src];
+        s.quantity[dst] = s.quantity[src];
+        s.order_count[dst] = s.order_count[src];
+    }
+    
+    template<typename Better>
+    static void update_level(side& s, price_t price, quantity_t quantity,
+                             uint32_t order_count, Better better) noexcept {
+        const size_t depth = s.depth;
+        
+        // Binary search for the first level not better than price
+        const price_t* it = lower_bound(s.price, s.price + depth, price, better);
+        const size_t idx = static_cast<size_t>(it - s.price);
+        
+        if (idx < depth && s.price[idx] == price) {
+            if (quantity != 0) {
+                s.quantity[idx] = quantity;
+                s.order_count[idx] = order_count;
+                return;
+            }
+            
+            // Delete level and close the gap
+            for (size_t i = idx; i + 1 < depth; ++i) {
+                copy_level(s, i, i + 1);
             }
-            it->price = price;
-            return {static_cast<size_t>(dist), true};
+            store_depth(s, depth - 1);
+            return;
+        }
+        
+        // Removing an untracked level, or new level is beyond our depth
+        if (quantity == 0 || idx >= max_levels) {
+            return;
+        }
+        
+        // Insert new level, dropping the worst level if the ladder is full
+        const size_t new_depth = depth < max_levels ? depth + 1 : max_levels;
+        for (size_t i = new_depth - 1; i > idx; --i) {
+            copy_level(s, i, i - 1);
         }
         
-        return {0, false};
+        s.price[idx] = price;
+        s.quantity[idx] = quantity;
+        s.order_count[idx] = order_count;
+        store_depth(s, new_depth);
+    }
+    
+    static void store_depth(side& s, size_t depth) noexcept {
+        *static_cast<volatile size_t*>(&s.depth) = depth;
     }
 };
 
-// Order imbalance signal generator
-class imbalance_signal {
-    static constexpr double threshold = 0.65;
+// Price-indexed order book for tick-bounded instruments.
+// Maps (price - anchor) / tick straight to a slot in a ring covering Slots
+// consecutive ticks, so updates never shift levels. Occupied slots are
+// tracked per side in a bitmap and the top of book is found with ctz/clz.
+// When a price lands outside the window the ring re-anchors around it and
+// levels that fall out of the window are dropped.
+// One writer core updates inside a seqlock write section. Readers copy
+// the fields while it may be writing and retry if the sequence moved, so
+// what they return is a consistent copy, not a read free of races.
+template<size_t Slots = 1024>
+    requires (Slots >= 64) && ((Slots & (Slots - 1)) == 0)  // Power of 2
+class direct_order_book {
+public:
+    static constexpr size_t max_levels = Slots;
+    
+private:
+    static constexpr size_t slot_mask = Slots - 1;
+    static constexpr size_t bitmap_words = Slots / 64;
+    static constexpr int64_t window = static_cast<int64_t>(Slots);
+    
+    // Both sides share a slot; a price is never bid and offered at once
+    struct slot {
+        atomic<quantity_t> bid{0};
+        atomic<quantity_t> ask{0};
+    };
+    
+    slot slots_[Slots];
+    uint64_t bid_bits_[bitmap_words]{};
+    uint64_t ask_bits_[bitmap_words]{};
+    price_t tick_size_;
+    price_t anchor_;          // Price of tick 0
+    int64_t base_tick_;       // Lowest tick inside the window
+    atomic<int64_t> best_bid_tick_{0};
+    atomic<int64_t> best_ask_tick_{0};
+    atomic<size_t> bid_depth_{0};
+    atomic<size_t> ask_depth_{0};
+    alignas(64) concurrent::seqlock sequence_;
     
 public:
-    enum class signal { strong_buy, buy, neutral, sell, strong_sell };
+    explicit direct_order_book(price_t tick_size = 1, price_t anchor = 0) noexcept
+        : tick_size_{tick_size}, anchor_{anchor}, base_tick_{-window / 2} {}
+    
+    // Update bid side (zero quantity removes the level)
+    void update_bid(price_t price, quantity_t quantity) noexcept {
+        const int64_t tick = to_tick(price);
+        if (!in_window(tick) && quantity == 0) {
+            return;
+        }
+        
+        const concurrent::seqlock_writer section{sequence_};
+        if (!in_window(tick)) {
+            reanchor(tick);
+        }
+        
+        const size_t idx = static_cast<size_t>(tick) & slot_mask;
+        if (quantity == 0) {
+            if (test(bid_bits_, idx)) {
+                clear(bid_bits_, idx);
+                slots_[idx].bid.store(0, memory_order::relaxed);
+                const size_t depth = bid_depth_.load(memory_order::relaxed) - 1;
+                if (depth > 0 && tick == best_bid_tick_.load(memory_order::relaxed)) {
+                    best_bid_tick_.store(find_below(bid_bits_, tick), memory_order::relaxed);
+                }
+                bid_depth_.store(depth, memory_order::release);
+            }
+        } else {
+            slots_[idx].bid.store(quantity, memory_order::relaxed);
+            if (!test(bid_bits_, idx)) {
+                set(bid_bits_, idx);
+                const size_t depth = bid_depth_.load(memory_order::relaxed);
+                if (depth == 0 || tick > best_bid_tick_.load(memory_order::relaxed)) {
+                    best_bid_tick_.store(tick, memory_order::relaxed);
+                }
+                bid_depth_.store(depth + 1, memory_order::release);
+            }
+        }
+    }
+    
+    // Update ask side (zero quantity removes the level)
+    void update_ask(price_t price, quantity_t quantity) noexcept {
+        const int64_t tick = to_tick(price);
+        if (!in_window(tick) && quantity == 0) {
+            return;
+        }
+        
+        const concurrent::seqlock_writer section{sequence_};
+        if (!in_window(tick)) {
+            reanchor(tick);
+        }
+        
+        const size_t idx = static_cast<size_t>(tick) & slot_mask;
+        if (quantity == 0) {
+            if (test(ask_bits_, idx)) {
+                clear(ask_bits_, idx);
+                slots_[idx].ask.store(0, memory_order::relaxed);
+                const size_t depth = ask_depth_.load(memory_order::relaxed) - 1;
+                if (depth > 0 && tick == best_ask_tick_.load(memory_order::relaxed)) {
+                    best_ask_tick_.store(find_above(ask_bits_, tick), memory_order::relaxed);
+                }
+                ask_depth_.store(depth, memory_order::release);
+            }
+        } else {
+            slots_[idx].ask.store(quantity, memory_order::relaxed);
+            if (!test(ask_bits_, idx)) {
+                set(ask_bits_, idx);
+                const size_t depth = ask_depth_.load(memory_order::relaxed);
+                if (depth == 0 || tick < best_ask_tick_.load(memory_order::relaxed)) {
+                    best_ask_tick_.store(tick, memory_order::relaxed);
+                }
+                ask_depth_.store(depth + 1, memory_order::release);
+            }
+        }
+    }
+
+    // One publish for a group of updates, as in order_book
+    void begin_batch() noexcept { sequence_.write_begin(); }
+    void end_batch() noexcept { sequence_.write_end(); }
+    
+    // Consistent copy of the top N levels of each side
+    template<size_t N = 5>
+    [[nodiscard]] book_snapshot<N> read_snapshot() const noexcept {
+        book_snapshot<N> snap;
+        for (;;) {
+            const uint64_t seq = sequence_.read_begin();
+            
+            snap.bid_depth = 0;
+            const size_t bids = min(N, bid_depth_.load(memory_order::relaxed));
+            int64_t tick = best_bid_tick_.load(memory_order::relaxed);
+            for (; snap.bid_depth < bids && in_window(tick); tick = find_below(bid_bits_, tick)) {
+                const size_t idx = static_cast<size_t>(tick) & slot_mask;
+                snap.bids[snap.bid_depth++] = {to_price(tick), slots_[idx].bid.load(memory_order::relaxed), 0};
+            }
+            
+            snap.ask_depth = 0;
+            const size_t asks = min(N, ask_depth_.load(memory_order::relaxed));
+            tick = best_ask_tick_.load(memory_order::relaxed);
+            for (; snap.ask_depth < asks && in_window(tick); tick = find_above(ask_bits_, tick)) {
+                const size_t idx = static_cast<size_t>(tick) & slot_mask;
+                snap.asks[snap.ask_depth++] = {to_price(tick), slots_[idx].ask.load(memory_order::relaxed), 0};
+            }
+            
+            if (!sequence_.read_retry(seq)) {
+                snap.sequence = seq >> 1;
+                return snap;
+            }
+        }
+    }
+    
+    // Calculate order imbalance over the top `depth` levels of each side
+    [[nodiscard]] double calculate_imbalance(size_t depth = 5) const noexcept {
+        struct volumes {
+            quantity_t bid;
+            quantity_t ask;
+        };
+        
+        const auto v = sequence_.read([&] {
+            volumes sums{0, 0};
+            const size_t bids = min(depth, bid_depth_.load(memory_order::relaxed));
+            const size_t asks = min(depth, ask_depth_.load(memory_order::relaxed));
+            
+            // Torn reads can hand us an out-of-window tick; stop and let the retry catch it
+            int64_t tick = best_bid_tick_.load(memory_order::relaxed);
+            for (size_t i = 0; i < bids && in_window(tick); ++i, tick = find_below(bid_bits_, tick)) {
+                sums.bid += slots_[static_cast<size_t>(tick) & slot_mask].bid.load(memory_order::relaxed);
+            }
+            
+            tick = best_ask_tick_.load(memory_order::relaxed);
+            for (size_t i = 0; i < asks && in_window(tick); ++i, tick = find_above(ask_bits_, tick)) {
+                sums.ask += slots_[static_cast<size_t>(tick) & slot_mask].ask.load(memory_order::relaxed);
+            }
+            return sums;
+        });
+        
+        double bid_volume = static_cast<double>(v.bid);
+        double ask_volume = static_cast<double>(v.ask);
+        double total = bid_volume + ask_volume;
+        return total > 0.0 ? (bid_volume - ask_volume) / total : 0.0;
+    }
+    
+    // Get best bid/ask spread as one consistent pair
+    [[nodiscard]] spread_info get_spread() const noexcept {
+        return sequence_.read([this] {
+            spread_info info{0, 0, 0, 0};
+            if (bid_depth_.load(memory_order::relaxed) > 0) {
+                const int64_t tick = best_bid_tick_.load(memory_order::relaxed);
+                info.bid_price = to_price(tick);
+                info.bid_size = slots_[static_cast<size_t>(tick) & slot_mask].bid.load(memory_order::relaxed);
+            }
+            if (ask_depth_.load(memory_order::relaxed) > 0) {
+                const int64_t tick = best_ask_tick_.load(memory_order::relaxed);
+                info.ask_price = to_price(tick);
+                info.ask_size = slots_[static_cast<size_t>(tick) & slot_mask].ask.load(memory_order::relaxed);
+            }
+            return info;
+        });
+    }
+    
+    [[nodiscard]] size_t bid_depth() const noexcept {
+        return bid_depth_.load(memory_order::acquire);
+    }
+    
+    [[nodiscard]] size_t ask_depth() const noexcept {
+        return ask_depth_.load(memory_order::acquire);
+    }
+    
+    [[nodiscard]] price_t tick_size() const noexcept { return tick_size_; }
+    
+    // Get sequence number (completed updates) for tracking changes
+    [[nodiscard]] uint64_t get_sequence() const noexcept {
+        return sequence_.sequence();
+    }
+    
+private:
+    constexpr int64_t to_tick(price_t price) const noexcept {
+        return (price - anchor_) / tick_size_;
+    }
+    
+    constexpr price_t to_price(int64_t tick) const noexcept {
+        return anchor_ + tick * tick_size_;
+    }
+    
+    constexpr bool in_window(int64_t tick) const noexcept {
+        return tick >= base_tick_ && tick < base_tick_ + window;
+    }
+    
+    static bool test(const uint64_t* bits, size_t idx) noexcept {
+        return (bits[idx / 64] >> (idx % 64)) & 1;
+    }
+    
+    static void set(uint64_t* bits, size_t idx) noexcept {
+        bits[idx / 64] |= 1ULL << (idx % 64);
+    }
+    
+    static void clear(uint64_t* bits, size_t idx) noexcept {
+        bits[idx / 64] &= ~(1ULL << (idx % 64));
+    }
+    
+    // Highest occupied tick strictly below `tick`, walking the ring downward
+    int64_t find_below(const uint64_t* bits, int64_t tick) const noexcept {
+        int64_t pos = tick - 1;
+        while (pos >= base_tick_) {
+            const size_t idx = static_cast<size_t>(pos) & slot_mask;
+            const size_t bit = idx % 64;
+            const uint64_t below = bit == 63 ? ~0ULL : (2ULL << bit) - 1;
+            const uint64_t word = bits[idx / 64] & below;
+            if (word) {
+                return pos - static_cast<int64_t>(bit - (63 - __builtin_clzll(word)));
+            }
+            pos -= static_cast<int64_t>(bit) + 1;
+        }
+        return base_tick_ - 1;
+    }
+    
+    // Lowest occupied tick strictly above `tick`, walking the ring upward
+    int64_t find_above(const uint64_t* bits, int64_t tick) const noexcept {
+        int64_t pos = tick + 1;
+        while (pos < base_tick_ + window) {
+            const size_t idx = static_cast<size_t>(pos) & slot_mask;
+            const size_t bit = idx % 64;
+            const uint64_t word = bits[idx / 64] & (~0ULL << bit);
+            if (word) {
+                return pos + static_cast<int64_t>(__builtin_ctzll(word) - bit);
+            }
+            pos += static_cast<int64_t>(64 - bit);
+        }
+        return base_tick_ + window;
+    }
     
-    template<typename OrderBook>
-    [[nodiscard]] signal generate(const OrderBook& book) const noexcept {
-        double imbalance = book.calculate_imbalance();
+    void evict(int64_t first_tick, int64_t last_tick) noexcept {
+        size_t bid_depth = bid_depth_.load(memory_order::relaxed);
+        size_t ask_depth = ask_depth_.load(memory_order::relaxed);
         
-        if (imbalance > threshold) return signal::strong_buy;
-        if (imbalance > threshold / 2) return signal::buy;
-        if (imbalance < -threshold) return signal::strong_sell;
-        if (imbalance < -threshold / 2) return signal::sell;
-        return signal::neutral;
+        for (int64_t tick = first_tick; tick < last_tick; ++tick) {
+            const size_t idx = static_cast<size_t>(tick) & slot_mask;
+            if (test(bid_bits_, idx)) {
+                clear(bid_bits_, idx);
+                slots_[idx].bid.store(0, memory_order::relaxed);
+                --bid_depth;
+            }
+            if (test(ask_bits_, idx)) {
+                clear(ask_bits_, idx);
+                slots_[idx].ask.store(0, memory_order::relaxed);
+                --ask_depth;
+            }
+        }
+        
+        bid_depth_.store(bid_depth, memory_order::release);
+        ask_depth_.store(ask_depth, memory_order::release);
+    }
+    
+    // Move the window so `tick` sits in the middle, dropping levels outside it
+    void reanchor(int64_t tick) noexcept {
+        const int64_t new_base = tick - window / 2;
+        const int64_t shift = new_base - base_tick_;
+        
+        if (shift >= window || shift <= -window) {
+            evict(base_tick_, base_tick_ + window);
+        } else if (shift > 0) {
+            evict(base_tick_, new_base);
+        } else {
+            evict(new_base + window, base_tick_ + window);
+        }
+        base_tick_ = new_base;
+        
+        // Re-derive the top of book if it fell out of the window
+        if (bid_depth_.load(memory_order::relaxed) > 0 &&
+            !in_window(best_bid_tick_.load(memory_order::relaxed))) {
+            best_bid_tick_.store(find_below(bid_bits_, base_tick_ + window), memory_order::relaxed);
+        }
+        if (ask_depth_.load(memory_order::relaxed) > 0 &&
+            !in_window(best_ask_tick_.load(memory_order::relaxed))) {
+            best_ask_tick_.store(find_above(ask_bits_, base_tick_ - 1), memory_order::relaxed);
+        }
     }
 };
 
@@ -183,7 +805,7 @@ struct order {
     price_t price;
     quantity_t quantity;
     bool is_buy;
-    uint64_t timestamp;
+    uint64_t timestamp;  // Wall-clock ns since the epoch (tsc_clock::wall_ns)
 };
 
 // Execution report
@@ -191,7 +813,399 @@ struct execution {
     order_id_t order_id;
     price_t fill_price;
     quantity_t fill_quantity;
-    uint64_t timestamp;
+    uint64_t timestamp;  // Wall-clock ns since the epoch (tsc_clock::wall_ns)
+};
+
+// Open-addressing index from 64-bit keys to 32-bit slots.
+// Linear probing with backward-shift deletion, so there are no tombstones
+// and lookups never degrade after heavy add/cancel churn.
+template<size_t Capacity>
+    requires (Capacity > 0) && ((Capacity & (Capacity - 1)) == 0)  // Power of 2
+class flat_index {
+public:
+    static constexpr uint32_t npos = 0xFFFFFFFF;
+    
+private:
+    struct entry {
+        uint64_t key;
+        uint32_t value;
+    };
+    
+    static constexpr size_t mask = Capacity - 1;
+    
+    entry entries_[Capacity];
+    
+    static constexpr size_t home(uint64_t key) noexcept {
+        // Fibonacci hashing spreads sequential exchange ids across the table
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+    }
+    
+public:
+    constexpr flat_index() noexcept {
+        for (auto& e : entries_) {
+            e.key = 0;
+            e.value = npos;
+        }
+    }
+    
+    [[nodiscard]] uint32_t find(uint64_t key) const noexcept {
+        for (size_t i = home(key);; i = (i + 1) & mask) {
+            const entry& e = entries_[i];
+            if (e.value == npos) return npos;
+            if (e.key == key) return e.value;
+        }
+    }
+    
+    // Insert a new key (caller guarantees it is absent and the table has room)
+    void insert(uint64_t key, uint32_t value) noexcept {
+        size_t i = home(key);
+        while (entries_[i].value != npos) {
+            i = (i + 1) & mask;
+        }
+        entries_[i] = {key, value};
+    }
+    
+    void erase(uint64_t key) noexcept {
+        size_t i = home(key);
+        while (entries_[i].key != key || entries_[i].value == npos) {
+            if (entries_[i].value == npos) return;
+            i = (i + 1) & mask;
+        }
+        
+        // Shift following entries back into the hole until the probe chain ends
+        for (size_t j = (i + 1) & mask; entries_[j].value != npos; j = (j + 1) & mask) {
+            const size_t h = home(entries_[j].key);
+            const bool movable = (i <= j) ? (h <= i || h > j) : (h <= i && h > j);
+            if (movable) {
+                entries_[i] = entries_[j];
+                i = j;
+            }
+        }
+        entries_[i].value = npos;
+    }
+};
+
+// Per-order (L3) book keyed by order_id_t.
+// Orders live in a fixed-capacity pool and are linked into intrusive FIFO
+// queues per price level, so add/cancel/modify/execute are O(1) with no
+// heap traffic. Aggregated depth is published into an order_book (or a
+// soa_order_book, which has the same writer API) so all top-of-book
+// signals work unchanged on an L3 feed. When a tracked level
+// empties and deeper levels exist, the next one is found by scanning the
+// level pool; this only runs when the book is deeper than MaxLevels.
+template<size_t MaxOrders = 65536, size_t MaxLevels = 32, typename Depth = order_book<MaxLevels>>
+    requires (MaxOrders > 0) && (MaxOrders < 0xFFFFFFFF) && (Depth::max_levels == MaxLevels)
+class l3_book {
+public:
+    static constexpr size_t max_orders = MaxOrders;
+    
+    struct queue_position {
+        quantity_t quantity_ahead;
+        uint32_t orders_ahead;
+    };
+    
+private:
+    static constexpr uint32_t nil = 0xFFFFFFFF;
+    static constexpr size_t index_size = next_power_of_two(MaxOrders * 2 + 2);
+    
+    struct order_node {
+        order data;
+        uint32_t prev;
+        uint32_t next;      // Also links the free list
+        uint32_t level;
+    };
+    
+    struct level_queue {
+        price_t price;
+        quantity_t quantity;
+        uint32_t count;
+        uint32_t head;
+        uint32_t tail;      // Also links the free list
+        bool is_buy;
+    };
+    
+    // Pools: bump allocation first, recycled slots from the free lists after
+    template<typename T, size_t N>
+    struct pool {
+        alignas(T) unsigned char storage[sizeof(T) * N];
+        uint32_t next_unused = 0;
+        uint32_t free_head = nil;
+        
+        T& operator[](uint32_t idx) noexcept {
+            return reinterpret_cast<T*>(storage)[idx];
+        }
+        const T& operator[](uint32_t idx) const noexcept {
+            return reinterpret_cast<const T*>(storage)[idx];
+        }
+    };
+    
+    Depth book_;
+    pool<order_node, MaxOrders> orders_;
+    pool<level_queue, MaxOrders + 1> levels_;  // +1: modify creates before it releases
+    flat_index<index_size> order_index_;
+    flat_index<index_size> level_index_;
+    size_t order_count_ = 0;
+    size_t bid_levels_ = 0;
+    size_t ask_levels_ = 0;
+    
+    static constexpr uint64_t level_key(price_t price, bool is_buy) noexcept {
+        return (static_cast<uint64_t>(price) << 1) | (is_buy ? 1 : 0);
+    }
+    
+public:
+    [[nodiscard]] bool add(order_id_t id, bool is_buy, price_t price,
+                           quantity_t quantity, uint64_t timestamp = 0) noexcept {
+        if (quantity == 0 || order_count_ >= max_orders) [[unlikely]] {
+            return false;
+        }
+        if (order_index_.find(id) != nil) [[unlikely]] {
+            return false;
+        }
+        
+        const uint32_t level = find_or_create_level(price, is_buy);
+        const uint32_t idx = allocate(orders_, &order_node::next);
+        
+        order_node& node = orders_[idx];
+        node.data = order{id, price, quantity, is_buy, timestamp};
+        node.level = level;
+        enqueue(level, idx);
+        
+        order_index_.insert(id, idx);
+        ++order_count_;
+        publish(level);
+        return true;
+    }
+    
+    // Cancel an order outright
+    [[nodiscard]] bool cancel(order_id_t id) noexcept {
+        const uint32_t idx = order_index_.find(id);
+        if (idx == nil) [[unlikely]] {
+            return false;
+        }
+        
+        remove(idx);
+        return true;
+    }
+    
+    // Fill `quantity` against a resting order; fully filled orders leave the book
+    [[nodiscard]] bool execute(order_id_t id, quantity_t quantity) noexcept {
+        const uint32_t idx = order_index_.find(id);
+        if (idx == nil) [[unlikely]] {
+            return false;
+        }
+        
+        order_node& node = orders_[idx];
+        if (quantity >= node.data.quantity) {
+            remove(idx);
+        } else {
+            node.data.quantity -= quantity;
+            levels_[node.level].quantity -= quantity;
+            publish(node.level);
+        }
+        return true;
+    }
+    
+    // Modify price and/or size. Reducing size at the same price keeps queue
+    // priority; a price change or size increase sends the order to the back.
+    [[nodiscard]] bool modify(order_id_t id, price_t price, quantity_t quantity) noexcept {
+        const uint32_t idx = order_index_.find(id);
+        if (idx == nil) [[unlikely]] {
+            return false;
+        }
+        if (quantity == 0) {
+            remove(idx);
+            return true;
+        }
+        
+        order_node& node = orders_[idx];
+        const uint32_t old_level = node.level;
+        
+        if (price == node.data.price && quantity <= node.data.quantity) {
+            levels_[old_level].quantity -= node.data.quantity - quantity;
+            node.data.quantity = quantity;
+            publish(old_level);
+            return true;
+        }
+        
+        // Create the destination first so the old level's slot is not reused
+        const uint32_t new_level = find_or_create_level(price, node.data.is_buy);
+        dequeue(idx);
+        
+        node.data.price = price;
+        node.data.quantity = quantity;
+        node.level = new_level;
+        enqueue(new_level, idx);
+        
+        release_level_if_empty(old_level);
+        if (new_level != old_level) {
+            publish(new_level);
+        }
+        return true;
+    }
+    
+    // Size and order count resting ahead of an order in its level's queue
+    [[nodiscard]] queue_position position(order_id_t id) const noexcept {
+        queue_position pos{0, 0};
+        const uint32_t idx = order_index_.find(id);
+        if (idx == nil) {
+            return pos;
+        }
+        
+        for (uint32_t cur = orders_[idx].prev; cur != nil; cur = orders_[cur].prev) {
+            pos.quantity_ahead += orders_[cur].data.quantity;
+            ++pos.orders_ahead;
+        }
+        return pos;
+    }
+    
+    [[nodiscard]] const order* find(order_id_t id) const noexcept {
+        const uint32_t idx = order_index_.find(id);
+        return idx == nil ? nullptr : &orders_[idx].data;
+    }
+    
+    // One publish of the aggregated depth for a group of book events
+    void begin_batch() noexcept { book_.begin_batch(); }
+    void end_batch() noexcept { book_.end_batch(); }
+    
+    // Aggregated depth view used by signals
+    [[nodiscard]] const Depth& levels() const noexcept { return book_; }
+    
+    [[nodiscard]] spread_info get_spread() const noexcept { return book_.get_spread(); }
+    
+    [[nodiscard]] size_t order_count() const noexcept { return order_count_; }
+    
+private:
+    template<typename T, size_t N>
+    static uint32_t allocate(pool<T, N>& p, uint32_t T::* link) noexcept {
+        if (p.free_head != nil) {
+            const uint32_t idx = p.free_head;
+            p.free_head = p[idx].*link;
+            return idx;
+        }
+        return p.next_unused++;
+    }
+    
+    template<typename T, size_t N>
+    static void deallocate(pool<T, N>& p, uint32_t T::* link, uint32_t idx) noexcept {
+        p[idx].*link = p.free_head;
+        p.free_head = idx;
+    }
+    
+    uint32_t find_or_create_level(price_t price, bool is_buy) noexcept {
+        const uint64_t key = level_key(price, is_buy);
+        uint32_t level = level_index_.find(key);
+        if (level != nil) {
+            return level;
+        }
+        
+        level = allocate(levels_, &level_queue::tail);
+        levels_[level] = level_queue{price, 0, 0, nil, nil, is_buy};
+        level_index_.insert(key, level);
+        ++(is_buy ? bid_levels_ : ask_levels_);
+        return level;
+    }
+    
+    void enqueue(uint32_t level, uint32_t idx) noexcept {
+        level_queue& q = levels_[level];
+        order_node& node = orders_[idx];
+        
+        node.prev = q.tail;
+        node.next = nil;
+        if (q.tail != nil) {
+            orders_[q.tail].next = idx;
+        } else {
+            q.head = idx;
+        }
+        q.tail = idx;
+        q.quantity += node.data.quantity;
+        ++q.count;
+    }
+    
+    void dequeue(uint32_t idx) noexcept {
+        order_node& node = orders_[idx];
+        level_queue& q = levels_[node.level];
+        
+        if (node.prev != nil) {
+            orders_[node.prev].next = node.next;
+        } else {
+            q.head = node.next;
+        }
+        if (node.next != nil) {
+            orders_[node.next].prev = node.prev;
+        } else {
+            q.tail = node.prev;
+        }
+        q.quantity -= node.data.quantity;
+        --q.count;
+    }
+    
+    void release_level_if_empty(uint32_t level) noexcept {
+        publish(level);
+        
+        level_queue& q = levels_[level];
+        if (q.count == 0) {
+            const bool is_buy = q.is_buy;
+            level_index_.erase(level_key(q.price, is_buy));
+            deallocate(levels_, &level_queue::tail, level);
+            --(is_buy ? bid_levels_ : ask_levels_);
+            refill(is_buy);
+        }
+    }
+    
+    // Pull untracked levels back into the aggregated ladder after it shrank
+    void refill(bool is_buy) noexcept {
+        const size_t live = is_buy ? bid_levels_ : ask_levels_;
+        const size_t target = min(live, MaxLevels);
+        
+        for (size_t depth = is_buy ? book_.bid_depth() : book_.ask_depth();
+             depth < target; ++depth) {
+            const bool bounded = depth > 0;
+            const price_t worst = bounded ? tracked_price(is_buy, depth - 1) : 0;
+            
+            uint32_t best = nil;
+            for (uint32_t i = 0; i < levels_.next_unused; ++i) {
+                const level_queue& q = levels_[i];
+                if (q.count == 0 || q.is_buy != is_buy) continue;
+                if (bounded && (is_buy ? q.price >= worst : q.price <= worst)) continue;
+                if (best == nil || (is_buy ? q.price > levels_[best].price
+                                           : q.price < levels_[best].price)) {
+                    best = i;
+                }
+            }
+            if (best == nil) return;
+            publish(best);
+        }
+    }
+    
+    // Price at depth idx of the published ladder (only the writer calls this)
+    price_t tracked_price(bool is_buy, size_t idx) const noexcept {
+        if constexpr (requires { book_.bid_prices(); }) {
+            return (is_buy ? book_.bid_prices() : book_.ask_prices())[idx];
+        } else {
+            return (is_buy ? book_.bid_level(idx) : book_.ask_level(idx)).price.load(memory_order::relaxed);
+        }
+    }
+    
+    void remove(uint32_t idx) noexcept {
+        order_node& node = orders_[idx];
+        const uint32_t level = node.level;
+        
+        dequeue(idx);
+        order_index_.erase(node.data.id);
+        deallocate(orders_, &order_node::next, idx);
+        --order_count_;
+        
+        release_level_if_empty(level);
+    }
+    
+    void publish(uint32_t level) noexcept {
+        const level_queue& q = levels_[level];
+        if (q.is_buy) {
+            book_.update_bid(q.price, q.quantity, q.count);
+        } else {
+            book_.update_ask(q.price, q.quantity, q.count);
+        }
+    }
 };
 
 } // namespace hft::trading
@@ -0,0 +1,216 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+#include "../include/freestanding/atomic.hpp"
+
+export module hft.tsc;
+import hft.core;
+import hft.pit;
+import hft.rtc;
+
+// Boot-time TSC setup behind tsc_clock.
+// init() checks for an invariant TSC, measures its frequency (CPUID leaf
+// 0x15 when it gives the crystal, the PIT otherwise) and anchors it to
+// the RTC, after which tsc_clock::now_ns() is wall-clock nanoseconds.
+// As each AP comes up, sync_with() measures its TSC offset from the boot
+// processor and, where IA32_TSC_ADJUST exists, removes it, so one TSC
+// value means the same instant on every core.
+export namespace hft::tsc {
+
+// Offset of one core's TSC from the boot processor's, in cycles, and the
+// measurement's uncertainty (half the best round trip)
+struct core_offset {
+    int64_t offset = 0;
+    uint64_t uncertainty = 0;
+    bool adjusted = false;  // IA32_TSC_ADJUST was written to remove it
+};
+
+} // namespace hft::tsc
+
+namespace hft::tsc {
+
+constexpr uint32_t TSC_ADJUST_MSR = 0x3B;
+constexpr uint64_t CALIBRATION_US = 50000;
+constexpr uint32_t CALIBRATION_RUNS = 3;
+constexpr uint32_t SYNC_ROUNDS = 64;
+constexpr uint64_t SYNC_TIMEOUT_NS = 10000000;
+
+// Ping-pong channel between the boot processor and the one AP being
+// synchronized (APs start one at a time)
+enum class verdict : uint32_t { none, adjust, done };
+
+struct sync_channel {
+    alignas(64) atomic<uint32_t> request{0};  // Round number the BSP asks for
+    alignas(64) atomic<uint32_t> reply{0};    // Last round the AP answered
+    atomic<uint64_t> sample{0};               // AP TSC for that round
+    alignas(64) atomic<verdict> decision{verdict::none};
+    atomic<uint64_t> correction{0};           // Cycles for the AP to subtract
+};
+
+inline sync_channel channel;
+inline core_offset offsets[topology::MAX_CPUS];
+inline bool invariant_ = false;
+inline bool synchronized_ = true;
+
+bool tsc_adjust_supported() noexcept {
+    uint32_t eax = 7, ebx, ecx = 0, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    return (ebx >> 1) & 1;
+}
+
+// Nominal frequency from CPUID leaf 0x15 (TSC/crystal ratio and crystal
+// frequency), or 0 if the leaf does not state the crystal
+uint64_t cpuid_frequency() noexcept {
+    uint32_t eax = 0, ebx, ecx = 0, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    if (eax < 0x15) return 0;
+
+    eax = 0x15;
+    ecx = 0;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+    if (eax == 0 || ebx == 0 || ecx == 0) return 0;
+    return static_cast<uint64_t>(ecx) * ebx / eax;
+}
+
+// Shortest of a few PIT intervals: interference (an SMI, a slow port
+// access) only ever makes an interval longer
+uint64_t pit_frequency() noexcept {
+    uint64_t best = ~0ULL;
+    for (uint32_t run = 0; run < CALIBRATION_RUNS; ++run) {
+        const uint64_t begin = tsc_clock::start();
+        pit::wait_us(CALIBRATION_US);
+        const uint64_t end = tsc_clock::stop();
+        best = min(best, end - begin);
+    }
+    return best * (1000000 / CALIBRATION_US);
+}
+
+// Boot processor side: offset of the AP's TSC, from the round trip with
+// the smallest window (the AP's read lies inside [begin, end], and the
+// midpoint is the best estimate)
+core_offset measure() noexcept {
+    const uint64_t timeout = tsc_clock::from_ns(SYNC_TIMEOUT_NS);
+    core_offset best{0, ~0ULL, false};
+
+    for (uint32_t i = 0; i < SYNC_ROUNDS; ++i) {
+        const uint32_t round = channel.request.load(memory_order::relaxed) + 1;
+        const uint64_t begin = tsc_clock::start();
+        channel.request.store(round, memory_order::release);
+        while (channel.reply.load(memory_order::acquire) != round) {
+            if (tsc_clock::now() - begin > timeout) return best;
+            asm volatile("pause");
+        }
+        const uint64_t end = tsc_clock::stop();
+
+        const uint64_t window = (end - begin) / 2;
+        if (window < best.uncertainty) {
+            const uint64_t midpoint = begin + window;
+            best.offset = static_cast<int64_t>(channel.sample.load(memory_order::relaxed) - midpoint);
+            best.uncertainty = window;
+        }
+    }
+    return best;
+}
+
+bool wait_for_verdict(verdict expected) noexcept {
+    const uint64_t timeout = tsc_clock::from_ns(SYNC_TIMEOUT_NS);
+    const uint64_t begin = tsc_clock::now();
+    while (channel.decision.load(memory_order::acquire) != expected) {
+        if (tsc_clock::now() - begin > timeout) return false;
+        asm volatile("pause");
+    }
+    return true;
+}
+
+uint64_t magnitude(int64_t value) noexcept {
+    return value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+}
+
+} // namespace hft::tsc
+
+export namespace hft::tsc {
+
+// Check for an invariant TSC, calibrate tsc_clock and anchor it to the
+// RTC. Boot processor, before hft.timer and before any AP starts; takes
+// up to a second waiting for the RTC's second edge.
+void init() noexcept {
+    invariant_ = tsc_clock::invariant();
+
+    uint64_t hz = cpuid_frequency();
+    if (hz == 0) hz = pit_frequency();
+    tsc_clock::calibrate(hz);
+
+    uint64_t edge = 0;
+    const rtc::date_time now = rtc::read_at_edge([&] { edge = tsc_clock::start(); });
+    tsc_clock::set_epoch(edge, rtc::to_unix_seconds(now) * 1000000000);
+}
+
+// Without an invariant TSC, deltas are not time across power-state
+// changes, and cores' TSCs may drift apart after sync_with()
+[[nodiscard]] bool invariant() noexcept {
+    return invariant_;
+}
+
+// AP side of sync_with(): answer rounds until the boot processor is
+// done, applying a correction if it sends one. Runs on each AP right
+// after it reports online.
+void answer_sync() noexcept {
+    uint32_t answered = channel.reply.load(memory_order::relaxed);
+    while (true) {
+        const verdict v = channel.decision.load(memory_order::acquire);
+        if (v == verdict::done) {
+            channel.decision.store(verdict::none, memory_order::release);
+            return;
+        }
+        if (v == verdict::adjust) {
+            const auto correction = static_cast<int64_t>(channel.correction.load(memory_order::relaxed));
+            write_msr(TSC_ADJUST_MSR, read_msr(TSC_ADJUST_MSR) - static_cast<uint64_t>(correction));
+            channel.decision.store(verdict::none, memory_order::release);
+        }
+
+        const uint32_t round = channel.request.load(memory_order::acquire);
+        if (round != answered) {
+            channel.sample.store(tsc_clock::start(), memory_order::relaxed);
+            channel.reply.store(round, memory_order::release);
+            answered = round;
+        }
+        asm volatile("pause");
+    }
+}
+
+// Boot processor side: measure the TSC offset of core cpu (which is in
+// answer_sync()), remove it through IA32_TSC_ADJUST if it is larger than
+// the measurement can resolve, and record the result
+core_offset sync_with(uint32_t cpu) noexcept {
+    core_offset result = measure();
+
+    if (magnitude(result.offset) > result.uncertainty && tsc_adjust_supported()) {
+        channel.correction.store(static_cast<uint64_t>(result.offset), memory_order::relaxed);
+        channel.decision.store(verdict::adjust, memory_order::release);
+        if (wait_for_verdict(verdict::none)) {
+            result = measure();
+            result.adjusted = true;
+        }
+    }
+
+    channel.decision.store(verdict::done, memory_order::release);
+    wait_for_verdict(verdict::none);
+
+    if (result.uncertainty == ~0ULL || magnitude(result.offset) > result.uncertainty) {
+        synchronized_ = false;  // No answer, or an offset that could not be removed
+    }
+    offsets[cpu] = result;
+    return result;
+}
+
+[[nodiscard]] core_offset offset(uint32_t cpu) noexcept {
+    return offsets[cpu];
+}
+
+// Every AP synchronized so far is within measurement error of the boot
+// processor
+[[nodiscard]] bool synchronized() noexcept {
+    return synchronized_;
+}
+
+} // namespace hft::tsc
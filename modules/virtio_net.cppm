@@ -0,0 +1,426 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+#include "../include/freestanding/atomic.hpp"
+
+export module hft.virtio_net;
+import hft.core;
+import hft.concurrent;
+import hft.vmm;
+import hft.pci;
+
+// Poll-mode virtio-net driver (virtio 1.0 PCI transport, split rings).
+// One receive and one transmit queue, set up once and never interrupted:
+// the device is told not to raise interrupts, INTx is masked and no
+// MSI-X vector is assigned. Rings and packet buffers share one 2 MiB
+// DMA region. poll(), run by one core, moves received buffers to
+// rx_ready() and posts frames from tx_ready(); packets stay in their DMA
+// buffers the whole way (the queues carry packet descriptors, not data):
+//
+//   rx: device -> poll() -> rx_ready -> consumer -> rx_done -> poll() -> device
+//   tx: tx_free -> producer -> tx_ready -> poll() -> device -> poll() -> tx_free
+export namespace hft::virtio_net {
+
+constexpr uint16_t QUEUE_SIZE = 256;
+constexpr uint32_t BUFFER_SIZE = 2048;   // virtio header + a full Ethernet frame
+constexpr uint32_t HEADER_SIZE = 12;     // virtio_net_hdr with num_buffers (virtio 1.0)
+constexpr uint32_t MAX_FRAME = BUFFER_SIZE - HEADER_SIZE;
+
+// A packet in a DMA buffer; id names the buffer for returning it
+struct packet {
+    uint8_t* data;    // Ethernet frame
+    uint16_t length;
+    uint16_t id;
+    uint64_t timestamp;  // TSC when poll() found it (virtio has no hardware stamp)
+};
+
+struct stats {
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t rx_backpressure;  // Received buffers held because rx_ready was full
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_notifies;      // Doorbell writes (VM exits under a hypervisor)
+};
+
+} // namespace hft::virtio_net
+
+namespace hft::virtio_net {
+
+constexpr uint16_t VIRTIO_VENDOR = 0x1AF4;
+constexpr uint16_t DEVICE_IDS[] = {0x1041, 0x1000};  // Modern, transitional
+
+constexpr uint16_t RX_QUEUE = 0;
+constexpr uint16_t TX_QUEUE = 1;
+
+// Device status bits
+constexpr uint8_t STATUS_ACKNOWLEDGE = 1;
+constexpr uint8_t STATUS_DRIVER = 2;
+constexpr uint8_t STATUS_DRIVER_OK = 4;
+constexpr uint8_t STATUS_FEATURES_OK = 8;
+constexpr uint8_t STATUS_FAILED = 128;
+
+constexpr uint64_t FEATURE_MAC = 1ULL << 5;
+constexpr uint64_t FEATURE_VERSION_1 = 1ULL << 32;
+
+// virtio_pci_cap cfg_type values
+constexpr uint8_t CAP_COMMON = 1;
+constexpr uint8_t CAP_NOTIFY = 2;
+constexpr uint8_t CAP_DEVICE = 4;
+
+constexpr uint16_t NO_VECTOR = 0xFFFF;
+
+constexpr uint16_t DESC_F_WRITE = 2;
+constexpr uint16_t AVAIL_F_NO_INTERRUPT = 1;
+constexpr uint16_t USED_F_NO_NOTIFY = 1;
+
+// virtio_pci_common_cfg (every field naturally aligned)
+struct common_cfg {
+    uint32_t device_feature_select;
+    uint32_t device_feature;
+    uint32_t driver_feature_select;
+    uint32_t driver_feature;
+    uint16_t msix_config;
+    uint16_t num_queues;
+    uint8_t device_status;
+    uint8_t config_generation;
+    uint16_t queue_select;
+    uint16_t queue_size;
+    uint16_t queue_msix_vector;
+    uint16_t queue_enable;
+    uint16_t queue_notify_off;
+    uint32_t queue_desc_lo;
+    uint32_t queue_desc_hi;
+    uint32_t queue_driver_lo;
+    uint32_t queue_driver_hi;
+    uint32_t queue_device_lo;
+    uint32_t queue_device_hi;
+};
+static_assert(sizeof(common_cfg) == 56);
+
+struct descriptor {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+};
+
+struct avail_ring {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[QUEUE_SIZE];
+    uint16_t used_event;
+};
+
+struct used_element {
+    uint32_t id;
+    uint32_t len;
+};
+
+struct used_ring {
+    uint16_t flags;
+    uint16_t idx;
+    used_element ring[QUEUE_SIZE];
+    uint16_t avail_event;
+};
+
+// One split virtqueue. Descriptor i always points at buffer i, so a
+// buffer id is also its descriptor and ring slot never need a free list.
+struct virtqueue {
+    descriptor* desc = nullptr;
+    avail_ring* avail = nullptr;
+    volatile used_ring* used = nullptr;
+    volatile uint16_t* notify = nullptr;
+    uint16_t size = 0;
+    uint16_t avail_idx = 0;     // Next avail slot (driver-private copy)
+    uint16_t used_seen = 0;     // Used entries consumed so far
+    uint16_t pending_notify = 0;
+};
+
+// Ring and buffer layout inside the DMA region, per queue
+constexpr uint64_t DESC_OFFSET = 0;
+constexpr uint64_t AVAIL_OFFSET = 4096;
+constexpr uint64_t USED_OFFSET = 8192;
+constexpr uint64_t QUEUE_BYTES = 12288;
+constexpr uint64_t BUFFERS_OFFSET = 2 * QUEUE_BYTES;
+
+struct driver_state {
+    pci::device pci;
+    volatile common_cfg* common = nullptr;
+    uint64_t notify_base = 0;
+    uint32_t notify_multiplier = 0;
+    volatile uint8_t* device_cfg = nullptr;
+    vmm::dma_region dma;
+    virtqueue rx;
+    virtqueue tx;
+    uint8_t* rx_buffers = nullptr;
+    uint8_t* tx_buffers = nullptr;
+    uint8_t mac[6] = {};
+    stats counters = {};
+    bool up = false;
+};
+
+inline driver_state nic;
+
+// Queues between poll() and its users. Every buffer id is in exactly one
+// place at a time: the device, one of these queues, or a user.
+inline concurrent::spsc_queue<packet, QUEUE_SIZE * 2> rx_ready_queue;
+inline concurrent::spsc_queue<uint16_t, QUEUE_SIZE * 2> rx_done_queue;
+inline concurrent::spsc_queue<packet, QUEUE_SIZE * 2> tx_free_queue;
+inline concurrent::spsc_queue<packet, QUEUE_SIZE * 2> tx_ready_queue;
+
+// Map the structure a virtio capability describes; returns its address
+// or 0
+uint64_t map_capability(const pci::device& d, uint8_t cap, uint32_t* multiplier = nullptr) noexcept {
+    const uint8_t bar = pci::read8(d, static_cast<uint8_t>(cap + 4));
+    const uint32_t offset = pci::read32(d, static_cast<uint8_t>(cap + 8));
+    const uint32_t length = pci::read32(d, static_cast<uint8_t>(cap + 12));
+    if (multiplier) *multiplier = pci::read32(d, static_cast<uint8_t>(cap + 16));
+    if (bar > 5) return 0;
+
+    const uint64_t base = pci::bar_address(d, bar);
+    if (base == 0) return 0;
+    return vmm::map_mmio(base + offset, length);
+}
+
+bool find_structures(const pci::device& d) noexcept {
+    for (uint8_t cap = pci::find_capability(d, pci::CAP_VENDOR); cap;
+         cap = pci::find_capability(d, pci::CAP_VENDOR, cap)) {
+        const uint8_t type = pci::read8(d, static_cast<uint8_t>(cap + 3));
+        if (type == CAP_COMMON && !nic.common) {
+            nic.common = reinterpret_cast<volatile common_cfg*>(map_capability(d, cap));
+        } else if (type == CAP_NOTIFY && !nic.notify_base) {
+            nic.notify_base = map_capability(d, cap, &nic.notify_multiplier);
+        } else if (type == CAP_DEVICE && !nic.device_cfg) {
+            nic.device_cfg = reinterpret_cast<volatile uint8_t*>(map_capability(d, cap));
+        }
+    }
+    return nic.common && nic.notify_base;
+}
+
+bool negotiate() noexcept {
+    volatile common_cfg& cfg = *nic.common;
+
+    cfg.device_feature_select = 0;
+    uint64_t offered = cfg.device_feature;
+    cfg.device_feature_select = 1;
+    offered |= static_cast<uint64_t>(cfg.device_feature) << 32;
+    if (!(offered & FEATURE_VERSION_1)) return false;
+
+    // No checksum offload, GSO or mergeable buffers: one frame per buffer
+    const uint64_t wanted = FEATURE_VERSION_1 | (offered & FEATURE_MAC);
+    cfg.driver_feature_select = 0;
+    cfg.driver_feature = static_cast<uint32_t>(wanted);
+    cfg.driver_feature_select = 1;
+    cfg.driver_feature = static_cast<uint32_t>(wanted >> 32);
+
+    cfg.device_status = cfg.device_status | STATUS_FEATURES_OK;
+    if (!(cfg.device_status & STATUS_FEATURES_OK)) return false;
+
+    if ((wanted & FEATURE_MAC) && nic.device_cfg) {
+        for (int i = 0; i < 6; ++i) nic.mac[i] = nic.device_cfg[i];
+    }
+    return true;
+}
+
+bool setup_queue(virtqueue& q, uint16_t index, uint64_t offset) noexcept {
+    volatile common_cfg& cfg = *nic.common;
+    cfg.queue_select = index;
+
+    const uint16_t max_size = cfg.queue_size;
+    if (max_size == 0) return false;
+    q.size = min(max_size, QUEUE_SIZE);
+    cfg.queue_size = q.size;  // Split rings need a power of two; both are
+
+    auto* base = reinterpret_cast<uint8_t*>(nic.dma.virt + offset);
+    q.desc = reinterpret_cast<descriptor*>(base + DESC_OFFSET);
+    q.avail = reinterpret_cast<avail_ring*>(base + AVAIL_OFFSET);
+    q.used = reinterpret_cast<volatile used_ring*>(base + USED_OFFSET);
+    q.avail->flags = AVAIL_F_NO_INTERRUPT;
+
+    const uint64_t desc = nic.dma.phys_of(q.desc);
+    const uint64_t avail = nic.dma.phys_of(q.avail);
+    const uint64_t used = nic.dma.phys_of(const_cast<used_ring*>(q.used));
+    cfg.queue_desc_lo = static_cast<uint32_t>(desc);
+    cfg.queue_desc_hi = static_cast<uint32_t>(desc >> 32);
+    cfg.queue_driver_lo = static_cast<uint32_t>(avail);
+    cfg.queue_driver_hi = static_cast<uint32_t>(avail >> 32);
+    cfg.queue_device_lo = static_cast<uint32_t>(used);
+    cfg.queue_device_hi = static_cast<uint32_t>(used >> 32);
+    cfg.queue_msix_vector = NO_VECTOR;
+
+    q.notify = reinterpret_cast<volatile uint16_t*>(
+        nic.notify_base + static_cast<uint64_t>(cfg.queue_notify_off) * nic.notify_multiplier);
+    cfg.queue_enable = 1;
+    return true;
+}
+
+// Make buffer id available to the device (descriptor id is preset)
+void post(virtqueue& q, uint16_t id, uint32_t length) noexcept {
+    q.desc[id].len = length;
+    q.avail->ring[q.avail_idx % q.size] = id;
+    ++q.avail_idx;
+    ++q.pending_notify;
+}
+
+// Publish posted buffers and ring the doorbell unless the device polls
+void kick(virtqueue& q, uint16_t queue_index) noexcept {
+    if (q.pending_notify == 0) return;
+    q.pending_notify = 0;
+
+    __atomic_store_n(&q.avail->idx, q.avail_idx, __ATOMIC_RELEASE);
+    atomic_thread_fence(memory_order::seq_cst);  // idx store before the flags load
+    if (!(q.used->flags & USED_F_NO_NOTIFY)) {
+        *q.notify = queue_index;
+        if (queue_index == TX_QUEUE) ++nic.counters.tx_notifies;
+    }
+}
+
+uint16_t used_available(const virtqueue& q) noexcept {
+    return static_cast<uint16_t>(__atomic_load_n(&q.used->idx, __ATOMIC_ACQUIRE) - q.used_seen);
+}
+
+void poll_rx() noexcept {
+    // Buffers consumers are done with go back to the device
+    uint16_t id;
+    while (rx_done_queue.try_pop(id)) {
+        post(nic.rx, id, BUFFER_SIZE);
+    }
+
+    uint16_t n = used_available(nic.rx);
+    const uint64_t now = n > 0 ? tsc_clock::now() : 0;  // One stamp per batch
+    for (; n > 0; --n) {
+        const volatile used_element& e = nic.rx.used->ring[nic.rx.used_seen % nic.rx.size];
+        const auto buffer = static_cast<uint16_t>(e.id);
+        const uint32_t length = e.len > HEADER_SIZE ? e.len - HEADER_SIZE : 0;
+
+        const packet p{nic.rx_buffers + static_cast<uint64_t>(buffer) * BUFFER_SIZE + HEADER_SIZE,
+                       static_cast<uint16_t>(length), buffer, now};
+        if (!rx_ready_queue.try_push(p)) {
+            ++nic.counters.rx_backpressure;
+            break;  // Picked up again on the next poll
+        }
+        ++nic.rx.used_seen;
+        ++nic.counters.rx_packets;
+        nic.counters.rx_bytes += length;
+    }
+    kick(nic.rx, RX_QUEUE);
+}
+
+void poll_tx() noexcept {
+    // Completed transmissions free their buffers
+    for (uint16_t n = used_available(nic.tx); n > 0; --n) {
+        const auto buffer = static_cast<uint16_t>(nic.tx.used->ring[nic.tx.used_seen % nic.tx.size].id);
+        ++nic.tx.used_seen;
+        const packet free{nic.tx_buffers + static_cast<uint64_t>(buffer) * BUFFER_SIZE + HEADER_SIZE,
+                          0, buffer, 0};
+        (void)tx_free_queue.try_push(free);  // Sized for every buffer: cannot fail
+    }
+
+    packet p;
+    while (tx_ready_queue.try_pop(p)) {
+        post(nic.tx, p.id, HEADER_SIZE + min<uint32_t>(p.length, MAX_FRAME));
+        ++nic.counters.tx_packets;
+        nic.counters.tx_bytes += p.length;
+    }
+    kick(nic.tx, TX_QUEUE);
+}
+
+} // namespace hft::virtio_net
+
+export namespace hft::virtio_net {
+
+// Find the first virtio-net device, reset it and bring up both queues
+// with every receive buffer posted. Boot processor, once; node picks the
+// NUMA node for rings and buffers (the polling core's).
+bool init(uint32_t node = topology::current_node()) noexcept {
+    const pci::device d = pci::find(VIRTIO_VENDOR, {DEVICE_IDS, 2});
+    if (!d.valid()) return false;
+    nic.pci = d;
+
+    pci::set_command(d, pci::memory_space | pci::bus_master | pci::interrupt_disable, pci::io_space);
+    if (!find_structures(d)) return false;
+
+    volatile common_cfg& cfg = *nic.common;
+    cfg.device_status = 0;  // Reset
+    while (cfg.device_status != 0) {
+        asm volatile("pause");
+    }
+    cfg.device_status = STATUS_ACKNOWLEDGE;
+    cfg.device_status = STATUS_ACKNOWLEDGE | STATUS_DRIVER;
+    cfg.msix_config = NO_VECTOR;
+
+    if (!negotiate()) {
+        cfg.device_status = cfg.device_status | STATUS_FAILED;
+        return false;
+    }
+
+    nic.dma = vmm::allocate_dma(BUFFERS_OFFSET + 2ULL * QUEUE_SIZE * BUFFER_SIZE, node);
+    if (nic.dma.virt == 0 ||
+        !setup_queue(nic.rx, RX_QUEUE, 0) || !setup_queue(nic.tx, TX_QUEUE, QUEUE_BYTES)) {
+        cfg.device_status = cfg.device_status | STATUS_FAILED;
+        return false;
+    }
+
+    nic.rx_buffers = reinterpret_cast<uint8_t*>(nic.dma.virt + BUFFERS_OFFSET);
+    nic.tx_buffers = nic.rx_buffers + static_cast<uint64_t>(QUEUE_SIZE) * BUFFER_SIZE;
+
+    for (uint16_t i = 0; i < nic.rx.size; ++i) {
+        nic.rx.desc[i] = {nic.dma.phys_of(nic.rx_buffers + static_cast<uint64_t>(i) * BUFFER_SIZE),
+                          BUFFER_SIZE, DESC_F_WRITE, 0};
+        post(nic.rx, i, BUFFER_SIZE);
+    }
+    for (uint16_t i = 0; i < nic.tx.size; ++i) {
+        uint8_t* buffer = nic.tx_buffers + static_cast<uint64_t>(i) * BUFFER_SIZE;
+        nic.tx.desc[i] = {nic.dma.phys_of(buffer), 0, 0, 0};
+        (void)tx_free_queue.try_push(packet{buffer + HEADER_SIZE, 0, i, 0});  // Header stays zero
+    }
+
+    cfg.device_status = cfg.device_status | STATUS_DRIVER_OK;
+    kick(nic.rx, RX_QUEUE);
+    nic.up = true;
+    return true;
+}
+
+[[nodiscard]] bool up() noexcept {
+    return nic.up;
+}
+
+[[nodiscard]] const uint8_t* mac_address() noexcept {
+    return nic.mac;
+}
+
+// Driver step, on the one core that owns the device: hand received
+// packets on, recycle returned buffers, send queued frames, reclaim
+// transmitted ones. Never blocks.
+void poll() noexcept {
+    poll_rx();
+    poll_tx();
+}
+
+// Received packets, in arrival order (consumer side). Return each buffer
+// through rx_done() when finished with it.
+[[nodiscard]] concurrent::spsc_queue<packet, QUEUE_SIZE * 2>& rx_ready() noexcept {
+    return rx_ready_queue;
+}
+
+[[nodiscard]] concurrent::spsc_queue<uint16_t, QUEUE_SIZE * 2>& rx_done() noexcept {
+    return rx_done_queue;
+}
+
+// Empty transmit buffers (producer side): take one, build a frame of
+// up to MAX_FRAME bytes at data, set length, push it to tx_ready()
+[[nodiscard]] concurrent::spsc_queue<packet, QUEUE_SIZE * 2>& tx_free() noexcept {
+    return tx_free_queue;
+}
+
+[[nodiscard]] concurrent::spsc_queue<packet, QUEUE_SIZE * 2>& tx_ready() noexcept {
+    return tx_ready_queue;
+}
+
+// Owner core only (the counters are not atomic)
+[[nodiscard]] stats counters() noexcept {
+    return nic.counters;
+}
+
+} // namespace hft::virtio_net
@@ -4,6 +4,7 @@ module;
 #include "../include/freestanding/atomic.hpp"
 
 export module hft.vmm;
+import hft.core;
 import hft.pmm;
 
 export namespace hft::vmm {
@@ -46,9 +47,7 @@ struct [[gnu::aligned(4096)]] page_table {
     uint64_t entries[512];
     
     void clear() noexcept {
-        for (int i = 0; i < 512; ++i) {
-            entries[i] = 0;
-        }
+        fill_words(entries, 0, 512);
     }
     
     uint64_t& operator[](size_t idx) noexcept {
@@ -83,6 +82,11 @@ public:
         return true;
     }
     
+    // Take over tables built elsewhere (vmm::init)
+    void init(page_table* root) noexcept {
+        pml4 = root;
+    }
+    
     void destroy() noexcept {
         if (!pml4) return;
         
@@ -156,6 +160,74 @@ public:
         return true;
     }
     
+    // Map one 2 MiB page; virt and phys must be 2 MiB aligned and the
+    // range must not already be covered by a page table
+    bool map_large(uint64_t virt, uint64_t phys, uint64_t flags) noexcept {
+        virtual_address va(virt);
+        
+        page_table* pdpt = get_or_create_table(pml4, va.pml4_index);
+        if (!pdpt) return false;
+        
+        page_table* pdt = get_or_create_table(pdpt, va.pdpt_index);
+        if (!pdt) return false;
+        
+        if (pdt->entries[va.pd_index] & present) return false;
+        
+        pdt->entries[va.pd_index] = phys | flags | large | present;
+        mapped_pages.fetch_add(512, memory_order::relaxed);
+        invlpg(virt);
+        
+        return true;
+    }
+    
+    // Map one 1 GiB page; virt and phys must be 1 GiB aligned
+    bool map_huge(uint64_t virt, uint64_t phys, uint64_t flags) noexcept {
+        virtual_address va(virt);
+        
+        page_table* pdpt = get_or_create_table(pml4, va.pml4_index);
+        if (!pdpt) return false;
+        
+        if (pdpt->entries[va.pdpt_index] & present) return false;
+        
+        pdpt->entries[va.pdpt_index] = phys | flags | large | present;
+        mapped_pages.fetch_add(512 * 512, memory_order::relaxed);
+        invlpg(virt);
+        
+        return true;
+    }
+    
+    // Remove a 2 MiB or 1 GiB mapping; page tables stay in place
+    bool unmap_large(uint64_t virt) noexcept {
+        virtual_address va(virt);
+        
+        if (!(pml4->entries[va.pml4_index] & present)) return false;
+        
+        auto* pdpt = reinterpret_cast<page_table*>(
+            pml4->entries[va.pml4_index] & ~0xFFF
+        );
+        
+        uint64_t& pdpte = pdpt->entries[va.pdpt_index];
+        if (!(pdpte & present)) return false;
+        
+        if (pdpte & large) {
+            pdpte = 0;
+            mapped_pages.fetch_add(-(512 * 512), memory_order::relaxed);
+            invlpg(virt);
+            return true;
+        }
+        
+        auto* pdt = reinterpret_cast<page_table*>(pdpte & ~0xFFF);
+        
+        uint64_t& pde = pdt->entries[va.pd_index];
+        if ((pde & (present | large)) != (present | large)) return false;
+        
+        pde = 0;
+        mapped_pages.fetch_add(-512, memory_order::relaxed);
+        invlpg(virt);
+        
+        return true;
+    }
+    
     uint64_t get_physical(uint64_t virt) const noexcept {
         virtual_address va(virt);
         
@@ -202,6 +274,11 @@ public:
     
 private:
     page_table* get_or_create_table(page_table* parent, size_t index) noexcept {
+        // Already covered by a large page, there is no table to descend into
+        if ((parent->entries[index] & (present | large)) == (present | large)) {
+            return nullptr;
+        }
+        
         if (parent->entries[index] & present) {
             return reinterpret_cast<page_table*>(
                 parent->entries[index] & ~0xFFF
@@ -224,8 +301,9 @@ private:
     void free_pdpt(uint64_t pdpt_phys) noexcept {
         auto* pdpt = reinterpret_cast<page_table*>(pdpt_phys);
         
+        // Large page frames belong to their region, only tables are freed
         for (int i = 0; i < 512; ++i) {
-            if (pdpt->entries[i] & present) {
+            if ((pdpt->entries[i] & (present | large)) == present) {
                 free_pdt(pdpt->entries[i] & ~0xFFF);
             }
         }
@@ -237,7 +315,7 @@ private:
         auto* pdt = reinterpret_cast<page_table*>(pdt_phys);
         
         for (int i = 0; i < 512; ++i) {
-            if (pdt->entries[i] & present) {
+            if ((pdt->entries[i] & (present | large)) == present) {
                 free_pt(pdt->entries[i] & ~0xFFF);
             }
         }
@@ -254,6 +332,22 @@ private:
     }
 };
 
+// Page sizes for region allocation
+enum class page_size {
+    small,  // 4 KiB
+    large,  // 2 MiB
+    huge    // 1 GiB (needs CPUID.80000001h:EDX.Page1GB)
+};
+
+constexpr uint64_t LARGE_PAGE_SIZE = 2ULL * 1024 * 1024;
+constexpr uint64_t HUGE_PAGE_SIZE = 1ULL * 1024 * 1024 * 1024;
+
+constexpr uint64_t page_bytes(page_size size) noexcept {
+    return size == page_size::huge  ? HUGE_PAGE_SIZE :
+           size == page_size::large ? LARGE_PAGE_SIZE :
+                                      pmm::PAGE_SIZE;
+}
+
 // Global kernel address space
 inline address_space kernel_space;
 
@@ -262,22 +356,119 @@ constexpr uint64_t KERNEL_VIRT_BASE = 0xFFFFFFFF80000000;
 constexpr uint64_t KERNEL_PHYS_BASE = 0x0;
 constexpr uint64_t KERNEL_SIZE = 1ULL * 1024 * 1024 * 1024;  // 1GB
 
-// Initialize virtual memory manager
-void init() noexcept {
-    // Initialize kernel address space
-    kernel_space.init();
-    
-    // Map the kernel (1GB identity mapped at higher half)
-    for (uint64_t offset = 0; offset < KERNEL_SIZE; offset += pmm::PAGE_SIZE) {
-        kernel_space.map(
-            KERNEL_VIRT_BASE + offset,
-            KERNEL_PHYS_BASE + offset,
-            present | writable | global
-        );
+// Top of the identity map: the boot tables' first GiB until init()
+// replaces them with a map of all RAM
+inline uint64_t identity_end = KERNEL_SIZE;
+
+// Page table for an entry of the loaded tables, creating it if missing.
+// New tables must stay reachable through the boot identity map (and below
+// 4 GiB, where the AP trampoline's 32-bit CR3 load can reach the PML4).
+page_table* mmio_table(uint64_t& entry) noexcept {
+    if (entry & present) {
+        return reinterpret_cast<page_table*>(entry & ~0xFFFULL);
+    }
+    
+    const uint64_t phys = pmm::allocate_page(0, pmm::zone_type::dma);
+    if (phys == 0) return nullptr;
+    if (phys >= KERNEL_SIZE) {
+        pmm::free_page(phys);
+        return nullptr;
+    }
+    
+    auto* table = reinterpret_cast<page_table*>(phys);
+    table->clear();
+    entry = phys | present | writable;
+    return table;
+}
+
+// Whether the CPU can map 1 GiB pages
+bool huge_pages_supported() noexcept {
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x80000000), "c"(0));
+    if (eax < 0x80000001) return false;
+    
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x80000001), "c"(0));
+    return (edx >> 26) & 1;
+}
+
+// Identity map [base, end) into pml4 with the largest pages that fit: a
+// 1 GiB page where the whole aligned GiB is inside the range (and huge
+// is set), 2 MiB pages for the rest, rounded outward
+bool map_identity(page_table* pml4, uint64_t base, uint64_t end, bool huge) noexcept {
+    uint64_t page = base & ~(LARGE_PAGE_SIZE - 1);
+    const uint64_t last = (end + LARGE_PAGE_SIZE - 1) & ~(LARGE_PAGE_SIZE - 1);
+    
+    while (page < last) {
+        virtual_address va(page);
+        
+        page_table* pdpt = mmio_table(pml4->entries[va.pml4_index]);
+        if (!pdpt) return false;
+        
+        uint64_t& pdpte = pdpt->entries[va.pdpt_index];
+        const bool whole = page % HUGE_PAGE_SIZE == 0 && page >= base && end - page >= HUGE_PAGE_SIZE;
+        if (huge && whole && !(pdpte & present)) {
+            pdpte = page | present | writable | large;
+            page += HUGE_PAGE_SIZE;
+            continue;
+        }
+        if (pdpte & large) {  // A 1 GiB page from an earlier range
+            page = (page | (HUGE_PAGE_SIZE - 1)) + 1;
+            continue;
+        }
+        
+        page_table* pdt = mmio_table(pdpte);
+        if (!pdt) return false;
+        
+        pdt->entries[va.pd_index] = page | present | writable | large;
+        page += LARGE_PAGE_SIZE;
+    }
+    return true;
+}
+
+// Build the kernel's final page tables in one pass and switch to them:
+// low memory and every RAM range the memory map lists identity mapped
+// with 1 GiB and 2 MiB pages, and the first GiB again at KERNEL_VIRT_BASE
+// with global pages. Holes between ranges stay unmapped, so map_mmio()
+// can still give device windows there uncached pages of their own. A
+// few table pages cover any machine, so this is quick enough to do on
+// the boot core alone. Returns false (and stays on the boot tables) if
+// a table page cannot be allocated.
+bool init() noexcept {
+    uint64_t root = 0;
+    page_table* pml4 = mmio_table(root);
+    if (!pml4) return false;
+    
+    const bool huge = huge_pages_supported();
+    
+    // The first 2 MiB whatever the map says: BIOS areas (RSDP, EBDA) and
+    // the AP trampoline
+    if (!map_identity(pml4, 0, LARGE_PAGE_SIZE, huge)) return false;
+    
+    uint64_t top = LARGE_PAGE_SIZE;
+    for (const auto& range : pmm::ram_ranges()) {
+        if (!map_identity(pml4, range.base, range.end, huge)) return false;
+        top = max(top, range.end);
     }
     
-    // Load kernel address space
+    virtual_address kva(KERNEL_VIRT_BASE);
+    page_table* kernel_pdpt = mmio_table(pml4->entries[kva.pml4_index]);
+    if (!kernel_pdpt) return false;
+    
+    if (huge) {
+        kernel_pdpt->entries[kva.pdpt_index] = KERNEL_PHYS_BASE | present | writable | large | global;
+    } else {
+        page_table* kernel_pdt = mmio_table(kernel_pdpt->entries[kva.pdpt_index]);
+        if (!kernel_pdt) return false;
+        for (uint64_t i = 0; i < 512; ++i) {
+            kernel_pdt->entries[i] = (KERNEL_PHYS_BASE + i * LARGE_PAGE_SIZE)
+                                   | present | writable | large | global;
+        }
+    }
+    
+    kernel_space.init(pml4);
     kernel_space.load();
+    identity_end = top;
+    return true;
 }
 
 // Static pool for address spaces
@@ -337,18 +528,26 @@ void switch_address_space(address_space* space) noexcept {
     }
 }
 
-// Allocate virtual memory region
-uint64_t allocate_region(size_t pages, uint64_t flags = present | writable) noexcept {
-    // Simple allocation: Find free virtual address range
-    // For now, use a static counter
-    static uint64_t next_virt = 0x10000000;  // Start at 256MB
-    
-    uint64_t virt = next_virt;
-    next_virt += pages * pmm::PAGE_SIZE;
+// Next free virtual address for regions
+// Simple allocation: a bump counter, address space is not reclaimed
+constexpr uint64_t REGION_BASE = 0xFFFF800000000000;  // Bottom of the upper half, clear of the identity map
+inline uint64_t next_region_virt = REGION_BASE;
+
+uint64_t reserve_virtual(uint64_t bytes, uint64_t align) noexcept {
+    uint64_t virt = (next_region_virt + align - 1) & ~(align - 1);
+    next_region_virt = virt + bytes;
+    return virt;
+}
+
+// Allocate virtual memory region backed by pages from a NUMA node
+// (default: the calling core's)
+uint64_t allocate_region(size_t pages, uint64_t flags = present | writable,
+                         uint32_t node = topology::current_node()) noexcept {
+    uint64_t virt = reserve_virtual(pages * pmm::PAGE_SIZE, pmm::PAGE_SIZE);
     
     // Map each page
     for (size_t i = 0; i < pages; ++i) {
-        uint64_t phys = pmm::allocate_page();
+        uint64_t phys = pmm::allocate_page(node);
         if (phys == 0) {
             // Failed to allocate, unmap what we've mapped
             for (size_t j = 0; j < i; ++j) {
@@ -389,4 +588,169 @@ void free_region(uint64_t virt, size_t pages) noexcept {
     }
 }
 
+// Free a region from allocate_large_region (same size and page size)
+void free_large_region(uint64_t virt, size_t bytes, page_size size) noexcept {
+    if (size == page_size::small) {
+        free_region(virt, (bytes + pmm::PAGE_SIZE - 1) / pmm::PAGE_SIZE);
+        return;
+    }
+    
+    const uint64_t page = page_bytes(size);
+    for (uint64_t offset = 0; offset < bytes; offset += page) {
+        uint64_t p = get_physical(virt + offset);
+        
+        if (p && kernel_space.unmap_large(virt + offset)) {
+            pmm::free_pages(p, page / pmm::PAGE_SIZE);
+        }
+    }
+}
+
+// Allocate a region backed by 2 MiB or 1 GiB pages, so it costs one TLB
+// entry per page instead of one per 4 KiB. bytes is rounded up to whole
+// pages; 1 GiB requests fall back to 2 MiB pages on CPUs without support.
+// Each page comes from a physically contiguous, naturally aligned run,
+// taken from node if it has one free.
+uint64_t allocate_large_region(size_t bytes, page_size size = page_size::large,
+                               uint64_t flags = present | writable,
+                               uint32_t node = topology::current_node()) noexcept {
+    if (size == page_size::huge && !huge_pages_supported()) {
+        size = page_size::large;
+    }
+    
+    if (size == page_size::small) {
+        return allocate_region((bytes + pmm::PAGE_SIZE - 1) / pmm::PAGE_SIZE, flags, node);
+    }
+    
+    const uint64_t page = page_bytes(size);
+    const uint64_t count = (bytes + page - 1) / page;
+    const uint64_t virt = reserve_virtual(count * page, page);
+    
+    for (uint64_t i = 0; i < count; ++i) {
+        const uint64_t phys = pmm::allocate_aligned_pages(page / pmm::PAGE_SIZE, page,
+                                                           pmm::zone_type::normal, node);
+        const bool mapped = phys != 0 &&
+            (size == page_size::huge ? kernel_space.map_huge(virt + i * page, phys, flags)
+                                     : kernel_space.map_large(virt + i * page, phys, flags));
+        
+        if (!mapped) {
+            // Failed to allocate or map, release what we have so far
+            if (phys) pmm::free_pages(phys, page / pmm::PAGE_SIZE);
+            free_large_region(virt, i * page, size);
+            return 0;
+        }
+    }
+    
+    return virt;
+}
+
+// Physically contiguous memory a device can DMA to (descriptor rings,
+// packet buffers)
+struct dma_region {
+    uint64_t virt = 0;
+    uint64_t phys = 0;
+    uint64_t bytes = 0;
+
+    [[nodiscard]] uint64_t phys_of(const void* p) const noexcept {
+        return phys + (reinterpret_cast<uint64_t>(p) - virt);
+    }
+};
+
+// Allocate bytes (rounded up to 2 MiB) of contiguous, 2 MiB aligned
+// memory from node. It is used at its physical address, through the
+// identity map's large pages (the boot tables' first GiB before init()),
+// so a driver touching rings and buffers costs few TLB entries. The
+// memory is zeroed. Returns an empty region on failure.
+dma_region allocate_dma(size_t bytes, uint32_t node = topology::current_node()) noexcept {
+    const uint64_t size = (bytes + LARGE_PAGE_SIZE - 1) & ~(LARGE_PAGE_SIZE - 1);
+    const uint64_t phys = pmm::allocate_aligned_pages(size / pmm::PAGE_SIZE, LARGE_PAGE_SIZE,
+                                                       pmm::zone_type::normal, node);
+    if (phys == 0) return {};
+    if (phys + size > identity_end) {
+        pmm::free_pages(phys, size / pmm::PAGE_SIZE);
+        return {};
+    }
+
+    zero_bytes(reinterpret_cast<void*>(phys), size);
+    return {phys, phys, size};
+}
+
+// Give back a region from allocate_dma
+void free_dma(const dma_region& region) noexcept {
+    if (region.bytes == 0) return;
+    pmm::free_pages(region.phys, region.bytes / pmm::PAGE_SIZE);
+}
+
+// Replace the 1 GiB page in pdpte with a page directory of 2 MiB pages
+// mapping the same memory with the same flags (PAT, the one flag above
+// bit 8, sits at bit 12 in both forms). The entry is switched with one
+// store once the directory is complete, so the range stays mapped the
+// whole time. Returns the directory, or nullptr if no table was free.
+page_table* split_huge(uint64_t& pdpte, uint64_t gib) noexcept {
+    constexpr uint64_t HUGE_ADDRESS = 0x000FFFFFC0000000ULL;
+    const uint64_t phys = pmm::allocate_page(0, pmm::zone_type::dma);
+    if (phys == 0) return nullptr;
+    if (phys >= KERNEL_SIZE) {
+        pmm::free_page(phys);
+        return nullptr;
+    }
+
+    auto* pdt = reinterpret_cast<page_table*>(phys);
+    const uint64_t base = pdpte & HUGE_ADDRESS;
+    const uint64_t flags = pdpte & ~HUGE_ADDRESS;
+    for (size_t i = 0; i < 512; ++i) {
+        pdt->entries[i] = (base + i * LARGE_PAGE_SIZE) | flags;
+    }
+    pdpte = phys | present | writable;
+    asm volatile("invlpg (%0)" : : "r"(gib) : "memory");  // This core only: split before others use the range
+    return pdt;
+}
+
+// Map [phys, phys + bytes) at its physical address, in 2 MiB pages with
+// the given cache flags, into the page tables currently loaded. A 1 GiB
+// page covering part of the range is split into 2 MiB pages first, so
+// the range never inherits its write-back caching. Usable before init(),
+// on the boot tables. Returns the virtual address (equal to phys) or 0 if
+// a page table could not be created or the range is already mapped with
+// 4 KiB pages.
+uint64_t map_physical(uint64_t phys, uint64_t bytes, uint64_t cache) noexcept {
+    uint64_t cr3;
+    asm volatile("movq %%cr3, %0" : "=r"(cr3));
+    auto* pml4 = reinterpret_cast<page_table*>(cr3 & ~0xFFFULL);
+    
+    const uint64_t first = phys & ~(LARGE_PAGE_SIZE - 1);
+    const uint64_t last = (phys + bytes + LARGE_PAGE_SIZE - 1) & ~(LARGE_PAGE_SIZE - 1);
+    
+    for (uint64_t page = first; page < last; page += LARGE_PAGE_SIZE) {
+        virtual_address va(page);
+        
+        page_table* pdpt = mmio_table(pml4->entries[va.pml4_index]);
+        if (!pdpt) return 0;
+        
+        uint64_t& pdpte = pdpt->entries[va.pdpt_index];
+        page_table* pdt = (pdpte & (present | large)) == (present | large)
+            ? split_huge(pdpte, page & ~(HUGE_PAGE_SIZE - 1))
+            : mmio_table(pdpte);
+        if (!pdt) return 0;
+        
+        uint64_t& pde = pdt->entries[va.pd_index];
+        if ((pde & (present | large)) == present) return 0;
+        
+        pde = page | present | writable | cache | large;
+        asm volatile("invlpg (%0)" : : "r"(page) : "memory");
+    }
+    
+    return phys;
+}
+
+// Device registers (local APIC, IOAPIC, PCI BARs): uncached
+uint64_t map_mmio(uint64_t phys, uint64_t bytes) noexcept {
+    return map_physical(phys, bytes, write_through | cache_disable);
+}
+
+// Memory outside the PMM's care (reserved RAM, shared-memory BARs):
+// write-back, like RAM
+uint64_t map_memory(uint64_t phys, uint64_t bytes) noexcept {
+    return map_physical(phys, bytes, 0);
+}
+
 } // namespace hft::vmm
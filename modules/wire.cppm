@@ -0,0 +1,128 @@
+module;
+
+#include "../include/freestanding/types.hpp"
+
+export module hft.wire;
+import hft.core;
+
+// Compile-time message layouts for binary exchange protocols.
+// A message type lists its fields as field<> types (offset, width, byte
+// order); reading or writing one is a fixed-size load or store plus a
+// byte swap, straight on the packet buffer. Field offsets are checked
+// against the message length at compile time, the received length once
+// per message at dispatch. dispatcher<> turns a set of message types into
+// a 256-entry table indexed by the type byte.
+export namespace hft::wire {
+
+enum class byte_order : uint8_t {
+    big,     // Network order: ITCH, OUCH, MoldUDP64
+    little   // SBE, and raw byte strings (symbols) compared as integers
+};
+
+// Integral (or enum, or char) field of Width bytes at Offset
+template<typename T, size_t Offset, size_t Width = sizeof(T), byte_order Order = byte_order::big>
+struct field {
+    static_assert(Width > 0 && Width <= 8 && Width <= sizeof(T), "field wider than its type");
+
+    using type = T;
+    static constexpr size_t offset = Offset;
+    static constexpr size_t width = Width;
+    static constexpr size_t end = Offset + Width;
+
+    [[nodiscard]] static T read(const uint8_t* message) noexcept {
+        uint64_t raw = 0;
+        memcpy(&raw, message + Offset, Width);
+        if constexpr (Order == byte_order::big) {
+            raw = __builtin_bswap64(raw) >> (64 - 8 * Width);
+        }
+        return static_cast<T>(raw);
+    }
+
+    static void write(uint8_t* message, T value) noexcept {
+        uint64_t raw = static_cast<uint64_t>(value);
+        if constexpr (Order == byte_order::big) {
+            raw = __builtin_bswap64(raw) >> (64 - 8 * Width);
+        }
+        memcpy(message + Offset, &raw, Width);
+    }
+};
+
+// Do all the fields fit inside a message of Length bytes?
+template<size_t Length, typename... Fields>
+constexpr bool fits = ((Fields::end <= Length) && ...);
+
+// Read-only view of one received message of type Message. get<F>() only
+// compiles for fields that lie inside Message::length; the dispatcher has
+// already checked the buffer holds that many bytes.
+template<typename Message>
+struct view {
+    const uint8_t* data;
+
+    template<typename Field>
+    [[nodiscard]] typename Field::type get() const noexcept {
+        static_assert(Field::end <= Message::length, "field lies outside the message");
+        return Field::read(data);
+    }
+};
+
+// Jump table from the first byte of a message to the handler overload for
+// its type. Message types provide `type` (the tag byte) and `length` (the
+// fixed size); Handler provides operator()(view<M>) for the types it cares
+// about, others are skipped.
+template<typename Handler, typename... Messages>
+class dispatcher {
+    using thunk = void (*)(Handler&, const uint8_t*) noexcept;
+
+    struct entry {
+        thunk handle;
+        uint32_t length;  // Minimum bytes for this type (0: unknown type)
+    };
+
+    struct table_type {
+        entry entries[256];
+    };
+
+    template<typename Message>
+    static void invoke(Handler& handler, const uint8_t* message) noexcept {
+        handler(view<Message>{message});
+    }
+
+    static void skip(Handler&, const uint8_t*) noexcept {}
+
+    template<typename Message>
+    static constexpr thunk handler_for() noexcept {
+        if constexpr (requires(Handler& h, view<Message> v) { h(v); }) {
+            return &invoke<Message>;
+        } else {
+            return &skip;
+        }
+    }
+
+    static constexpr table_type build() noexcept {
+        table_type table{};
+        for (entry& e : table.entries) {
+            e = {&skip, 0};
+        }
+        ((table.entries[Messages::type] = {handler_for<Messages>(), Messages::length}), ...);
+        return table;
+    }
+
+    static constexpr table_type table = build();
+
+public:
+    // Handle one message of length bytes; false if it is shorter than its
+    // type's layout (unknown types are skipped and still count as handled)
+    static bool dispatch(Handler& handler, const uint8_t* message, size_t length) noexcept {
+        if (length == 0) [[unlikely]] return false;
+        const entry& e = table.entries[message[0]];
+        if (length < e.length) [[unlikely]] return false;
+        e.handle(handler, message);
+        return true;
+    }
+
+    [[nodiscard]] static constexpr bool known(uint8_t type) noexcept {
+        return table.entries[type].length != 0;
+    }
+};
+
+} // namespace hft::wire